@@ -0,0 +1,303 @@
+#define _GNU_SOURCE
+#include "channel.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+
+#define CHANNEL_HAS_ACK 0x2     // The sender received datagrams, the ack fields are valid
+
+extern int DGRAM; // data.c
+
+/**
+ * function channelNowMs
+ * @brief Function to get the monotonic time in milliseconds
+ * @return long long
+ */
+static long long channelNowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * function seqNewer
+ * @brief Function to compare two 16-bit sequences, with wrap around
+ * @param a - sequence
+ * @param b - sequence
+ * @return int - 1 if a is more recent than b
+ */
+static int seqNewer(unsigned short a, unsigned short b) {
+    return (short)(a - b) > 0;
+}
+
+/**
+ * function windowMark
+ * @brief Function to record the reception of an id in a window of 33 ids (latest + 32 bits)
+ * @param latest - most recent id received
+ * @param bits - reception of the 32 ids before latest
+ * @param any - 1 once an id was received
+ * @param id - id received
+ * @return int - 1 if the id is new, 0 if it was already received or is too old to tell
+ */
+static int windowMark(unsigned short *latest, unsigned int *bits, int *any, unsigned short id) {
+    if (!*any) {
+        *any = 1;
+        *latest = id;
+        *bits = 0;
+        return 1;
+    }
+    if (seqNewer(id, *latest)) {
+        unsigned short shift = id - *latest;
+        *bits = shift > 32 ? 0 : ((shift == 32 ? 0 : *bits << shift) | (1u << (shift - 1)));
+        *latest = id;
+        return 1;
+    }
+    unsigned short age = *latest - id;
+    if (age == 0 || age > 32 || (*bits & (1u << (age - 1)))) {
+        return 0;
+    }
+    *bits |= 1u << (age - 1);
+    return 1;
+}
+
+/**
+ * function seqAcked
+ * @brief Function to know if a sequence is acked by the ack fields of a datagram
+ * @param header - header of the datagram
+ * @param seq - sequence sent
+ * @return int - 1 if acked
+ */
+static int seqAcked(const channel_header_t *header, unsigned short seq) {
+    if (!(header->flags & CHANNEL_HAS_ACK)) {
+        return 0;
+    }
+    unsigned short age = header->ack - seq;
+    if (age == 0) {
+        return 1;
+    }
+    return age <= 32 && (header->ack_bits & (1u << (age - 1)));
+}
+
+/**
+ * function channelSendRaw
+ * @brief Function to send one datagram with a new sequence
+ * @param sock - socket of the channel
+ * @param peer - state of the channel with the peer
+ * @param flags - CHANNEL_RELIABLE or 0
+ * @param type - type of the message
+ * @param rel_id - id of the reliable message
+ * @param payload - payload of the message
+ * @param len - size of the payload
+ * @param seq - sequence given to the datagram (NULL if not needed)
+ * @return int - 0 on success, -1 on error
+ */
+static int channelSendRaw(socket_t *sock, channel_peer_t *peer, int flags, int type, unsigned short rel_id,
+                          const void *payload, size_t len, unsigned short *seq) {
+    channel_packet_t packet;
+    packet.header.magic = CHANNEL_MAGIC;
+    packet.header.flags = flags | (peer->received ? CHANNEL_HAS_ACK : 0);
+    packet.header.type = type;
+    packet.header.seq = peer->local_seq++;
+    packet.header.ack = peer->remote_seq;
+    packet.header.ack_bits = peer->remote_bits;
+    packet.header.rel_id = rel_id;
+    packet.header.len = len;
+    packet.header.token = peer->token;
+    if (seq != NULL) {
+        *seq = packet.header.seq;
+    }
+    if (len > 0) {
+        memcpy(packet.payload, payload, len);
+    }
+
+    peer->ack_due = 0;
+    peer->last_sent_ms = channelNowMs();
+    peer->sent++;
+    if (sendto(sock->fd, &packet, sizeof(channel_header_t) + len, MSG_NOSIGNAL,
+               (struct sockaddr *)&peer->addr, sizeof peer->addr) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * function channelSocket
+ * @brief Function to create the UDP socket of the channel
+ * @param adrIP - address to bind ("any" for every interface), NULL to leave it unbound (client)
+ * @param port - port to bind
+ * @return socket_t - fd is -1 on error
+ */
+socket_t channelSocket(const char *adrIP, short port) {
+    socket_t sock = creerSocket(DGRAM);
+    fcntl(sock.fd, F_SETFL, fcntl(sock.fd, F_GETFL) | O_NONBLOCK);
+    fcntl(sock.fd, F_SETFD, FD_CLOEXEC);
+    if (adrIP == NULL) {
+        return sock;
+    }
+
+    memset(&sock.addrLoc, 0, sizeof sock.addrLoc);
+    sock.addrLoc.sin_family = AF_INET;
+    sock.addrLoc.sin_port = htons(port);
+    if (strcmp(adrIP, "any") == 0) {
+        sock.addrLoc.sin_addr.s_addr = htonl(INADDR_ANY);
+    } else if (inet_pton(AF_INET, adrIP, &sock.addrLoc.sin_addr) <= 0) {
+        fprintf(stderr, "channel: invalid address %s\n", adrIP);
+        close(sock.fd);
+        sock.fd = -1;
+        return sock;
+    }
+    if (bind(sock.fd, (struct sockaddr *)&sock.addrLoc, sizeof sock.addrLoc) < 0) {
+        perror("channel bind");
+        close(sock.fd);
+        sock.fd = -1;
+    }
+    return sock;
+}
+
+/**
+ * function channelPeerInit
+ * @brief Function to initialize the state of the channel with a peer
+ * @param peer - state to initialize
+ * @param addr - address of the peer, NULL if it is not known yet (server)
+ * @param token - session token of the player
+ * @return void
+ */
+void channelPeerInit(channel_peer_t *peer, const struct sockaddr_in *addr, unsigned long long token) {
+    memset(peer, 0, sizeof(*peer));
+    if (addr != NULL) {
+        peer->addr = *addr;
+        peer->known = 1;
+    }
+    peer->token = token;
+}
+
+/**
+ * function channelSend
+ * @brief Function to send a message to a peer, with the acks of the datagrams received from it
+ * @param sock - socket of the channel
+ * @param peer - state of the channel with the peer
+ * @param type - type of the message
+ * @param payload - payload of the message
+ * @param len - size of the payload (at most CHANNEL_MAX_PAYLOAD)
+ * @param reliable - 1 to send the message again until it is acked
+ * @return int - 0 on success, -1 on error
+ */
+int channelSend(socket_t *sock, channel_peer_t *peer, channel_type_t type, const void *payload, size_t len, int reliable) {
+    if (!peer->known || sock->fd < 0 || len > CHANNEL_MAX_PAYLOAD) {
+        return -1;
+    }
+    if (!reliable) {
+        return channelSendRaw(sock, peer, 0, type, 0, payload, len, NULL);
+    }
+
+    channel_pending_t *pending = NULL;
+    for (int i = 0; i < CHANNEL_RELIABLE_SLOTS && pending == NULL; i++) {
+        if (!peer->pending[i].used) {
+            pending = &peer->pending[i];
+        }
+    }
+    if (pending == NULL) {
+        return -1; // Too many reliable messages in flight
+    }
+    pending->used = 1;
+    pending->rel_id = peer->rel_next++;
+    pending->type = type;
+    pending->len = len;
+    memcpy(pending->payload, payload, len);
+    // Even if this datagram is lost, channelUpdate sends the message again
+    channelSendRaw(sock, peer, CHANNEL_RELIABLE, type, pending->rel_id, payload, len, &pending->seq);
+    pending->sent_ms = peer->last_sent_ms;
+    return 0;
+}
+
+/**
+ * function channelReceive
+ * @brief Function to receive one datagram, without blocking
+ * @param sock - socket of the channel
+ * @param packet - datagram received
+ * @param from - address of the sender
+ * @return int - 1 if a valid datagram was received, 0 if none is waiting, -1 on error
+ */
+int channelReceive(socket_t *sock, channel_packet_t *packet, struct sockaddr_in *from) {
+    while (1) {
+        socklen_t fromlen = sizeof(*from);
+        ssize_t n = recvfrom(sock->fd, packet, sizeof(*packet), MSG_DONTWAIT, (struct sockaddr *)from, &fromlen);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            // ECONNREFUSED: a previous datagram was refused, the peer may come back
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNREFUSED) return 0;
+            return -1;
+        }
+        // Datagrams that are not ours are ignored
+        if ((size_t)n >= sizeof(channel_header_t) && packet->header.magic == CHANNEL_MAGIC
+            && packet->header.len <= CHANNEL_MAX_PAYLOAD && (size_t)n == sizeof(channel_header_t) + packet->header.len) {
+            return 1;
+        }
+    }
+}
+
+/**
+ * function channelAccept
+ * @brief Function to process a datagram received from a peer: acks, stale and duplicate detection
+ * @param peer - state of the channel with the sender
+ * @param packet - datagram received
+ * @return int - 1 if the message must be delivered, 0 if it is stale, a duplicate or an ack
+ */
+int channelAccept(channel_peer_t *peer, const channel_packet_t *packet) {
+    const channel_header_t *header = &packet->header;
+
+    // The reliable messages whose last datagram is acked are delivered
+    for (int i = 0; i < CHANNEL_RELIABLE_SLOTS; i++) {
+        if (peer->pending[i].used && seqAcked(header, peer->pending[i].seq)) {
+            peer->pending[i].used = 0;
+        }
+    }
+
+    int newer = !peer->received || seqNewer(header->seq, peer->remote_seq);
+    if (!windowMark(&peer->remote_seq, &peer->remote_bits, &peer->received, header->seq)) {
+        return 0; // Duplicated datagram
+    }
+    peer->ack_due = 1;
+
+    if (header->type == CHANNEL_ACK) {
+        return 0;
+    }
+    if (header->flags & CHANNEL_RELIABLE) {
+        // Delivered once, whatever its order
+        if (!windowMark(&peer->rel_latest, &peer->rel_bits, &peer->rel_received, header->rel_id)) {
+            return 0;
+        }
+    } else if (!newer) {
+        // A state older than the one already delivered is useless
+        peer->stale++;
+        return 0;
+    }
+    peer->delivered++;
+    return 1;
+}
+
+/**
+ * function channelUpdate
+ * @brief Function to send again the reliable messages not acked in time, and the acks due
+ * @param sock - socket of the channel
+ * @param peer - state of the channel with the peer
+ * @return void
+ */
+void channelUpdate(socket_t *sock, channel_peer_t *peer) {
+    if (!peer->known || sock->fd < 0) {
+        return;
+    }
+    long long now = channelNowMs();
+    for (int i = 0; i < CHANNEL_RELIABLE_SLOTS; i++) {
+        channel_pending_t *pending = &peer->pending[i];
+        if (pending->used && now - pending->sent_ms >= CHANNEL_RESEND_MS) {
+            channelSendRaw(sock, peer, CHANNEL_RELIABLE, pending->type, pending->rel_id, pending->payload, pending->len, &pending->seq);
+            pending->sent_ms = now;
+            peer->resent++;
+        }
+    }
+    if (peer->ack_due && now - peer->last_sent_ms >= CHANNEL_ACK_MS) {
+        channelSendRaw(sock, peer, 0, CHANNEL_ACK, 0, NULL, 0, NULL);
+    }
+}
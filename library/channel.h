@@ -0,0 +1,185 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+/*******************************************/
+/*		I N C L U D E S                    */
+/*******************************************/
+#include "session.h"
+
+/*******************************************/
+/*		D E F I N E S                      */
+/*******************************************/
+/**
+ * @brief Magic number of the datagrams of the channel
+ * @def CHANNEL_MAGIC
+ */
+#define CHANNEL_MAGIC 0xB021
+
+/**
+ * @brief Maximum size of the payload of a datagram (stays below the MTU)
+ * @def CHANNEL_MAX_PAYLOAD
+ */
+#define CHANNEL_MAX_PAYLOAD 512
+
+/**
+ * @brief Number of reliable messages waiting for their ack, per peer
+ * @def CHANNEL_RELIABLE_SLOTS
+ */
+#define CHANNEL_RELIABLE_SLOTS 32
+
+/**
+ * @brief A reliable message is sent again until acked, every CHANNEL_RESEND_MS milliseconds.
+ *        A peer that received datagrams without sending any acks them after CHANNEL_ACK_MS.
+ * @def CHANNEL_RESEND_MS
+ */
+#define CHANNEL_RESEND_MS 100
+#define CHANNEL_ACK_MS 50
+
+/**
+ * @brief Flags of the datagrams
+ * @def CHANNEL_RELIABLE
+ */
+#define CHANNEL_RELIABLE 0x1    // Delivered once, even out of order, and sent again until acked
+
+/*******************************************/
+/*		S T R U C T U R E S                */
+/*******************************************/
+/**
+ * @brief Types of the messages carried by the channel
+ * @typedef channel_type_t
+ */
+typedef enum {
+    CHANNEL_ACK = 0,        // No payload, only carries the acks
+    CHANNEL_JOIN = 1,       // Reliable, gives the address of the client to the server
+    CHANNEL_POSITION = 2,   // Point {x, y, role} of the sender (client) or of the opponent (server)
+} channel_type_t;
+
+/**
+ * @brief Header of every datagram (24 bytes). Every datagram acks the last 33 sequences received:
+ *        ack and the sequences ack - 1 - i for every bit i set in ack_bits.
+ * @typedef channel_header_t
+ */
+typedef struct {
+    unsigned short magic;
+    unsigned char flags;
+    unsigned char type;
+    unsigned short seq;             // Sequence of the datagram, a new one for every datagram sent
+    unsigned short ack;             // Most recent sequence received from the peer
+    unsigned int ack_bits;
+    unsigned short rel_id;          // Id of the reliable message (CHANNEL_RELIABLE)
+    unsigned short len;             // Size of the payload
+    unsigned long long token;       // Session token of the player
+} channel_header_t;
+
+/**
+ * @brief Datagram received or sent
+ * @typedef channel_packet_t
+ */
+typedef struct {
+    channel_header_t header;
+    unsigned char payload[CHANNEL_MAX_PAYLOAD];
+} channel_packet_t;
+
+/**
+ * @brief Reliable message waiting for the ack of the last datagram that carried it
+ * @typedef channel_pending_t
+ */
+typedef struct {
+    int used;
+    unsigned short rel_id;
+    unsigned short seq;
+    long long sent_ms;
+    unsigned char type;
+    unsigned short len;
+    unsigned char payload[CHANNEL_MAX_PAYLOAD];
+} channel_pending_t;
+
+/**
+ * @brief State of the channel with one peer
+ * @typedef channel_peer_t
+ */
+typedef struct {
+    struct sockaddr_in addr;        // Address of the peer (learned from its datagrams on the server)
+    int known;                      // 1 once addr is set
+    unsigned long long token;
+    unsigned short local_seq;       // Next sequence sent
+    unsigned short remote_seq;      // Most recent sequence received
+    unsigned int remote_bits;       // Reception of the 32 sequences before remote_seq
+    int received;                   // 1 once a datagram was received
+    int ack_due;                    // Datagrams received since the last one sent
+    long long last_sent_ms;
+    unsigned short rel_next;        // Next reliable id sent
+    unsigned short rel_latest;      // Most recent reliable id received
+    unsigned int rel_bits;          // Reception of the 32 reliable ids before rel_latest
+    int rel_received;
+    channel_pending_t pending[CHANNEL_RELIABLE_SLOTS];
+    unsigned long sent;             // Statistics
+    unsigned long delivered;
+    unsigned long stale;
+    unsigned long resent;
+} channel_peer_t;
+
+/*******************************************/
+/*		F O N C T I O N S                  */
+/*******************************************/
+/**
+ * function channelSocket
+ * @brief Function to create the UDP socket of the channel
+ * @param adrIP - address to bind ("any" for every interface), NULL to leave it unbound (client)
+ * @param port - port to bind
+ * @return socket_t - fd is -1 on error
+ */
+socket_t channelSocket(const char *adrIP, short port);
+
+/**
+ * function channelPeerInit
+ * @brief Function to initialize the state of the channel with a peer
+ * @param peer - state to initialize
+ * @param addr - address of the peer, NULL if it is not known yet (server)
+ * @param token - session token of the player
+ * @return void
+ */
+void channelPeerInit(channel_peer_t *peer, const struct sockaddr_in *addr, unsigned long long token);
+
+/**
+ * function channelSend
+ * @brief Function to send a message to a peer, with the acks of the datagrams received from it
+ * @param sock - socket of the channel
+ * @param peer - state of the channel with the peer
+ * @param type - type of the message
+ * @param payload - payload of the message
+ * @param len - size of the payload (at most CHANNEL_MAX_PAYLOAD)
+ * @param reliable - 1 to send the message again until it is acked
+ * @return int - 0 on success, -1 on error
+ */
+int channelSend(socket_t *sock, channel_peer_t *peer, channel_type_t type, const void *payload, size_t len, int reliable);
+
+/**
+ * function channelReceive
+ * @brief Function to receive one datagram, without blocking
+ * @param sock - socket of the channel
+ * @param packet - datagram received
+ * @param from - address of the sender
+ * @return int - 1 if a valid datagram was received, 0 if none is waiting, -1 on error
+ */
+int channelReceive(socket_t *sock, channel_packet_t *packet, struct sockaddr_in *from);
+
+/**
+ * function channelAccept
+ * @brief Function to process a datagram received from a peer: acks, stale and duplicate detection
+ * @param peer - state of the channel with the sender
+ * @param packet - datagram received
+ * @return int - 1 if the message must be delivered, 0 if it is stale, a duplicate or an ack
+ */
+int channelAccept(channel_peer_t *peer, const channel_packet_t *packet);
+
+/**
+ * function channelUpdate
+ * @brief Function to send again the reliable messages not acked in time, and the acks due
+ * @param sock - socket of the channel
+ * @param peer - state of the channel with the peer
+ * @return void
+ */
+void channelUpdate(socket_t *sock, channel_peer_t *peer);
+
+#endif /* CHANNEL_H */
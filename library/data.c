@@ -2,7 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <stdarg.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -10,125 +10,505 @@
 
 int DGRAM = SOCK_DGRAM;
 
+// --- Fields ---
+
 /**
- * function envoyer
- * @brief function to send the message
- * @param sockEch - socket to send the message
- * @param quoi - message to send
- * @param serial - function to serialize the message
- * @param ... - arguments to serialize
- * @return void
+ * function putVarint
+ * @brief function to encode an int as a varint (zigzag, 7 bits per byte)
+ * @param p - where to write
+ * @param value - value to encode
+ * @return unsigned char* - end of the varint
  */
-void envoyer(socket_t *sockEch, generic quoi, pFct serial, ...)
+static unsigned char *putVarint(unsigned char *p, int value)
+{
+    unsigned int v = ((unsigned int)value << 1) ^ (unsigned int)(value >> 31);
+    while (v >= 0x80)
+    {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+/**
+ * function getVarint
+ * @brief function to decode a varint
+ * @param p - where to read
+ * @param end - end of the payload
+ * @param value - value decoded
+ * @return const unsigned char* - end of the varint, NULL if it is invalid
+ */
+static const unsigned char *getVarint(const unsigned char *p, const unsigned char *end, int *value)
+{
+    unsigned int v = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7)
+    {
+        unsigned char byte = *p++;
+        v |= (unsigned int)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            *value = (int)(v >> 1) ^ -(int)(v & 1);
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static unsigned char *putU32(unsigned char *p, unsigned int value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+    return p + 4;
+}
+
+static const unsigned char *getU32(const unsigned char *p, const unsigned char *end, unsigned int *value)
+{
+    if (end - p < 4) return NULL;
+    *value = p[0] | (unsigned int)p[1] << 8 | (unsigned int)p[2] << 16 | (unsigned int)p[3] << 24;
+    return p + 4;
+}
+
+static unsigned char *putU64(unsigned char *p, unsigned long long value)
+{
+    p = putU32(p, (unsigned int)value);
+    return putU32(p, (unsigned int)(value >> 32));
+}
+
+static const unsigned char *getU64(const unsigned char *p, const unsigned char *end, unsigned long long *value)
+{
+    unsigned int low, high;
+    if ((p = getU32(p, end, &low)) == NULL || (p = getU32(p, end, &high)) == NULL) return NULL;
+    *value = (unsigned long long)high << 32 | low;
+    return p;
+}
+
+static unsigned char *putText(unsigned char *p, const char *text)
+{
+    size_t len = strnlen(text, MAX_BUFFER - 1);
+    p = putVarint(p, (int)len);
+    memcpy(p, text, len);
+    return p + len;
+}
+
+static const unsigned char *getText(const unsigned char *p, const unsigned char *end, char *text)
+{
+    int len;
+    if ((p = getVarint(p, end, &len)) == NULL || len < 0 || len > MAX_BUFFER - 1 || end - p < len) return NULL;
+    memcpy(text, p, len);
+    text[len] = '\0';
+    return p + len;
+}
+
+static unsigned char *putCells(unsigned char *p, const int *cells, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        // The states of the cells always fit in one byte
+        if ((unsigned int)cells[i] < 64)
+        {
+            *p++ = (unsigned char)(cells[i] << 1);
+        }
+        else
+        {
+            p = putVarint(p, cells[i]);
+        }
+    }
+    return p;
+}
+
+static const unsigned char *getCells(const unsigned char *p, const unsigned char *end, int *cells, int width, int height)
 {
-    buffer_t buffer;
-    // Check if serialization is needed
-    if (serial != NULL)
+    // Each side on its own: their product overflows for a forged map
+    if (width <= 0 || width > MAX_MAP_WIDTH || height <= 0 || height > MAX_MAP_HEIGHT) return NULL;
+    for (int i = 0; i < width * height && p != NULL; i++)
     {
-        // Call the serialization function, passing the address of buffer and the variable arguments
-        va_list args;
-        va_start(args, serial);
-        //(*serial)(buffer, args);
-        va_end(args);
+        if (p < end && !(*p & 0x81))
+        {
+            cells[i] = *p++ >> 1;
+        }
+        else
+        {
+            p = getVarint(p, end, &cells[i]);
+        }
     }
-    else
+    return p;
+}
+
+static unsigned char *putRows(unsigned char *p, const unsigned long long *masks, int count)
+{
+    for (int i = 0; i < count; i++)
     {
-        // Directly assign quoi to buffer (assumed to be a char pointer)
-        strcpy(buffer, (char *)quoi);
+        unsigned long long v = masks[i];
+        while (v >= 0x80)
+        {
+            *p++ = (unsigned char)(v | 0x80);
+            v >>= 7;
+        }
+        *p++ = (unsigned char)v;
     }
+    return p;
+}
 
-    // Send the buffer to the socket
-    ssize_t bytes_written;
-    CHECK(bytes_written = write(sockEch->fd, buffer, strlen(buffer) + 1), "write");
+static const unsigned char *getRows(const unsigned char *p, const unsigned char *end, unsigned long long *masks, int count)
+{
+    if (count < 0 || count > MAX_MAP_HEIGHT) return NULL;
+    for (int i = 0; i < count; i++)
+    {
+        unsigned long long v = 0;
+        int shift = 0;
+        do
+        {
+            if (p == end || shift > 63) return NULL;
+            v |= (unsigned long long)(*p & 0x7F) << shift;
+            shift += 7;
+        } while (*p++ & 0x80);
+        masks[i] = v;
+    }
+    return p;
 }
 
+// --- Codecs generated from the schema ---
+
+#define ENCODE_VARINT(field) p = putVarint(p, (int)m->field);
+#define ENCODE_U32(field) p = putU32(p, m->field);
+#define ENCODE_U64(field) p = putU64(p, m->field);
+#define ENCODE_TEXT(field) p = putText(p, m->field);
+#define ENCODE_CELLS(field) p = putCells(p, m->field, m->width * m->height);
+#define ENCODE_ROWS(field) p = putRows(p, m->field, m->rows);
+#define ENCODE_FIELD(kind, field) ENCODE_##kind(field)
+
+#define DECODE_VARINT(field) { int v; if ((p = getVarint(p, end, &v)) == NULL) return -1; m->field = v; }
+#define DECODE_U32(field) if ((p = getU32(p, end, &m->field)) == NULL) return -1;
+#define DECODE_U64(field) if ((p = getU64(p, end, &m->field)) == NULL) return -1;
+#define DECODE_TEXT(field) if ((p = getText(p, end, m->field)) == NULL) return -1;
+#define DECODE_CELLS(field) if ((p = getCells(p, end, m->field, m->width, m->height)) == NULL) return -1;
+#define DECODE_ROWS(field) if ((p = getRows(p, end, m->field, m->rows)) == NULL) return -1;
+#define DECODE_FIELD(kind, field) DECODE_##kind(field)
+
+#define BOUND_VARINT(field) + 5
+#define BOUND_U32(field) + 4
+#define BOUND_U64(field) + 8
+#define BOUND_TEXT(field) + 5 + strnlen(m->field, MAX_BUFFER - 1)
+#define BOUND_CELLS(field) + 5 * (size_t)(m->width * m->height)
+#define BOUND_ROWS(field) + 10 * (size_t)m->rows
+#define BOUND_FIELD(kind, field) BOUND_##kind(field)
+
+#define SCHEMA_CODEC(NAME, ID, name, TYPE, FIELDS) \
+    static size_t bound_##name(const TYPE *m) \
+    { \
+        (void)m; \
+        return FRAME_HEADER_SIZE FIELDS(BOUND_FIELD); \
+    } \
+    static unsigned char *encode_##name(unsigned char *p, const TYPE *m) \
+    { \
+        (void)m; \
+        FIELDS(ENCODE_FIELD) \
+        return p; \
+    } \
+    static int decode_##name(const unsigned char *p, const unsigned char *end, TYPE *m) \
+    { \
+        (void)m; \
+        FIELDS(DECODE_FIELD) \
+        return p == end ? 0 : -1; \
+    }
+SCHEMA_MESSAGES(SCHEMA_CODEC)
+
 /**
- * function recevoir
- * @brief function to serialize the message 
- * @param sockEch - socket to receive the message
- * @param quoi - message to receive
- * @param deSerial - function to deserialize the message
- * @return void
+ * function encodePayload
+ * @brief function to encode the fields of a message
+ * @param buffer - buffer of at least MAX_FRAME_PAYLOAD bytes
+ * @param type - type of the message
+ * @param quoi - message, of the C type given by the schema
+ * @return size_t - size of the payload, 0 if the type is unknown
  */
-void recevoir(socket_t *sockEch, generic quoi, pFct deSerial)
+size_t encodePayload(unsigned char *buffer, msg_type_t type, const void *quoi)
 {
-    buffer_t buffer;
-    ssize_t nread = read(sockEch->fd, buffer, MAX_BUFFER - 1);
-    buffer[nread] = '\0'; // Null-terminate the received data
+    switch (type)
+    {
+#define SCHEMA_ENCODE_CASE(NAME, ID, name, TYPE, FIELDS) \
+        case NAME: return encode_##name(buffer, (const TYPE *)quoi) - buffer;
+        SCHEMA_MESSAGES(SCHEMA_ENCODE_CASE)
+#undef SCHEMA_ENCODE_CASE
+    }
+    return 0;
+}
 
-    // Check if deserialization is needed
-    if (deSerial != NULL)
+/**
+ * function decodePayload
+ * @brief function to decode the fields of a message
+ * @param type - type of the message
+ * @param payload - payload received
+ * @param len - size of the payload
+ * @param quoi - message decoded, of the C type given by the schema
+ * @return int - 0 on success, -1 if the payload is invalid
+ */
+int decodePayload(msg_type_t type, const unsigned char *payload, size_t len, void *quoi)
+{
+    switch (type)
     {
-        // Call the deserialization function, passing the buffer and the address of quoi
-        (*deSerial)(buffer, quoi);
+#define SCHEMA_DECODE_CASE(NAME, ID, name, TYPE, FIELDS) \
+        case NAME: return decode_##name(payload, payload + len, (TYPE *)quoi);
+        SCHEMA_MESSAGES(SCHEMA_DECODE_CASE)
+#undef SCHEMA_DECODE_CASE
     }
-    else
+    return -1;
+}
+
+/**
+ * function messageBound
+ * @brief function to get the maximum size of the frame of a message, before encoding it
+ * @param type - type of the message
+ * @param quoi - message, of the C type given by the schema
+ * @return size_t - size in bytes, 0 if the type is unknown
+ */
+size_t messageBound(msg_type_t type, const void *quoi)
+{
+    switch (type)
     {
-        // Directly assign the buffer to quoi (assumed to be a char pointer)
-        strncpy((char *)quoi, buffer, MAX_BUFFER);
+#define SCHEMA_BOUND_CASE(NAME, ID, name, TYPE, FIELDS) \
+        case NAME: return bound_##name((const TYPE *)quoi);
+        SCHEMA_MESSAGES(SCHEMA_BOUND_CASE)
+#undef SCHEMA_BOUND_CASE
     }
+    return 0;
 }
 
 /**
- * function serial_string
- * @brief function to serialize the message
- * @param quoi - message to serialize
- * @param args - arguments to serialize
- * @return void
+ * function encodeMessage
+ * @brief function to encode a message as a frame
+ * @param frame - buffer of at least MAX_FRAME bytes
+ * @param type - type of the message
+ * @param quoi - message, of the C type given by the schema
+ * @return size_t - size of the frame, 0 if the type is unknown
  */
-void deserial_string(generic buffer, generic quoi)
+size_t encodeMessage(unsigned char *frame, msg_type_t type, const void *quoi)
 {
-    // The buffer is a char with this format: "message"
-    char *message = (char *)buffer;
-    strcpy((char *)quoi, message);
+    size_t len = encodePayload(frame + FRAME_HEADER_SIZE, type, quoi);
+    if (len == 0 && type != MSG_QUIT)
+    {
+        return 0;
+    }
+    frame[0] = type;
+    frame[1] = len;
+    frame[2] = len >> 8;
+    return FRAME_HEADER_SIZE + len;
 }
 
 /**
- * function serial_long_int
- * @brief function to serialize the message as an integer
- * @param buffer - buffer to store the message
- * @param quoi - message to serialize
- * @return void
+ * function decodeHeader
+ * @brief function to decode the header of a frame
+ * @param header - FRAME_HEADER_SIZE bytes received
+ * @param type - type of the message
+ * @param len - size of the payload
+ * @return int - 0 on success, -1 if the header is invalid
  */
-void serial_long_int(generic buffer, generic args)
+int decodeHeader(const unsigned char *header, msg_type_t *type, size_t *len)
 {
-    // serialize the long int as a string in the buffer
-    sprintf(buffer, "%ld", *(long int *)args);
+    *type = header[0];
+    *len = header[1] | (size_t)header[2] << 8;
+    return *len <= MAX_FRAME_PAYLOAD ? 0 : -1;
 }
 
 /**
- * function deserial_long_int
- * @brief function to deserialize the message
- * @param quoi - message to serialize
- * @param args - arguments to serialize
- * @return void
+ * function envoyer
+ * @brief function to send a message
+ * @param sockEch - socket to send the message
+ * @param type - type of the message
+ * @param quoi - message to send, of the C type given by the schema
+ * @return int - 0 on success, -1 on error
  */
-void deserial_long_int(generic buffer, generic quoi)
+int envoyer(socket_t *sockEch, msg_type_t type, const void *quoi)
 {
-    // Deserialize the buffer as a long int
-    sscanf(buffer, "%ld", (long int *)quoi);
+    unsigned char frame[MAX_FRAME];
+    size_t len = encodeMessage(frame, type, quoi);
+    // A client that went away must not stop the server
+    if (len == 0 || envoyerOctets(sockEch, frame, len) < 0)
+    {
+        return -1;
+    }
+    return 0;
 }
 
 /**
- * funtion serial_point
- * @brief function to serialize the message as a point
- * @param buffer - buffer to store the message
- * @param args - arguments to deserialize
- * @return void
+ * function recevoir
+ * @brief function to receive a message
+ * @param sockEch - socket to receive the message
+ * @param quoi - message received
+ * @return int - type of the message, -1 on error or if the connection is closed
  */
-void serial_point(generic buffer, generic args){
-    Point *point = (Point *)args;
-    memcpy(buffer, point, sizeof(Point));
+int recevoir(socket_t *sockEch, message_u *quoi)
+{
+    unsigned char header[FRAME_HEADER_SIZE];
+    unsigned char payload[MAX_FRAME_PAYLOAD];
+    msg_type_t type;
+    size_t len;
+    if (recevoirOctets(sockEch, header, FRAME_HEADER_SIZE) < 0
+        || decodeHeader(header, &type, &len) < 0
+        || recevoirOctets(sockEch, payload, len) < 0
+        || decodePayload(type, payload, len, quoi) < 0)
+    {
+        return -1;
+    }
+    return type;
 }
 
+// --- Map received in pieces ---
+
 /**
- * function deserial_point
- * @brief Function to deserialize the message as a point
- * 
- * @param buffer 
- * @param quoi 
+ * function mapStreamInit
+ * @brief function to start the decoding of a map received in pieces
+ * @param stream - decoder
+ * @param map - map written by the decoder
+ * @param len - size of the payload
  * @return void
  */
-void deserial_point(generic buffer, generic quoi) {
-    memcpy(quoi, buffer, sizeof(Point));
+void mapStreamInit(map_stream_t *stream, Map *map, size_t len)
+{
+    stream->map = map;
+    stream->left = len;
+    stream->field = 0;
+    stream->cells = 0;
+    stream->value = 0;
+    stream->shift = 0;
+    map->width = 0;
+    map->height = 0;
+}
+
+/**
+ * function mapStreamFeed
+ * @brief function to decode the next bytes of the payload of a map, same encoding as getVarint and getCells
+ * @param stream - decoder
+ * @param bytes - bytes received
+ * @param len - number of bytes (at most the bytes left in the payload)
+ * @return int - rows of the map complete so far, -1 if the payload is invalid
+ */
+int mapStreamFeed(map_stream_t *stream, const unsigned char *bytes, size_t len)
+{
+    Map *map = stream->map;
+    if (len > stream->left)
+    {
+        return -1;
+    }
+    stream->left -= len;
+    // The state is kept in locals while decoding: the stores of the cells could alias it
+    int cells = stream->cells;
+    int total = map->width * map->height;
+    size_t i = 0;
+    while (i < len && stream->field < 3)
+    {
+        // A cell holds in one byte, the varints only for the dimensions and unknown states
+        if (stream->field == 2 && stream->shift == 0)
+        {
+            int *out = map->cells;
+            while (i < len && cells < total && !(bytes[i] & 0x81))
+            {
+                out[cells++] = bytes[i++] >> 1;
+            }
+            if (cells == total)
+            {
+                stream->field = 3;
+                break;
+            }
+            if (i == len)
+            {
+                break;
+            }
+        }
+        unsigned char byte = bytes[i++];
+        stream->value |= (unsigned int)(byte & 0x7F) << stream->shift;
+        if (byte & 0x80)
+        {
+            stream->shift += 7;
+            if (stream->shift >= 35)
+            {
+                return -1;
+            }
+            continue;
+        }
+        int value = (int)(stream->value >> 1) ^ -(int)(stream->value & 1);
+        stream->value = 0;
+        stream->shift = 0;
+        if (stream->field == 0)
+        {
+            map->width = value;
+            stream->field++;
+        }
+        else if (stream->field == 1)
+        {
+            if (map->width <= 0 || map->width > MAX_MAP_WIDTH || value <= 0 || value > MAX_MAP_HEIGHT)
+            {
+                return -1;
+            }
+            map->height = value;
+            total = map->width * value;
+            stream->field++;
+        }
+        else
+        {
+            map->cells[cells++] = value;
+            if (cells == total)
+            {
+                stream->field = 3;
+            }
+        }
+    }
+    stream->cells = cells;
+    // The payload must hold all the cells
+    if (stream->left == 0 && stream->field < 3)
+    {
+        return -1;
+    }
+    return stream->field < 2 ? 0 : cells / map->width;
+}
+
+/**
+ * function recevoirMap
+ * @brief function to receive a map without copying it: its cells are decoded into the map as they arrive
+ * @param sockEch - socket to receive the map
+ * @param map - map received
+ * @param rows - called when rows are complete, NULL if not needed
+ * @param arg - argument of rows
+ * @return int - 0 on success, -1 on error, if the connection is closed or if the message is not a map
+ */
+int recevoirMap(socket_t *sockEch, Map *map, map_rows_t rows, void *arg)
+{
+    unsigned char header[FRAME_HEADER_SIZE];
+    msg_type_t type;
+    size_t len;
+    if (recevoirOctets(sockEch, header, FRAME_HEADER_SIZE) < 0
+        || decodeHeader(header, &type, &len) < 0
+        || type != MSG_MAP)
+    {
+        return -1;
+    }
+    map_stream_t stream;
+    mapStreamInit(&stream, map, len);
+    unsigned char chunk[MAP_STREAM_CHUNK];
+    int done = 0;
+    while (stream.left > 0)
+    {
+        ssize_t n = lireSocket(sockEch, chunk, stream.left < sizeof chunk ? stream.left : sizeof chunk);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        int complete = mapStreamFeed(&stream, chunk, (size_t)n);
+        if (complete < 0)
+        {
+            return -1;
+        }
+        if (complete > done && rows != NULL)
+        {
+            rows(map, done, complete, arg);
+        }
+        done = complete;
+    }
+    return 0;
 }
@@ -45,6 +45,27 @@ typedef struct {
     int state;
 } Point;
 
+/**
+ * @brief Cells destroyed by the detonations of a tick, one bit per cell: bit x of masks[i] is the cell (x, top + i)
+ * @typedef blast_t
+ */
+typedef struct {
+    int top;
+    int rows;
+    unsigned long long masks[MAX_MAP_HEIGHT];
+} blast_t;
+
+/**
+ * @brief Position of a player of the match, sent to the spectators (id is the slot of the player)
+ * @typedef actor_t
+ */
+typedef struct {
+    int id;
+    int x;
+    int y;
+    int role;
+} actor_t;
+
 /**
  * @brief structure to store the socket
  * @typedef socket_t
@@ -52,90 +73,164 @@ typedef struct {
  */
 typedef char buffer_t[MAX_BUFFER];
 
+#include "schema.h"
+
 /**
- * @brief structure to store the socket
- * @typedef socket_t
- * 
+ * @brief Type of a message, from the schema
+ * @typedef msg_type_t
  */
-typedef void *generic;
+#define SCHEMA_ENUM(NAME, ID, name, TYPE, FIELDS) NAME = ID,
+typedef enum {
+    SCHEMA_MESSAGES(SCHEMA_ENUM)
+} msg_type_t;
+#undef SCHEMA_ENUM
 
 /**
- * @brief structure to store the socket
- * @typedef socket_t
- * 
+ * @brief Any message received, the member read depends on its type
+ * @typedef message_u
+ */
+#define SCHEMA_MEMBER(NAME, ID, name, TYPE, FIELDS) TYPE name;
+typedef union {
+    SCHEMA_MESSAGES(SCHEMA_MEMBER)
+} message_u;
+#undef SCHEMA_MEMBER
+
+/**
+ * @brief Size of the header of a frame (type, size of the payload) and maximum size of a payload
+ * @def FRAME_HEADER_SIZE
+ */
+#define FRAME_HEADER_SIZE 3
+#define MAX_FRAME_PAYLOAD 6144
+#define MAX_FRAME (FRAME_HEADER_SIZE + MAX_FRAME_PAYLOAD)
+
+/**
+ * @brief Bytes of a map read at once by recevoirMap, decoded before the next read
+ * @def MAP_STREAM_CHUNK
  */
-typedef void (*pFct)(generic, generic);
+#define MAP_STREAM_CHUNK 2048
+
+/**
+ * @brief Decoder of a map received in pieces (MSG_MAP payload): the fields are decoded straight
+ *        into the map as their bytes arrive, a varint can be split between two pieces
+ * @typedef map_stream_t
+ */
+typedef struct {
+    Map *map;                   // Map written
+    size_t left;                // Bytes of the payload not decoded yet
+    int field;                  // 0: width, 1: height, 2: cells, 3: the fields added after the cells
+    int cells;                  // Cells decoded
+    unsigned int value;         // Varint being decoded
+    int shift;
+} map_stream_t;
+
+/**
+ * @brief Called by recevoirMap each time rows of the map are complete
+ * @typedef map_rows_t
+ */
+typedef void (*map_rows_t)(const Map *map, int first, int last, void *arg);
 
 
 /*******************************************/
 /*		F O N C T I O N S                  */
 /*******************************************/
 /**
- * function envoyer
- * @brief Function to send the message
- * @param sockEch - socket to send the message
- * @param quoi - message to send
- * @param serial - function to serialize the message
- * @param ... - arguments to serialize
- * @return void
+ * function encodePayload
+ * @brief Function to encode the fields of a message
+ * @param buffer - buffer of at least MAX_FRAME_PAYLOAD bytes
+ * @param type - type of the message
+ * @param quoi - message, of the C type given by the schema
+ * @return size_t - size of the payload, 0 if the type is unknown
  */
-void envoyer(socket_t *sockEch, generic quoi, pFct serial, ...);
+size_t encodePayload(unsigned char *buffer, msg_type_t type, const void *quoi);
 
 /**
- * function recevoir
- * @brief Function to receive the message
- * @param sockEch - socket to receive the message
- * @param quoi - message to receive
- * @param deSerial - function to deserialize the message
- * @return void
+ * function decodePayload
+ * @brief Function to decode the fields of a message
+ * @param type - type of the message
+ * @param payload - payload received
+ * @param len - size of the payload
+ * @param quoi - message decoded, of the C type given by the schema
+ * @return int - 0 on success, -1 if the payload is invalid
  */
-void recevoir(socket_t *sockEch, generic quoi, pFct deSerial);
+int decodePayload(msg_type_t type, const unsigned char *payload, size_t len, void *quoi);
 
 /**
- * function serial_string
- * @brief Function to serialize the message
- * @param buffer - buffer to store the message
- * @param quoi - message to serialize
- * @return void
+ * function messageBound
+ * @brief Function to get the maximum size of the frame of a message, before encoding it
+ * @param type - type of the message
+ * @param quoi - message, of the C type given by the schema
+ * @return size_t - size in bytes, 0 if the type is unknown
  */
-void deserial_string(generic buffer, generic quoi);
+size_t messageBound(msg_type_t type, const void *quoi);
 
 /**
- * function serial_int
- * @brief Function to serialize the message as an integer
- * @param buffer - buffer to store the message
- * @param args - arguments to serialize
- * @return void
+ * function encodeMessage
+ * @brief Function to encode a message as a frame
+ * @param frame - buffer of at least MAX_FRAME bytes
+ * @param type - type of the message
+ * @param quoi - message, of the C type given by the schema
+ * @return size_t - size of the frame, 0 if the type is unknown
  */
-void serial_long_int(generic buffer, generic args);
+size_t encodeMessage(unsigned char *frame, msg_type_t type, const void *quoi);
 
 /**
- * function deserial_int
- * @brief Function to deserialize the message as an integer
- * @param buffer - buffer to store the message
- * @param quoi - message to deserialize
- * @return void
+ * function decodeHeader
+ * @brief Function to decode the header of a frame
+ * @param header - FRAME_HEADER_SIZE bytes received
+ * @param type - type of the message
+ * @param len - size of the payload
+ * @return int - 0 on success, -1 if the header is invalid
  */
-void deserial_long_int(generic buffer, generic quoi);
+int decodeHeader(const unsigned char *header, msg_type_t *type, size_t *len);
 
 /**
- * funtion serial_point
- * @brief Function to serialize the message as a point
- * 
- * @param buffer 
- * @param args 
- * @return void
+ * function envoyer
+ * @brief Function to send a message
+ * @param sockEch - socket to send the message
+ * @param type - type of the message
+ * @param quoi - message to send, of the C type given by the schema
+ * @return int - 0 on success, -1 on error
  */
-void serial_point(generic buffer, generic args);
+int envoyer(socket_t *sockEch, msg_type_t type, const void *quoi);
 
 /**
- * function deserial_point
- * @brief Function to deserialize the message as a point
- * 
- * @param buffer 
- * @param quoi
+ * function recevoir
+ * @brief Function to receive a message
+ * @param sockEch - socket to receive the message
+ * @param quoi - message received
+ * @return int - type of the message, -1 on error or if the connection is closed
+ */
+int recevoir(socket_t *sockEch, message_u *quoi);
+
+/**
+ * function mapStreamInit
+ * @brief Function to start the decoding of a map received in pieces
+ * @param stream - decoder
+ * @param map - map written by the decoder
+ * @param len - size of the payload
  * @return void
  */
-void deserial_point(generic buffer, generic quoi);
+void mapStreamInit(map_stream_t *stream, Map *map, size_t len);
+
+/**
+ * function mapStreamFeed
+ * @brief Function to decode the next bytes of the payload of a map
+ * @param stream - decoder
+ * @param bytes - bytes received
+ * @param len - number of bytes (at most the bytes left in the payload)
+ * @return int - rows of the map complete so far, -1 if the payload is invalid
+ */
+int mapStreamFeed(map_stream_t *stream, const unsigned char *bytes, size_t len);
+
+/**
+ * function recevoirMap
+ * @brief Function to receive a map without copying it: its cells are decoded into the map as they arrive
+ * @param sockEch - socket to receive the map
+ * @param map - map received
+ * @param rows - called when rows are complete, NULL if not needed
+ * @param arg - argument of rows
+ * @return int - 0 on success, -1 on error, if the connection is closed or if the message is not a map
+ */
+int recevoirMap(socket_t *sockEch, Map *map, map_rows_t rows, void *arg);
 
-#endif // DATA_H
\ No newline at end of file
+#endif // DATA_H
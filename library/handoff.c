@@ -0,0 +1,163 @@
+#define _GNU_SOURCE
+#include "handoff.h"
+#include <string.h>
+#include <sys/un.h>
+
+/**
+ * function handoffAddress
+ * @brief Function to fill the address of the UNIX socket
+ * @param addr - address to fill
+ * @param path - path of the socket
+ * @return void
+ */
+static void handoffAddress(struct sockaddr_un *addr, const char *path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    snprintf(addr->sun_path, sizeof addr->sun_path, "%s", path);
+}
+
+/**
+ * function handoffListen
+ * @brief Function to create the UNIX socket where the next server asks for the handoff
+ * @param path - path of the socket (an existing one is replaced)
+ * @return socket_t - fd is -1 on error
+ */
+socket_t handoffListen(const char *path) {
+    socket_t sock;
+    memset(&sock, 0, sizeof sock);
+    sock.mode = SOCK_SEQPACKET;
+    sock.fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock.fd < 0) {
+        perror("handoff socket");
+        return sock;
+    }
+    struct sockaddr_un addr;
+    handoffAddress(&addr, path);
+    unlink(path);
+    if (bind(sock.fd, (struct sockaddr *)&addr, sizeof addr) < 0 || listen(sock.fd, 1) < 0) {
+        perror("handoff bind");
+        close(sock.fd);
+        sock.fd = -1;
+    }
+    return sock;
+}
+
+/**
+ * function handoffAccept
+ * @brief Function to accept the next server, only a process of the same user is accepted
+ * @param listener - socket created by handoffListen
+ * @return int - connected descriptor, -1 on error or for another user
+ */
+int handoffAccept(const socket_t listener) {
+    int fd = accept4(listener.fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+        perror("handoff accept");
+        return -1;
+    }
+    struct ucred cred;
+    socklen_t len = sizeof cred;
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0 || cred.uid != getuid()) {
+        fprintf(stderr, "handoff: refused a process of another user\n");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * function handoffConnect
+ * @brief Function to connect to the running server to take its sockets over
+ * @param path - path of the UNIX socket of the running server
+ * @return int - connected descriptor, -1 on error
+ */
+int handoffConnect(const char *path) {
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("handoff socket");
+        return -1;
+    }
+    struct sockaddr_un addr;
+    handoffAddress(&addr, path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof addr) < 0) {
+        fprintf(stderr, "Connection to %s failed\n", path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * function handoffSend
+ * @brief Function to send a record with descriptors (SCM_RIGHTS), the receiver gets its own copies
+ * @param fd - connected descriptor
+ * @param buf - record
+ * @param len - size of the record (at most HANDOFF_MAX_RECORD)
+ * @param fds - descriptors passed with the record
+ * @param count - number of descriptors (at most HANDOFF_MAX_FDS)
+ * @return int - 0 on success, -1 on error
+ */
+int handoffSend(int fd, const void *buf, size_t len, const int *fds, int count) {
+    if (len > HANDOFF_MAX_RECORD || count < 0 || count > HANDOFF_MAX_FDS) {
+        return -1;
+    }
+    struct iovec iov = { .iov_base = (void *)buf, .iov_len = len };
+    union {
+        char buf[CMSG_SPACE(HANDOFF_MAX_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (count > 0) {
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(count * sizeof(int));
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, count * sizeof(int));
+    }
+    return sendmsg(fd, &msg, MSG_NOSIGNAL) == (ssize_t)len ? 0 : -1;
+}
+
+/**
+ * function handoffReceive
+ * @brief Function to receive a record and its descriptors
+ * @param fd - connected descriptor
+ * @param buf - buffer of HANDOFF_MAX_RECORD bytes
+ * @param fds - descriptors received, HANDOFF_MAX_FDS of them at most
+ * @param count - number of descriptors received
+ * @return ssize_t - size of the record, 0 if the peer closed the connection, -1 on error
+ */
+ssize_t handoffReceive(int fd, void *buf, int *fds, int *count) {
+    struct iovec iov = { .iov_base = buf, .iov_len = HANDOFF_MAX_RECORD };
+    union {
+        char buf[CMSG_SPACE(HANDOFF_MAX_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof control.buf;
+    *count = 0;
+    ssize_t len = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (len <= 0) {
+        return len;
+    }
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        *count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(cmsg), *count * sizeof(int));
+    }
+    if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        for (int i = 0; i < *count; i++) {
+            close(fds[i]);
+        }
+        *count = 0;
+        return -1;
+    }
+    return len;
+}
@@ -0,0 +1,80 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+/*******************************************/
+/*		I N C L U D E S                    */
+/*******************************************/
+#include "session.h"
+
+/*******************************************/
+/*		D E F I N E S                      */
+/*******************************************/
+/**
+ * @brief Path of the UNIX socket where a running server hands its sockets over to the next one
+ * @def HANDOFF_PATH
+ */
+#define HANDOFF_PATH "/tmp/bombo2i.handoff"
+
+/**
+ * @brief Maximum number of descriptors passed with one record
+ * @def HANDOFF_MAX_FDS
+ */
+#define HANDOFF_MAX_FDS 64
+
+/**
+ * @brief Maximum size of a record (the records keep their boundaries, SOCK_SEQPACKET)
+ * @def HANDOFF_MAX_RECORD
+ */
+#define HANDOFF_MAX_RECORD (64 * 1024)
+
+/*******************************************/
+/*		F O N C T I O N S                  */
+/*******************************************/
+/**
+ * function handoffListen
+ * @brief Function to create the UNIX socket where the next server asks for the handoff
+ * @param path - path of the socket (an existing one is replaced)
+ * @return socket_t - fd is -1 on error
+ */
+socket_t handoffListen(const char *path);
+
+/**
+ * function handoffAccept
+ * @brief Function to accept the next server, only a process of the same user is accepted
+ * @param listener - socket created by handoffListen
+ * @return int - connected descriptor, -1 on error or for another user
+ */
+int handoffAccept(const socket_t listener);
+
+/**
+ * function handoffConnect
+ * @brief Function to connect to the running server to take its sockets over
+ * @param path - path of the UNIX socket of the running server
+ * @return int - connected descriptor, -1 on error
+ */
+int handoffConnect(const char *path);
+
+/**
+ * function handoffSend
+ * @brief Function to send a record with descriptors (SCM_RIGHTS), the receiver gets its own copies
+ * @param fd - connected descriptor
+ * @param buf - record
+ * @param len - size of the record (at most HANDOFF_MAX_RECORD)
+ * @param fds - descriptors passed with the record
+ * @param count - number of descriptors (at most HANDOFF_MAX_FDS)
+ * @return int - 0 on success, -1 on error
+ */
+int handoffSend(int fd, const void *buf, size_t len, const int *fds, int count);
+
+/**
+ * function handoffReceive
+ * @brief Function to receive a record and its descriptors
+ * @param fd - connected descriptor
+ * @param buf - buffer of HANDOFF_MAX_RECORD bytes
+ * @param fds - descriptors received, HANDOFF_MAX_FDS of them at most
+ * @param count - number of descriptors received
+ * @return ssize_t - size of the record, 0 if the peer closed the connection, -1 on error
+ */
+ssize_t handoffReceive(int fd, void *buf, int *fds, int *count);
+
+#endif /* HANDOFF_H */
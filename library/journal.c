@@ -0,0 +1,268 @@
+#define _GNU_SOURCE
+#include "journal.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * function journalNow
+ * @brief Function to get the monotonic time in nanoseconds
+ * @return unsigned long long
+ */
+static unsigned long long journalNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * function journalGrow
+ * @brief Function to extend the file by one chunk and remap it
+ * @param journal - journal to grow
+ * @return int - 0 on success, -1 on error
+ */
+static int journalGrow(journal_t *journal) {
+    size_t size = journal->mapped + JOURNAL_CHUNK;
+    if (ftruncate(journal->fd, size) < 0) {
+        perror("journal ftruncate");
+        return -1;
+    }
+    char *base = journal->base == NULL
+        ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, journal->fd, 0)
+        : mremap(journal->base, journal->mapped, size, MREMAP_MAYMOVE);
+    if (base == MAP_FAILED) {
+        perror("journal mmap");
+        return -1;
+    }
+    journal->base = base;
+    journal->mapped = size;
+    return 0;
+}
+
+/**
+ * function journalOpen
+ * @brief Function to create a journal and map it in memory
+ * @param journal - journal to initialize
+ * @param path - path of the file (truncated if it exists)
+ * @return int - 0 on success, -1 on error
+ */
+int journalOpen(journal_t *journal, const char *path) {
+    memset(journal, 0, sizeof(*journal));
+    journal->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (journal->fd < 0) {
+        perror("journal open");
+        return -1;
+    }
+    if (journalGrow(journal) < 0) {
+        close(journal->fd);
+        journal->fd = -1;
+        return -1;
+    }
+    pthread_mutex_init(&journal->mutex, NULL);
+
+    journal_header_t header = {
+        .magic = JOURNAL_MAGIC,
+        .version = JOURNAL_VERSION,
+        .record_size = sizeof(journal_record_t),
+        .created = (unsigned long long)time(NULL)
+    };
+    memcpy(journal->base, &header, sizeof header);
+    journal->used = sizeof header;
+    journal->start = journalNow();
+    journal->last_sync = journal->start;
+    return 0;
+}
+
+/**
+ * function journalAdopt
+ * @brief Function to map a journal opened by another process (hot restart) and go on writing it
+ * @param journal - journal to initialize
+ * @param fd - descriptor of the file, owned by the journal
+ * @param used - bytes written so far
+ * @param start - start of the journal (monotonic ns), the timestamps go on from it
+ * @return int - 0 on success, -1 on error
+ */
+int journalAdopt(journal_t *journal, int fd, size_t used, unsigned long long start) {
+    memset(journal, 0, sizeof(*journal));
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < used) {
+        perror("journal adopt");
+        close(fd);
+        journal->fd = -1;
+        return -1;
+    }
+    char *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        perror("journal mmap");
+        close(fd);
+        journal->fd = -1;
+        return -1;
+    }
+    pthread_mutex_init(&journal->mutex, NULL);
+    journal->fd = fd;
+    journal->base = base;
+    journal->mapped = st.st_size;
+    journal->used = used;
+    journal->synced = used;
+    journal->start = start;
+    journal->last_sync = journalNow();
+    return 0;
+}
+
+/**
+ * function journalAppend
+ * @brief Function to append a record, the timestamp is set by the journal
+ * @param journal - journal opened with journalOpen
+ * @param type - type of the record
+ * @param player - slot of the player (-1 if none)
+ * @param a, b, c, d - payload of the record (see journal_type_t)
+ * @return int - 0 on success, -1 on error
+ */
+int journalAppend(journal_t *journal, journal_type_t type, int player, int a, int b, int c, int d) {
+    if (journal->fd < 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&journal->mutex);
+    if (journal->used + sizeof(journal_record_t) > journal->mapped && journalGrow(journal) < 0) {
+        pthread_mutex_unlock(&journal->mutex);
+        return -1;
+    }
+
+    unsigned long long now = journalNow();
+    journal_record_t record = {
+        .timestamp = now - journal->start,
+        .type = type,
+        .player = player,
+        .a = a, .b = b, .c = c, .d = d
+    };
+    memcpy(journal->base + journal->used, &record, sizeof record);
+    journal->used += sizeof record;
+
+    // Batch the writeback: start it asynchronously for the whole dirty range
+    if (journal->used - journal->synced >= JOURNAL_SYNC_RECORDS * sizeof(journal_record_t)
+        || now - journal->last_sync >= JOURNAL_SYNC_MS * 1000000ULL) {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t from = journal->synced & ~(page - 1);
+        msync(journal->base + from, journal->used - from, MS_ASYNC);
+        journal->synced = journal->used;
+        journal->last_sync = now;
+    }
+    pthread_mutex_unlock(&journal->mutex);
+    return 0;
+}
+
+/**
+ * function journalSync
+ * @brief Function to write the journal to the disk and wait for it
+ * @param journal - journal opened with journalOpen
+ * @return int - 0 on success, -1 on error
+ */
+int journalSync(journal_t *journal) {
+    if (journal->fd < 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&journal->mutex);
+    int sts = msync(journal->base, journal->used, MS_SYNC);
+    journal->synced = journal->used;
+    journal->last_sync = journalNow();
+    pthread_mutex_unlock(&journal->mutex);
+    return sts;
+}
+
+/**
+ * function journalClose
+ * @brief Function to sync the journal, trim the file to its used size and unmap it
+ * @param journal - journal opened with journalOpen
+ * @return void
+ */
+void journalClose(journal_t *journal) {
+    if (journal->fd < 0) {
+        return;
+    }
+    journalSync(journal);
+    munmap(journal->base, journal->mapped);
+    if (ftruncate(journal->fd, journal->used) < 0) {
+        perror("journal ftruncate");
+    }
+    close(journal->fd);
+    pthread_mutex_destroy(&journal->mutex);
+    journal->fd = -1;
+    journal->base = NULL;
+}
+
+/**
+ * function journalOpenRead
+ * @brief Function to map an existing journal for reading
+ * @param reader - reader to initialize
+ * @param path - path of the file
+ * @return int - 0 on success, -1 on error
+ */
+int journalOpenRead(journal_reader_t *reader, const char *path) {
+    memset(reader, 0, sizeof(*reader));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror("journal open");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(journal_header_t)) {
+        fprintf(stderr, "journal: %s is too small\n", path);
+        close(fd);
+        return -1;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("journal mmap");
+        return -1;
+    }
+    memcpy(&reader->header, base, sizeof reader->header);
+    if (reader->header.magic != JOURNAL_MAGIC || reader->header.version != JOURNAL_VERSION
+        || reader->header.record_size != sizeof(journal_record_t)) {
+        fprintf(stderr, "journal: %s is not a version %d journal\n", path, JOURNAL_VERSION);
+        munmap(base, st.st_size);
+        return -1;
+    }
+    reader->base = base;
+    reader->size = st.st_size;
+    reader->offset = sizeof(journal_header_t);
+    madvise(base, st.st_size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+/**
+ * function journalNext
+ * @brief Function to read the next record
+ * @param reader - reader opened with journalOpenRead
+ * @param record - record read
+ * @return int - 1 if a record was read, 0 at the end of the journal
+ */
+int journalNext(journal_reader_t *reader, journal_record_t *record) {
+    if (reader->offset + sizeof(journal_record_t) > reader->size) {
+        return 0;
+    }
+    memcpy(record, reader->base + reader->offset, sizeof(journal_record_t));
+    // A journal that was not closed ends with the zeroed part of its last chunk
+    if (record->type == 0) {
+        return 0;
+    }
+    reader->offset += sizeof(journal_record_t);
+    return 1;
+}
+
+/**
+ * function journalCloseRead
+ * @brief Function to unmap a journal opened for reading
+ * @param reader - reader opened with journalOpenRead
+ * @return void
+ */
+void journalCloseRead(journal_reader_t *reader) {
+    if (reader->base != NULL) {
+        munmap((void *)reader->base, reader->size);
+        reader->base = NULL;
+    }
+}
@@ -0,0 +1,177 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+/*******************************************/
+/*		I N C L U D E S                    */
+/*******************************************/
+#include <stddef.h>
+#include <pthread.h>
+
+/*******************************************/
+/*		D E F I N E S                      */
+/*******************************************/
+/**
+ * @brief Magic number and version written at the start of every journal
+ * @def JOURNAL_MAGIC
+ */
+#define JOURNAL_MAGIC 0x4C4E524Au // "JRNL"
+#define JOURNAL_VERSION 1
+
+/**
+ * @brief The file is grown (and remapped) by chunks of this size
+ * @def JOURNAL_CHUNK
+ */
+#define JOURNAL_CHUNK (256 * 1024)
+
+/**
+ * @brief Writeback of the dirty pages is started every JOURNAL_SYNC_RECORDS records
+ *        or JOURNAL_SYNC_MS milliseconds, whichever comes first
+ * @def JOURNAL_SYNC_RECORDS
+ */
+#define JOURNAL_SYNC_RECORDS 64
+#define JOURNAL_SYNC_MS 200
+
+/*******************************************/
+/*		S T R U C T U R E S                */
+/*******************************************/
+/**
+ * @brief Types of the journal records
+ * @typedef journal_type_t
+ */
+typedef enum {
+    JOURNAL_MAP_SEED = 1,   // a = seed, b = width, c = height, d = checksum of the cells
+    JOURNAL_ROLE = 2,       // player = slot, a = role, b = x, c = y
+    JOURNAL_ACTION = 3,     // player = slot, a = x, b = y, c = requested state, d = resulting state
+    JOURNAL_END = 4,        // a = winner role
+    JOURNAL_MAP_GENERATOR = 5 // a = generator of the next map, the maps of the journals without it come from rand()
+} journal_type_t;
+
+/**
+ * @brief Header at the start of the file (16 bytes)
+ * @typedef journal_header_t
+ */
+typedef struct {
+    unsigned int magic;
+    unsigned short version;
+    unsigned short record_size;
+    unsigned long long created;     // Wall clock time of creation (s since epoch)
+} journal_header_t;
+
+/**
+ * @brief Fixed-size record (32 bytes), the timestamp is monotonic (ns since the journal was opened)
+ * @typedef journal_record_t
+ */
+typedef struct {
+    unsigned long long timestamp;
+    unsigned short type;
+    unsigned short reserved;
+    int player;
+    int a;
+    int b;
+    int c;
+    int d;
+} journal_record_t;
+
+/**
+ * @brief Journal opened for writing
+ * @typedef journal_t
+ */
+typedef struct {
+    int fd;
+    char *base;             // Mapping of the file
+    size_t mapped;          // Size of the mapping (and of the file while it is open)
+    size_t used;            // Bytes written
+    size_t synced;          // Bytes whose writeback was started
+    unsigned long long start;
+    unsigned long long last_sync;
+    pthread_mutex_t mutex;
+} journal_t;
+
+/**
+ * @brief Journal opened for reading
+ * @typedef journal_reader_t
+ */
+typedef struct {
+    const char *base;
+    size_t size;
+    size_t offset;
+    journal_header_t header;
+} journal_reader_t;
+
+/*******************************************/
+/*		F O N C T I O N S                  */
+/*******************************************/
+/**
+ * function journalOpen
+ * @brief Function to create a journal and map it in memory
+ * @param journal - journal to initialize
+ * @param path - path of the file (truncated if it exists)
+ * @return int - 0 on success, -1 on error
+ */
+int journalOpen(journal_t *journal, const char *path);
+
+/**
+ * function journalAdopt
+ * @brief Function to map a journal opened by another process (hot restart) and go on writing it
+ * @param journal - journal to initialize
+ * @param fd - descriptor of the file, owned by the journal
+ * @param used - bytes written so far
+ * @param start - start of the journal (monotonic ns), the timestamps go on from it
+ * @return int - 0 on success, -1 on error
+ */
+int journalAdopt(journal_t *journal, int fd, size_t used, unsigned long long start);
+
+/**
+ * function journalAppend
+ * @brief Function to append a record, the timestamp is set by the journal
+ * @param journal - journal opened with journalOpen
+ * @param type - type of the record
+ * @param player - slot of the player (-1 if none)
+ * @param a, b, c, d - payload of the record (see journal_type_t)
+ * @return int - 0 on success, -1 on error
+ */
+int journalAppend(journal_t *journal, journal_type_t type, int player, int a, int b, int c, int d);
+
+/**
+ * function journalSync
+ * @brief Function to write the journal to the disk and wait for it
+ * @param journal - journal opened with journalOpen
+ * @return int - 0 on success, -1 on error
+ */
+int journalSync(journal_t *journal);
+
+/**
+ * function journalClose
+ * @brief Function to sync the journal, trim the file to its used size and unmap it
+ * @param journal - journal opened with journalOpen
+ * @return void
+ */
+void journalClose(journal_t *journal);
+
+/**
+ * function journalOpenRead
+ * @brief Function to map an existing journal for reading
+ * @param reader - reader to initialize
+ * @param path - path of the file
+ * @return int - 0 on success, -1 on error
+ */
+int journalOpenRead(journal_reader_t *reader, const char *path);
+
+/**
+ * function journalNext
+ * @brief Function to read the next record
+ * @param reader - reader opened with journalOpenRead
+ * @param record - record read
+ * @return int - 1 if a record was read, 0 at the end of the journal
+ */
+int journalNext(journal_reader_t *reader, journal_record_t *record);
+
+/**
+ * function journalCloseRead
+ * @brief Function to unmap a journal opened for reading
+ * @param reader - reader opened with journalOpenRead
+ * @return void
+ */
+void journalCloseRead(journal_reader_t *reader);
+
+#endif /* JOURNAL_H */
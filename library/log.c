@@ -0,0 +1,503 @@
+#define _GNU_SOURCE
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#define LOG_LINE_SIZE 512
+
+/**
+ * @brief Classes of arguments found in a printf-like format
+ * @typedef log_arg_t
+ */
+typedef enum {
+    ARG_NONE,
+    ARG_INT,
+    ARG_LONG,
+    ARG_LLONG,
+    ARG_SIZE,
+    ARG_INTMAX,
+    ARG_PTRDIFF,
+    ARG_DOUBLE,
+    ARG_LDOUBLE,
+    ARG_PTR,
+    ARG_STR
+} log_arg_t;
+
+/**
+ * @brief Conversion specification parsed from a format
+ * @typedef log_spec_t
+ */
+typedef struct {
+    const char *start;  // Position of the '%'
+    const char *end;    // Position after the conversion character
+    int stars;          // Number of '*' (width and precision passed as arguments)
+    log_arg_t arg;
+} log_spec_t;
+
+/**
+ * @brief Record stored in the ring buffers, the arguments are raw bytes
+ * @typedef log_record_t
+ */
+typedef struct {
+    unsigned long long timestamp;
+    const char *fmt;
+    int level;
+    int size;
+    unsigned char args[LOG_RECORD_ARGS];
+} log_record_t;
+
+/**
+ * @brief Single producer / single consumer ring owned by one thread
+ * @typedef log_ring_t
+ */
+typedef struct log_ring {
+    log_record_t records[LOG_RING_SIZE];
+    unsigned int head __attribute__((aligned(64)));  // Written by the owner thread
+    unsigned int tail __attribute__((aligned(64)));  // Written by the writer thread
+    int active;
+    int tid;
+    struct log_ring *next;
+} log_ring_t;
+
+static const char *level_names[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+
+static log_ring_t *rings = NULL;
+static __thread log_ring_t *thread_ring = NULL;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static int next_tid = 0;
+
+static pthread_t writer_thread;
+static int writer_running = 0;
+static FILE *output = NULL;
+static unsigned long long start_time = 0;
+static unsigned long dropped = 0;
+
+/**
+ * function logNow
+ * @brief Function to get the monotonic time in nanoseconds
+ * @return unsigned long long
+ */
+static unsigned long long logNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * function logParseSpec
+ * @brief Function to parse the conversion specification starting at a '%'
+ * @param p - position of the '%' in the format
+ * @param spec - parsed specification
+ * @return void
+ */
+static void logParseSpec(const char *p, log_spec_t *spec) {
+    spec->start = p++;
+    spec->stars = 0;
+
+    // Flags, width and precision
+    while (*p && strchr("-+ #0", *p)) p++;
+    if (*p == '*') { spec->stars++; p++; }
+    while (*p >= '0' && *p <= '9') p++;
+    if (*p == '.') {
+        p++;
+        if (*p == '*') { spec->stars++; p++; }
+        while (*p >= '0' && *p <= '9') p++;
+    }
+
+    // Length modifier
+    char length = 0;
+    if (*p == 'h') { length = 'h'; p++; if (*p == 'h') p++; }
+    else if (*p == 'l') { length = 'l'; p++; if (*p == 'l') { length = 'q'; p++; } }
+    else if (*p && strchr("zjtL", *p)) { length = *p; p++; }
+
+    // Conversion
+    switch (*p) {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+            switch (length) {
+                case 'l': spec->arg = ARG_LONG; break;
+                case 'q': spec->arg = ARG_LLONG; break;
+                case 'z': spec->arg = ARG_SIZE; break;
+                case 'j': spec->arg = ARG_INTMAX; break;
+                case 't': spec->arg = ARG_PTRDIFF; break;
+                default: spec->arg = ARG_INT; break;
+            }
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            spec->arg = length == 'L' ? ARG_LDOUBLE : ARG_DOUBLE;
+            break;
+        case 'p':
+            spec->arg = ARG_PTR;
+            break;
+        case 's':
+            spec->arg = ARG_STR;
+            break;
+        default:
+            // '%%', '%n' or unsupported conversion, nothing is captured
+            spec->arg = ARG_NONE;
+            break;
+    }
+    spec->end = *p ? p + 1 : p;
+}
+
+/**
+ * function logPush
+ * @brief Function to append raw bytes to the arguments of a record
+ * @param rec - record
+ * @param data - bytes to append
+ * @param size - number of bytes
+ * @return int - 0 if the record is full
+ */
+static int logPush(log_record_t *rec, const void *data, size_t size) {
+    if (rec->size + size > LOG_RECORD_ARGS) {
+        return 0;
+    }
+    memcpy(rec->args + rec->size, data, size);
+    rec->size += size;
+    return 1;
+}
+
+#define LOG_CAPTURE(type, promoted) do { type v = (type)va_arg(ap, promoted); if (!logPush(rec, &v, sizeof v)) return; } while (0)
+
+/**
+ * function logCapture
+ * @brief Function to capture the arguments of a format as raw bytes, strings are copied
+ * @param rec - record receiving the arguments
+ * @param ap - arguments
+ * @return void
+ */
+static void logCapture(log_record_t *rec, va_list ap) {
+    log_spec_t spec;
+    rec->size = 0;
+
+    for (const char *p = rec->fmt; *p; ) {
+        if (*p != '%') { p++; continue; }
+        logParseSpec(p, &spec);
+        p = spec.end;
+
+        for (int i = 0; i < spec.stars; i++) {
+            LOG_CAPTURE(int, int);
+        }
+        switch (spec.arg) {
+            case ARG_INT: LOG_CAPTURE(int, int); break;
+            case ARG_LONG: LOG_CAPTURE(long, long); break;
+            case ARG_LLONG: LOG_CAPTURE(long long, long long); break;
+            case ARG_SIZE: LOG_CAPTURE(size_t, size_t); break;
+            case ARG_INTMAX: LOG_CAPTURE(intmax_t, intmax_t); break;
+            case ARG_PTRDIFF: LOG_CAPTURE(ptrdiff_t, ptrdiff_t); break;
+            case ARG_DOUBLE: LOG_CAPTURE(double, double); break;
+            case ARG_LDOUBLE: LOG_CAPTURE(long double, long double); break;
+            case ARG_PTR: LOG_CAPTURE(void *, void *); break;
+            case ARG_STR: {
+                const char *s = va_arg(ap, const char *);
+                if (s == NULL) s = "(null)";
+                size_t len = strlen(s);
+                size_t room = LOG_RECORD_ARGS - rec->size;
+                if (room == 0) return;
+                // Truncate long strings instead of dropping the record
+                if (len >= room) len = room - 1;
+                memcpy(rec->args + rec->size, s, len);
+                rec->args[rec->size + len] = '\0';
+                rec->size += len + 1;
+                break;
+            }
+            case ARG_NONE:
+                break;
+        }
+    }
+}
+
+#define LOG_FORMAT(type) do { \
+        type v; \
+        if (offset + sizeof v > (size_t)rec->size) goto truncated; \
+        memcpy(&v, rec->args + offset, sizeof v); \
+        offset += sizeof v; \
+        n = spec.stars == 0 ? snprintf(line + pos, room, conv, v) \
+          : spec.stars == 1 ? snprintf(line + pos, room, conv, stars[0], v) \
+          : snprintf(line + pos, room, conv, stars[0], stars[1], v); \
+    } while (0)
+
+/**
+ * function logFormat
+ * @brief Function to format a record and write it on the output
+ * @param rec - record to format
+ * @param tid - id of the thread that produced the record
+ * @param out - output stream
+ * @return void
+ */
+static void logFormat(const log_record_t *rec, int tid, FILE *out) {
+    char line[LOG_LINE_SIZE];
+    char conv[32];
+    size_t offset = 0;
+    int pos, n;
+    log_spec_t spec;
+
+    unsigned long long elapsed = rec->timestamp > start_time ? rec->timestamp - start_time : 0;
+    pos = snprintf(line, sizeof line, "[%5llu.%06llu] [T%02d] %s ",
+                   elapsed / 1000000000ULL, (elapsed / 1000ULL) % 1000000ULL, tid, level_names[rec->level]);
+
+    for (const char *p = rec->fmt; *p && pos < (int)sizeof line - 1; ) {
+        if (*p != '%') {
+            line[pos++] = *p++;
+            continue;
+        }
+        logParseSpec(p, &spec);
+        p = spec.end;
+        if (spec.end[-1] == '%' && spec.end - spec.start == 2) {
+            line[pos++] = '%';
+            continue;
+        }
+
+        size_t len = spec.end - spec.start;
+        if (len >= sizeof conv) goto truncated;
+        memcpy(conv, spec.start, len);
+        conv[len] = '\0';
+
+        int stars[2] = {0, 0};
+        for (int i = 0; i < spec.stars; i++) {
+            if (offset + sizeof(int) > (size_t)rec->size) goto truncated;
+            memcpy(&stars[i], rec->args + offset, sizeof(int));
+            offset += sizeof(int);
+        }
+
+        size_t room = sizeof line - pos;
+        n = 0;
+        switch (spec.arg) {
+            case ARG_INT: LOG_FORMAT(int); break;
+            case ARG_LONG: LOG_FORMAT(long); break;
+            case ARG_LLONG: LOG_FORMAT(long long); break;
+            case ARG_SIZE: LOG_FORMAT(size_t); break;
+            case ARG_INTMAX: LOG_FORMAT(intmax_t); break;
+            case ARG_PTRDIFF: LOG_FORMAT(ptrdiff_t); break;
+            case ARG_DOUBLE: LOG_FORMAT(double); break;
+            case ARG_LDOUBLE: LOG_FORMAT(long double); break;
+            case ARG_PTR: LOG_FORMAT(void *); break;
+            case ARG_STR: {
+                if (offset >= (size_t)rec->size) goto truncated;
+                const char *s = (const char *)rec->args + offset;
+                offset += strlen(s) + 1;
+                n = spec.stars == 0 ? snprintf(line + pos, room, conv, s)
+                  : spec.stars == 1 ? snprintf(line + pos, room, conv, stars[0], s)
+                  : snprintf(line + pos, room, conv, stars[0], stars[1], s);
+                break;
+            }
+            case ARG_NONE:
+                break;
+        }
+        if (n > 0) {
+            pos += (size_t)n < room ? n : (int)room - 1;
+        }
+    }
+    goto done;
+
+truncated:
+    pos += snprintf(line + pos, sizeof line - pos, "...");
+
+done:
+    if (pos > (int)sizeof line - 2) pos = sizeof line - 2;
+    // Strip the new lines kept from the former printf calls
+    while (pos > 0 && line[pos - 1] == '\n') pos--;
+    line[pos++] = '\n';
+    fwrite(line, 1, pos, out);
+}
+
+/**
+ * function logReleaseRing
+ * @brief Destructor of the thread key, the ring can be reused once drained
+ * @param arg - ring of the exiting thread
+ * @return void
+ */
+static void logReleaseRing(void *arg) {
+    log_ring_t *ring = (log_ring_t *)arg;
+    __atomic_store_n(&ring->active, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * function logCreateKey
+ * @brief Function to create the thread key used to release the rings
+ * @return void
+ */
+static void logCreateKey(void) {
+    pthread_key_create(&ring_key, logReleaseRing);
+}
+
+/**
+ * function logThreadRing
+ * @brief Function to get the ring of the calling thread, a drained ring of an exited thread is reused
+ * @return log_ring_t* - NULL if no memory is available
+ */
+static log_ring_t *logThreadRing(void) {
+    if (thread_ring != NULL) {
+        return thread_ring;
+    }
+    pthread_once(&ring_key_once, logCreateKey);
+
+    // Reuse the ring of a thread that exited
+    log_ring_t *ring;
+    for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        int expected = 0;
+        if (__atomic_load_n(&ring->active, __ATOMIC_ACQUIRE) == 0
+            && __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == ring->head
+            && __atomic_compare_exchange_n(&ring->active, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (ring == NULL) {
+        ring = calloc(1, sizeof(log_ring_t));
+        if (ring == NULL) {
+            return NULL;
+        }
+        ring->active = 1;
+        ring->tid = __atomic_fetch_add(&next_tid, 1, __ATOMIC_RELAXED);
+        ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+
+    pthread_setspecific(ring_key, ring);
+    thread_ring = ring;
+    return ring;
+}
+
+/**
+ * function logDrain
+ * @brief Function to format every pending record of every ring
+ * @return int - number of records written
+ */
+static int logDrain(void) {
+    int count = 0;
+    for (log_ring_t *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        unsigned int tail = ring->tail;
+        while (tail != head) {
+            logFormat(&ring->records[tail & (LOG_RING_SIZE - 1)], ring->tid, output);
+            tail++;
+            count++;
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+    return count;
+}
+
+/**
+ * function logWriter
+ * @brief Background thread formatting the records
+ * @param arg - unused
+ * @return void*
+ */
+static void *logWriter(void *arg) {
+    (void)arg;
+    struct timespec idle = {0, 500000}; // 0.5 ms
+
+    while (__atomic_load_n(&writer_running, __ATOMIC_ACQUIRE)) {
+        if (logDrain() > 0) {
+            fflush(output);
+        } else {
+            nanosleep(&idle, NULL);
+        }
+    }
+
+    // Last pass once every producer is done
+    logDrain();
+    unsigned long lost = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+    if (lost > 0) {
+        fprintf(output, "[log] %lu records dropped (ring full)\n", lost);
+    }
+    fflush(output);
+    return NULL;
+}
+
+/**
+ * function logInit
+ * @brief Function to start the background writer thread
+ * @param out - stream where the formatted records are written (stdout if NULL)
+ * @return int
+ */
+int logInit(FILE *out) {
+    if (writer_running) {
+        return 0;
+    }
+    output = out != NULL ? out : stdout;
+    start_time = logNow();
+    __atomic_store_n(&writer_running, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&writer_thread, NULL, logWriter, NULL) != 0) {
+        writer_running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * function logShutdown
+ * @brief Function to flush every pending record and stop the writer thread
+ * @return void
+ */
+void logShutdown(void) {
+    if (!__atomic_exchange_n(&writer_running, 0, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    pthread_join(writer_thread, NULL);
+}
+
+/**
+ * function logRecord
+ * @brief Function to push a record in the ring buffer of the calling thread
+ * @param level - level of the record
+ * @param fmt - printf-like format (string literal)
+ * @param ... - arguments of the format
+ * @return void
+ */
+void logRecord(int level, const char *fmt, ...) {
+    va_list ap;
+
+    // No writer: format the record directly
+    if (!__atomic_load_n(&writer_running, __ATOMIC_ACQUIRE)) {
+        log_record_t rec;
+        rec.timestamp = logNow();
+        if (start_time == 0) start_time = rec.timestamp;
+        rec.fmt = fmt;
+        rec.level = level;
+        va_start(ap, fmt);
+        logCapture(&rec, ap);
+        va_end(ap);
+        logFormat(&rec, 0, output != NULL ? output : stdout);
+        return;
+    }
+
+    log_ring_t *ring = logThreadRing();
+    if (ring == NULL) {
+        __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    unsigned int head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SIZE) {
+        // Never block the caller, the record is lost
+        __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    log_record_t *rec = &ring->records[head & (LOG_RING_SIZE - 1)];
+    rec->timestamp = logNow();
+    rec->fmt = fmt;
+    rec->level = level;
+    va_start(ap, fmt);
+    logCapture(rec, ap);
+    va_end(ap);
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * function logDropped
+ * @brief Function to get the number of records dropped because a ring was full
+ * @return unsigned long
+ */
+unsigned long logDropped(void) {
+    return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
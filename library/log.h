@@ -0,0 +1,110 @@
+#ifndef LOG_H
+#define LOG_H
+
+/*******************************************/
+/*		I N C L U D E S                    */
+/*******************************************/
+#include <stdio.h>
+
+/*******************************************/
+/*		D E F I N E S                      */
+/*******************************************/
+/**
+ * @brief Log levels, from the most verbose to the least verbose
+ * @def LOG_LEVEL_DEBUG
+ */
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE 4
+
+/**
+ * @brief Compile-time log level, the calls below this level are removed by the preprocessor
+ * @def LOG_LEVEL
+ * @see make LOG_LEVEL=LOG_LEVEL_INFO
+ */
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+/**
+ * @brief Number of records in the ring buffer of each thread (power of 2)
+ * @def LOG_RING_SIZE
+ */
+#define LOG_RING_SIZE 256
+
+/**
+ * @brief Number of bytes available to capture the arguments of one record
+ * @def LOG_RECORD_ARGS
+ */
+#define LOG_RECORD_ARGS 224
+
+/**
+ * @brief Logging macros, the format string must be a literal (it is kept by pointer until the writer formats it)
+ * @def LOG_DEBUG
+ * @param ... - printf-like format and arguments, without the trailing new line
+ */
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logRecord(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) logRecord(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) logRecord(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logRecord(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
+
+/*******************************************/
+/*		F O N C T I O N S                  */
+/*******************************************/
+/**
+ * function logInit
+ * @brief Function to start the background writer thread
+ * @param out - stream where the formatted records are written (stdout if NULL)
+ * @return int - 0 on success, -1 if the writer thread can't be started
+ */
+int logInit(FILE *out);
+
+/**
+ * function logShutdown
+ * @brief Function to flush every pending record and stop the writer thread
+ * @return void
+ */
+void logShutdown(void);
+
+/**
+ * function logRecord
+ * @brief Function to push a record in the ring buffer of the calling thread
+ * @details The arguments are captured as raw bytes (strings are copied), the formatting
+ *          is done later by the writer thread. If the ring is full the record is dropped
+ *          and counted, the caller never blocks. Without writer the record is printed directly.
+ * @param level - level of the record
+ * @param fmt - printf-like format (string literal)
+ * @param ... - arguments of the format
+ * @return void
+ */
+void logRecord(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * function logDropped
+ * @brief Function to get the number of records dropped because a ring was full
+ * @return unsigned long
+ */
+unsigned long logDropped(void);
+
+#endif /* LOG_H */
@@ -0,0 +1,114 @@
+#include "pool.h"
+#include <stdlib.h>
+
+// Buffers allocated together, freed with the pool
+struct frame_slab_s {
+    frame_slab_t *next;
+    frame_buf_t buffers[POOL_SLAB];
+};
+
+/**
+ * function poolInit
+ * @brief Function to initialize an empty pool, the buffers are allocated on the first poolGet
+ * @param pool - pool to initialize
+ * @return void
+ */
+void poolInit(frame_pool_t *pool) {
+    pool->free = NULL;
+    pool->slabs = NULL;
+    pool->allocated = 0;
+    pool->in_use = 0;
+}
+
+/**
+ * function poolDestroy
+ * @brief Function to free the slabs of a pool, no buffer must be in use
+ * @param pool - pool
+ * @return void
+ */
+void poolDestroy(frame_pool_t *pool) {
+    while (pool->slabs != NULL) {
+        frame_slab_t *slab = pool->slabs;
+        pool->slabs = slab->next;
+        free(slab);
+    }
+    poolInit(pool);
+}
+
+/**
+ * function poolGet
+ * @brief Function to take a buffer from a pool
+ * @param pool - pool
+ * @return frame_buf_t* - buffer holding one reference, NULL if the memory is exhausted
+ */
+frame_buf_t *poolGet(frame_pool_t *pool) {
+    if (pool->free == NULL) {
+        frame_slab_t *slab = malloc(sizeof(frame_slab_t));
+        if (slab == NULL) {
+            return NULL;
+        }
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        for (int i = 0; i < POOL_SLAB; i++) {
+            slab->buffers[i].pool = pool;
+            slab->buffers[i].next = pool->free;
+            pool->free = &slab->buffers[i];
+        }
+        pool->allocated += POOL_SLAB;
+    }
+    frame_buf_t *frame = pool->free;
+    pool->free = frame->next;
+    pool->in_use++;
+    frame->next = NULL;
+    frame->refs = 1;
+    frame->len = 0;
+    return frame;
+}
+
+/**
+ * function poolEncode
+ * @brief Function to take a buffer from a pool and encode a message in it
+ * @param pool - pool
+ * @param type - type of the message
+ * @param quoi - message, of the C type given by the schema
+ * @return frame_buf_t* - buffer holding one reference, NULL on error
+ */
+frame_buf_t *poolEncode(frame_pool_t *pool, msg_type_t type, const void *quoi) {
+    frame_buf_t *frame = poolGet(pool);
+    if (frame == NULL) {
+        return NULL;
+    }
+    frame->len = encodeMessage(frame->data, type, quoi);
+    if (frame->len == 0) {
+        frameRelease(frame);
+        return NULL;
+    }
+    return frame;
+}
+
+/**
+ * function frameRetain
+ * @brief Function to take one more reference on a buffer (one per pending send)
+ * @param frame - buffer
+ * @return frame_buf_t* - the buffer
+ */
+frame_buf_t *frameRetain(frame_buf_t *frame) {
+    frame->refs++;
+    return frame;
+}
+
+/**
+ * function frameRelease
+ * @brief Function to release a reference, the last one gives the buffer back to its pool
+ * @param frame - buffer (NULL is ignored)
+ * @return void
+ */
+void frameRelease(frame_buf_t *frame) {
+    if (frame == NULL || --frame->refs > 0) {
+        return;
+    }
+    frame_pool_t *pool = frame->pool;
+    frame->next = pool->free;
+    pool->free = frame;
+    pool->in_use--;
+}
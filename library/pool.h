@@ -0,0 +1,101 @@
+#ifndef POOL_H
+#define POOL_H
+
+/*******************************************/
+/*		I N C L U D E S                    */
+/*******************************************/
+#include "data.h"
+
+/*******************************************/
+/*		D E F I N E S                      */
+/*******************************************/
+/**
+ * @brief Buffers allocated at once when a pool is empty (one malloc per slab)
+ * @def POOL_SLAB
+ */
+#define POOL_SLAB 8
+
+/*******************************************/
+/*		S T R U C T U R E S                */
+/*******************************************/
+typedef struct frame_pool_s frame_pool_t;
+typedef struct frame_slab_s frame_slab_t;
+
+/**
+ * @brief Outgoing frame, encoded once and shared by all its recipients. Each pending send holds
+ *        a reference, the buffer goes back to its pool when the last one is released.
+ * @typedef frame_buf_t
+ */
+typedef struct frame_buf_s {
+    struct frame_buf_s *next;       // Next free buffer of the pool
+    frame_pool_t *pool;
+    int refs;
+    size_t len;                     // Size of the frame
+    unsigned char data[MAX_FRAME];
+} frame_buf_t;
+
+/**
+ * @brief Pool of frame buffers. A pool and its buffers are used under the lock of their owner (a room).
+ * @typedef frame_pool_t
+ */
+struct frame_pool_s {
+    frame_buf_t *free;
+    frame_slab_t *slabs;
+    unsigned int allocated;         // Buffers of the slabs (statistics)
+    unsigned int in_use;
+};
+
+/*******************************************/
+/*		F O N C T I O N S                  */
+/*******************************************/
+/**
+ * function poolInit
+ * @brief Function to initialize an empty pool, the buffers are allocated on the first poolGet
+ * @param pool - pool to initialize
+ * @return void
+ */
+void poolInit(frame_pool_t *pool);
+
+/**
+ * function poolDestroy
+ * @brief Function to free the slabs of a pool, no buffer must be in use
+ * @param pool - pool
+ * @return void
+ */
+void poolDestroy(frame_pool_t *pool);
+
+/**
+ * function poolGet
+ * @brief Function to take a buffer from a pool
+ * @param pool - pool
+ * @return frame_buf_t* - buffer holding one reference, NULL if the memory is exhausted
+ */
+frame_buf_t *poolGet(frame_pool_t *pool);
+
+/**
+ * function poolEncode
+ * @brief Function to take a buffer from a pool and encode a message in it
+ * @param pool - pool
+ * @param type - type of the message
+ * @param quoi - message, of the C type given by the schema
+ * @return frame_buf_t* - buffer holding one reference, NULL on error
+ */
+frame_buf_t *poolEncode(frame_pool_t *pool, msg_type_t type, const void *quoi);
+
+/**
+ * function frameRetain
+ * @brief Function to take one more reference on a buffer (one per pending send)
+ * @param frame - buffer
+ * @return frame_buf_t* - the buffer
+ */
+frame_buf_t *frameRetain(frame_buf_t *frame);
+
+/**
+ * function frameRelease
+ * @brief Function to release a reference, the last one gives the buffer back to its pool
+ * @param frame - buffer (NULL is ignored)
+ * @return void
+ */
+void frameRelease(frame_buf_t *frame);
+
+#endif /* POOL_H */
@@ -0,0 +1,61 @@
+#include "ratelimit.h"
+
+/**
+ * function bucketInit
+ * @brief Function to initialize a full bucket
+ * @param bucket - bucket to initialize
+ * @param period_ns - time to earn a token, 0 for a bucket that never runs out
+ * @param burst - tokens that can be taken at once
+ * @param now - current time (monotonic ns)
+ * @return void
+ */
+void bucketInit(token_bucket_t *bucket, long long period_ns, int burst, long long now) {
+    bucket->period = period_ns;
+    bucket->capacity = period_ns * (burst > 0 ? burst : 1);
+    bucket->credit = bucket->capacity;
+    bucket->last = now;
+}
+
+/**
+ * function refill
+ * @brief Function to add the credit earned since the last refill
+ * @param bucket - bucket
+ * @param now - current time (monotonic ns)
+ * @return long long - credit of the bucket now
+ */
+static long long refill(const token_bucket_t *bucket, long long now) {
+    long long credit = bucket->credit + (now > bucket->last ? now - bucket->last : 0);
+    return credit < bucket->capacity ? credit : bucket->capacity;
+}
+
+/**
+ * function bucketTake
+ * @brief Function to take a token if the bucket has one
+ * @param bucket - bucket
+ * @param now - current time (monotonic ns), never before the previous one
+ * @return int - 1 if a token was taken, 0 if the bucket is empty
+ */
+int bucketTake(token_bucket_t *bucket, long long now) {
+    if (bucket->period == 0) {
+        return 1;
+    }
+    bucket->credit = refill(bucket, now);
+    bucket->last = now;
+    if (bucket->credit < bucket->period) {
+        return 0;
+    }
+    bucket->credit -= bucket->period;
+    return 1;
+}
+
+/**
+ * function bucketWait
+ * @brief Function to get the time before the next token
+ * @param bucket - bucket
+ * @param now - current time (monotonic ns)
+ * @return long long - ns before a token can be taken, 0 if one can be taken now
+ */
+long long bucketWait(const token_bucket_t *bucket, long long now) {
+    long long credit = refill(bucket, now);
+    return credit >= bucket->period ? 0 : bucket->period - credit;
+}
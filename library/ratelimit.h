@@ -0,0 +1,56 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+/*******************************************/
+/*		I N C L U D E S                    */
+/*******************************************/
+#include <stddef.h>
+
+/*******************************************/
+/*		S T R U C T U R E S                */
+/*******************************************/
+/**
+ * @brief Token bucket: a token is earned every period, up to burst tokens. The tokens are counted
+ *        in nanoseconds of credit, the refill needs no division.
+ * @typedef token_bucket_t
+ */
+typedef struct {
+    long long credit;       // Credit left (ns), a token costs a period
+    long long last;         // Time of the last refill (monotonic ns)
+    long long period;       // Time to earn a token (ns), 0 for no limit
+    long long capacity;     // Credit of a full bucket (burst * period)
+} token_bucket_t;
+
+/*******************************************/
+/*		F O N C T I O N S                  */
+/*******************************************/
+/**
+ * function bucketInit
+ * @brief Function to initialize a full bucket
+ * @param bucket - bucket to initialize
+ * @param period_ns - time to earn a token, 0 for a bucket that never runs out
+ * @param burst - tokens that can be taken at once
+ * @param now - current time (monotonic ns)
+ * @return void
+ */
+void bucketInit(token_bucket_t *bucket, long long period_ns, int burst, long long now);
+
+/**
+ * function bucketTake
+ * @brief Function to take a token if the bucket has one
+ * @param bucket - bucket
+ * @param now - current time (monotonic ns), never before the previous one
+ * @return int - 1 if a token was taken, 0 if the bucket is empty
+ */
+int bucketTake(token_bucket_t *bucket, long long now);
+
+/**
+ * function bucketWait
+ * @brief Function to get the time before the next token
+ * @param bucket - bucket
+ * @param now - current time (monotonic ns)
+ * @return long long - ns before a token can be taken, 0 if one can be taken now
+ */
+long long bucketWait(const token_bucket_t *bucket, long long now);
+
+#endif /* RATELIMIT_H */
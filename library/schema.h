@@ -0,0 +1,51 @@
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+/*******************************************/
+/*		S C H E M A                        */
+/*******************************************/
+/**
+ * @brief Messages exchanged between the server and the clients. Every message is a frame:
+ *        type (1 byte), size of the payload (2 bytes, little endian), then the fields in order.
+ *        The encoders and decoders of data.c are generated from these tables.
+ *
+ *        Kinds of fields:
+ *        VARINT - int, zigzag then 7 bits per byte (a coordinate takes 1 byte)
+ *        U32    - unsigned int, 4 bytes little endian
+ *        U64    - unsigned long long, 8 bytes little endian
+ *        TEXT   - char array of MAX_BUFFER, size as a VARINT then the bytes (no NUL)
+ *        CELLS  - int array of width * height cells of the message, a VARINT each
+ *        ROWS   - unsigned long long array of the rows of the message, 7 bits per byte each (an empty row takes 1 byte)
+ *
+ *        A field is only ever added at the end of a message, and a type is never reused.
+ */
+#define SCHEMA_HELLO(F)     F(U32, magic) F(U32, flags) F(U64, token)
+#define SCHEMA_TEXT(F)      F(TEXT, buffer)
+#define SCHEMA_POINT(F)     F(VARINT, x) F(VARINT, y) F(VARINT, state)
+#define SCHEMA_MAP(F)       F(VARINT, width) F(VARINT, height) F(CELLS, cells)
+#define SCHEMA_BLAST(F)     F(VARINT, top) F(VARINT, rows) F(ROWS, masks)
+#define SCHEMA_ACTOR(F)     F(VARINT, id) F(VARINT, x) F(VARINT, y) F(VARINT, role)
+#define SCHEMA_EMPTY(F)
+
+/**
+ * @brief Table of the messages: constant, type id, name, C type, fields
+ *        MSG_HELLO  - session handshake, both ways
+ *        MSG_TEXT   - message displayed by the clients
+ *        MSG_POINT  - request of a client, or cell updated by the server
+ *        MSG_PLAYER - player of the client (state is the role)
+ *        MSG_MAP    - map of the match
+ *        MSG_QUIT   - the client leaves the match
+ *        MSG_BLAST  - cells destroyed by the bombs that exploded, they become paths
+ *        MSG_ACTOR  - position of a player, sent to the spectators only
+ */
+#define SCHEMA_MESSAGES(M) \
+    M(MSG_HELLO,  1, hello,  session_hello_t, SCHEMA_HELLO) \
+    M(MSG_TEXT,   2, text,   message_t,       SCHEMA_TEXT) \
+    M(MSG_POINT,  3, point,  Point,           SCHEMA_POINT) \
+    M(MSG_PLAYER, 4, player, Point,           SCHEMA_POINT) \
+    M(MSG_MAP,    5, map,    Map,             SCHEMA_MAP) \
+    M(MSG_QUIT,   6, quit,   int,             SCHEMA_EMPTY) \
+    M(MSG_BLAST,  7, blast,  blast_t,         SCHEMA_BLAST) \
+    M(MSG_ACTOR,  8, actor,  actor_t,         SCHEMA_ACTOR)
+
+#endif /* SCHEMA_H */
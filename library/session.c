@@ -1,8 +1,294 @@
+#define _GNU_SOURCE
 #include "session.h"
+#include "shm.h"
+#include "data.h"
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <netinet/ip.h>
+#include <sys/random.h>
 
 int STREAM = SOCK_STREAM;
 
+// Keepalive of the connected sockets: a dropped peer is detected after ~KEEPALIVE_IDLE_S + 3 * 2 s
+#define KEEPALIVE_IDLE_S 5
+#define KEEPALIVE_INTERVAL_S 2
+#define KEEPALIVE_COUNT 3
+#define USER_TIMEOUT_MS 10000   // Unacknowledged data fails the connection after this delay
+#define DEFER_ACCEPT_S 2        // accept() only returns once the client sent its hello
+#define LISTEN_BACKLOG 128      // Connections waiting for accept() (a lobby opens with a storm of them)
+
+/**
+ * function nowMs
+ * @brief Function to get the monotonic time in milliseconds
+ * @return long long
+ */
+static long long nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * function setLatencyOptions
+ * @brief Function to set the latency-oriented options of a connected TCP socket
+ *        (TCP_NODELAY, TCP_QUICKACK, short keepalive and user timeout to detect dropped peers)
+ * @param sock - connected socket
+ * @return void
+ */
+void setLatencyOptions(socket_t *sock) {
+    int on = 1;
+    int idle = KEEPALIVE_IDLE_S, interval = KEEPALIVE_INTERVAL_S, count = KEEPALIVE_COUNT;
+    unsigned int user_timeout = USER_TIMEOUT_MS;
+    int tos = IPTOS_LOWDELAY;
+
+    // The game sends small messages that must leave immediately
+    setsockopt(sock->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    setsockopt(sock->fd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof on);
+    setsockopt(sock->fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof on);
+    setsockopt(sock->fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof idle);
+    setsockopt(sock->fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof interval);
+    setsockopt(sock->fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof count);
+    setsockopt(sock->fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &user_timeout, sizeof user_timeout);
+    setsockopt(sock->fd, IPPROTO_IP, IP_TOS, &tos, sizeof tos); // Fails harmlessly on IPv6
+}
+
+/**
+ * function ecrireSocket
+ * @brief Function to write on a socket, network or shared memory (send semantics, no SIGPIPE)
+ * @param sockEch - socket to write on
+ * @param buf - bytes to write
+ * @param len - number of bytes
+ * @return ssize_t - bytes written, -1 on error
+ */
+ssize_t ecrireSocket(socket_t *sockEch, const void *buf, size_t len) {
+    if (sockEch->shm != NULL) {
+        return shmWrite(sockEch->shm, buf, len);
+    }
+    return send(sockEch->fd, buf, len, MSG_NOSIGNAL);
+}
+
+/**
+ * function lireSocket
+ * @brief Function to read from a socket, network or shared memory (recv semantics)
+ * @param sockEch - socket to read from
+ * @param buf - buffer
+ * @param len - size of the buffer
+ * @return ssize_t - bytes read, 0 if the peer closed the connection, -1 on error
+ */
+ssize_t lireSocket(socket_t *sockEch, void *buf, size_t len) {
+    if (sockEch->shm != NULL) {
+        return shmRead(sockEch->shm, buf, len);
+    }
+    return recv(sockEch->fd, buf, len, 0);
+}
+
+/**
+ * function lireSocketDisponible
+ * @brief Function to read the bytes already received on a socket, network or shared memory, without waiting
+ * @param sockEch - socket to read from
+ * @param buf - buffer
+ * @param len - size of the buffer
+ * @return ssize_t - bytes read (at most len), 0 if none yet, -1 if the peer closed the connection or on error
+ */
+ssize_t lireSocketDisponible(socket_t *sockEch, void *buf, size_t len) {
+    if (sockEch->shm != NULL) {
+        // The bytes counted by the peek are there, the read does not wait
+        ssize_t n = shmPeek(sockEch->shm, buf, len);
+        return n > 0 ? shmRead(sockEch->shm, buf, n) : n;
+    }
+    ssize_t n = recv(sockEch->fd, buf, len, MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return 0;
+    }
+    return n == 0 && len > 0 ? -1 : n;
+}
+
+/**
+ * function socketPollFd
+ * @brief Function to get the descriptor to poll (POLLIN) for the next bytes of a socket. For shared memory,
+ *        it is woken by the bytes sent after a lireSocketDisponible that did not get all the bytes asked.
+ * @param sockEch - socket
+ * @return int - descriptor
+ */
+int socketPollFd(socket_t *sockEch) {
+    if (sockEch->shm != NULL) {
+        return shmReadFd(sockEch->shm);
+    }
+    return sockEch->fd;
+}
+
+/**
+ * function fermerSocket
+ * @brief Function to close a socket, network or shared memory
+ * @param sockEch - socket to close, its fd is set to -1
+ * @return void
+ */
+void fermerSocket(socket_t *sockEch) {
+    if (sockEch->shm != NULL) {
+        shmClose(sockEch->shm);
+        sockEch->shm = NULL;
+    }
+    if (sockEch->fd >= 0) {
+        close(sockEch->fd);
+    }
+    sockEch->fd = -1;
+}
+
+/**
+ * function setReceiveTimeout
+ * @brief Function to set the timeout of the reads of a socket
+ * @param sockEch - socket
+ * @param timeout_ms - timeout, 0 for none
+ * @return void
+ */
+void setReceiveTimeout(socket_t *sockEch, int timeout_ms) {
+    if (sockEch->shm != NULL) {
+        sockEch->shm->timeout_ms = timeout_ms > 0 ? timeout_ms : -1;
+        return;
+    }
+    struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+    setsockopt(sockEch->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+}
+
+/**
+ * function envoyerOctets
+ * @brief Function to send a whole buffer (partial writes are retried, no SIGPIPE)
+ * @param sockEch - socket to send the bytes
+ * @param buf - bytes to send
+ * @param len - number of bytes
+ * @return int - 0 on success, -1 on error
+ */
+int envoyerOctets(socket_t *sockEch, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = ecrireSocket(sockEch, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * function recevoirOctets
+ * @brief Function to receive exactly len bytes
+ * @param sockEch - socket to receive the bytes
+ * @param buf - buffer receiving the bytes
+ * @param len - number of bytes
+ * @return int - 0 on success, -1 on error or if the peer closed the connection
+ */
+int recevoirOctets(socket_t *sockEch, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = lireSocket(sockEch, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * function newSessionToken
+ * @brief Function to draw a random, non-zero session token
+ * @return unsigned long long
+ */
+unsigned long long newSessionToken(void) {
+    unsigned long long token = 0;
+    if (getrandom(&token, sizeof token, GRND_NONBLOCK) != sizeof token) {
+        // No entropy yet (early boot): mix the clock and the pid, tokens only need to be hard to guess by accident
+        static unsigned long long counter;
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        token = ((unsigned long long)ts.tv_sec << 32) ^ ts.tv_nsec ^ ((unsigned long long)getpid() << 16)
+              ^ (__atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED) * 0x9E3779B97F4A7C15ULL);
+    }
+    return token != 0 ? token : 1;
+}
+
+/**
+ * function sendHello
+ * @brief Function to send the session handshake
+ * @param sock - connected socket
+ * @param token - session token (0 for a new session)
+ * @param flags - SESSION_* flags
+ * @return int - 0 on success, -1 on error
+ */
+int sendHello(socket_t *sock, unsigned long long token, unsigned int flags) {
+    session_hello_t hello = {
+        .magic = SESSION_MAGIC,
+        .flags = flags,
+        .token = token
+    };
+    return envoyer(sock, MSG_HELLO, &hello);
+}
+
+/**
+ * function receiveHello
+ * @brief Function to receive the session handshake
+ * @param sock - connected socket
+ * @param hello - handshake received
+ * @param timeout_ms - maximum time to wait for it
+ * @return int - 0 on success, -1 on error, timeout or bad magic number
+ */
+int receiveHello(socket_t *sock, session_hello_t *hello, int timeout_ms) {
+    message_u message;
+    setReceiveTimeout(sock, timeout_ms);
+    int type = recevoir(sock, &message);
+    setReceiveTimeout(sock, 0);
+    if (type != MSG_HELLO || message.hello.magic != SESSION_MAGIC) {
+        return -1;
+    }
+    *hello = message.hello;
+    return 0;
+}
+
+/**
+ * function readHello
+ * @brief Function to read the part of the session handshake already received, without waiting
+ * @param sock - connected socket
+ * @param reader - bytes of the hello read so far (zeroed before the first call)
+ * @param hello - handshake received
+ * @return int - 1 once the hello is read, 0 if more bytes are needed, -1 if the connection is closed or it is no hello
+ */
+int readHello(socket_t *sock, hello_reader_t *reader, session_hello_t *hello) {
+    msg_type_t type;
+    size_t len = 0;
+    while (1) {
+        // The header first, then only the bytes of the hello: the next messages stay in the socket
+        size_t want;
+        if (reader->received < FRAME_HEADER_SIZE) {
+            want = FRAME_HEADER_SIZE - reader->received;
+        } else {
+            if (decodeHeader(reader->frame, &type, &len) < 0 || type != MSG_HELLO || FRAME_HEADER_SIZE + len > SESSION_HELLO_MAX) {
+                return -1;
+            }
+            want = FRAME_HEADER_SIZE + len - reader->received;
+            if (want == 0) {
+                break;
+            }
+        }
+        ssize_t n = lireSocketDisponible(sock, reader->frame + reader->received, want);
+        if (n <= 0) {
+            return n;
+        }
+        reader->received += n;
+    }
+    if (decodePayload(MSG_HELLO, reader->frame + FRAME_HEADER_SIZE, len, hello) < 0 || hello->magic != SESSION_MAGIC) {
+        return -1;
+    }
+    return 1;
+}
+
 /**
  * function adr2struct
  * @brief Function to convert an IP address and port number to a sockaddr_in structure
@@ -65,15 +351,19 @@ socket_t creerSocket(int mode) {
 
 /**
  * function createAndConnectToServer
- * @brief Function to create a socket and connect to the server
- * @return socket_t
+ * @brief Function to create a socket and connect to the server (SERVER_ENV addresses or INADDR_SVC)
+ * @return socket_t - fd is -1 if the connection failed
  */
 socket_t createAndConnectToServer() {
-    // Création de la socket pour envoi de la requête
-    socket_t sock = creerSocket(SOCK_STREAM);
-    struct sockaddr_in svc = creerAddr_in(INADDR_SVC, PORT_SVC);
-    CHECK(connect(sock.fd, (struct sockaddr *)&svc, sizeof svc), "Can't connect");
-    return sock;
+    const char *servers = getenv(SERVER_ENV);
+    if (servers == NULL || *servers == '\0') {
+        servers = INADDR_SVC;
+    }
+    if (strncmp(servers, SHM_PREFIX, strlen(SHM_PREFIX)) == 0) {
+        const char *path = servers + strlen(SHM_PREFIX);
+        return shmConnect(*path != '\0' ? path : SHM_SOCKET_PATH);
+    }
+    return connecterClt2Srv(servers, PORT_SVC, CONNECT_TIMEOUT_MS);
 }
 
 /**
@@ -114,57 +404,149 @@ socket_t creerSocketEcoute(char *adrIP, short port) {
     if (strcmp(adrIP, "any") == 0) { // If "any" is passed, use INADDR_ANY
         addr.sin_addr.s_addr = INADDR_ANY;
     } else if (inet_pton(AF_INET, adrIP, &addr.sin_addr) <= 0) {
-        printf("test in creerSocketEcoute\n");
         printf("Invalid address/ Address not supported \n");
-        exit(EXIT_FAILURE);
+        close(sock.fd);
+        sock.fd = -1;
+        return sock;
     }
     
+    // Restart without waiting for the TIME_WAIT of the previous server, let several listeners
+    // share the port (the kernel spreads the connections), and only wake accept() once the client sent its hello
+    int on = 1, defer = DEFER_ACCEPT_S;
+    setsockopt(sock.fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+    setsockopt(sock.fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof on);
+    setsockopt(sock.fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer, sizeof defer);
+
     if (bind(sock.fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
         perror("Bind failed");
-        exit(EXIT_FAILURE);
+        close(sock.fd);
+        sock.fd = -1;
+        return sock;
     }
     
-    if (listen(sock.fd, 10) < 0) {
+    if (listen(sock.fd, LISTEN_BACKLOG) < 0) {
         perror("Listen failed");
-        exit(EXIT_FAILURE);
+        close(sock.fd);
+        sock.fd = -1;
+        return sock;
     }
+    sock.addrLoc = addr;
     return sock;
 }
 
 /**
  * function accepterClt
- * @brief Function to accept a client connection
+ * @brief Function to accept a client connection, with the latency options set
  * @param sockEcoute - listening socket
- * @return socket_t
+ * @return socket_t - fd is -1 if accept failed
  */
 socket_t accepterClt(const socket_t sockEcoute) {
     struct sockaddr_in client_addr;
     socklen_t clilen = sizeof(client_addr);
-    int newsockfd = accept(sockEcoute.fd, (struct sockaddr *)&client_addr, &clilen);
-    if (newsockfd < 0) {
+    socket_t newsock;
+    memset(&newsock, 0, sizeof newsock);
+    newsock.mode = STREAM;
+    // A failed accept (EMFILE, aborted connection...) must not stop the server
+    newsock.fd = accept4(sockEcoute.fd, (struct sockaddr *)&client_addr, &clilen, SOCK_CLOEXEC);
+    if (newsock.fd < 0) {
         perror("ERROR on accept");
-        exit(EXIT_FAILURE);
+        return newsock;
     }
-    socket_t newsock;
-    newsock.fd = newsockfd;
+    newsock.addrDst = client_addr;
+    setLatencyOptions(&newsock);
     return newsock;
 }
 
 /**
  * function connecterClt2Srv
- * @brief Function to connect a client to a server
- * @param adrIP - IP address of the server
+ * @brief Function to connect a client to a server with a non-blocking connect and a timeout.
+ *        Every address is tried in parallel, the first established connection is kept.
+ * @param adrIP - addresses or host names of the server, separated by commas
  * @param port - port number of the server
- * @return socket_t
+ * @param timeout_ms - timeout of the connection
+ * @return socket_t - fd is -1 if no address could be reached
  */
-socket_t connecterClt2Srv(char *adrIP, short port) {
-    socket_t sock = creerSocket(STREAM); // Assuming STREAM is for TCP
-    struct sockaddr_in serv_addr;
-    adr2struct(&serv_addr, adrIP, port);
-    
-    if (connect(sock.fd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-        perror("Connection Failed");
-        exit(EXIT_FAILURE);
+socket_t connecterClt2Srv(const char *adrIP, short port, int timeout_ms) {
+    socket_t sock;
+    memset(&sock, 0, sizeof sock);
+    sock.fd = -1;
+    sock.mode = STREAM;
+
+    struct pollfd attempts[MAX_CONNECT_ATTEMPTS];
+    struct sockaddr_in targets[MAX_CONNECT_ATTEMPTS];
+    int n = 0;
+
+    char hosts[256], service[8];
+    snprintf(hosts, sizeof hosts, "%s", adrIP);
+    snprintf(service, sizeof service, "%hu", (unsigned short)port);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV;
+
+    // Start a non-blocking connect to every address of every host
+    char *save = NULL;
+    for (char *host = strtok_r(hosts, ", ", &save); host != NULL && n < MAX_CONNECT_ATTEMPTS;
+         host = strtok_r(NULL, ", ", &save)) {
+        struct addrinfo *res = NULL;
+        int sts = getaddrinfo(host, service, &hints, &res);
+        if (sts != 0) {
+            fprintf(stderr, "%s: %s\n", host, gai_strerror(sts));
+            continue;
+        }
+        for (struct addrinfo *ai = res; ai != NULL && n < MAX_CONNECT_ATTEMPTS; ai = ai->ai_next) {
+            int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+            if (fd < 0) continue;
+            if (connect(fd, ai->ai_addr, ai->ai_addrlen) < 0 && errno != EINPROGRESS) {
+                close(fd);
+                continue;
+            }
+            memset(&targets[n], 0, sizeof targets[n]);
+            if (ai->ai_family == AF_INET) {
+                memcpy(&targets[n], ai->ai_addr, sizeof targets[n]);
+            }
+            attempts[n].fd = fd;
+            attempts[n].events = POLLOUT;
+            attempts[n].revents = 0;
+            n++;
+        }
+        freeaddrinfo(res);
+    }
+
+    // Keep the first connection established, poll ignores the attempts already closed (fd -1)
+    long long deadline = nowMs() + timeout_ms;
+    int pending = n;
+    while (sock.fd < 0 && pending > 0) {
+        long long left = deadline - nowMs();
+        if (left <= 0) break;
+        int ready = poll(attempts, n, (int)left);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0) break;
+        for (int i = 0; i < n; i++) {
+            if (attempts[i].fd < 0 || attempts[i].revents == 0) continue;
+            int err = 0;
+            socklen_t len = sizeof err;
+            getsockopt(attempts[i].fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err == 0 && sock.fd < 0) {
+                sock.fd = attempts[i].fd;
+                sock.addrDst = targets[i];
+            } else {
+                close(attempts[i].fd);
+            }
+            attempts[i].fd = -1;
+            pending--;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        if (attempts[i].fd >= 0) close(attempts[i].fd);
+    }
+
+    if (sock.fd < 0) {
+        fprintf(stderr, "Connection to %s:%d failed\n", adrIP, port);
+        return sock;
     }
+    fcntl(sock.fd, F_SETFL, fcntl(sock.fd, F_GETFL) & ~O_NONBLOCK);
+    setLatencyOptions(&sock);
     return sock;
 }
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
 
 /*******************************************/
 /*		D E F I N E S                      */
@@ -19,8 +20,38 @@
  * @see INADDR_SVC
  */
 #define PORT_SVC 8080
-#define INADDR_SVC "192.168.144.100"
-#define INADDR_SVC "0.0.0.0"
+#define INADDR_SVC "0.0.0.0" // e.g. "192.168.144.100", overridden by the SERVER_ENV variable
+
+/**
+ * @brief Environment variable giving the server addresses, separated by commas (tried in parallel)
+ * @def SERVER_ENV
+ */
+#define SERVER_ENV "BOMBO2I_SERVER"
+
+/**
+ * @brief Timeout of the connection to the server, in milliseconds
+ * @def CONNECT_TIMEOUT_MS
+ */
+#define CONNECT_TIMEOUT_MS 3000
+
+/**
+ * @brief Maximum number of addresses tried in parallel by connecterClt2Srv
+ * @def MAX_CONNECT_ATTEMPTS
+ */
+#define MAX_CONNECT_ATTEMPTS 8
+
+/**
+ * @brief Session handshake: magic number and flags of session_hello_t
+ * @def SESSION_MAGIC
+ */
+#define SESSION_MAGIC 0x31493242u // "B2I1"
+#define SESSION_RESUMED 0x1      // The server resumed the session of the token
+#define SESSION_FULL 0x2         // The server can't take a new player now
+#define SESSION_SPECTATE 0x4     // The client watches a match: its token gives the room (0 for any), answered with the room
+#define SESSION_QUEUED 0x8       // The player waits for an opponent, its session hello follows once it is placed
+#define SESSION_BOMBER 0x10      // The player asks to be the Bomber
+#define SESSION_MINE_CLEARER 0x20 // The player asks to be the Mine clearer
+#define SESSION_HELLO_MAX 40     // Largest frame of a hello (header and varints), a longer one is not a hello
 
 /**
  * @brief Macro to check the return value of a function
@@ -50,6 +81,7 @@ struct socket {
 	int mode;
 	struct sockaddr_in addrLoc;	
 	struct sockaddr_in addrDst;	
+	struct shm_link *shm;	// Shared memory link (shm.h) used instead of fd, NULL for a network socket
 };
 
 /**
@@ -59,6 +91,26 @@ struct socket {
  */
 typedef struct socket socket_t; 
 
+/**
+ * @brief Handshake message, sent by the client after the connection and answered by the server.
+ *        A client sends the token of its previous session to resume it (0 for a new session).
+ * @typedef session_hello_t
+ */
+typedef struct {
+	unsigned int magic;
+	unsigned int flags;
+	unsigned long long token;
+} session_hello_t;
+
+/**
+ * @brief Hello read in pieces as its bytes arrive, by readHello
+ * @typedef hello_reader_t
+ */
+typedef struct {
+	unsigned char frame[SESSION_HELLO_MAX];
+	size_t received;
+} hello_reader_t;
+
 /*******************************************/
 /*		F O N C T I O N S                  */
 /*******************************************/
@@ -82,8 +134,9 @@ socket_t creerSocket (int mode);
 
 /**
  * function createAndConnectToServer
- * @brief Function to create a socket and connect to the server
- * @return socket_t
+ * @brief Function to create a socket and connect to the server (SERVER_ENV addresses or INADDR_SVC).
+ *        An address "shm:<path>" connects through shared memory (shm.h) to a server on the same host.
+ * @return socket_t - fd is -1 if the connection failed
  */
 socket_t createAndConnectToServer();
 
@@ -99,29 +152,154 @@ socket_t creerSocketAdr (int mode, char *adrIP, short port);
 
 /**
  * function creerSocketEcoute
- * @brief Function to create a listening socket
+ * @brief Function to create a listening socket. The port can be shared by several listening sockets
+ *        (SO_REUSEPORT): the kernel spreads the new connections between them
  * @param adrIP - IP address
  * @param port - port number
- * @return socket_t
+ * @return socket_t - fd is -1 if the address can't be bound
  */
 socket_t creerSocketEcoute (char *adrIP, short port);
 
 /**
  * function accepterClt
- * @brief Function to accept a client connection
+ * @brief Function to accept a client connection, with the latency options set
  * @param sockEcoute - listening socket
- * @return socket_t
+ * @return socket_t - fd is -1 if accept failed
  */
 socket_t accepterClt (const socket_t sockEcoute);
 
 /**
  * function connecterClt2Srv
- * @brief Function to connect a client to a server
- * @param adrIP - IP address of the server
+ * @brief Function to connect a client to a server with a non-blocking connect and a timeout.
+ *        Every address is tried in parallel, the first established connection is kept.
+ * @param adrIP - addresses or host names of the server, separated by commas
  * @param port - port number of the server
- * @return socket_t
+ * @param timeout_ms - timeout of the connection
+ * @return socket_t - fd is -1 if no address could be reached
+ */
+socket_t connecterClt2Srv (const char *adrIP, short port, int timeout_ms);
+
+/**
+ * function setLatencyOptions
+ * @brief Function to set the latency-oriented options of a connected TCP socket
+ *        (TCP_NODELAY, TCP_QUICKACK, short keepalive and user timeout to detect dropped peers)
+ * @param sock - connected socket
+ * @return void
+ */
+void setLatencyOptions(socket_t *sock);
+
+/**
+ * function ecrireSocket
+ * @brief Function to write on a socket, network or shared memory (send semantics, no SIGPIPE)
+ * @param sockEch - socket to write on
+ * @param buf - bytes to write
+ * @param len - number of bytes
+ * @return ssize_t - bytes written, -1 on error
+ */
+ssize_t ecrireSocket(socket_t *sockEch, const void *buf, size_t len);
+
+/**
+ * function lireSocket
+ * @brief Function to read from a socket, network or shared memory (recv semantics)
+ * @param sockEch - socket to read from
+ * @param buf - buffer
+ * @param len - size of the buffer
+ * @return ssize_t - bytes read, 0 if the peer closed the connection, -1 on error
+ */
+ssize_t lireSocket(socket_t *sockEch, void *buf, size_t len);
+
+/**
+ * function lireSocketDisponible
+ * @brief Function to read the bytes already received on a socket, network or shared memory, without waiting
+ * @param sockEch - socket to read from
+ * @param buf - buffer
+ * @param len - size of the buffer
+ * @return ssize_t - bytes read (at most len), 0 if none yet, -1 if the peer closed the connection or on error
+ */
+ssize_t lireSocketDisponible(socket_t *sockEch, void *buf, size_t len);
+
+/**
+ * function socketPollFd
+ * @brief Function to get the descriptor to poll (POLLIN) for the next bytes of a socket. For shared memory,
+ *        it is woken by the bytes sent after a lireSocketDisponible that did not get all the bytes asked.
+ * @param sockEch - socket
+ * @return int - descriptor
+ */
+int socketPollFd(socket_t *sockEch);
+
+/**
+ * function fermerSocket
+ * @brief Function to close a socket, network or shared memory
+ * @param sockEch - socket to close, its fd is set to -1
+ * @return void
+ */
+void fermerSocket(socket_t *sockEch);
+
+/**
+ * function setReceiveTimeout
+ * @brief Function to set the timeout of the reads of a socket
+ * @param sockEch - socket
+ * @param timeout_ms - timeout, 0 for none
+ * @return void
+ */
+void setReceiveTimeout(socket_t *sockEch, int timeout_ms);
+
+/**
+ * function envoyerOctets
+ * @brief Function to send a whole buffer (partial writes are retried, no SIGPIPE)
+ * @param sockEch - socket to send the bytes
+ * @param buf - bytes to send
+ * @param len - number of bytes
+ * @return int - 0 on success, -1 on error
+ */
+int envoyerOctets(socket_t *sockEch, const void *buf, size_t len);
+
+/**
+ * function recevoirOctets
+ * @brief Function to receive exactly len bytes
+ * @param sockEch - socket to receive the bytes
+ * @param buf - buffer receiving the bytes
+ * @param len - number of bytes
+ * @return int - 0 on success, -1 on error or if the peer closed the connection
+ */
+int recevoirOctets(socket_t *sockEch, void *buf, size_t len);
+
+/**
+ * function newSessionToken
+ * @brief Function to draw a random, non-zero session token
+ * @return unsigned long long
+ */
+unsigned long long newSessionToken(void);
+
+/**
+ * function sendHello
+ * @brief Function to send the session handshake
+ * @param sock - connected socket
+ * @param token - session token (0 for a new session)
+ * @param flags - SESSION_* flags
+ * @return int - 0 on success, -1 on error
+ */
+int sendHello(socket_t *sock, unsigned long long token, unsigned int flags);
+
+/**
+ * function receiveHello
+ * @brief Function to receive the session handshake
+ * @param sock - connected socket
+ * @param hello - handshake received
+ * @param timeout_ms - maximum time to wait for it
+ * @return int - 0 on success, -1 on error, timeout or bad magic number
+ */
+int receiveHello(socket_t *sock, session_hello_t *hello, int timeout_ms);
+
+/**
+ * function readHello
+ * @brief Function to read the part of the session handshake already received, without waiting
+ * @param sock - connected socket
+ * @param reader - bytes of the hello read so far (zeroed before the first call)
+ * @param hello - handshake received
+ * @return int - 1 once the hello is read, 0 if more bytes are needed, -1 if the connection is closed or it is no hello
  */
-socket_t connecterClt2Srv (char *adrIP, short port);
+int readHello(socket_t *sock, hello_reader_t *reader, session_hello_t *hello);
 
 /**
  * function creerAddr_in
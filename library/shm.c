@@ -0,0 +1,482 @@
+#define _GNU_SOURCE
+#include "shm.h"
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+
+#define SHM_FDS 5 // memfd, 2 data eventfds, 2 space eventfds
+
+/**
+ * function shmIn
+ * @brief Function to get the ring read by this end of the link
+ * @param link - end of the link
+ * @return shm_ring_t*
+ */
+static shm_ring_t *shmIn(struct shm_link *link) {
+    return &link->region->rings[link->side == 0 ? 0 : 1];
+}
+
+/**
+ * function shmOut
+ * @brief Function to get the ring written by this end of the link
+ * @param link - end of the link
+ * @return shm_ring_t*
+ */
+static shm_ring_t *shmOut(struct shm_link *link) {
+    return &link->region->rings[link->side == 0 ? 1 : 0];
+}
+
+/**
+ * function shmWake
+ * @brief Function to wake the other side if it announced that it sleeps
+ * @param sleeping - flag of the other side in the ring
+ * @param fd - eventfd of the other side
+ * @return void
+ */
+static void shmWake(int *sleeping, int fd) {
+    // Pairs with the fence of shmSleep: either it sees our update, or we see its flag
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(sleeping, __ATOMIC_RELAXED)) {
+        uint64_t one = 1;
+        if (write(fd, &one, sizeof one) < 0) {
+            perror("shm eventfd");
+        }
+    }
+}
+
+/**
+ * function shmSleep
+ * @brief Function to sleep on an eventfd until the other side wakes us, the peer goes away or the timeout
+ * @param link - end of the link
+ * @param sleeping - our flag in the ring
+ * @param fd - our eventfd
+ * @param ring - ring whose state we wait for
+ * @param reading - 1 to wait for data, 0 to wait for space
+ * @param timeout_ms - timeout, -1 for none
+ * @return int - 1 when the state may have changed, 0 if the peer is gone, -1 on timeout
+ */
+static int shmSleep(struct shm_link *link, int *sleeping, int fd, shm_ring_t *ring, int reading, int timeout_ms) {
+    __atomic_store_n(sleeping, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    unsigned int used = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if ((reading ? used > 0 : used < SHM_RING_SIZE) || __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(sleeping, 0, __ATOMIC_RELAXED);
+        return 1;
+    }
+
+    struct pollfd pfds[2] = {
+        { .fd = fd, .events = POLLIN },
+        { .fd = link->ctrl_fd, .events = POLLIN } // Nothing is sent on it: readable means hung up
+    };
+    int n;
+    do {
+        n = poll(pfds, 2, timeout_ms);
+    } while (n < 0 && errno == EINTR);
+    __atomic_store_n(sleeping, 0, __ATOMIC_RELAXED);
+    if (n == 0) {
+        return -1;
+    }
+    if (n > 0 && (pfds[0].revents & POLLIN)) {
+        uint64_t value;
+        if (read(fd, &value, sizeof value) < 0 && errno != EAGAIN) {
+            perror("shm eventfd");
+        }
+        return 1;
+    }
+    return n > 0 && pfds[1].revents ? 0 : -1;
+}
+
+/**
+ * function shmMap
+ * @brief Function to map the region of a link and build its end
+ * @param fds - memfd, data eventfds, space eventfds
+ * @param ctrl_fd - UNIX socket
+ * @param side - 0 server, 1 client
+ * @return struct shm_link* - NULL on error (the fds are closed)
+ */
+static struct shm_link *shmMap(int fds[SHM_FDS], int ctrl_fd, int side) {
+    shm_region_t *region = mmap(NULL, sizeof(shm_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    close(fds[0]);
+    struct shm_link *link = region == MAP_FAILED ? NULL : malloc(sizeof(struct shm_link));
+    if (link == NULL) {
+        perror("shm mmap");
+        if (region != MAP_FAILED) munmap(region, sizeof(shm_region_t));
+        for (int i = 1; i < SHM_FDS; i++) close(fds[i]);
+        return NULL;
+    }
+    link->side = side;
+    link->region = region;
+    link->data_fd[0] = fds[1];
+    link->data_fd[1] = fds[2];
+    link->space_fd[0] = fds[3];
+    link->space_fd[1] = fds[4];
+    link->ctrl_fd = ctrl_fd;
+    link->timeout_ms = -1;
+    pthread_mutex_init(&link->read_lock, NULL);
+    pthread_mutex_init(&link->write_lock, NULL);
+    return link;
+}
+
+/**
+ * function shmListen
+ * @brief Function to create the UNIX socket listening for local clients
+ * @param path - path of the socket (an existing one is replaced)
+ * @return socket_t - fd is -1 on error
+ */
+socket_t shmListen(const char *path) {
+    socket_t sock;
+    memset(&sock, 0, sizeof sock);
+    sock.mode = SOCK_STREAM;
+    sock.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock.fd < 0) {
+        perror("shm socket");
+        return sock;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof addr.sun_path, "%s", path);
+    unlink(path);
+    if (bind(sock.fd, (struct sockaddr *)&addr, sizeof addr) < 0 || listen(sock.fd, 10) < 0) {
+        perror("shm bind");
+        close(sock.fd);
+        sock.fd = -1;
+    }
+    return sock;
+}
+
+/**
+ * function shmAccept
+ * @brief Function to accept a local client and hand it a new shared memory link (SCM_RIGHTS)
+ * @param listener - socket created by shmListen
+ * @return socket_t - connected socket using the link, fd is -1 on error
+ */
+socket_t shmAccept(const socket_t listener) {
+    socket_t sock;
+    memset(&sock, 0, sizeof sock);
+    sock.mode = SOCK_STREAM;
+    sock.fd = accept4(listener.fd, NULL, NULL, SOCK_CLOEXEC);
+    if (sock.fd < 0) {
+        perror("shm accept");
+        return sock;
+    }
+
+    int fds[SHM_FDS];
+    fds[0] = memfd_create("bombo2i", MFD_CLOEXEC);
+    for (int i = 1; i < SHM_FDS; i++) {
+        fds[i] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    }
+    // A new memfd is zeroed: both rings are empty, only the magic number is written
+    unsigned int magic = SHM_MAGIC;
+    int ok = fds[0] >= 0 && ftruncate(fds[0], sizeof(shm_region_t)) == 0
+          && pwrite(fds[0], &magic, sizeof magic, 0) == sizeof magic;
+    for (int i = 1; i < SHM_FDS; i++) {
+        ok = ok && fds[i] >= 0;
+    }
+
+    // Hand the region and the eventfds to the client, with one byte of data
+    if (ok) {
+        char byte = 0;
+        struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+        union {
+            char buf[CMSG_SPACE(sizeof fds)];
+            struct cmsghdr align;
+        } control;
+        struct msghdr msg;
+        memset(&msg, 0, sizeof msg);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof control.buf;
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof fds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof fds);
+        ok = sendmsg(sock.fd, &msg, MSG_NOSIGNAL) == 1;
+    }
+
+    struct shm_link *link = NULL;
+    if (ok) {
+        link = shmMap(fds, sock.fd, 0);
+    } else {
+        perror("shm link");
+        for (int i = 0; i < SHM_FDS; i++) {
+            if (fds[i] >= 0) close(fds[i]);
+        }
+    }
+    if (link == NULL) {
+        close(sock.fd);
+        sock.fd = -1;
+        return sock;
+    }
+    sock.shm = link;
+    return sock;
+}
+
+/**
+ * function shmConnect
+ * @brief Function to connect to the server through shared memory
+ * @param path - path of the UNIX socket of the server
+ * @return socket_t - connected socket using the link, fd is -1 on error
+ */
+socket_t shmConnect(const char *path) {
+    socket_t sock;
+    memset(&sock, 0, sizeof sock);
+    sock.mode = SOCK_STREAM;
+    sock.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock.fd < 0) {
+        perror("shm socket");
+        return sock;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof addr.sun_path, "%s", path);
+    if (connect(sock.fd, (struct sockaddr *)&addr, sizeof addr) < 0) {
+        fprintf(stderr, "Connection to %s failed\n", path);
+        close(sock.fd);
+        sock.fd = -1;
+        return sock;
+    }
+
+    char byte;
+    struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+    union {
+        char buf[CMSG_SPACE(SHM_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof control.buf;
+    struct cmsghdr *cmsg = NULL;
+    if (recvmsg(sock.fd, &msg, MSG_CMSG_CLOEXEC) == 1) {
+        cmsg = CMSG_FIRSTHDR(&msg);
+    }
+    if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(SHM_FDS * sizeof(int))) {
+        fprintf(stderr, "shm: the server sent no link\n");
+        close(sock.fd);
+        sock.fd = -1;
+        return sock;
+    }
+    int fds[SHM_FDS];
+    memcpy(fds, CMSG_DATA(cmsg), sizeof fds);
+    struct shm_link *link = shmMap(fds, sock.fd, 1);
+    if (link == NULL || link->region->magic != SHM_MAGIC) {
+        if (link != NULL) shmClose(link);
+        close(sock.fd);
+        sock.fd = -1;
+        return sock;
+    }
+    sock.shm = link;
+    return sock;
+}
+
+/**
+ * function shmRead
+ * @brief Function to read from a link, waits until at least one byte is available
+ * @param link - end of the link
+ * @param buf - buffer
+ * @param len - size of the buffer
+ * @return ssize_t - bytes read, 0 if the peer closed the link, -1 on error or timeout
+ */
+ssize_t shmRead(struct shm_link *link, void *buf, size_t len) {
+    shm_ring_t *ring = shmIn(link);
+    int ring_id = link->side == 0 ? 0 : 1;
+    pthread_mutex_lock(&link->read_lock);
+
+    unsigned int tail = ring->tail;
+    unsigned int used = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+    for (int spin = 0; used == 0 && spin < SHM_SPIN; spin++) {
+        used = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+    }
+    while (used == 0) {
+        if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE)) {
+            pthread_mutex_unlock(&link->read_lock);
+            return 0;
+        }
+        int sts = shmSleep(link, &ring->consumer_sleeping, link->data_fd[ring_id], ring, 1, link->timeout_ms);
+        used = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+        if (used == 0 && sts <= 0) {
+            pthread_mutex_unlock(&link->read_lock);
+            if (sts < 0) errno = EAGAIN;
+            return sts < 0 ? -1 : 0;
+        }
+    }
+
+    size_t n = used < len ? used : len;
+    size_t offset = tail & (SHM_RING_SIZE - 1);
+    size_t first = n < SHM_RING_SIZE - offset ? n : SHM_RING_SIZE - offset;
+    memcpy(buf, ring->data + offset, first);
+    memcpy((char *)buf + first, ring->data, n - first);
+    __atomic_store_n(&ring->tail, tail + n, __ATOMIC_RELEASE);
+    shmWake(&ring->producer_sleeping, link->space_fd[ring_id]);
+    pthread_mutex_unlock(&link->read_lock);
+    return n;
+}
+
+/**
+ * function shmPeek
+ * @brief Function to copy the bytes available in a link without taking them and without waiting.
+ *        While fewer than len bytes are available, the next write wakes the eventfd of shmReadFd.
+ * @param link - end of the link
+ * @param buf - buffer
+ * @param len - number of bytes wanted
+ * @return ssize_t - bytes copied (at most len), -1 if the peer closed the link before sending len bytes
+ */
+ssize_t shmPeek(struct shm_link *link, void *buf, size_t len) {
+    shm_ring_t *ring = shmIn(link);
+    int ring_id = link->side == 0 ? 0 : 1;
+    uint64_t value;
+    // The wake up of the previous peek is taken, the flag is set before the bytes are counted (see shmSleep)
+    if (read(link->data_fd[ring_id], &value, sizeof value) < 0 && errno != EAGAIN) {
+        perror("shm eventfd");
+    }
+    __atomic_store_n(&ring->consumer_sleeping, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    pthread_mutex_lock(&link->read_lock);
+    unsigned int tail = ring->tail;
+    unsigned int used = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+    size_t n = used < len ? used : len;
+    size_t offset = tail & (SHM_RING_SIZE - 1);
+    size_t first = n < SHM_RING_SIZE - offset ? n : SHM_RING_SIZE - offset;
+    memcpy(buf, ring->data + offset, first);
+    memcpy((char *)buf + first, ring->data, n - first);
+    pthread_mutex_unlock(&link->read_lock);
+
+    if (n == len) {
+        __atomic_store_n(&ring->consumer_sleeping, 0, __ATOMIC_RELAXED);
+        return n;
+    }
+    return __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE) ? -1 : (ssize_t)n;
+}
+
+/**
+ * function shmReadFd
+ * @brief Function to get the eventfd woken when bytes arrive on a link after a shmPeek (to poll)
+ * @param link - end of the link
+ * @return int - eventfd
+ */
+int shmReadFd(struct shm_link *link) {
+    return link->data_fd[link->side == 0 ? 0 : 1];
+}
+
+/**
+ * function shmWrite
+ * @brief Function to write all the bytes to a link, waits for space in the ring
+ * @param link - end of the link
+ * @param buf - bytes to write
+ * @param len - number of bytes
+ * @return ssize_t - len, -1 if the peer closed the link
+ */
+ssize_t shmWrite(struct shm_link *link, const void *buf, size_t len) {
+    shm_ring_t *ring = shmOut(link);
+    int ring_id = link->side == 0 ? 1 : 0;
+    const char *p = buf;
+    size_t left = len;
+    pthread_mutex_lock(&link->write_lock);
+
+    while (left > 0) {
+        unsigned int head = ring->head;
+        unsigned int space = SHM_RING_SIZE - (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+        for (int spin = 0; space == 0 && spin < SHM_SPIN; spin++) {
+            space = SHM_RING_SIZE - (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+        }
+        if (space == 0) {
+            // The peer does not read: wait for it, unless it is gone
+            if (shmSleep(link, &ring->producer_sleeping, link->space_fd[ring_id], ring, 0, -1) == 0
+                || __atomic_load_n(&shmIn(link)->closed, __ATOMIC_ACQUIRE)) {
+                pthread_mutex_unlock(&link->write_lock);
+                errno = EPIPE;
+                return -1;
+            }
+            continue;
+        }
+        if (__atomic_load_n(&shmIn(link)->closed, __ATOMIC_ACQUIRE)) {
+            pthread_mutex_unlock(&link->write_lock);
+            errno = EPIPE;
+            return -1;
+        }
+
+        size_t n = space < left ? space : left;
+        size_t offset = head & (SHM_RING_SIZE - 1);
+        size_t first = n < SHM_RING_SIZE - offset ? n : SHM_RING_SIZE - offset;
+        memcpy(ring->data + offset, p, first);
+        memcpy(ring->data, p + first, n - first);
+        __atomic_store_n(&ring->head, head + n, __ATOMIC_RELEASE);
+        shmWake(&ring->consumer_sleeping, link->data_fd[ring_id]);
+        p += n;
+        left -= n;
+    }
+    pthread_mutex_unlock(&link->write_lock);
+    return len;
+}
+
+/**
+ * function shmTryWrite
+ * @brief Function to write all the bytes to a link without waiting, or none if the ring lacks the space
+ * @param link - end of the link
+ * @param buf - bytes to write
+ * @param len - number of bytes
+ * @return ssize_t - len, -1 if the peer closed the link or errno EAGAIN if it would wait
+ */
+ssize_t shmTryWrite(struct shm_link *link, const void *buf, size_t len) {
+    shm_ring_t *ring = shmOut(link);
+    int ring_id = link->side == 0 ? 1 : 0;
+    // Another writer waiting for space holds the lock: this one would wait too
+    if (pthread_mutex_trylock(&link->write_lock) != 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (__atomic_load_n(&shmIn(link)->closed, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_unlock(&link->write_lock);
+        errno = EPIPE;
+        return -1;
+    }
+    unsigned int head = ring->head;
+    unsigned int space = SHM_RING_SIZE - (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+    if (space < len) {
+        pthread_mutex_unlock(&link->write_lock);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    size_t offset = head & (SHM_RING_SIZE - 1);
+    size_t first = len < SHM_RING_SIZE - offset ? len : SHM_RING_SIZE - offset;
+    memcpy(ring->data + offset, buf, first);
+    memcpy(ring->data, (const char *)buf + first, len - first);
+    __atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+    shmWake(&ring->consumer_sleeping, link->data_fd[ring_id]);
+    pthread_mutex_unlock(&link->write_lock);
+    return len;
+}
+
+/**
+ * function shmClose
+ * @brief Function to close one end of a link and free it (the UNIX socket is closed by the caller)
+ * @param link - end of the link
+ * @return void
+ */
+void shmClose(struct shm_link *link) {
+    shm_ring_t *ring = shmOut(link);
+    int ring_id = link->side == 0 ? 1 : 0;
+    // The peer reads what is left, then the end of the link
+    __atomic_store_n(&ring->closed, 1, __ATOMIC_RELEASE);
+    shmWake(&ring->consumer_sleeping, link->data_fd[ring_id]);
+    munmap(link->region, sizeof(shm_region_t));
+    for (int i = 0; i < 2; i++) {
+        close(link->data_fd[i]);
+        close(link->space_fd[i]);
+    }
+    pthread_mutex_destroy(&link->read_lock);
+    pthread_mutex_destroy(&link->write_lock);
+    free(link);
+}
@@ -0,0 +1,165 @@
+#ifndef SHM_H
+#define SHM_H
+
+/*******************************************/
+/*		I N C L U D E S                    */
+/*******************************************/
+#include "session.h"
+#include <pthread.h>
+
+/*******************************************/
+/*		D E F I N E S                      */
+/*******************************************/
+/**
+ * @brief Path of the UNIX socket where the server hands out the shared memory links
+ * @def SHM_SOCKET_PATH
+ */
+#define SHM_SOCKET_PATH "/tmp/bombo2i.sock"
+
+/**
+ * @brief Prefix of a server address reached through shared memory ("shm:" alone for SHM_SOCKET_PATH)
+ * @def SHM_PREFIX
+ */
+#define SHM_PREFIX "shm:"
+
+/**
+ * @brief Size of each ring buffer (power of two)
+ * @def SHM_RING_SIZE
+ */
+#define SHM_RING_SIZE (64 * 1024)
+
+/**
+ * @brief Number of polls of an empty (or full) ring before sleeping on the eventfd
+ * @def SHM_SPIN
+ */
+#define SHM_SPIN 2000
+
+#define SHM_MAGIC 0x4D485342u // "BSHM"
+
+/*******************************************/
+/*		S T R U C T U R E S                */
+/*******************************************/
+/**
+ * @brief Single-producer single-consumer byte ring. head and tail count the bytes written and read
+ *        since the creation (they wrap), each on its own cache line. A side only makes a syscall
+ *        to wake the other one when it announced that it sleeps on its eventfd.
+ * @typedef shm_ring_t
+ */
+typedef struct {
+    unsigned int head __attribute__((aligned(64)));     // Written by the producer
+    int closed;                                         // The producer closed the link
+    int producer_sleeping;                              // The producer waits for space (space eventfd)
+    unsigned int tail __attribute__((aligned(64)));     // Written by the consumer
+    int consumer_sleeping;                              // The consumer waits for data (data eventfd)
+    unsigned char data[SHM_RING_SIZE] __attribute__((aligned(64)));
+} shm_ring_t;
+
+/**
+ * @brief Region shared by the server and one client (memfd)
+ * @typedef shm_region_t
+ */
+typedef struct {
+    unsigned int magic;
+    shm_ring_t rings[2];        // 0: client to server, 1: server to client
+} shm_region_t;
+
+/**
+ * @brief One end of a shared memory link, referenced by socket_t.shm.
+ *        The writes of several threads are serialized, a message is never interleaved with another.
+ */
+struct shm_link {
+    int side;                   // 0 server, 1 client
+    shm_region_t *region;
+    int data_fd[2];             // eventfd waking the consumer of each ring
+    int space_fd[2];            // eventfd waking the producer of each ring
+    int ctrl_fd;                // UNIX socket, hung up when the peer goes away
+    int timeout_ms;             // Timeout of the reads, -1 for none
+    pthread_mutex_t read_lock;
+    pthread_mutex_t write_lock;
+};
+
+/*******************************************/
+/*		F O N C T I O N S                  */
+/*******************************************/
+/**
+ * function shmListen
+ * @brief Function to create the UNIX socket listening for local clients
+ * @param path - path of the socket (an existing one is replaced)
+ * @return socket_t - fd is -1 on error
+ */
+socket_t shmListen(const char *path);
+
+/**
+ * function shmAccept
+ * @brief Function to accept a local client and hand it a new shared memory link (SCM_RIGHTS)
+ * @param listener - socket created by shmListen
+ * @return socket_t - connected socket using the link, fd is -1 on error
+ */
+socket_t shmAccept(const socket_t listener);
+
+/**
+ * function shmConnect
+ * @brief Function to connect to the server through shared memory
+ * @param path - path of the UNIX socket of the server
+ * @return socket_t - connected socket using the link, fd is -1 on error
+ */
+socket_t shmConnect(const char *path);
+
+/**
+ * function shmRead
+ * @brief Function to read from a link, waits until at least one byte is available
+ * @param link - end of the link
+ * @param buf - buffer
+ * @param len - size of the buffer
+ * @return ssize_t - bytes read, 0 if the peer closed the link, -1 on error or timeout
+ */
+ssize_t shmRead(struct shm_link *link, void *buf, size_t len);
+
+/**
+ * function shmPeek
+ * @brief Function to copy the bytes available in a link without taking them and without waiting.
+ *        While fewer than len bytes are available, the next write wakes the eventfd of shmReadFd.
+ * @param link - end of the link
+ * @param buf - buffer
+ * @param len - number of bytes wanted
+ * @return ssize_t - bytes copied (at most len), -1 if the peer closed the link before sending len bytes
+ */
+ssize_t shmPeek(struct shm_link *link, void *buf, size_t len);
+
+/**
+ * function shmReadFd
+ * @brief Function to get the eventfd woken when bytes arrive on a link after a shmPeek (to poll)
+ * @param link - end of the link
+ * @return int - eventfd
+ */
+int shmReadFd(struct shm_link *link);
+
+/**
+ * function shmWrite
+ * @brief Function to write all the bytes to a link, waits for space in the ring
+ * @param link - end of the link
+ * @param buf - bytes to write
+ * @param len - number of bytes
+ * @return ssize_t - len, -1 if the peer closed the link
+ */
+ssize_t shmWrite(struct shm_link *link, const void *buf, size_t len);
+
+/**
+ * function shmTryWrite
+ * @brief Function to write all the bytes to a link without waiting, or none if the ring lacks the space
+ * @param link - end of the link
+ * @param buf - bytes to write
+ * @param len - number of bytes
+ * @return ssize_t - len, -1 if the peer closed the link or errno EAGAIN if it would wait
+ */
+ssize_t shmTryWrite(struct shm_link *link, const void *buf, size_t len);
+
+/**
+ * function shmClose
+ * @brief Function to close one end of a link and free it (the UNIX socket is closed by the caller)
+ * @param link - end of the link
+ * @return void
+ */
+void shmClose(struct shm_link *link);
+
+#endif /* SHM_H */
@@ -0,0 +1,248 @@
+#define _GNU_SOURCE
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/**
+ * @brief Complete event ("ph": "X") recorded by traceEnd
+ * @typedef trace_event_t
+ */
+typedef struct {
+    const char *name;
+    unsigned long long start;
+    unsigned long long duration;
+} trace_event_t;
+
+/**
+ * @brief Events of one thread, only the owner thread writes in it
+ * @typedef trace_buffer_t
+ */
+typedef struct trace_buffer {
+    trace_event_t events[TRACE_RING_SIZE];
+    unsigned long count;
+    int active;                 // 0 once its thread exited, the buffer is then reused by a new thread
+    int tid;
+    const char *thread_name;
+    struct trace_buffer *next;
+} trace_buffer_t;
+
+static trace_buffer_t *buffers = NULL;
+static __thread trace_buffer_t *thread_buffer = NULL;
+static __thread const char *thread_name = NULL;
+static pthread_key_t buffer_key;
+static pthread_once_t buffer_key_once = PTHREAD_ONCE_INIT;
+static volatile int enabled = 0;
+static char trace_path[256] = "";
+static pthread_mutex_t dump_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * function traceNow
+ * @brief Function to get the monotonic time in nanoseconds
+ * @return unsigned long long
+ */
+static unsigned long long traceNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * function traceReleaseBuffer
+ * @brief Destructor of the thread key, the buffer is reused by the next thread that records a span
+ * @param arg - buffer of the exiting thread
+ * @return void
+ */
+static void traceReleaseBuffer(void *arg) {
+    trace_buffer_t *buffer = (trace_buffer_t *)arg;
+    __atomic_store_n(&buffer->active, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * function traceCreateKey
+ * @brief Function to create the thread key used to release the buffers
+ * @return void
+ */
+static void traceCreateKey(void) {
+    pthread_key_create(&buffer_key, traceReleaseBuffer);
+}
+
+/**
+ * function traceThreadBuffer
+ * @brief Function to get the buffer of the calling thread, the buffer of an exited thread is reused
+ * @return trace_buffer_t* - NULL if no memory is available
+ */
+static trace_buffer_t *traceThreadBuffer(void) {
+    if (thread_buffer != NULL) {
+        return thread_buffer;
+    }
+    pthread_once(&buffer_key_once, traceCreateKey);
+
+    // Reuse the buffer of a thread that exited, its events are replaced
+    trace_buffer_t *buffer;
+    for (buffer = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE); buffer != NULL; buffer = buffer->next) {
+        int expected = 0;
+        if (__atomic_load_n(&buffer->active, __ATOMIC_ACQUIRE) == 0
+            && __atomic_compare_exchange_n(&buffer->active, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (buffer == NULL) {
+        buffer = calloc(1, sizeof(trace_buffer_t));
+        if (buffer == NULL) {
+            return NULL;
+        }
+        buffer->active = 1;
+        buffer->next = __atomic_load_n(&buffers, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&buffers, &buffer->next, buffer, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+    buffer->tid = (int)syscall(SYS_gettid);
+    buffer->thread_name = thread_name;
+    __atomic_store_n(&buffer->count, 0, __ATOMIC_RELEASE);
+    pthread_setspecific(buffer_key, buffer);
+    thread_buffer = buffer;
+    return buffer;
+}
+
+/**
+ * function traceInit
+ * @brief Function to set the trace file, tracing is enabled if a path is given
+ * @param path - path of the JSON file (NULL to use the TRACE_ENV variable)
+ * @return void
+ */
+void traceInit(const char *path) {
+    if (path == NULL) {
+        path = getenv(TRACE_ENV);
+    }
+    if (path == NULL || path[0] == '\0') {
+        return;
+    }
+    snprintf(trace_path, sizeof trace_path, "%s", path);
+    traceEnable(1);
+}
+
+/**
+ * function traceEnable
+ * @brief Function to switch tracing on or off at runtime (async-signal-safe)
+ * @param on - 1 to record the spans, 0 to ignore them
+ * @return void
+ */
+void traceEnable(int on) {
+    __atomic_store_n(&enabled, on, __ATOMIC_RELAXED);
+}
+
+/**
+ * function traceEnabled
+ * @brief Function to know if tracing is enabled
+ * @return int
+ */
+int traceEnabled(void) {
+    return __atomic_load_n(&enabled, __ATOMIC_RELAXED);
+}
+
+/**
+ * function traceThreadName
+ * @brief Function to name the calling thread in the trace viewer, its buffer is only taken by its first span
+ * @param name - name of the thread (string literal)
+ * @return void
+ */
+void traceThreadName(const char *name) {
+    thread_name = name;
+    if (thread_buffer != NULL) {
+        thread_buffer->thread_name = name;
+    }
+}
+
+/**
+ * function traceBegin
+ * @brief Function to open a span
+ * @param name - name of the span (string literal)
+ * @return trace_span_t
+ */
+trace_span_t traceBegin(const char *name) {
+    trace_span_t span = { name, 0 };
+    // The buffer of the thread is taken once tracing is on
+    if (traceEnabled() && traceThreadBuffer() != NULL) {
+        span.start = traceNow();
+    }
+    return span;
+}
+
+/**
+ * function traceEnd
+ * @brief Function to close a span and record it in the buffer of the calling thread
+ * @param span - span opened by traceBegin
+ * @return void
+ */
+void traceEnd(trace_span_t *span) {
+    // Span opened while tracing was disabled
+    if (span->start == 0) {
+        return;
+    }
+    trace_buffer_t *buffer = thread_buffer;
+    unsigned long count = buffer->count;
+    trace_event_t *event = &buffer->events[count & (TRACE_RING_SIZE - 1)];
+    event->name = span->name;
+    event->start = span->start;
+    event->duration = traceNow() - span->start;
+    __atomic_store_n(&buffer->count, count + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * function traceMutexLock
+ * @brief Function to lock a mutex and record the time spent waiting for it
+ * @param mutex - mutex to lock
+ * @param name - name of the span (string literal)
+ * @return void
+ */
+void traceMutexLock(pthread_mutex_t *mutex, const char *name) {
+    trace_span_t span = traceBegin(name);
+    pthread_mutex_lock(mutex);
+    traceEnd(&span);
+}
+
+/**
+ * function traceDump
+ * @brief Function to write the recorded spans as Chrome/Perfetto trace-event JSON
+ * @return int - number of events written, -1 on error
+ */
+int traceDump(void) {
+    if (trace_path[0] == '\0') {
+        return 0;
+    }
+    pthread_mutex_lock(&dump_mutex);
+    FILE *out = fopen(trace_path, "w");
+    if (out == NULL) {
+        perror("Failed to open the trace file");
+        pthread_mutex_unlock(&dump_mutex);
+        return -1;
+    }
+
+    int pid = (int)getpid();
+    int written = 0;
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (trace_buffer_t *buffer = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE); buffer != NULL; buffer = buffer->next) {
+        if (buffer->thread_name != NULL) {
+            fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    written ? ",\n" : "", pid, buffer->tid, buffer->thread_name);
+            written++;
+        }
+        // Only the last TRACE_RING_SIZE events of each thread are kept
+        unsigned long count = __atomic_load_n(&buffer->count, __ATOMIC_ACQUIRE);
+        unsigned long first = count > TRACE_RING_SIZE ? count - TRACE_RING_SIZE : 0;
+        for (unsigned long i = first; i < count; i++) {
+            const trace_event_t *event = &buffer->events[i & (TRACE_RING_SIZE - 1)];
+            fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"bombo2i\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                    written ? ",\n" : "", event->name, event->start / 1000.0, event->duration / 1000.0, pid, buffer->tid);
+            written++;
+        }
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    pthread_mutex_unlock(&dump_mutex);
+    return written;
+}
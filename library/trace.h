@@ -0,0 +1,111 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*******************************************/
+/*		I N C L U D E S                    */
+/*******************************************/
+#include <pthread.h>
+
+/*******************************************/
+/*		D E F I N E S                      */
+/*******************************************/
+/**
+ * @brief Number of events kept per thread, the oldest events are overwritten (power of 2)
+ * @def TRACE_RING_SIZE
+ */
+#define TRACE_RING_SIZE 16384
+
+/**
+ * @brief Environment variable giving the path of the trace file, tracing starts enabled when it is set
+ * @def TRACE_ENV
+ */
+#define TRACE_ENV "BOMBO2I_TRACE"
+
+/**
+ * @brief Macros to open and close a span, the name must be a string literal
+ * @def TRACE_BEGIN
+ * @param span - variable holding the span
+ * @param name - name of the span
+ */
+#define TRACE_BEGIN(span, name) trace_span_t span = traceBegin(name)
+#define TRACE_END(span) traceEnd(&(span))
+
+/*******************************************/
+/*		S T R U C T U R E S                */
+/*******************************************/
+/**
+ * @brief Span opened by traceBegin, start is 0 when tracing is disabled
+ * @typedef trace_span_t
+ */
+typedef struct {
+    const char *name;
+    unsigned long long start;
+} trace_span_t;
+
+/*******************************************/
+/*		F O N C T I O N S                  */
+/*******************************************/
+/**
+ * function traceInit
+ * @brief Function to set the trace file, tracing is enabled if a path is given
+ * @param path - path of the JSON file (NULL to use the TRACE_ENV variable)
+ * @return void
+ */
+void traceInit(const char *path);
+
+/**
+ * function traceEnable
+ * @brief Function to switch tracing on or off at runtime (async-signal-safe)
+ * @param enabled - 1 to record the spans, 0 to ignore them
+ * @return void
+ */
+void traceEnable(int enabled);
+
+/**
+ * function traceEnabled
+ * @brief Function to know if tracing is enabled
+ * @return int
+ */
+int traceEnabled(void);
+
+/**
+ * function traceThreadName
+ * @brief Function to name the calling thread in the trace viewer, its buffer is only taken by its first span
+ * @param name - name of the thread (string literal)
+ * @return void
+ */
+void traceThreadName(const char *name);
+
+/**
+ * function traceBegin
+ * @brief Function to open a span
+ * @param name - name of the span (string literal)
+ * @return trace_span_t
+ */
+trace_span_t traceBegin(const char *name);
+
+/**
+ * function traceEnd
+ * @brief Function to close a span and record it in the buffer of the calling thread
+ * @param span - span opened by traceBegin
+ * @return void
+ */
+void traceEnd(trace_span_t *span);
+
+/**
+ * function traceMutexLock
+ * @brief Function to lock a mutex and record the time spent waiting for it
+ * @param mutex - mutex to lock
+ * @param name - name of the span (string literal)
+ * @return void
+ */
+void traceMutexLock(pthread_mutex_t *mutex, const char *name);
+
+/**
+ * function traceDump
+ * @brief Function to write the recorded spans as Chrome/Perfetto trace-event JSON
+ * @return int - number of events written, -1 on error
+ */
+int traceDump(void);
+
+#endif /* TRACE_H */
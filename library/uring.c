@@ -0,0 +1,487 @@
+#define _GNU_SOURCE
+#include "uring.h"
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// Multishot receptions and provided buffer rings need the headers of Linux 6.0 or more
+#if defined(__NR_io_uring_setup) && defined(IORING_RECV_MULTISHOT)
+
+#define URING_BUF_GROUP 0
+
+/**
+ * function uringEnter
+ * @brief Function to call io_uring_enter
+ * @param ring - instance
+ * @param submit - number of requests to submit
+ * @param wait - number of completions to wait for
+ * @return int - number of requests submitted, -1 on error
+ */
+static int uringEnter(uring_t *ring, unsigned int submit, unsigned int wait) {
+    ring->enters++;
+    return syscall(__NR_io_uring_enter, ring->fd, submit, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+/**
+ * function uringGetSqe
+ * @brief Function to get a free entry of the submission queue, submits the queued requests if it is full
+ * @param ring - instance
+ * @return struct io_uring_sqe* - cleared entry, NULL if the queue stays full
+ */
+static struct io_uring_sqe *uringGetSqe(uring_t *ring) {
+    if (ring->fd < 0) {
+        return NULL;
+    }
+    unsigned int tail = *ring->sq_tail + ring->sq_queued;
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) > ring->sq_mask) {
+        if (uringSubmit(ring, 0) < 0) {
+            return NULL;
+        }
+        tail = *ring->sq_tail;
+        if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) > ring->sq_mask) {
+            return NULL;
+        }
+    }
+    unsigned int index = tail & ring->sq_mask;
+    ring->sq_array[index] = index;
+    ring->sq_queued++;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+/**
+ * function uringInit
+ * @brief Function to create an io_uring instance
+ * @param ring - instance to initialize
+ * @param entries - size of the submission queue
+ * @param buffers - 1 to provide URING_BUF_COUNT buffers for the receptions
+ * @return int - 0 on success, -1 if io_uring is not available (kernel, headers or sandbox)
+ */
+int uringInit(uring_t *ring, unsigned int entries, int buffers) {
+    memset(ring, 0, sizeof(*ring));
+    struct io_uring_params params;
+    memset(&params, 0, sizeof params);
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return -1;
+    }
+
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_map_size > ring->sq_map_size) {
+            ring->sq_map_size = ring->cq_map_size;
+        }
+        ring->cq_map_size = 0;
+    }
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_map = ring->cq_map_size == 0 ? ring->sq_map
+        : mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_map == MAP_FAILED || ring->cq_map == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->sq_map == MAP_FAILED) ring->sq_map = NULL;
+        if (ring->cq_map == MAP_FAILED) ring->cq_map = NULL;
+        if (ring->sqes == MAP_FAILED) ring->sqes = NULL;
+        uringClose(ring);
+        return -1;
+    }
+
+    unsigned char *sq = ring->sq_map;
+    ring->sq_head = (unsigned int *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned int *)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned int *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *)(sq + params.sq_off.array);
+    unsigned char *cq = ring->cq_map;
+    ring->cq_head = (unsigned int *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned int *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned int *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    if (buffers) {
+        // The kernel takes the buffers from a ring shared with it, filled back by uringRecycle
+        ring->buf_ring = mmap(NULL, URING_BUF_COUNT * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        ring->buffers = malloc(URING_BUF_COUNT * URING_BUF_SIZE);
+        if (ring->buf_ring == MAP_FAILED || ring->buffers == NULL) {
+            if (ring->buf_ring == MAP_FAILED) ring->buf_ring = NULL;
+            uringClose(ring);
+            return -1;
+        }
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof reg);
+        reg.ring_addr = (unsigned long)ring->buf_ring;
+        reg.ring_entries = URING_BUF_COUNT;
+        reg.bgid = URING_BUF_GROUP;
+        if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            uringClose(ring);
+            return -1;
+        }
+        for (int i = 0; i < URING_BUF_COUNT; i++) {
+            uringRecycle(ring, i);
+        }
+    }
+    return 0;
+}
+
+/**
+ * function uringClose
+ * @brief Function to destroy an io_uring instance, its pending requests are cancelled
+ * @param ring - instance
+ * @return void
+ */
+void uringClose(uring_t *ring) {
+    if (ring->sqes != NULL) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_map != NULL && ring->cq_map != ring->sq_map) munmap(ring->cq_map, ring->cq_map_size);
+    if (ring->sq_map != NULL) munmap(ring->sq_map, ring->sq_map_size);
+    if (ring->fd >= 0) close(ring->fd);
+    if (ring->buf_ring != NULL) munmap(ring->buf_ring, URING_BUF_COUNT * sizeof(struct io_uring_buf));
+    free(ring->buffers);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+/**
+ * function uringSend
+ * @brief Function to queue a send of all the bytes (MSG_WAITALL), submitted by the next uringSubmit
+ * @param ring - instance
+ * @param fd - socket
+ * @param buf - bytes to send, must stay valid until the completion
+ * @param len - number of bytes
+ * @param user_data - given back by the completion
+ * @return int - 0 on success, -1 if the queue is full
+ */
+int uringSend(uring_t *ring, int fd, const void *buf, size_t len, unsigned long long user_data) {
+    struct io_uring_sqe *sqe = uringGetSqe(ring);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)buf;
+    sqe->len = len;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+/**
+ * function uringAcceptMultishot
+ * @brief Function to queue an accept that completes once for every connection
+ * @param ring - instance
+ * @param fd - listening socket
+ * @param user_data - given back by the completions
+ * @return int - 0 on success, -1 if the queue is full
+ */
+int uringAcceptMultishot(uring_t *ring, int fd, unsigned long long user_data) {
+    struct io_uring_sqe *sqe = uringGetSqe(ring);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+/**
+ * function uringPollMultishot
+ * @brief Function to queue a poll that completes every time the fd becomes readable
+ * @param ring - instance
+ * @param fd - file descriptor
+ * @param user_data - given back by the completions
+ * @return int - 0 on success, -1 if the queue is full
+ */
+int uringPollMultishot(uring_t *ring, int fd, unsigned long long user_data) {
+    struct io_uring_sqe *sqe = uringGetSqe(ring);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+/**
+ * function uringRecvMultishot
+ * @brief Function to queue a reception that completes for every data received, in the provided buffers
+ * @param ring - instance, created with buffers
+ * @param fd - socket
+ * @param user_data - given back by the completions
+ * @return int - 0 on success, -1 if the queue is full
+ */
+int uringRecvMultishot(uring_t *ring, int fd, unsigned long long user_data) {
+    struct io_uring_sqe *sqe = uringGetSqe(ring);
+    if (sqe == NULL || ring->buf_ring == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+/**
+ * function uringSubmit
+ * @brief Function to submit all the queued requests with one io_uring_enter
+ * @param ring - instance
+ * @param wait - number of completions to wait for
+ * @return int - number of requests submitted, -1 on error
+ */
+int uringSubmit(uring_t *ring, unsigned int wait) {
+    unsigned int submit = ring->sq_queued;
+    if (submit == 0 && wait == 0) {
+        return 0;
+    }
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + submit, __ATOMIC_RELEASE);
+    ring->sq_queued = 0;
+    int ret;
+    while ((ret = uringEnter(ring, submit, wait)) < 0 && errno == EINTR) {
+        // Interrupted before submitting anything: nothing is lost, try again
+    }
+    return ret;
+}
+
+/**
+ * function uringPeek
+ * @brief Function to take a completion without any syscall
+ * @param ring - instance
+ * @param cqe - completion taken
+ * @return int - 1 if a completion was taken, 0 if none is waiting
+ */
+int uringPeek(uring_t *ring, uring_cqe_t *cqe) {
+    unsigned int head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    const struct io_uring_cqe *entry = &ring->cqes[head & ring->cq_mask];
+    cqe->user_data = entry->user_data;
+    cqe->res = entry->res;
+    cqe->flags = entry->flags;
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/**
+ * function uringWait
+ * @brief Function to take a completion, submits the queued requests and waits if none is waiting
+ * @param ring - instance
+ * @param cqe - completion taken
+ * @return int - 0 on success, -1 on error
+ */
+int uringWait(uring_t *ring, uring_cqe_t *cqe) {
+    while (!uringPeek(ring, cqe)) {
+        if (uringSubmit(ring, 1) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * function uringBuffer
+ * @brief Function to get the provided buffer filled by a reception
+ * @param ring - instance
+ * @param cqe - completion of the reception
+ * @param bid - id of the buffer, to give it back with uringRecycle
+ * @return const void* - data received, NULL if the completion has no buffer
+ */
+const void *uringBuffer(uring_t *ring, const uring_cqe_t *cqe, int *bid) {
+    if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+        *bid = -1;
+        return NULL;
+    }
+    *bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    return ring->buffers + (size_t)*bid * URING_BUF_SIZE;
+}
+
+/**
+ * function uringRecycle
+ * @brief Function to give a buffer back to the kernel
+ * @param ring - instance
+ * @param bid - id of the buffer
+ * @return void
+ */
+void uringRecycle(uring_t *ring, int bid) {
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[ring->buf_tail & (URING_BUF_COUNT - 1)];
+    buf->addr = (unsigned long)(ring->buffers + (size_t)bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    ring->buf_tail++;
+    __atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * function uringStreamOpen
+ * @brief Function to start reading a socket through a multishot reception
+ * @param stream - stream to initialize
+ * @param fd - socket
+ * @return int - 0 on success, -1 if io_uring is not available
+ */
+int uringStreamOpen(uring_stream_t *stream, int fd) {
+    memset(stream, 0, sizeof(*stream));
+    stream->fd = fd;
+    stream->bid = -1;
+    return uringInit(&stream->ring, 8, 1);
+}
+
+/**
+ * function uringStreamRead
+ * @brief Function to read exactly len bytes from a stream
+ * @param stream - stream
+ * @param buf - buffer
+ * @param len - number of bytes
+ * @return ssize_t - len, 0 if the peer closed the connection, -1 on error
+ */
+ssize_t uringStreamRead(uring_stream_t *stream, void *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        if (stream->left > 0) {
+            size_t n = stream->left < len - done ? stream->left : len - done;
+            memcpy((unsigned char *)buf + done, stream->data, n);
+            stream->data += n;
+            stream->left -= n;
+            done += n;
+            if (stream->left == 0 && stream->bid >= 0) {
+                uringRecycle(&stream->ring, stream->bid);
+                stream->bid = -1;
+            }
+            continue;
+        }
+
+        // The reception stays armed between the reads, it stops when the kernel runs out of buffers
+        if (!stream->armed) {
+            if (uringRecvMultishot(&stream->ring, stream->fd, 0) < 0) {
+                return -1;
+            }
+            stream->armed = 1;
+        }
+        uring_cqe_t cqe;
+        if (uringWait(&stream->ring, &cqe) < 0) {
+            return -1;
+        }
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            stream->armed = 0;
+        }
+        if (cqe.res == -ENOBUFS) {
+            continue;
+        }
+        if (cqe.res <= 0) {
+            int bid;
+            if (uringBuffer(&stream->ring, &cqe, &bid) != NULL) {
+                uringRecycle(&stream->ring, bid);
+            }
+            if (cqe.res == 0) {
+                return 0;
+            }
+            errno = -cqe.res;
+            return -1;
+        }
+        stream->data = uringBuffer(&stream->ring, &cqe, &stream->bid);
+        stream->left = stream->data != NULL ? (size_t)cqe.res : 0;
+    }
+    return len;
+}
+
+/**
+ * function uringStreamClose
+ * @brief Function to stop reading a stream (the socket stays open)
+ * @param stream - stream
+ * @return void
+ */
+void uringStreamClose(uring_stream_t *stream) {
+    uringClose(&stream->ring);
+    stream->armed = 0;
+    stream->left = 0;
+    stream->bid = -1;
+}
+
+#else
+
+int uringInit(uring_t *ring, unsigned int entries, int buffers) {
+    (void)entries;
+    (void)buffers;
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    return -1;
+}
+
+void uringClose(uring_t *ring) {
+    ring->fd = -1;
+}
+
+int uringSend(uring_t *ring, int fd, const void *buf, size_t len, unsigned long long user_data) {
+    (void)ring; (void)fd; (void)buf; (void)len; (void)user_data;
+    return -1;
+}
+
+int uringAcceptMultishot(uring_t *ring, int fd, unsigned long long user_data) {
+    (void)ring; (void)fd; (void)user_data;
+    return -1;
+}
+
+int uringPollMultishot(uring_t *ring, int fd, unsigned long long user_data) {
+    (void)ring; (void)fd; (void)user_data;
+    return -1;
+}
+
+int uringRecvMultishot(uring_t *ring, int fd, unsigned long long user_data) {
+    (void)ring; (void)fd; (void)user_data;
+    return -1;
+}
+
+int uringSubmit(uring_t *ring, unsigned int wait) {
+    (void)ring; (void)wait;
+    return -1;
+}
+
+int uringPeek(uring_t *ring, uring_cqe_t *cqe) {
+    (void)ring; (void)cqe;
+    return 0;
+}
+
+int uringWait(uring_t *ring, uring_cqe_t *cqe) {
+    (void)ring; (void)cqe;
+    return -1;
+}
+
+const void *uringBuffer(uring_t *ring, const uring_cqe_t *cqe, int *bid) {
+    (void)ring; (void)cqe;
+    *bid = -1;
+    return NULL;
+}
+
+void uringRecycle(uring_t *ring, int bid) {
+    (void)ring; (void)bid;
+}
+
+int uringStreamOpen(uring_stream_t *stream, int fd) {
+    (void)fd;
+    memset(stream, 0, sizeof(*stream));
+    stream->ring.fd = -1;
+    return -1;
+}
+
+ssize_t uringStreamRead(uring_stream_t *stream, void *buf, size_t len) {
+    (void)stream; (void)buf; (void)len;
+    return -1;
+}
+
+void uringStreamClose(uring_stream_t *stream) {
+    (void)stream;
+}
+
+#endif
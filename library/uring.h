@@ -0,0 +1,222 @@
+#ifndef URING_H
+#define URING_H
+
+/*******************************************/
+/*		I N C L U D E S                    */
+/*******************************************/
+#include "session.h"
+
+/*******************************************/
+/*		D E F I N E S                      */
+/*******************************************/
+/**
+ * @brief Number of entries of the submission queue of a ring
+ * @def URING_ENTRIES
+ */
+#define URING_ENTRIES 64
+
+/**
+ * @brief Buffers given to the kernel for the multishot receptions (count is a power of two)
+ * @def URING_BUF_COUNT
+ */
+#define URING_BUF_COUNT 16
+#define URING_BUF_SIZE 1024
+
+/**
+ * @brief user_data of the completions that are not tied to a request of the caller
+ * @def URING_NO_DATA
+ */
+#define URING_NO_DATA 0xFFFFFFFFFFFFFFFFull
+
+/*******************************************/
+/*		S T R U C T U R E S                */
+/*******************************************/
+/**
+ * @brief Completion of a request
+ * @typedef uring_cqe_t
+ */
+typedef struct {
+    unsigned long long user_data;
+    int res;                    // Result of the request, -errno on error
+    unsigned int flags;         // IORING_CQE_F_*
+} uring_cqe_t;
+
+/**
+ * @brief io_uring instance, used by one thread at a time. The rings are mapped from the kernel,
+ *        no liburing: the requests are written in the submission queue and all sent by one io_uring_enter.
+ * @typedef uring_t
+ */
+typedef struct {
+    int fd;                             // -1 when io_uring is not available
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int sq_mask;
+    unsigned int *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned int sq_queued;             // Requests written and not submitted yet
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;
+    size_t cq_map_size;
+    size_t sqes_size;
+    struct io_uring_buf_ring *buf_ring; // Buffers provided for the receptions (NULL if none)
+    unsigned char *buffers;
+    unsigned short buf_tail;
+    unsigned long enters;               // io_uring_enter made (statistics)
+} uring_t;
+
+/**
+ * @brief Stream read through a multishot reception: the kernel fills the provided buffers
+ *        as the data arrives, a read only makes a syscall when no completion is waiting
+ * @typedef uring_stream_t
+ */
+typedef struct {
+    uring_t ring;
+    int fd;
+    int armed;                          // A multishot reception is running
+    int bid;                            // Buffer being read, -1 for none
+    const unsigned char *data;
+    size_t left;
+} uring_stream_t;
+
+/*******************************************/
+/*		F O N C T I O N S                  */
+/*******************************************/
+/**
+ * function uringInit
+ * @brief Function to create an io_uring instance
+ * @param ring - instance to initialize
+ * @param entries - size of the submission queue
+ * @param buffers - 1 to provide URING_BUF_COUNT buffers for the receptions
+ * @return int - 0 on success, -1 if io_uring is not available (kernel, headers or sandbox)
+ */
+int uringInit(uring_t *ring, unsigned int entries, int buffers);
+
+/**
+ * function uringClose
+ * @brief Function to destroy an io_uring instance, its pending requests are cancelled
+ * @param ring - instance
+ * @return void
+ */
+void uringClose(uring_t *ring);
+
+/**
+ * function uringSend
+ * @brief Function to queue a send of all the bytes (MSG_WAITALL), submitted by the next uringSubmit
+ * @param ring - instance
+ * @param fd - socket
+ * @param buf - bytes to send, must stay valid until the completion
+ * @param len - number of bytes
+ * @param user_data - given back by the completion
+ * @return int - 0 on success, -1 if the queue is full
+ */
+int uringSend(uring_t *ring, int fd, const void *buf, size_t len, unsigned long long user_data);
+
+/**
+ * function uringAcceptMultishot
+ * @brief Function to queue an accept that completes once for every connection
+ * @param ring - instance
+ * @param fd - listening socket
+ * @param user_data - given back by the completions
+ * @return int - 0 on success, -1 if the queue is full
+ */
+int uringAcceptMultishot(uring_t *ring, int fd, unsigned long long user_data);
+
+/**
+ * function uringPollMultishot
+ * @brief Function to queue a poll that completes every time the fd becomes readable
+ * @param ring - instance
+ * @param fd - file descriptor
+ * @param user_data - given back by the completions
+ * @return int - 0 on success, -1 if the queue is full
+ */
+int uringPollMultishot(uring_t *ring, int fd, unsigned long long user_data);
+
+/**
+ * function uringRecvMultishot
+ * @brief Function to queue a reception that completes for every data received, in the provided buffers
+ * @param ring - instance, created with buffers
+ * @param fd - socket
+ * @param user_data - given back by the completions
+ * @return int - 0 on success, -1 if the queue is full
+ */
+int uringRecvMultishot(uring_t *ring, int fd, unsigned long long user_data);
+
+/**
+ * function uringSubmit
+ * @brief Function to submit all the queued requests with one io_uring_enter
+ * @param ring - instance
+ * @param wait - number of completions to wait for
+ * @return int - number of requests submitted, -1 on error
+ */
+int uringSubmit(uring_t *ring, unsigned int wait);
+
+/**
+ * function uringPeek
+ * @brief Function to take a completion without any syscall
+ * @param ring - instance
+ * @param cqe - completion taken
+ * @return int - 1 if a completion was taken, 0 if none is waiting
+ */
+int uringPeek(uring_t *ring, uring_cqe_t *cqe);
+
+/**
+ * function uringWait
+ * @brief Function to take a completion, submits the queued requests and waits if none is waiting
+ * @param ring - instance
+ * @param cqe - completion taken
+ * @return int - 0 on success, -1 on error
+ */
+int uringWait(uring_t *ring, uring_cqe_t *cqe);
+
+/**
+ * function uringBuffer
+ * @brief Function to get the provided buffer filled by a reception
+ * @param ring - instance
+ * @param cqe - completion of the reception
+ * @param bid - id of the buffer, to give it back with uringRecycle
+ * @return const void* - data received, NULL if the completion has no buffer
+ */
+const void *uringBuffer(uring_t *ring, const uring_cqe_t *cqe, int *bid);
+
+/**
+ * function uringRecycle
+ * @brief Function to give a buffer back to the kernel
+ * @param ring - instance
+ * @param bid - id of the buffer
+ * @return void
+ */
+void uringRecycle(uring_t *ring, int bid);
+
+/**
+ * function uringStreamOpen
+ * @brief Function to start reading a socket through a multishot reception
+ * @param stream - stream to initialize
+ * @param fd - socket
+ * @return int - 0 on success, -1 if io_uring is not available
+ */
+int uringStreamOpen(uring_stream_t *stream, int fd);
+
+/**
+ * function uringStreamRead
+ * @brief Function to read exactly len bytes from a stream
+ * @param stream - stream
+ * @param buf - buffer
+ * @param len - number of bytes
+ * @return ssize_t - len, 0 if the peer closed the connection, -1 on error
+ */
+ssize_t uringStreamRead(uring_stream_t *stream, void *buf, size_t len);
+
+/**
+ * function uringStreamClose
+ * @brief Function to stop reading a stream (the socket stays open)
+ * @param stream - stream
+ * @return void
+ */
+void uringStreamClose(uring_stream_t *stream);
+
+#endif /* URING_H */
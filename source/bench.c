@@ -0,0 +1,933 @@
+#define _GNU_SOURCE
+#include "game.h"
+#include "entity.h"
+#include "blast.h"
+#include "mapgen.h"
+#include "bot.h"
+#include <time.h>
+#include <math.h>
+#include <sys/socket.h>
+#include "../library/shm.h"
+#include "../library/uring.h"
+#include "../library/pool.h"
+#include <stdarg.h>
+#include <poll.h>
+#include <sched.h>
+
+// --- Constants ---
+#define BENCH_WARMUP_NS 50000000LL   // 50 ms of warmup per kernel
+#define BENCH_RUN_NS 20000000LL      // Each run lasts about 20 ms
+#define BENCH_RUNS 15
+#define BENCH_MAX_KERNELS 32
+#define BENCH_BOTS 8                 // Connections of the bot load kernels
+#define BENCH_BURST 16               // Requests sent at once by a bot
+#define BENCH_STORM 32               // Connections opened at once by the accept kernels
+#define BENCH_ACCEPTORS 4            // Accept threads, each with its listener on the port (SO_REUSEPORT)
+
+// --- Structures ---
+typedef struct {
+    const char *name;
+    void (*setup)(void);
+    void (*run)(long iterations);
+    void (*teardown)(void);
+} bench_kernel_t;
+
+typedef struct {
+    const char *name;
+    long iterations;
+    double ns_min;
+    double ns_median;
+    double ns_mean;
+    double ns_stddev;
+    double allocs_per_op;
+    double bytes_per_op;
+    double syscalls_per_op;
+} bench_result_t;
+
+// --- Allocation counters (malloc, calloc and realloc are wrapped at link time) ---
+static unsigned long alloc_count = 0;
+static unsigned long alloc_bytes = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&alloc_bytes, size, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&alloc_bytes, nmemb * size, __ATOMIC_RELAXED);
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&alloc_bytes, size, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+
+// --- Syscall counters (send, recv and syscall are wrapped at link time, the bots use read and write) ---
+static unsigned long syscall_count = 0;
+
+ssize_t __real_send(int fd, const void *buf, size_t len, int flags);
+ssize_t __real_recv(int fd, void *buf, size_t len, int flags);
+long __real_syscall(long number, ...);
+
+ssize_t __wrap_send(int fd, const void *buf, size_t len, int flags) {
+    __atomic_fetch_add(&syscall_count, 1, __ATOMIC_RELAXED);
+    return __real_send(fd, buf, len, flags);
+}
+
+ssize_t __wrap_recv(int fd, void *buf, size_t len, int flags) {
+    __atomic_fetch_add(&syscall_count, 1, __ATOMIC_RELAXED);
+    return __real_recv(fd, buf, len, flags);
+}
+
+long __wrap_syscall(long number, ...) {
+    va_list args;
+    va_start(args, number);
+    long a[6];
+    for (int i = 0; i < 6; i++) a[i] = va_arg(args, long);
+    va_end(args);
+    __atomic_fetch_add(&syscall_count, 1, __ATOMIC_RELAXED);
+    return __real_syscall(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+// --- Shared fixtures ---
+static Map *bench_map = NULL;
+static socket_t bench_pair[2];
+static socket_t bench_server[BENCH_BOTS];     // Server side of the bot connections
+static int bench_bots[BENCH_BOTS];            // Bot side
+static uring_t bench_ring;
+static uring_stream_t bench_streams[BENCH_BOTS];
+static frame_pool_t bench_pool;
+static frame_buf_t *bench_in_flight[BENCH_BOTS];     // Send of each bot not completed yet
+static socket_t bench_listeners[BENCH_ACCEPTORS];
+static pthread_t bench_acceptors[BENCH_ACCEPTORS];
+static int bench_acceptor_count = 0;
+static struct sockaddr_in bench_listen_addr;
+static unsigned long bench_accepted = 0;
+static int bench_stop = 0;
+static volatile long bench_sink = 0;
+
+/**
+ * function benchNow
+ * @brief Get the monotonic time in nanoseconds
+ *
+ * @return long long
+ */
+static long long benchNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * function setupMap
+ * @brief Create and generate the map used by the game kernels
+ *
+ * @return void
+ */
+static void setupMap(void) {
+    srand(42);
+    bench_map = map_new(MAX_MAP_WIDTH, MAX_MAP_HEIGHT);
+    generateMap(bench_map);
+}
+
+/**
+ * function teardownMap
+ * @brief Free the map used by the game kernels
+ *
+ * @return void
+ */
+static void teardownMap(void) {
+    free(bench_map);
+    bench_map = NULL;
+}
+
+/**
+ * function setupSocketPair
+ * @brief Create a connected pair of local sockets for the transfer kernels
+ *
+ * @return void
+ */
+static void setupSocketPair(void) {
+    int sv[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), "socketpair");
+    bench_pair[0].fd = sv[0];
+    bench_pair[0].mode = SOCK_STREAM;
+    bench_pair[1].fd = sv[1];
+    bench_pair[1].mode = SOCK_STREAM;
+    setupMap();
+}
+
+/**
+ * function teardownSocketPair
+ * @brief Close the pair of local sockets
+ *
+ * @return void
+ */
+static void teardownSocketPair(void) {
+    close(bench_pair[0].fd);
+    close(bench_pair[1].fd);
+    teardownMap();
+}
+
+/**
+ * function connectShm
+ * @brief Connect to the shared memory listener of the benchmark (thread, shmConnect waits for the accept)
+ *
+ * @param arg (path of the listener)
+ * @return void* (socket_t allocated)
+ */
+static void *connectShm(void *arg) {
+    socket_t *sock = malloc(sizeof(socket_t));
+    *sock = shmConnect((const char *)arg);
+    return sock;
+}
+
+/**
+ * function setupShmPair
+ * @brief Create a shared memory link for the transfer kernels, to compare it with the local sockets
+ *
+ * @return void
+ */
+static void setupShmPair(void) {
+    char path[64];
+    snprintf(path, sizeof path, "/tmp/bombo2i_bench_%d.sock", (int)getpid());
+    socket_t listener = shmListen(path);
+    CHECK(listener.fd, "shmListen");
+    pthread_t thread;
+    pthread_create(&thread, NULL, connectShm, path);
+    bench_pair[0] = shmAccept(listener);
+    socket_t *client;
+    pthread_join(thread, (void **)&client);
+    bench_pair[1] = *client;
+    free(client);
+    close(listener.fd);
+    unlink(path);
+    if (bench_pair[0].fd < 0 || bench_pair[1].fd < 0) {
+        fprintf(stderr, "shared memory link failed\n");
+        exit(EXIT_FAILURE);
+    }
+    setupMap();
+}
+
+/**
+ * function teardownShmPair
+ * @brief Close the shared memory link
+ *
+ * @return void
+ */
+static void teardownShmPair(void) {
+    fermerSocket(&bench_pair[0]);
+    fermerSocket(&bench_pair[1]);
+    teardownMap();
+}
+
+/**
+ * function setupBots
+ * @brief Connect the bots to the server with local sockets, like the bot load of a match
+ *
+ * @return void
+ */
+static void setupBots(void) {
+    for (int i = 0; i < BENCH_BOTS; i++) {
+        int sv[2];
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), "socketpair");
+        memset(&bench_server[i], 0, sizeof(socket_t));
+        bench_server[i].fd = sv[0];
+        bench_server[i].mode = SOCK_STREAM;
+        bench_bots[i] = sv[1];
+        bench_in_flight[i] = NULL;
+    }
+    poolInit(&bench_pool);
+}
+
+/**
+ * function setupBotsUring
+ * @brief Connect the bots and create the io_uring instances of the server (sends and receptions)
+ *
+ * @return void
+ */
+static void setupBotsUring(void) {
+    setupBots();
+    if (uringInit(&bench_ring, URING_ENTRIES, 0) < 0) {
+        fprintf(stderr, "io_uring is not available\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < BENCH_BOTS; i++) {
+        if (uringStreamOpen(&bench_streams[i], bench_server[i].fd) < 0) {
+            fprintf(stderr, "io_uring is not available\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * function teardownBots
+ * @brief Close the bot connections (and the io_uring instances)
+ *
+ * @return void
+ */
+static void teardownBots(void) {
+    for (int i = 0; i < BENCH_BOTS; i++) {
+        uringStreamClose(&bench_streams[i]);
+        close(bench_server[i].fd);
+        close(bench_bots[i]);
+    }
+    uringClose(&bench_ring);
+    poolDestroy(&bench_pool);
+}
+
+/**
+ * function acceptLoop
+ * @brief Accept thread of the accept kernels: hello received and answered, like a worker of the server
+ *
+ * @param arg (socket_t * listening)
+ * @return void*
+ */
+static void *acceptLoop(void *arg) {
+    socket_t *listener = (socket_t *)arg;
+    struct pollfd pfd = { .fd = listener->fd, .events = POLLIN };
+    while (!__atomic_load_n(&bench_stop, __ATOMIC_ACQUIRE)) {
+        if (poll(&pfd, 1, 10) <= 0) {
+            continue;
+        }
+        socket_t client = accepterClt(*listener);
+        if (client.fd < 0) {
+            continue;
+        }
+        session_hello_t hello;
+        if (receiveHello(&client, &hello, 1000) == 0) {
+            sendHello(&client, newSessionToken(), 0);
+        }
+        fermerSocket(&client);
+        __atomic_fetch_add(&bench_accepted, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/**
+ * function setupAcceptors
+ * @brief Start the accept threads, their listeners share a free port of the loopback
+ *
+ * @param count
+ * @return void
+ */
+static void setupAcceptors(int count) {
+    bench_stop = 0;
+    bench_acceptor_count = count;
+    for (int i = 0; i < count; i++) {
+        short port = i == 0 ? 0 : ntohs(bench_listen_addr.sin_port);
+        bench_listeners[i] = creerSocketEcoute("127.0.0.1", port);
+        CHECK(bench_listeners[i].fd, "creerSocketEcoute");
+        if (i == 0) {
+            socklen_t len = sizeof bench_listen_addr;
+            getsockname(bench_listeners[0].fd, (struct sockaddr *)&bench_listen_addr, &len);
+        }
+        pthread_create(&bench_acceptors[i], NULL, acceptLoop, &bench_listeners[i]);
+    }
+}
+
+static void setupAcceptSingle(void) {
+    setupAcceptors(1);
+}
+
+static void setupAcceptReuseport(void) {
+    setupAcceptors(BENCH_ACCEPTORS);
+}
+
+/**
+ * function teardownAcceptors
+ * @brief Stop the accept threads and close their listeners
+ *
+ * @return void
+ */
+static void teardownAcceptors(void) {
+    __atomic_store_n(&bench_stop, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < bench_acceptor_count; i++) {
+        pthread_join(bench_acceptors[i], NULL);
+        close(bench_listeners[i].fd);
+    }
+}
+
+/**
+ * function drainBots
+ * @brief Read what the server sent to the bots, so that the sends never block
+ *
+ * @return void
+ */
+static void drainBots(void) {
+    char buffer[4096];
+    for (int i = 0; i < BENCH_BOTS; i++) {
+        while (recvfrom(bench_bots[i], buffer, sizeof buffer, MSG_DONTWAIT, NULL, NULL) > 0) {
+        }
+    }
+}
+
+// --- Kernels ---
+
+static void runEnvoyerRecevoir(long iterations) {
+    message_t text = { "A bomb has been placed by the Bomber!\n", 0 };
+    message_u message;
+    for (long i = 0; i < iterations; i++) {
+        envoyer(&bench_pair[0], MSG_TEXT, &text);
+        recevoir(&bench_pair[1], &message);
+    }
+    bench_sink += message.text.buffer[0];
+}
+
+static void runEncodePoint(long iterations) {
+    unsigned char frame[MAX_FRAME];
+    for (long i = 0; i < iterations; i++) {
+        Point point = { (int)i & 31, (int)i & 15, BOMB };
+        bench_sink += encodeMessage(frame, MSG_POINT, &point);
+    }
+}
+
+static void runDecodePoint(long iterations) {
+    unsigned char frame[MAX_FRAME];
+    Point point = { 12, 7, BOMB };
+    size_t len = encodeMessage(frame, MSG_POINT, &point) - FRAME_HEADER_SIZE;
+    for (long i = 0; i < iterations; i++) {
+        decodePayload(MSG_POINT, frame + FRAME_HEADER_SIZE, len, &point);
+        bench_sink += point.x;
+    }
+}
+
+static void runDecodeText(long iterations) {
+    unsigned char frame[MAX_FRAME];
+    message_t text = { "Game ended: Victory for the Mine clearer!\n", 0 };
+    size_t len = encodeMessage(frame, MSG_TEXT, &text) - FRAME_HEADER_SIZE;
+    for (long i = 0; i < iterations; i++) {
+        decodePayload(MSG_TEXT, frame + FRAME_HEADER_SIZE, len, &text);
+    }
+    bench_sink += text.buffer[0];
+}
+
+static void runEncodeMap(long iterations) {
+    unsigned char frame[MAX_FRAME];
+    for (long i = 0; i < iterations; i++) {
+        bench_sink += encodeMessage(frame, MSG_MAP, bench_map);
+    }
+}
+
+static void runGenerateMap(long iterations) {
+    for (long i = 0; i < iterations; i++) {
+        generateMap(bench_map);
+    }
+    bench_sink += bench_map->cells[MAX_MAP_WIDTH + 1];
+}
+
+// One op is a map of a generator of the map pool, a new seed each time
+static void runGenerator(int generator, long iterations) {
+    for (long i = 0; i < iterations; i++) {
+        generateMapWith(bench_map, generator, (unsigned int)i);
+    }
+    bench_sink += bench_map->cells[MAX_MAP_WIDTH + 1];
+}
+
+static void runGenerateGrid(long iterations) {
+    runGenerator(GENERATOR_GRID, iterations);
+}
+
+static void runGenerateMaze(long iterations) {
+    runGenerator(GENERATOR_MAZE, iterations);
+}
+
+static void runGenerateCaves(long iterations) {
+    runGenerator(GENERATOR_CAVES, iterations);
+}
+
+static void runGenerateRooms(long iterations) {
+    runGenerator(GENERATOR_ROOMS, iterations);
+}
+
+static regions_t bench_regions;
+
+static void runRegionsBuild(long iterations) {
+    for (long i = 0; i < iterations; i++) {
+        regionsBuild(&bench_regions, bench_map);
+    }
+    bench_sink += bench_regions.count;
+}
+
+static void runIsAccessible(long iterations) {
+    int size = bench_map->width * bench_map->height;
+    int count = 0;
+    regionsBuild(&bench_regions, bench_map);
+    for (long i = 0; i < iterations; i++) {
+        int cell = (int)(i % size);
+        count += isAccessible(&bench_regions, cell % bench_map->width, cell / bench_map->width);
+    }
+    bench_sink += count;
+}
+
+static void runMovePlayer(long iterations) {
+    static const int moves[4][2] = {{0, -1}, {1, 0}, {0, 1}, {-1, 0}};
+    Player player = { 1, 1, BOMBER };
+    unsigned int state = 1;
+    for (long i = 0; i < iterations; i++) {
+        // Cheap xorshift random walk, rand() would dominate the measure
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        movePlayer(&player, bench_map, moves[state & 3][0], moves[state & 3][1]);
+    }
+    bench_sink += player.x + player.y;
+}
+
+// One op is a whole search of a bot across the map, from a corner to the opposite one (A*)
+static bot_t bench_bot;
+
+static void runBotSearch(long iterations) {
+    int from = MAX_MAP_WIDTH + 1, to = 0, found = 0;
+    for (int cell = bench_map->width * bench_map->height - 1; cell >= 0 && to == 0; cell--) {
+        to = bench_map->cells[cell] != WALL ? cell : 0;
+    }
+    for (long i = 0; i < iterations; i++) {
+        int budget = MAX_MAP_SIZE;
+        botSearchStart(&bench_bot, from, to);
+        found += botSearchStep(&bench_bot, bench_map, &budget) == BOT_SEARCH_FOUND;
+    }
+    bench_sink += found + bench_bot.path_length;
+}
+
+// One op is a tick of a full store: MAX_PLAYERS cooldowns and MAX_BOMBS timers, half of the bombs counting down
+static entities_t bench_entities;
+
+static void setupEntities(void) {
+    entitiesReset(&bench_entities);
+    Player player = { 1, 1, BOMBER };
+    while (entityAddPlayer(&bench_entities, &player) >= 0) {
+        player.role = player.role == BOMBER ? MINE_CLEARER : BOMBER;
+    }
+    for (int i = 0; entityAddBomb(&bench_entities, i % MAX_MAP_WIDTH, i / MAX_MAP_WIDTH) >= 0; i++) {
+    }
+    for (int i = 0; i < MAX_BOMBS; i += 2) {
+        bench_entities.bombs.state[i] = DEACTIVATED_BOMB;
+    }
+}
+
+static void runEntitiesTick(long iterations) {
+    int exploded = 0;
+    for (long i = 0; i < iterations; i++) {
+        if ((i & 1023) == 0) {
+            // Re-armed now and then, so the timers never all reach 0
+            entityArmBombs(&bench_entities, 1024);
+            for (int k = 0; k < MAX_PLAYERS; k++) {
+                bench_entities.players.cooldown[k] = k;
+            }
+        }
+        exploded += entitiesTick(&bench_entities);
+    }
+    bench_sink += exploded + bench_entities.bombs.timer[1];
+}
+
+// One op is the detonation of a full map: a bomb on every other cell of every other row, open
+// everywhere else, the bomb of a corner sets off all the others (BLAST_RADIUS reaches the next ones)
+static Map *blast_map = NULL;
+
+static void setupBlastMap(void) {
+    blast_map = map_new(MAX_MAP_WIDTH, MAX_MAP_HEIGHT);
+    for (int y = 0; y < MAX_MAP_HEIGHT; y++) {
+        for (int x = 0; x < MAX_MAP_WIDTH; x++) {
+            blast_map->cells[y * MAX_MAP_WIDTH + x] = (x % 2 == 0 && y % 2 == 0) ? BOMB : PATH;
+        }
+    }
+}
+
+static void teardownBlastMap(void) {
+    free(blast_map);
+    blast_map = NULL;
+}
+
+static void runBlastChain(long iterations) {
+    blast_field_t field;
+    row_mask_t detonated[MAX_MAP_HEIGHT], fire[MAX_MAP_HEIGHT];
+    blast_t delta;
+    int count = 0;
+    for (long i = 0; i < iterations; i++) {
+        blastFieldInit(&field, blast_map);
+        memset(detonated, 0, sizeof(detonated));
+        detonated[0] = 1;
+        count += blastChain(&field, detonated, BLAST_RADIUS, fire);
+        count += blastDelta(fire, blast_map->height, &delta);
+    }
+    bench_sink += count;
+}
+
+// One op is a query for the 4 active bombs nearest to a random cell, among the bombs of blast_map
+// (288, half of them deactivated): with the grid of the store, then by scanning the map
+static entities_t bench_bombs;
+
+static void setupBombGrid(void) {
+    setupBlastMap();
+    entitiesReset(&bench_bombs);
+    for (int i = 0; i < MAX_MAP_SIZE; i++) {
+        if (blast_map->cells[i] == BOMB && (i / MAX_MAP_WIDTH) % 4 == 2) {
+            blast_map->cells[i] = DEACTIVATED_BOMB;
+        }
+        if (blast_map->cells[i] == BOMB || blast_map->cells[i] == DEACTIVATED_BOMB) {
+            int id = entityAddBomb(&bench_bombs, i % MAX_MAP_WIDTH, i / MAX_MAP_WIDTH);
+            bench_bombs.bombs.state[id] = blast_map->cells[i];
+        }
+    }
+}
+
+static void runNearestGrid(long iterations) {
+    int ids[4], found = 0;
+    unsigned int state = 1;
+    for (long i = 0; i < iterations; i++) {
+        state = state * 1103515245u + 12345u;
+        int cell = (int)((state >> 8) % MAX_MAP_SIZE);
+        found += entityNearestBombs(&bench_bombs, cell % MAX_MAP_WIDTH, cell / MAX_MAP_WIDTH, BOMB, 4, ids);
+    }
+    bench_sink += found + ids[0];
+}
+
+static void runNearestScan(long iterations) {
+    int dist[4], found = 0;
+    unsigned int state = 1;
+    for (long i = 0; i < iterations; i++) {
+        state = state * 1103515245u + 12345u;
+        int cell = (int)((state >> 8) % MAX_MAP_SIZE);
+        int x = cell % MAX_MAP_WIDTH, y = cell / MAX_MAP_WIDTH, count = 0;
+        for (int c = 0; c < MAX_MAP_SIZE; c++) {
+            if (blast_map->cells[c] != BOMB) {
+                continue;
+            }
+            int d = abs(c % MAX_MAP_WIDTH - x) + abs(c / MAX_MAP_WIDTH - y);
+            if (count == 4 && d >= dist[3]) {
+                continue;
+            }
+            int j = count < 4 ? count++ : 3;
+            while (j > 0 && dist[j - 1] > d) {
+                dist[j] = dist[j - 1];
+                j--;
+            }
+            dist[j] = d;
+        }
+        found += count;
+    }
+    bench_sink += found + dist[0];
+}
+
+static void runMapTransfer(long iterations) {
+    Map *received = map_new(MAX_MAP_WIDTH, MAX_MAP_HEIGHT);
+    for (long i = 0; i < iterations; i++) {
+        sendMap(&bench_pair[0], 1, bench_map);
+        if (receiveMap(&bench_pair[1], received, NULL, NULL) < 0) {
+            fprintf(stderr, "map transfer failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    bench_sink += received->cells[0];
+    free(received);
+}
+
+// Reference of map_transfer: the map decoded in a message, then copied into the map of the client
+static void runMapTransferCopy(long iterations) {
+    Map *received = map_new(MAX_MAP_WIDTH, MAX_MAP_HEIGHT);
+    message_u message;
+    for (long i = 0; i < iterations; i++) {
+        sendMap(&bench_pair[0], 1, bench_map);
+        if (recevoir(&bench_pair[1], &message) != MSG_MAP) {
+            fprintf(stderr, "map transfer failed\n");
+            exit(EXIT_FAILURE);
+        }
+        received->width = message.map.width;
+        received->height = message.map.height;
+        memcpy(received->cells, message.map.cells, received->width * received->height * sizeof(int));
+    }
+    bench_sink += received->cells[0];
+    free(received);
+}
+
+// One op is a point encoded once in a pooled frame and sent to every bot, with a send per bot
+static void runBroadcastBlocking(long iterations) {
+    for (long i = 0; i < iterations; i++) {
+        Point point = { (int)i & 31, 1, BOMB };
+        frame_buf_t *frame = poolEncode(&bench_pool, MSG_POINT, &point);
+        for (int b = 0; b < BENCH_BOTS; b++) {
+            ecrireSocket(&bench_server[b], frame->data, frame->len);
+        }
+        frameRelease(frame);
+        if ((i & 255) == 255) drainBots();
+    }
+    drainBots();
+}
+
+/**
+ * function completeBenchSend
+ * @brief Wait for a send of the broadcast kernel (or take a completed one) and release its frame
+ *
+ * @param wait - 1 to wait for a completion
+ * @return int - 1 if a send completed
+ */
+static int completeBenchSend(int wait) {
+    uring_cqe_t cqe;
+    if (wait ? uringWait(&bench_ring, &cqe) < 0 : !uringPeek(&bench_ring, &cqe)) {
+        return 0;
+    }
+    frameRelease(bench_in_flight[cqe.user_data]);
+    bench_in_flight[cqe.user_data] = NULL;
+    return 1;
+}
+
+// One op is a point encoded once in a pooled frame and sent to every bot by one io_uring_enter that does not wait:
+// each send holds a reference, the frame goes back to the pool with the last completion
+static void runBroadcastUring(long iterations) {
+    for (long i = 0; i < iterations; i++) {
+        Point point = { (int)i & 31, 1, BOMB };
+        frame_buf_t *frame = poolEncode(&bench_pool, MSG_POINT, &point);
+        for (int b = 0; b < BENCH_BOTS; b++) {
+            while (bench_in_flight[b] != NULL && completeBenchSend(1)) {
+            }
+            uringSend(&bench_ring, bench_server[b].fd, frame->data, frame->len, b);
+            bench_in_flight[b] = frameRetain(frame);
+        }
+        uringSubmit(&bench_ring, 0);
+        while (completeBenchSend(0)) {
+        }
+        frameRelease(frame);
+        if ((i & 255) == 255) drainBots();
+    }
+    for (int b = 0; b < BENCH_BOTS; b++) {
+        while (bench_in_flight[b] != NULL && completeBenchSend(1)) {
+        }
+    }
+    drainBots();
+}
+
+// One op is a request read by the server, the bots send them in bursts
+static void runRequestsBlocking(long iterations) {
+    Point burst[BENCH_BURST], point;
+    for (int k = 0; k < BENCH_BURST; k++) burst[k] = (Point){ k, k, BOMB };
+    for (long i = 0; i < iterations; i += BENCH_BURST) {
+        int b = (i / BENCH_BURST) % BENCH_BOTS;
+        CHECK(write(bench_bots[b], burst, sizeof burst), "write");
+        for (int k = 0; k < BENCH_BURST; k++) {
+            lireSocket(&bench_server[b], &point, sizeof(Point));
+        }
+    }
+    bench_sink += point.x;
+}
+
+// One op is a request read by the server through the multishot reception
+static void runRequestsUring(long iterations) {
+    Point burst[BENCH_BURST], point;
+    for (int k = 0; k < BENCH_BURST; k++) burst[k] = (Point){ k, k, BOMB };
+    for (long i = 0; i < iterations; i += BENCH_BURST) {
+        int b = (i / BENCH_BURST) % BENCH_BOTS;
+        CHECK(write(bench_bots[b], burst, sizeof burst), "write");
+        for (int k = 0; k < BENCH_BURST; k++) {
+            uringStreamRead(&bench_streams[b], &point, sizeof(Point));
+        }
+    }
+    bench_sink += point.x;
+}
+
+// One op is a connection accepted with its hello, the clients connect in storms of BENCH_STORM
+static void runAcceptStorm(long iterations) {
+    socket_t clients[BENCH_STORM];
+    struct linger reset = { 1, 0 }; // No TIME_WAIT left by the thousands of connections
+    for (long i = 0; i < iterations; i += BENCH_STORM) {
+        unsigned long target = __atomic_load_n(&bench_accepted, __ATOMIC_ACQUIRE) + BENCH_STORM;
+        for (int k = 0; k < BENCH_STORM; k++) {
+            memset(&clients[k], 0, sizeof(socket_t));
+            clients[k].mode = SOCK_STREAM;
+            clients[k].fd = socket(AF_INET, SOCK_STREAM, 0);
+            setsockopt(clients[k].fd, SOL_SOCKET, SO_LINGER, &reset, sizeof reset);
+            CHECK(connect(clients[k].fd, (struct sockaddr *)&bench_listen_addr, sizeof bench_listen_addr), "connect");
+            sendHello(&clients[k], 0, 0);
+        }
+        while (__atomic_load_n(&bench_accepted, __ATOMIC_ACQUIRE) < target) {
+            sched_yield();
+        }
+        for (int k = 0; k < BENCH_STORM; k++) {
+            close(clients[k].fd);
+        }
+    }
+}
+
+static const bench_kernel_t kernels[] = {
+    { "envoyer_recevoir", setupSocketPair, runEnvoyerRecevoir, teardownSocketPair },
+    { "encode_point", NULL, runEncodePoint, NULL },
+    { "decode_point", NULL, runDecodePoint, NULL },
+    { "decode_text", NULL, runDecodeText, NULL },
+    { "encode_map", setupMap, runEncodeMap, teardownMap },
+    { "generateMap", setupMap, runGenerateMap, teardownMap },
+    { "generate_grid", setupMap, runGenerateGrid, teardownMap },
+    { "generate_maze", setupMap, runGenerateMaze, teardownMap },
+    { "generate_caves", setupMap, runGenerateCaves, teardownMap },
+    { "generate_rooms", setupMap, runGenerateRooms, teardownMap },
+    { "regionsBuild", setupMap, runRegionsBuild, teardownMap },
+    { "isAccessible", setupMap, runIsAccessible, teardownMap },
+    { "movePlayer", setupMap, runMovePlayer, teardownMap },
+    { "bot_search", setupMap, runBotSearch, teardownMap },
+    { "entitiesTick", setupEntities, runEntitiesTick, NULL },
+    { "blast_chain", setupBlastMap, runBlastChain, teardownBlastMap },
+    { "nearest_bombs_grid", setupBombGrid, runNearestGrid, teardownBlastMap },
+    { "nearest_bombs_scan", setupBombGrid, runNearestScan, teardownBlastMap },
+    { "map_transfer", setupSocketPair, runMapTransfer, teardownSocketPair },
+    { "map_transfer_copy", setupSocketPair, runMapTransferCopy, teardownSocketPair },
+    { "envoyer_recevoir_shm", setupShmPair, runEnvoyerRecevoir, teardownShmPair },
+    { "map_transfer_shm", setupShmPair, runMapTransfer, teardownShmPair },
+    { "broadcast_blocking", setupBots, runBroadcastBlocking, teardownBots },
+    { "broadcast_uring", setupBotsUring, runBroadcastUring, teardownBots },
+    { "requests_blocking", setupBots, runRequestsBlocking, teardownBots },
+    { "requests_uring", setupBotsUring, runRequestsUring, teardownBots },
+    { "accept_single", setupAcceptSingle, runAcceptStorm, teardownAcceptors },
+    { "accept_reuseport", setupAcceptReuseport, runAcceptStorm, teardownAcceptors },
+};
+
+/**
+ * function compareDouble
+ * @brief qsort comparator for the run timings
+ *
+ * @param a
+ * @param b
+ * @return int
+ */
+static int compareDouble(const void *a, const void *b) {
+    double da = *(const double *)a, db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+/**
+ * function runKernel
+ * @brief Warm up a kernel, calibrate the number of iterations and measure the runs
+ *
+ * @param kernel
+ * @param result
+ * @return void
+ */
+static void runKernel(const bench_kernel_t *kernel, bench_result_t *result) {
+    if (kernel->setup) kernel->setup();
+
+    // Warmup, doubling the iterations until the warmup budget is spent
+    long iterations = 1;
+    long long elapsed = 0;
+    long long warmup_start = benchNow();
+    while (benchNow() - warmup_start < BENCH_WARMUP_NS) {
+        long long start = benchNow();
+        kernel->run(iterations);
+        elapsed = benchNow() - start;
+        if (elapsed < BENCH_RUN_NS / 2) iterations *= 2;
+    }
+    // Calibrate the iterations so that one run lasts about BENCH_RUN_NS
+    if (elapsed > 0) {
+        iterations = (long)((double)iterations * BENCH_RUN_NS / elapsed);
+    }
+    if (iterations < 1) iterations = 1;
+
+    double ns[BENCH_RUNS];
+    unsigned long allocs = 0, bytes = 0, syscalls = 0;
+    for (int r = 0; r < BENCH_RUNS; r++) {
+        unsigned long syscalls_before = __atomic_load_n(&syscall_count, __ATOMIC_RELAXED);
+        unsigned long allocs_before = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+        unsigned long bytes_before = __atomic_load_n(&alloc_bytes, __ATOMIC_RELAXED);
+        long long start = benchNow();
+        kernel->run(iterations);
+        ns[r] = (double)(benchNow() - start) / iterations;
+        allocs += __atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - allocs_before;
+        bytes += __atomic_load_n(&alloc_bytes, __ATOMIC_RELAXED) - bytes_before;
+        syscalls += __atomic_load_n(&syscall_count, __ATOMIC_RELAXED) - syscalls_before;
+    }
+
+    if (kernel->teardown) kernel->teardown();
+
+    double sum = 0.0, sq = 0.0;
+    for (int r = 0; r < BENCH_RUNS; r++) sum += ns[r];
+    double mean = sum / BENCH_RUNS;
+    for (int r = 0; r < BENCH_RUNS; r++) sq += (ns[r] - mean) * (ns[r] - mean);
+    qsort(ns, BENCH_RUNS, sizeof(double), compareDouble);
+
+    result->name = kernel->name;
+    result->iterations = iterations;
+    result->ns_min = ns[0];
+    result->ns_median = ns[BENCH_RUNS / 2];
+    result->ns_mean = mean;
+    result->ns_stddev = sqrt(sq / BENCH_RUNS);
+    result->allocs_per_op = (double)allocs / ((double)iterations * BENCH_RUNS);
+    result->bytes_per_op = (double)bytes / ((double)iterations * BENCH_RUNS);
+    result->syscalls_per_op = (double)syscalls / ((double)iterations * BENCH_RUNS);
+}
+
+/**
+ * function writeJson
+ * @brief Write the results as JSON so runs can be compared across commits
+ *
+ * @param path
+ * @param commit
+ * @param results
+ * @param count
+ * @return int (0 on success, -1 on error)
+ */
+static int writeJson(const char *path, const char *commit, const bench_result_t *results, int count) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        perror("Failed to open the benchmark output");
+        return -1;
+    }
+    fprintf(out, "{\n  \"commit\": \"%s\",\n  \"timestamp\": %ld,\n  \"runs\": %d,\n  \"results\": [\n",
+            commit, (long)time(NULL), BENCH_RUNS);
+    for (int i = 0; i < count; i++) {
+        const bench_result_t *r = &results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": {\"min\": %.3f, \"median\": %.3f, \"mean\": %.3f, \"stddev\": %.3f}, \"allocs_per_op\": %.4f, \"bytes_per_op\": %.1f, \"syscalls_per_op\": %.4f}%s\n",
+                r->name, r->iterations, r->ns_min, r->ns_median, r->ns_mean, r->ns_stddev,
+                r->allocs_per_op, r->bytes_per_op, r->syscalls_per_op, i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    fclose(out);
+    return 0;
+}
+
+/**
+ * function main
+ * @brief Run every kernel (or the ones given after the output path) and write the JSON results
+ *
+ * usage: bench [output.json] [commit] [kernel...]
+ * @return int
+ */
+int main(int argc, char *argv[]) {
+    const char *output = argc > 1 ? argv[1] : "bench.json";
+    const char *commit = argc > 2 ? argv[2] : "unknown";
+    int num_kernels = sizeof(kernels) / sizeof(kernels[0]);
+    bench_result_t results[BENCH_MAX_KERNELS];
+    int count = 0;
+
+    // Debug logs stay enabled, like in production, but are discarded
+    FILE *devnull = fopen("/dev/null", "w");
+    logInit(devnull);
+
+    printf("%-20s %12s %12s %12s %10s %10s %11s\n", "kernel", "iterations", "median ns/op", "min ns/op", "allocs/op", "bytes/op", "syscalls/op");
+    for (int i = 0; i < num_kernels; i++) {
+        // Optional filter on the kernel names
+        if (argc > 3) {
+            int selected = 0;
+            for (int a = 3; a < argc; a++) {
+                if (strcmp(argv[a], kernels[i].name) == 0) selected = 1;
+            }
+            if (!selected) continue;
+        }
+        bench_result_t *r = &results[count++];
+        runKernel(&kernels[i], r);
+        printf("%-20s %12ld %12.1f %12.1f %10.3f %10.1f %11.3f\n", r->name, r->iterations, r->ns_median, r->ns_min, r->allocs_per_op, r->bytes_per_op, r->syscalls_per_op);
+    }
+
+    logShutdown();
+    fclose(devnull);
+
+    if (writeJson(output, commit, results, count) < 0) {
+        return 1;
+    }
+    printf("Results written to %s\n", output);
+    return 0;
+}
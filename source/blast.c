@@ -0,0 +1,127 @@
+#include "blast.h"
+
+/**
+ * function blastFieldInit
+ * @brief Build the row masks of the walls and of the active bombs of a map
+ *
+ * @param field
+ * @param map
+ * @return void
+ */
+void blastFieldInit(blast_field_t *field, const Map *map) {
+    field->height = map->height;
+    for (int y = 0; y < map->height; y++) {
+        const int *row = &map->cells[y * map->width];
+        row_mask_t open = 0, bombs = 0;
+        for (int x = 0; x < map->width; x++) {
+            open |= (row_mask_t)(row[x] != WALL) << x;
+            bombs |= (row_mask_t)(row[x] == BOMB) << x;
+        }
+        field->open[y] = open;
+        field->bombs[y] = bombs;
+    }
+}
+
+/**
+ * function blastSpread
+ * @brief Add to the fire the cells reached by the blasts of the sources. All the sources of a row spread
+ *        together: a step shifts the whole row, and a wall clears the bit that would go through it.
+ *
+ * @param field
+ * @param sources (row masks of the exploding cells)
+ * @param radius
+ * @param fire (row masks, the reached cells are added)
+ * @return void
+ */
+void blastSpread(const blast_field_t *field, const row_mask_t sources[], int radius, row_mask_t fire[]) {
+    int height = field->height;
+    row_mask_t up[MAX_MAP_HEIGHT], down[MAX_MAP_HEIGHT];
+
+    for (int y = 0; y < height; y++) {
+        row_mask_t left = sources[y], right = sources[y];
+        row_mask_t reached = sources[y];
+        for (int step = 0; step < radius; step++) {
+            left = (left >> 1) & field->open[y];
+            right = (right << 1) & field->open[y];
+            reached |= left | right;
+        }
+        fire[y] |= reached;
+        up[y] = down[y] = sources[y];
+    }
+
+    // Along the columns a step moves the rows by one, a row keeps the bits of its neighbour that are open
+    for (int step = 0; step < radius; step++) {
+        for (int y = height - 1; y > 0; y--) {
+            down[y] = down[y - 1] & field->open[y];
+            fire[y] |= down[y];
+        }
+        down[0] = 0;
+        for (int y = 0; y < height - 1; y++) {
+            up[y] = up[y + 1] & field->open[y];
+            fire[y] |= up[y];
+        }
+        up[height - 1] = 0;
+    }
+}
+
+/**
+ * function blastChain
+ * @brief Spread the blasts of the detonated bombs, and of the bombs they reach, until no bomb is left in the fire.
+ *        A wave costs radius passes over the rows, whatever the number of bombs exploding in it.
+ *
+ * @param field
+ * @param detonated (row masks of the first bombs to explode, all the bombs that exploded on return)
+ * @param radius
+ * @param fire (row masks, set to the cells reached by the blasts)
+ * @return int (number of bombs that exploded)
+ */
+int blastChain(const blast_field_t *field, row_mask_t detonated[], int radius, row_mask_t fire[]) {
+    int height = field->height;
+    row_mask_t wave[MAX_MAP_HEIGHT];
+    int count = 0;
+    for (int y = 0; y < height; y++) {
+        wave[y] = detonated[y];
+        fire[y] = 0;
+        count += __builtin_popcountll(detonated[y]);
+    }
+
+    int exploding = count;
+    while (exploding > 0) {
+        blastSpread(field, wave, radius, fire);
+        // The bombs reached for the first time explode in the next wave
+        exploding = 0;
+        for (int y = 0; y < height; y++) {
+            wave[y] = fire[y] & field->bombs[y] & ~detonated[y];
+            detonated[y] |= wave[y];
+            exploding += __builtin_popcountll(wave[y]);
+        }
+        count += exploding;
+    }
+    return count;
+}
+
+/**
+ * function blastDelta
+ * @brief Keep the rows of the fire between its first and last non empty rows, sent as one message
+ *
+ * @param fire
+ * @param height
+ * @param delta
+ * @return int (number of cells destroyed)
+ */
+int blastDelta(const row_mask_t fire[], int height, blast_t *delta) {
+    int top = 0, bottom = height - 1, cells = 0;
+    while (top < height && fire[top] == 0) {
+        top++;
+    }
+    while (bottom >= top && fire[bottom] == 0) {
+        bottom--;
+    }
+    delta->top = top;
+    delta->rows = bottom - top + 1;
+    for (int i = 0; i < delta->rows; i++) {
+        delta->masks[i] = fire[top + i];
+        cells += __builtin_popcountll(fire[top + i]);
+    }
+    return cells;
+}
@@ -0,0 +1,30 @@
+#ifndef BLAST_H
+#define BLAST_H
+
+#include "game.h"
+
+// --- Constants ---
+#define BLAST_RADIUS 2  // Cells a blast reaches in each direction, unless a wall stops it
+
+#if MAX_MAP_WIDTH > 64
+#error "A row of the map must fit in a row_mask_t"
+#endif
+
+// --- Structures ---
+// Row of the map, bit x is the cell of column x
+typedef unsigned long long row_mask_t;
+
+// Cells of a map as row masks, built once per detonation
+typedef struct {
+    int height;
+    row_mask_t open[MAX_MAP_HEIGHT];    // Cells a blast goes through (not a wall)
+    row_mask_t bombs[MAX_MAP_HEIGHT];   // Active bombs, they explode when a blast reaches them
+} blast_field_t;
+
+// --- Functions ---
+void blastFieldInit(blast_field_t *field, const Map *map);
+void blastSpread(const blast_field_t *field, const row_mask_t sources[], int radius, row_mask_t fire[]);
+int blastChain(const blast_field_t *field, row_mask_t detonated[], int radius, row_mask_t fire[]);
+int blastDelta(const row_mask_t fire[], int height, blast_t *delta);
+
+#endif // BLAST_H
@@ -0,0 +1,285 @@
+#include "bot.h"
+
+/**
+ * function botInit
+ * @brief Prepare a bot for a new match
+ *
+ * @param bot
+ * @param role
+ * @param seed (seed of its random choices)
+ * @return void
+ */
+void botInit(bot_t *bot, Role role, unsigned int seed) {
+    bot->active = 1;
+    bot->role = role;
+    bot->requests = 0;
+    bot->wait = 0;
+    bot->goal = -1;
+    bot->searching = 0;
+    bot->path_length = 0;
+    bot->path_next = 0;
+    rngSeed(&bot->rng, seed);
+}
+
+/**
+ * function heuristic
+ * @brief Get the moves left from a cell to the target of the search, walls ignored (0 for the nearest bomb)
+ *
+ * @param bot
+ * @param map
+ * @param cell
+ * @return int
+ */
+static int heuristic(const bot_t *bot, const Map *map, int cell) {
+    if (bot->target < 0) {
+        return 0;
+    }
+    return abs(cell % map->width - bot->target % map->width) + abs(cell / map->width - bot->target / map->width);
+}
+
+/**
+ * function heapBefore
+ * @brief Check if a cell is expanded before another: the lower estimate first, the farther from the start on a tie
+ *
+ * @param bot
+ * @param map
+ * @param a
+ * @param b
+ * @return int
+ */
+static int heapBefore(const bot_t *bot, const Map *map, int a, int b) {
+    int fa = bot->g[a] + heuristic(bot, map, a);
+    int fb = bot->g[b] + heuristic(bot, map, b);
+    return fa < fb || (fa == fb && bot->g[a] > bot->g[b]);
+}
+
+/**
+ * function heapSet
+ * @brief Put a cell at an index of the open heap
+ *
+ * @param bot
+ * @param index
+ * @param cell
+ * @return void
+ */
+static void heapSet(bot_t *bot, int index, int cell) {
+    bot->heap[index] = cell;
+    bot->heap_pos[cell] = index;
+}
+
+/**
+ * function heapUp
+ * @brief Move a cell of the open heap up to its place, after it was added or its estimate lowered
+ *
+ * @param bot
+ * @param map
+ * @param index
+ * @return void
+ */
+static void heapUp(bot_t *bot, const Map *map, int index) {
+    int cell = bot->heap[index];
+    while (index > 0 && heapBefore(bot, map, cell, bot->heap[(index - 1) / 2])) {
+        heapSet(bot, index, bot->heap[(index - 1) / 2]);
+        index = (index - 1) / 2;
+    }
+    heapSet(bot, index, cell);
+}
+
+/**
+ * function heapPop
+ * @brief Take the first cell of the open heap
+ *
+ * @param bot
+ * @param map
+ * @return int
+ */
+static int heapPop(bot_t *bot, const Map *map) {
+    int first = bot->heap[0];
+    int cell = bot->heap[--bot->heap_count];
+    int index = 0;
+    while (2 * index + 1 < bot->heap_count) {
+        int child = 2 * index + 1;
+        if (child + 1 < bot->heap_count && heapBefore(bot, map, bot->heap[child + 1], bot->heap[child])) {
+            child++;
+        }
+        if (!heapBefore(bot, map, bot->heap[child], cell)) {
+            break;
+        }
+        heapSet(bot, index, bot->heap[child]);
+        index = child;
+    }
+    if (bot->heap_count > 0) {
+        heapSet(bot, index, cell);
+    }
+    bot->heap_pos[first] = -1;
+    return first;
+}
+
+/**
+ * function botSearchStart
+ * @brief Start the search of a path, expanded by botSearchStep within the budgets of the ticks
+ *
+ * @param bot
+ * @param from (cell of the bot)
+ * @param target (cell to reach, BOT_GOAL_BOMB for the nearest active bomb)
+ * @return void
+ */
+void botSearchStart(bot_t *bot, int from, int target) {
+    if (++bot->stamp == 0) {
+        memset(bot->seen, 0, sizeof(bot->seen));
+        bot->stamp = 1;
+    }
+    bot->searching = 1;
+    bot->target = target;
+    bot->heap_count = 0;
+    bot->seen[from] = bot->stamp;
+    bot->g[from] = 0;
+    bot->parent[from] = -1;
+    heapSet(bot, bot->heap_count++, from);
+}
+
+/**
+ * function botSearchStep
+ * @brief Expand the cells of a search until it ends or the budget runs out. The cost of a move is 1:
+ *        A* with the Manhattan distance towards a cell, Dijkstra (a BFS) towards the nearest bomb.
+ *
+ * @param bot
+ * @param map
+ * @param budget (cells the search can still expand, lowered by the cells expanded)
+ * @return int (bot_search_t, the path and the goal of the bot are set when it is found)
+ */
+int botSearchStep(bot_t *bot, const Map *map, int *budget) {
+    static const int dx[4] = { 0, 0, -1, 1 };
+    static const int dy[4] = { -1, 1, 0, 0 };
+    while (bot->heap_count > 0) {
+        if (*budget <= 0) {
+            return BOT_SEARCH_PENDING;
+        }
+        (*budget)--;
+        int cell = heapPop(bot, map);
+        int found = bot->target >= 0 ? cell == bot->target : map->cells[cell] == BOMB;
+        if (found) {
+            bot->path_length = bot->g[cell];
+            for (int c = cell, i = bot->path_length - 1; i >= 0; c = bot->parent[c], i--) {
+                bot->path[i] = c;
+            }
+            bot->path_next = 0;
+            bot->goal = cell;
+            bot->searching = 0;
+            return BOT_SEARCH_FOUND;
+        }
+
+        int x = cell % map->width, y = cell / map->width;
+        for (int d = 0; d < 4; d++) {
+            int nx = x + dx[d], ny = y + dy[d];
+            if (nx < 0 || nx >= map->width || ny < 0 || ny >= map->height) {
+                continue;
+            }
+            int next = ny * map->width + nx;
+            if (map->cells[next] == WALL) {
+                continue;
+            }
+            if (bot->seen[next] != bot->stamp) {
+                bot->seen[next] = bot->stamp;
+                bot->g[next] = bot->g[cell] + 1;
+                bot->parent[next] = cell;
+                heapSet(bot, bot->heap_count++, next);
+                heapUp(bot, map, bot->heap_count - 1);
+            } else if (bot->heap_pos[next] >= 0 && bot->g[cell] + 1 < bot->g[next]) {
+                bot->g[next] = bot->g[cell] + 1;
+                bot->parent[next] = cell;
+                heapUp(bot, map, bot->heap_pos[next]);
+            }
+        }
+    }
+    bot->searching = 0;
+    return BOT_SEARCH_NONE;
+}
+
+/**
+ * function botPickTarget
+ * @brief Pick the next cell where a Bomber bot places a bomb: a free path, not too close
+ *
+ * @param bot
+ * @param map
+ * @param x
+ * @param y
+ * @return int (cell, -1 if none was found this time)
+ */
+static int botPickTarget(bot_t *bot, const Map *map, int x, int y) {
+    for (int attempt = 0; attempt < 16; attempt++) {
+        int cell = rngRange(&bot->rng, map->width * map->height);
+        int moves = abs(cell % map->width - x) + abs(cell / map->width - y);
+        if (map->cells[cell] == PATH && moves >= BOT_MIN_TRAVEL) {
+            return cell;
+        }
+    }
+    return -1;
+}
+
+/**
+ * function botTick
+ * @brief Play one tick of a bot: a move along its path, a request once it arrives, or a part of its next search.
+ *        A Bomber bot places its bombs on random paths, a Mine clearer bot heads to the nearest active bomb.
+ *
+ * @param bot
+ * @param map
+ * @param x (position of the bot, updated when it moves)
+ * @param y
+ * @param budget (cells its search can expand, lowered by the cells expanded)
+ * @param request (set when the bot sends a request)
+ * @return int (bot_action_t)
+ */
+int botTick(bot_t *bot, const Map *map, int *x, int *y, int *budget, Point *request) {
+    if (bot->wait > 0) {
+        bot->wait--;
+        return BOT_IDLE;
+    }
+
+    // Next cell of the path, the map may have changed since the search
+    if (bot->path_next < bot->path_length) {
+        int next = bot->path[bot->path_next++];
+        if (map->cells[next] == WALL) {
+            bot->path_length = 0;
+            bot->goal = -1;
+            return BOT_IDLE;
+        }
+        *x = next % map->width;
+        *y = next / map->width;
+        bot->wait = BOT_MOVE_TICKS - 1;
+        return BOT_MOVED;
+    }
+
+    // Arrived: the bomb is placed or deactivated, unless the cell changed meanwhile
+    if (bot->goal >= 0) {
+        int cell = bot->goal;
+        bot->goal = -1;
+        bot->path_length = 0;
+        if (map->cells[cell] != (bot->role == BOMBER ? PATH : BOMB)) {
+            return BOT_IDLE;
+        }
+        request->x = *x;
+        request->y = *y;
+        request->state = bot->role == BOMBER ? BOMB : DEACTIVATED_BOMB;
+        bot->requests++;
+        bot->wait = BOT_MOVE_TICKS - 1;
+        return BOT_REQUEST;
+    }
+
+    if (!bot->searching) {
+        int from = *y * map->width + *x;
+        if (bot->role == BOMBER) {
+            int target = bot->requests < BOMB_COUNT ? botPickTarget(bot, map, *x, *y) : -1;
+            if (target < 0) {
+                return BOT_IDLE;
+            }
+            botSearchStart(bot, from, target);
+        } else {
+            botSearchStart(bot, from, BOT_GOAL_BOMB);
+        }
+    }
+    if (botSearchStep(bot, map, budget) == BOT_SEARCH_NONE) {
+        bot->wait = BOT_RETRY_TICKS;
+    }
+    return BOT_IDLE;
+}
@@ -0,0 +1,62 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include "game.h"
+#include "mapgen.h"
+
+// --- Constants ---
+#define BOT_NODES_PER_TICK 512  // Cells the searches of the bots of a room expand at most per tick
+#define BOT_MOVE_TICKS 3        // Ticks between two moves of a bot (10 cells per second)
+#define BOT_RETRY_TICKS 15      // Ticks a bot waits before searching again when it found nothing
+#define BOT_MIN_TRAVEL 6        // Fewest moves between a Bomber bot and the next bomb it places
+#define BOT_GOAL_BOMB -1        // Goal of a search: the nearest active bomb
+
+// Result of a step of the search of a bot
+typedef enum {
+    BOT_SEARCH_NONE = -1,   // No path to the goal
+    BOT_SEARCH_PENDING,     // The budget ran out, the search goes on at the next tick
+    BOT_SEARCH_FOUND
+} bot_search_t;
+
+// What a bot did during a tick
+typedef enum {
+    BOT_IDLE,
+    BOT_MOVED,              // The position of the bot changed
+    BOT_REQUEST             // The bot sends a request, as a client would
+} bot_action_t;
+
+// --- Structures ---
+// Player played by the server. Its search (A*, or Dijkstra towards the nearest bomb) is kept between the ticks,
+// a tick only expands the cells of its budget.
+typedef struct {
+    int active;
+    Role role;
+    int requests;                       // Requests sent, a Bomber bot stops after BOMB_COUNT bombs
+    int wait;                           // Ticks before the next move or search
+    int goal;                           // Cell the bot heads to, -1 if it has none
+    rng_t rng;
+
+    // Search: a cell is known if its stamp is the stamp of the search
+    int searching;
+    int target;                         // Cell searched, BOT_GOAL_BOMB for the nearest active bomb
+    unsigned int stamp;
+    unsigned int seen[MAX_MAP_SIZE];
+    short parent[MAX_MAP_SIZE];
+    short g[MAX_MAP_SIZE];              // Moves from the start
+    short heap_pos[MAX_MAP_SIZE];       // Index in the open heap, -1 once the cell is expanded
+    short heap[MAX_MAP_SIZE];           // Open cells, ordered by g + h
+    int heap_count;
+
+    // Path found, walked one cell per BOT_MOVE_TICKS
+    short path[MAX_MAP_SIZE];
+    int path_length;
+    int path_next;
+} bot_t;
+
+// --- Functions ---
+void botInit(bot_t *bot, Role role, unsigned int seed);
+void botSearchStart(bot_t *bot, int from, int target);
+int botSearchStep(bot_t *bot, const Map *map, int *budget);
+int botTick(bot_t *bot, const Map *map, int *x, int *y, int *budget, Point *request);
+
+#endif // BOT_H
@@ -1,36 +1,73 @@
+#define _GNU_SOURCE
 #include "communication_socket.h"
 
-// --- Global variables for managing the clients ---
-socket_t client_sockets[MAX_CLIENTS];
-pthread_mutex_t client_sockets_mutex = PTHREAD_MUTEX_INITIALIZER;
-int roles_assigned[MAX_CLIENTS] = {0, 0}; // 0 = not assigned, 1 = assigned
-// --- Global variables for managing the game ---
-game_state_t game_state = {
-    .bombCount = 0,
-    .deactivatedBombCount = 0,
-    .start_time = 0,
-    .gameEnded = 0,
-    .mutex = PTHREAD_MUTEX_INITIALIZER,
-    .cond = PTHREAD_COND_INITIALIZER
-};
+// --- Workers and their rooms ---
+worker_t workers[MAX_WORKERS];
+int worker_count = 0;
+room_t rooms[MAX_ROOMS];
+// --- Matchmaking: players waiting for an opponent ---
+matchmaker_t matchmaker;
+socket_t channel_socket = { .fd = -1 };
+// --- io_uring backend, selected by BOMBO2I_IO=uring ---
+int use_uring = 0;
+// --- Maps generated ahead of the matches ---
+map_pool_t map_pool;
+// --- Bots: they join a player waiting alone (BOMBO2I_BOT_WAIT), or play matches between them (BOMBO2I_BOT_MATCHES) ---
+long long bot_wait_ns = -1;
+int bot_matches = 0;
+// --- Spectators: one thread sends them the updates of all the rooms, behind the matches ---
+pthread_mutex_t spectator_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t spectator_cond = PTHREAD_COND_INITIALIZER;
+int spectator_work = 0;
+// --- Hot restart: the next server takes the sockets and the matches over (BOMBO2I_HANDOFF) ---
+socket_t handoff_listener = { .fd = -1 };
+int handoff_event = -1;     // eventfd readable during a handoff: the threads reading the sockets park
+int handoff_active = 0;
+int handoff_threads = 0;    // Threads reading the sockets, counted by their creator
+int handoff_parked = 0;
+pthread_mutex_t handoff_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t handoff_cond = PTHREAD_COND_INITIALIZER;
+// --- Admission control and rate limits of the clients ---
+admission_t admission = { .fd_budget = 1 << 30 };
+int rate_limit = 1;
 
 /**
- * function handle_sigint
- * @brief Handle the SIGINT signal (Ctrl+C) to shut down the server
+ * function signalThread
+ * @brief Wait for the SIGINT signal (Ctrl+C), blocked in the other threads, and shut down the server.
+ *        The shutdown is not async-signal-safe, it runs on this thread instead of a signal handler.
  * 
- * @param sig 
- * @return void
+ * @param arg (sigset_t * of the signals waited for)
+ * @return void*
  */
-void handle_sigint(int sig) {
-    printf("\nServer shutting down...\n");
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (client_sockets[i].fd != 0) {
-            close(client_sockets[i].fd);
+void *signalThread(void *arg) {
+    const sigset_t *signals = (const sigset_t *)arg;
+    traceThreadName("signals");
+    int sig;
+    while (sigwait(signals, &sig) != 0);
+    LOG_INFO("Server shutting down...");
+    for (int r = 0; r < worker_count * ROOMS_PER_WORKER; r++) {
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (rooms[r].client_sockets[i].fd != 0) {
+                fermerSocket(&rooms[r].client_sockets[i]);
+            }
         }
     }
+    traceDump();
+    logShutdown();
     exit(0);
 }
 
+/**
+ * function handle_sigusr1
+ * @brief Handle the SIGUSR1 signal to switch the span tracing on or off
+ * 
+ * @param sig 
+ * @return void
+ */
+void handle_sigusr1(int sig) {
+    traceEnable(!traceEnabled());
+}
+
 /**
  * function handleClient
  * @brief Handle the client requests
@@ -46,477 +83,2990 @@ void *handleClient(void *data) {
         pthread_exit(NULL);
     }
 
+    traceThreadName("client");
     socket_t client_socket = client_data->client_socket;
-    Map *map = client_data->map;
-    Player *player = client_data->player;
+    room_t *room = client_data->room;
+    Map *map = room->map;
 
-    if (player == NULL) {
-        fprintf(stderr, "Error: player is NULL\n");
-        pthread_exit(NULL);
-    }
     if (map == NULL) {
         fprintf(stderr, "Error: map is NULL\n");
+        leaveMatch(room);
         pthread_exit(NULL);
     }
 
     // Send the player data to the client
-    if (send(client_socket.fd, player, sizeof(Player), 0) < 0) {
+    traceMutexLock(&room->mutex, "lock_wait room");
+    Player player = entityPlayer(&room->entities, client_data->slot);
+    pthread_mutex_unlock(&room->mutex);
+    // A thread reading a TCP connection is counted for the handoffs (its creator counted it)
+    int reading = client_socket.shm == NULL && client_socket.fd >= 0;
+    Point player_msg = { player.x, player.y, player.role };
+    if (!client_data->restored && envoyer(&client_socket, MSG_PLAYER, &player_msg) < 0) {
         perror("Failed to send player data");
-        close(client_socket.fd);
+        if (reading) {
+            handoffCount(-1);
+        }
+        releaseClient(room, client_data->slot, &client_socket);
         free(client_data);
+        leaveMatch(room);
         pthread_exit(NULL);
     }
 
+    // With io_uring the requests arrive through a multishot reception, read without syscall when they queue up
+    uring_stream_t stream;
+    openRequestStream(&stream, &client_socket);
+
+    // The messages of the connection are limited, a client flooding the server only loses its requests
+    token_bucket_t requests;
+    bucketInit(&requests, rate_limit ? REQUEST_RATE_MS * 1000000LL : 0, REQUEST_BURST, nowNs());
+    int dropped = 0;
+
     // Handle the client's requests
     while (1) {
         // Receive the client's request
-        Point point;
-        ssize_t recv_size = recv(client_socket.fd, &point, sizeof(Point), 0);
+        message_u request;
+        TRACE_BEGIN(recv_span, "recv");
+        // A player disconnected when its match was handed over has no socket, it resumes its session
+        int type = client_socket.fd >= 0 ? readRequest(&stream, &client_socket, &request) : -1;
+        TRACE_END(recv_span);
 
-        if (recv_size <= 0) {
-            if (recv_size == 0) {
-                printf("Client %d disconnected.\n", client_socket.fd);
+        if (type == MSG_QUIT) {
+            LOG_INFO("Player %d left the match", client_data->slot);
+            break;
+        }
+        if (type < 0) {
+            LOG_INFO("Client %d disconnected.", client_socket.fd);
+            if (room->game_state.gameEnded) {
                 break;
-            } else {
-                perror("recv");
+            }
+            // Keep the player in the match until it resumes its session or the delay expires
+            LOG_INFO("Waiting %d s for player %d to resume its session", RESUME_TIMEOUT_S, client_data->slot);
+            uringStreamClose(&stream);
+            if (reading) {
+                handoffCount(-1);
+                reading = 0;
+            }
+            if (waitForResume(room, client_data->slot, &client_socket) < 0) {
+                LOG_INFO("Player %d did not resume its session", client_data->slot);
                 break;
             }
+            if (client_socket.shm == NULL) {
+                handoffCount(1);
+                reading = 1;
+            }
+            openRequestStream(&stream, &client_socket);
+            bucketInit(&requests, requests.period, REQUEST_BURST, nowNs());
+            dropped = 0;
+            continue;
         }
-
-        pthread_mutex_lock(&game_state.mutex);
-        // Handle the request
-        switch (point.state) {
-            case 2:
-                if (game_state.bombCount < BOMB_COUNT) {
-                    setSpecialPoint(map, player->x, player->y, BOMB);
-                    point.state = BOMB;
-                    game_state.bombCount++;
-
-                    if(game_state.bombCount < 5){
-                        char message[BUFFER_SIZE] = "A bomb has been placed by the Bomber!\n";
-                        broadcastMessage(message);
-                        usleep(100000); // 100 ms
-
-                    } else if (game_state.bombCount == BOMB_COUNT) {
-                        // Start the countdown thread
-                        pthread_t countdown_thread;
-                        if (pthread_create(&countdown_thread, NULL, countdownMonitor, NULL) != 0) {
-                            perror("Failed to create countdown thread");
-                            pthread_mutex_unlock(&game_state.mutex);
-                            close(client_socket.fd);
-                            free(client_data);
-                            pthread_exit(NULL);
-                        }
-                        usleep(100000); // 100 ms
-                    }
-                    // Delay
-                    usleep(100000); // 100 ms
-                    // Broadcast the point to all clients
-                    broadcastPoint(point);
-                } else {
-                    char message[BUFFER_SIZE] = "Bomb limit reached\n";
-                    send(client_socket.fd, message, strlen(message), 0);
-                }
-                printf("Debug - Bomb count: %d\n", game_state.bombCount);
-                break;
-            case 3:
-                setSpecialPoint(map, player->x, player->y, DEACTIVATED_BOMB);
-                point.state = DEACTIVATED_BOMB;
-                game_state.deactivatedBombCount++;
-                // Broadcast the point to all clients
-                broadcastPoint(point);
-                // delay
-                usleep(100000); // 100 ms
-                char message[BUFFER_SIZE] = "A bomb has been deactivated by the Mine clearer!\n";
-                broadcastMessage(message);
+        long long now = nowNs();
+        if (!bucketTake(&requests, now)) {
+            if (++dropped == REQUEST_KICK) {
+                LOG_WARN("Client %d keeps flooding the server, connection closed", client_socket.fd);
                 break;
-            default:
-                fprintf(stderr, "Unknown request: %d\n", point.state);
-                break;
-        }
-
-        if (!game_state.gameEnded) {
-            if (game_state.deactivatedBombCount == 5 && game_state.start_time != 0 && time(NULL) - game_state.start_time < 60) {
-                game_state.gameEnded = 1;
-                char message[BUFFER_SIZE] = "Game ended: Victory for the Mine clearer!\n";
-
-                broadcastMessage(message);
-                pthread_cond_broadcast(&game_state.cond);
             }
+            continue;
         }
-
-        pthread_mutex_unlock(&game_state.mutex);
-
-        if (game_state.gameEnded) {
+        dropped = 0;
+        if (type != MSG_POINT) {
+            LOG_WARN("Unexpected message %d from client %d", type, client_socket.fd);
+            continue;
+        }
+        // A client without the UDP channel sends its moves on the connection, a point on a path
+        if (request.point.state == PATH) {
+            traceMutexLock(&room->mutex, "lock_wait room");
+            movePlayerTo(room, client_data->slot, request.point);
+            pthread_mutex_unlock(&room->mutex);
+            continue;
+        }
+        // The request is applied by the next tick of the room, in the order of arrival (the tick checks its delay)
+        input_t input = { request.point, now };
+        if (inputPush(&room->inputs[client_data->slot], &input) < 0) {
+            LOG_WARN("Input queue of player %d is full, request dropped", client_data->slot);
+        }
+        if (__atomic_load_n(&room->game_state.gameEnded, __ATOMIC_ACQUIRE)) {
             break;
         }
-
-        // Short delay to avoid busy-waiting
-        usleep(100000); // 100 ms
     }
 
-    // Close the client socket
-    close(client_socket.fd);
+    // Close the client socket (already closed if the player never resumed its session)
+    if (reading) {
+        handoffCount(-1);
+    }
+    uringStreamClose(&stream);
+    releaseClient(room, client_data->slot, &client_socket);
     free(client_data);
+    leaveMatch(room);
     pthread_exit(NULL);
 
     return NULL;
 }
 
 /**
- * function countdownMonitor
- * @brief Monitor the countdown for the game
+ * function leaveMatch
+ * @brief Count a client thread of the match out: when the last one leaves (quit, or not resumed in time)
+ *        before a victory, the match ends without a winner and its room is reset for the next one
  * 
- * @param arg 
- * @return void* 
+ * @param room 
+ * @return void
  */
-void *countdownMonitor(void *arg) {
-    pthread_mutex_lock(&game_state.mutex);
-    char message[BUFFER_SIZE] = "All bombs are placed. The countdown starts now! 30 seconds left!\n";
-    broadcastMessage(message);
-    game_state.start_time = time(NULL);
-    pthread_mutex_unlock(&game_state.mutex);
-    
-    while (1) {
-        sleep(1); // Check every second
-
-        pthread_mutex_lock(&game_state.mutex);
-        if (game_state.start_time != 0 && time(NULL) - game_state.start_time >= 60) {
-            if (!game_state.gameEnded) {
-                game_state.gameEnded = 1;
-                char message[BUFFER_SIZE] = "Game ended: Victory for the Bomber!\n";
-                broadcastMessage(message);
-                pthread_cond_broadcast(&game_state.cond);
-            }
-        }
-        pthread_mutex_unlock(&game_state.mutex);
-
-        if (game_state.gameEnded) {
-            break;
-        }
+void leaveMatch(room_t *room) {
+    if (__atomic_sub_fetch(&room->live_clients, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
     }
-    
-    return NULL;
+    traceMutexLock(&room->game_state.mutex, "lock_wait game_state");
+    if (!room->game_state.gameEnded) {
+        LOG_INFO("All the players left room %d, the match ends", room->id);
+        __atomic_store_n(&room->game_state.gameEnded, 1, __ATOMIC_RELEASE);
+        journalAppend(&room->game_state.journal, JOURNAL_END, -1, -1, 0, 0, 0);
+        pthread_cond_broadcast(&room->game_state.cond);
+    }
+    pthread_mutex_unlock(&room->game_state.mutex);
 }
 
 /**
- * function sendMap
- * @brief Send the map to all clients
+ * function releaseClient
+ * @brief Remove the socket of a client from the broadcasts, then close it
  * 
- * @param client_socket 
- * @param num_clients
- * @param map 
+ * @param room 
+ * @param slot 
+ * @param sock (closed, its fd is set to -1)
  * @return void
  */
-void sendMap(socket_t client_sockets[], int num_clients, Map *map) {
-    int map_size[2] = {map->width, map->height};
-
-    for (int i = 0; i < num_clients; i++) {
-        printf("Sending map to client %d\n", client_sockets[i].fd);
-        if (client_sockets[i].fd != 0) {
-            ssize_t bytes_sent = send(client_sockets[i].fd, map_size, 2 * sizeof(int), 0);
-            if (bytes_sent != 2 * sizeof(int)) {
-                perror("Failed to send map dimensions");
-                continue;
-            }
+void releaseClient(room_t *room, int slot, socket_t *sock) {
+    if (sock->fd < 0) {
+        return;
+    }
+    traceMutexLock(&room->mutex, "lock_wait room");
+    if (room->client_sockets[slot].fd == sock->fd) {
+        room->client_sockets[slot].fd = 0;
+        room->client_sockets[slot].shm = NULL;
+    }
+    pthread_mutex_unlock(&room->mutex);
+    fermerSocket(sock);
+}
 
-            // Send the map cells
-            size_t total_bytes = map->width * map->height * sizeof(int);
-            size_t total_sent = 0;
-            while (total_sent < total_bytes) {
-                bytes_sent = send(client_sockets[i].fd, ((char*)map->cells) + total_sent, total_bytes - total_sent, 0);
-                if (bytes_sent < 0) {
-                    perror("Failed to send map cells");
-                    break;
-                }
-                total_sent += bytes_sent;
+/**
+ * function readRequest
+ * @brief Read the next message of a client, from its multishot reception or from its socket
+ * 
+ * @param stream (ring fd -1 to read the socket)
+ * @param sock 
+ * @param request (message read)
+ * @return int (type of the message, -1 on error or if the client is gone)
+ */
+int readRequest(uring_stream_t *stream, socket_t *sock, message_u *request) {
+    if (stream->ring.fd < 0) {
+        // During a handoff the thread parks between two requests: a request is never split between two servers
+        while (sock->shm == NULL && handoff_event >= 0) {
+            struct pollfd pfds[2] = {
+                { .fd = sock->fd, .events = POLLIN },
+                { .fd = handoff_event, .events = POLLIN }
+            };
+            int ready = poll(pfds, 2, -1);
+            if (ready > 0 && (pfds[1].revents & POLLIN)) {
+                parkThread();
+            } else if (ready >= 0 || errno != EINTR) {
+                break;
             }
-            // // Send the map dimensions
-            // send(client_sockets[i].fd, map_size, 2 * sizeof(int), 0);
-            
-            // // Send the map cells
-            // send(client_sockets[i].fd, map->cells, map->width * map->height * sizeof(int), 0);
         }
+        return recevoir(sock, request);
+    }
+    unsigned char header[FRAME_HEADER_SIZE];
+    unsigned char payload[MAX_FRAME_PAYLOAD];
+    msg_type_t type;
+    size_t len;
+    if (uringStreamRead(stream, header, FRAME_HEADER_SIZE) <= 0
+        || decodeHeader(header, &type, &len) < 0
+        || (len > 0 && uringStreamRead(stream, payload, len) <= 0)
+        || decodePayload(type, payload, len, request) < 0) {
+        return -1;
     }
+    return type;
 }
 
 /**
- * function main
- * @brief Main function to start the server
+ * function encodeText
+ * @brief Encode a text message as a frame
  * 
- * @return int
+ * @param frame (at least MAX_FRAME bytes)
+ * @param text 
+ * @return size_t (size of the frame)
  */
-int main() {
-    // Handle ctrl+c
-    signal(SIGINT, handle_sigint);
-
-    srand(time(NULL));  // Seed the random number generator
+size_t encodeText(unsigned char *frame, const char *text) {
+    message_t message;
+    size_t len = strnlen(text, MAX_BUFFER - 1);
+    memcpy(message.buffer, text, len);
+    message.buffer[len] = '\0';
+    return encodeMessage(frame, MSG_TEXT, &message);
+}
 
-    socket_t server_socket = creerSocketEcoute(ADDRESS_SERVER, PORT_SERVER);
-    if (server_socket.fd < 0) {
-        perror("Failed to create server socket");
-        return 1;
+/**
+ * function openRequestStream
+ * @brief Start the multishot reception of the requests of a client, when the io_uring backend is used
+ * 
+ * @param stream (its ring fd is -1 if the requests are read with lireSocket)
+ * @param sock 
+ * @return void
+ */
+void openRequestStream(uring_stream_t *stream, socket_t *sock) {
+    if (!use_uring || sock->shm != NULL || uringStreamOpen(stream, sock->fd) < 0) {
+        memset(stream, 0, sizeof(*stream));
+        stream->ring.fd = -1;
     }
+}
 
-    // Generate the map (shared between all clients)
-    Map *map = map_new(MAX_MAP_WIDTH, MAX_MAP_HEIGHT);
-    generateMap(map);
-
-    // Message to indicate the server is running and listening for clients
-    printf("Server running on %s:%d and listening for clients...\n", ADDRESS_SERVER, PORT_SERVER);
-
-    for (int i = 1; i <= MAX_CLIENTS; i++) {
-        client_sockets[i].fd = 0;
+/**
+ * function acceptClient
+ * @brief Wait for a client on the TCP socket of the worker or on the local (shared memory) socket and accept it
+ * 
+ * @param worker 
+ * @return socket_t (fd -1 on error)
+ */
+socket_t acceptClient(worker_t *worker) {
+    if (use_uring) {
+        return acceptClientUring(worker);
     }
-
-    int connected_clients = 0;
-
+    socket_t server_socket = worker->server_socket;
+    socket_t local_socket = worker->local_socket;
+    struct pollfd pfds[3] = {
+        { .fd = server_socket.fd, .events = POLLIN },
+        { .fd = local_socket.fd, .events = POLLIN },
+        { .fd = handoff_event, .events = POLLIN }
+    };
     while (1) {
-        socket_t client_socket = accepterClt(server_socket);
-        if (client_socket.fd < 0) {
-            perror("Failed to accept client connection");
-            continue;
-        }
-
-        // Find an empty slot in the client_sockets array and assign the client socket
-        int empty_slot = -1;
-        pthread_mutex_lock(&client_sockets_mutex);
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (client_sockets[i].fd == 0) {
-                empty_slot = i;
-                break;
+        if (poll(pfds, 3, -1) < 0) {
+            if (errno != EINTR) {
+                socket_t none = { .fd = -1 };
+                return none;
             }
+            continue;
         }
-        if (empty_slot != -1) {
-            client_sockets[empty_slot] = client_socket;
-            connected_clients++;
+        // A handoff stops the accepts, the listening sockets go to the next server
+        if (!(pfds[2].revents & POLLIN)) {
+            break;
         }
-        pthread_mutex_unlock(&client_sockets_mutex);
-
-        printf("Player connected (id=%d)\n", client_socket.fd);
+        parkThread();
+    }
+    if (pfds[1].revents & POLLIN) {
+        return shmAccept(local_socket);
+    }
+    return accepterClt(server_socket);
+}
 
-        // Send a welcome message to the client
-        envoyer(&client_socket, "\t💣Welcome to Bombo2I!💣\n", NULL);
+/**
+ * function acceptClientUring
+ * @brief Wait for a client with io_uring: a multishot accept on the TCP socket and a multishot poll
+ *        on the local socket stay armed, an accept costs one io_uring_enter
+ * 
+ * @param worker 
+ * @return socket_t (fd -1 on error)
+ */
+socket_t acceptClientUring(worker_t *worker) {
+    socket_t server_socket = worker->server_socket;
+    socket_t local_socket = worker->local_socket;
+    socket_t sock;
+    memset(&sock, 0, sizeof sock);
+    sock.fd = -1;
+    if (!worker->tcp_armed) {
+        worker->tcp_armed = uringAcceptMultishot(&worker->accept_ring, server_socket.fd, server_socket.fd) == 0;
+    }
+    if (!worker->local_armed && local_socket.fd >= 0) {
+        worker->local_armed = uringPollMultishot(&worker->accept_ring, local_socket.fd, local_socket.fd) == 0;
+    }
 
-        // Waiting for 2 clients to connect
-        if (connected_clients < 2) {
-            printf("Waiting for %d more players to connect...\n", 2 - connected_clients);
-            continue;
-        }
+    uring_cqe_t cqe;
+    if (uringWait(&worker->accept_ring, &cqe) < 0) {
+        return sock;
+    }
+    int from_tcp = cqe.user_data == (unsigned long long)server_socket.fd;
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        // The kernel stopped the request (error, overflow): it is armed again by the next call
+        if (from_tcp) worker->tcp_armed = 0; else worker->local_armed = 0;
+    }
+    if (cqe.res < 0) {
+        errno = -cqe.res;
+        return sock;
+    }
+    if (!from_tcp) {
+        return shmAccept(local_socket);
+    }
+    sock.fd = cqe.res;
+    sock.mode = SOCK_STREAM;
+    socklen_t len = sizeof sock.addrDst;
+    getpeername(sock.fd, (struct sockaddr *)&sock.addrDst, &len);
+    setLatencyOptions(&sock);
+    return sock;
+}
 
-        printf("\tAll players connected! Game starting...\n");
+/**
+ * function sendToClients
+ * @brief Send a frame to every connected client of a room (the mutex of the room must be held).
+ *        With io_uring, the sends to all the TCP clients are submitted by a single io_uring_enter
+ *        that does not wait for them: each send holds a reference on the frame until it completes.
+ * 
+ * @param room 
+ * @param frame (encoded once for all the clients)
+ * @return void
+ */
+void sendToClients(room_t *room, frame_buf_t *frame) {
+    int queued = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        queued += queueSend(room, i, frame);
+    }
+    if (queued > 0) {
+        submitSends(room);
+    }
+}
 
-        // Send the map to all clients when all clients are connected and initialize the players
-        if (connected_clients == MAX_CLIENTS) {
-            sendMap(client_sockets, MAX_CLIENTS, map);
+/**
+ * function sendToClient
+ * @brief Send a frame to one client of a room, in order with the broadcasts (the mutex of the room must be held)
+ * 
+ * @param room 
+ * @param slot 
+ * @param frame 
+ * @return void
+ */
+void sendToClient(room_t *room, int slot, frame_buf_t *frame) {
+    if (queueSend(room, slot, frame)) {
+        submitSends(room);
+    }
+}
 
-            // Create a thread for each client
-            pthread_t threads[MAX_CLIENTS];
-            for (int i = 0; i < MAX_CLIENTS; i++) {
-                client_data_t *client_data = malloc(sizeof(client_data_t));
-                client_data->client_socket = client_sockets[i];
-                client_data->map = map;
-                client_data->player = malloc(sizeof(Player));
-                initPlayer(client_data->player, map, &roles_assigned[BOMBER], &roles_assigned[MINE_CLEARER]);
-                pthread_create(&threads[i], NULL, handleClient, client_data);
-            }
+/**
+ * function queueSend
+ * @brief Queue the send of a frame to a client on the ring of the room, or send it right away.
+ *        A client has one send in flight at most, so that its frames arrive in order.
+ * 
+ * @param room 
+ * @param slot 
+ * @param frame 
+ * @return int (1 if the send is queued and must be submitted, 0 otherwise)
+ */
+int queueSend(room_t *room, int slot, frame_buf_t *frame) {
+    socket_t *sock = &room->client_sockets[slot];
+    if (sock->fd == 0) {
+        return 0;
+    }
+    int queued = 0;
+    TRACE_BEGIN(send_span, "send");
+    if (use_uring && sock->shm == NULL) {
+        flushClient(room, slot);
+        if (uringSend(&room->send_ring, sock->fd, frame->data, frame->len, slot) == 0) {
+            room->in_flight[slot] = frameRetain(frame);
+            queued = 1;
+        }
+    }
+    // A frame cut by a partial write would corrupt the stream of the client: the rest is sent too
+    if (!queued && envoyerOctets(sock, frame->data, frame->len) < 0) {
+        LOG_WARN("Send to client %d failed: %s", sock->fd, strerror(errno));
+    }
+    TRACE_END(send_span);
+    return queued;
+}
 
-            // Wait for all threads to finish
-            for (int i = 0; i < MAX_CLIENTS; i++) {
-                pthread_join(threads[i], NULL);
-                pthread_mutex_lock(&client_sockets_mutex);
-                client_sockets[i].fd = 0;
-                pthread_mutex_unlock(&client_sockets_mutex);
-                // Reset the roles_assigned counter
-                roles_assigned[i] = 0;
-            }
+/**
+ * function submitSends
+ * @brief Submit the queued sends of a room without waiting, then release the frames of the completed ones
+ * 
+ * @param room 
+ * @return void
+ */
+void submitSends(room_t *room) {
+    TRACE_BEGIN(submit_span, "io_uring_enter");
+    if (uringSubmit(&room->send_ring, 0) < 0) {
+        perror("io_uring_enter");
+    }
+    TRACE_END(submit_span);
+    uring_cqe_t cqe;
+    while (uringPeek(&room->send_ring, &cqe)) {
+        completeSend(room, &cqe);
+    }
+}
 
-            // Reset the connected_clients counter and the game state
-            connected_clients = 0;
-            game_state.bombCount = 0;
-            game_state.deactivatedBombCount = 0;
-            game_state.start_time = 0;
-            game_state.gameEnded = 0;
-            // Reset the map for the next game
-            generateMap(map);
+/**
+ * function flushClient
+ * @brief Wait for the send in flight to a client, if any (the mutex of the room must be held)
+ * 
+ * @param room 
+ * @param slot 
+ * @return void
+ */
+void flushClient(room_t *room, int slot) {
+    while (room->in_flight[slot] != NULL) {
+        uring_cqe_t cqe;
+        if (uringWait(&room->send_ring, &cqe) < 0) {
+            perror("io_uring_enter");
+            return;
         }
+        completeSend(room, &cqe);
     }
+}
 
-    return 0;
+/**
+ * function completeSend
+ * @brief Handle the completion of a send: its reference on the frame is released
+ * 
+ * @param room 
+ * @param cqe 
+ * @return void
+ */
+void completeSend(room_t *room, const uring_cqe_t *cqe) {
+    int slot = (int)cqe->user_data;
+    if (cqe->res < 0) {
+        LOG_WARN("Send to client %d failed: %s", room->client_sockets[slot].fd, strerror(-cqe->res));
+    }
+    frameRelease(room->in_flight[slot]);
+    room->in_flight[slot] = NULL;
 }
 
 /**
- * function map_new
- * @brief Create a new map
+ * function nowNs
+ * @brief Get the monotonic time in nanoseconds
  * 
- * @param width 
- * @param height 
- * @return Map*
+ * @return long long
  */
-Map* map_new(int width, int height) {
-    Map *map = malloc(sizeof(Map));
-    if (map == NULL) {
-        fprintf(stderr, "Could not allocate memory for map\n");
-        exit(1);
+long long nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * function inputPush
+ * @brief Add an input to the queue of a player (client thread only)
+ * 
+ * @param queue 
+ * @param input 
+ * @return int (0 on success, -1 if the queue is full)
+ */
+int inputPush(input_queue_t *queue, const input_t *input) {
+    unsigned int head = queue->head;
+    if (head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == INPUT_QUEUE_SIZE) {
+        return -1;
     }
-    map->width = width;
-    map->height = height;
-    for (int i = 0; i < width * height; i++) {
-        map->cells[i] = WALL;
+    queue->inputs[head & (INPUT_QUEUE_SIZE - 1)] = *input;
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * function inputPeek
+ * @brief Get the oldest input of the queue of a player, without taking it (tick only)
+ * 
+ * @param queue 
+ * @return input_t* (NULL if the queue is empty)
+ */
+input_t *inputPeek(input_queue_t *queue) {
+    unsigned int tail = queue->tail;
+    if (tail == __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) {
+        return NULL;
     }
-    return map;
+    return &queue->inputs[tail & (INPUT_QUEUE_SIZE - 1)];
+}
+
+/**
+ * function inputPop
+ * @brief Remove the oldest input of the queue of a player (tick only)
+ * 
+ * @param queue 
+ * @return void
+ */
+void inputPop(input_queue_t *queue) {
+    __atomic_store_n(&queue->tail, queue->tail + 1, __ATOMIC_RELEASE);
 }
 
 /**
- * function generateMap
- * @brief Generate a map with multiple paths (and on some paths no walls)
+ * function roomTick
+ * @brief Step of the simulation of a room: the inputs of all the players are applied in the order of
+ *        their arrival, then the updates they produced are sent to the clients together
  * 
- * @param map 
+ * @param room 
  * @return void
  */
-void generateMap(Map *map) {
-    // Initialize the map with walls
-    for (int y = 0; y < map->height; y++) {
-        for (int x = 0; x < map->width; x++) {
-            map->cells[y * map->width + x] = WALL;
+void roomTick(room_t *room) {
+    traceMutexLock(&room->game_state.mutex, "lock_wait game_state");
+    TRACE_BEGIN(tick_span, "tick");
+    // The bots queue their requests like the client threads, before the inputs are applied
+    botsTick(room);
+    while (!room->game_state.gameEnded) {
+        int slot = -1;
+        input_t *oldest = NULL;
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            // A player on cooldown keeps its requests for the next ticks
+            input_t *input = room->entities.players.cooldown[i] > 0 ? NULL : inputPeek(&room->inputs[i]);
+            if (input != NULL && (oldest == NULL || input->time_ns < oldest->time_ns)) {
+                oldest = input;
+                slot = i;
+            }
+        }
+        if (oldest == NULL) {
+            break;
         }
+        applyInput(room, slot, oldest->point);
+        inputPop(&room->inputs[slot]);
     }
 
-    // Create multiple paths by carving out a grid-like pattern
-    for (int y = 1; y < map->height; y += 2) {
-        for (int x = 1; x < map->width; x += 2) {
-            map->cells[y * map->width + x] = PATH;
-            if (x + 1 < map->width) {
-                map->cells[y * map->width + x + 1] = PATH; // carve right
-            }
-            if (y + 1 < map->height) {
-                map->cells[(y + 1) * map->width + x] = PATH; // carve down
-            }
+    // The countdown of the Bomber: a bomb still active when its timer expires explodes
+    if (entitiesTick(&room->entities) > 0 && detonateBombs(room) > 0 && !room->game_state.gameEnded) {
+        __atomic_store_n(&room->game_state.gameEnded, 1, __ATOMIC_RELEASE);
+        journalAppend(&room->game_state.journal, JOURNAL_END, -1, BOMBER, 0, 0, 0);
+        emitText(room, "Game ended: Victory for the Bomber!\n");
+        pthread_cond_broadcast(&room->game_state.cond);
+    }
+
+    traceMutexLock(&room->mutex, "lock_wait room");
+    flushUpdate(room);
+    queueActors(room);
+    pthread_mutex_unlock(&room->mutex);
+
+    // Hint for the Mine clearer after a deactivation, once the update is sent: how far the next active bomb is
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        int nearest;
+        if (room->hint_pending[i] && !room->game_state.gameEnded
+            && entityNearestBombs(&room->entities, room->entities.players.x[i], room->entities.players.y[i], BOMB, 1, &nearest) == 1) {
+            char hint[64];
+            int moves = abs(room->entities.bombs.x[nearest] - room->entities.players.x[i]) + abs(room->entities.bombs.y[nearest] - room->entities.players.y[i]);
+            snprintf(hint, sizeof(hint), "The nearest bomb is %d cells away\n", moves);
+            sendText(room, i, hint);
+        }
+        room->hint_pending[i] = 0;
+    }
+    TRACE_END(tick_span);
+    pthread_mutex_unlock(&room->game_state.mutex);
+}
+
+/**
+ * function applyInput
+ * @brief Apply the request of a player to the game (the mutex of the game must be held)
+ * 
+ * @param room 
+ * @param slot 
+ * @param point (request, where the client reports its player)
+ * @return void
+ */
+void applyInput(room_t *room, int slot, Point point) {
+    // The request is applied where the server has the player. The client may report the next cell,
+    // its move is still on the way: the move is made, a cell further away is refused
+    traceMutexLock(&room->mutex, "lock_wait room");
+    int moves = abs(point.x - room->entities.players.x[slot]) + abs(point.y - room->entities.players.y[slot]);
+    if (moves > 1) {
+        pthread_mutex_unlock(&room->mutex);
+        sendText(room, slot, "Cannot place point: You are not on this cell.\n");
+        return;
+    }
+    if (moves == 1) {
+        if (!movePlayerTo(room, slot, point)) {
+            pthread_mutex_unlock(&room->mutex);
+            sendText(room, slot, "Cannot place point: The cell is not accessible.\n");
+            return;
         }
     }
+    Player actor = entityPlayer(&room->entities, slot); // The channel thread moves the player meanwhile
+    pthread_mutex_unlock(&room->mutex);
+    room->entities.players.cooldown[slot] = BOMB_COOLDOWN_TICKS;
+    int requested = point.state;
+    // Handle the request
+    switch (point.state) {
+        case 2: {
+            // Only the Bomber places bombs, whatever role the client claims
+            if (actor.role != BOMBER) {
+                sendText(room, slot, "Only the Bomber can place a bomb\n");
+                break;
+            }
+            // A cell holds one bomb
+            if (entityFindBomb(&room->entities, point.x, point.y) != BOMB_NONE) {
+                sendText(room, slot, "There is already a bomb here\n");
+                break;
+            }
+            if (!takeAction(room, slot, &room->sessions[slot].bombs)) {
+                break;
+            }
+            TRACE_BEGIN(set_span, "setSpecialPoint");
+            int placed = applyRequest(room->map, &actor, BOMB, &room->game_state.bombCount, &room->game_state.deactivatedBombCount);
+            TRACE_END(set_span);
+            if (placed == BOMB) {
+                point.state = BOMB;
+                entityAddBomb(&room->entities, point.x, point.y);
+                journalAppend(&room->game_state.journal, JOURNAL_ACTION, slot, point.x, point.y, requested, BOMB);
 
-    // Create open areas without walls
-    for (int y = 3; y < map->height; y += 4) {
-        for (int x = 3; x < map->width; x += 4) {
-            map->cells[y * map->width + x] = PATH;
-            if (x + 1 < map->width) {
-                map->cells[y * map->width + x + 1] = PATH; // open right
+                if (room->game_state.bombCount < 5) {
+                    emitText(room, "A bomb has been placed by the Bomber!\n");
+                } else if (room->game_state.bombCount == BOMB_COUNT) {
+                    // The countdown starts, the timers of the bombs run down with the ticks
+                    emitText(room, "All bombs are placed. The countdown starts now! 30 seconds left!\n");
+                    room->game_state.start_time = time(NULL);
+                    entityArmBombs(&room->entities, COUNTDOWN_TICKS);
+                }
+                emitUpdate(room, MSG_POINT, &point);
+            } else {
+                sendText(room, slot, "Bomb limit reached\n");
             }
-            if (y + 1 < map->height) {
-                map->cells[(y + 1) * map->width + x] = PATH; // open down
+            LOG_DEBUG("Bomb count: %d", room->game_state.bombCount);
+            break;
+        }
+        case 3: {
+            if (actor.role != MINE_CLEARER) {
+                sendText(room, slot, "Only the Mine clearer can deactivate a bomb\n");
+                break;
             }
-            if (x - 1 > 0) {
-                map->cells[y * map->width + x - 1] = PATH; // open left
+            // Only an active bomb can be deactivated, whatever the client displays
+            int bomb = entityFindBomb(&room->entities, point.x, point.y);
+            if (bomb == BOMB_NONE || room->entities.bombs.state[bomb] != BOMB) {
+                sendText(room, slot, "There is no bomb to deactivate here\n");
+                break;
             }
-            if (y - 1 > 0) {
-                map->cells[(y - 1) * map->width + x] = PATH; // open up
+            if (!takeAction(room, slot, &room->sessions[slot].deactivations)) {
+                break;
             }
+            TRACE_BEGIN(set_span, "setSpecialPoint");
+            point.state = applyRequest(room->map, &actor, DEACTIVATED_BOMB, &room->game_state.bombCount, &room->game_state.deactivatedBombCount);
+            TRACE_END(set_span);
+            room->entities.bombs.state[bomb] = DEACTIVATED_BOMB;
+            room->entities.bombs.timer[bomb] = BOMB_TIMER_NONE;
+            journalAppend(&room->game_state.journal, JOURNAL_ACTION, slot, point.x, point.y, requested, point.state);
+            emitUpdate(room, MSG_POINT, &point);
+            emitText(room, "A bomb has been deactivated by the Mine clearer!\n");
+            room->hint_pending[slot] = 1;
+            break;
         }
+        default:
+            fprintf(stderr, "Unknown request: %d\n", point.state);
+            break;
     }
 
-    // Add some random obstacles 
-    for (int y = 1; y < map->height; y++) {
-        for (int x = 1; x < map->width; x++) {
-            if (map->cells[y * map->width + x] == PATH && rand() % 100 < 4) {
-                map->cells[y * map->width + x] = WALL;
-            }
+    if (!room->game_state.gameEnded) {
+        if (room->game_state.deactivatedBombCount == 5 && room->game_state.start_time != 0 && time(NULL) - room->game_state.start_time < 60) {
+            __atomic_store_n(&room->game_state.gameEnded, 1, __ATOMIC_RELEASE);
+            journalAppend(&room->game_state.journal, JOURNAL_END, -1, MINE_CLEARER, 0, 0, 0);
+            emitText(room, "Game ended: Victory for the Mine clearer!\n");
+            pthread_cond_broadcast(&room->game_state.cond);
         }
     }
 }
 
 /**
- * function broadcastPoint
- * @brief Broadcast a point to all connected clients except one
- *  
- * @param point 
- * @return void
+ * function takeAction
+ * @brief Take a token of the delay of an action, once the tick accepted the request: a refused request costs none.
+ *        Each action has its own delay, as the client enforces it (only a modified client meets them)
+ * 
+ * @param room 
+ * @param slot 
+ * @param bucket (bombs or deactivations of the session of the player)
+ * @return int (1 if the action is made, 0 if the player must wait, it is told how long)
  */
-void broadcastPoint(Point point) {
-    pthread_mutex_lock(&client_sockets_mutex);
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (client_sockets[i].fd != 0) {
-            printf("Broadcasting point (%d, %d) with state %d to client %d\n", point.x, point.y, point.state, client_sockets[i].fd);
-            send(client_sockets[i].fd, &point, sizeof(Point), 0);
-        }
+int takeAction(room_t *room, int slot, token_bucket_t *bucket) {
+    long long now = nowNs();
+    if (isBot(room, slot) || bucketTake(bucket, now)) {
+        return 1;
     }
-    pthread_mutex_unlock(&client_sockets_mutex);
+    char text[64];
+    snprintf(text, sizeof text, "Wait %lld s before the next request\n", (bucketWait(bucket, now) + 999999999LL) / 1000000000LL);
+    sendText(room, slot, text);
+    return 0;
 }
 
 /**
- * function broadcastMessage
- * @brief Broadcast a message to all connected clients
+ * function detonateBombs
+ * @brief Explode the bombs whose timer expired, and the bombs their blasts reach. The destroyed cells
+ *        become paths and are sent as one update (the mutex of the game must be held).
  * 
- * @param message 
- * @return void
+ * @param room 
+ * @return int (number of bombs that exploded)
  */
-void broadcastMessage(const char *message) {
-    for (int i = 0; i < MAX_CLIENTS; ++i) {
-        if (client_sockets[i].fd != 0) {
-            if (send(client_sockets[i].fd, message, strlen(message), 0) < 0) {
-                perror("send");
-            }
+int detonateBombs(room_t *room) {
+    TRACE_BEGIN(blast_span, "blast");
+    bomb_store_t *bombs = &room->entities.bombs;
+    row_mask_t detonated[MAX_MAP_HEIGHT] = { 0 };
+    row_mask_t fire[MAX_MAP_HEIGHT];
+    for (int i = 0; i < bombs->count; i++) {
+        if (bombs->state[i] == BOMB && bombs->timer[i] == 0) {
+            detonated[bombs->y[i]] |= (row_mask_t)1 << bombs->x[i];
+        }
+    }
+    blast_field_t field;
+    blastFieldInit(&field, room->map);
+    int count = blastChain(&field, detonated, BLAST_RADIUS, fire);
+
+    // The bombs in the fire are gone, exploded or destroyed (a removal moves the last bomb, already seen)
+    for (int i = bombs->count - 1; i >= 0; i--) {
+        if (fire[bombs->y[i]] >> bombs->x[i] & 1) {
+            entityRemoveBomb(&room->entities, i);
         }
     }
+    blast_t delta;
+    int cells = blastDelta(fire, room->map->height, &delta);
+    applyBlast(room->map, &delta);
+    if (cells > 0) {
+        emitUpdate(room, MSG_BLAST, &delta);
+    }
+    LOG_DEBUG("%d bombs exploded in room %d, %d cells destroyed", count, room->id, cells);
+    TRACE_END(blast_span);
+    return count;
 }
 
-// --- Player functions ---
+/**
+ * function sendText
+ * @brief Send a text to one player only, at once
+ * 
+ * @param room 
+ * @param slot 
+ * @param text 
+ * @return void
+ */
+void sendText(room_t *room, int slot, const char *text) {
+    traceMutexLock(&room->mutex, "lock_wait room");
+    frame_buf_t *frame = poolGet(&room->pool);
+    if (frame != NULL) {
+        frame->len = encodeText(frame->data, text);
+        sendToClient(room, slot, frame);
+        frameRelease(frame);
+    }
+    pthread_mutex_unlock(&room->mutex);
+}
 
 /**
- * function initPlayer
- * @brief Initialize the player position and role
+ * function emitUpdate
+ * @brief Add a message to the update of the current tick, sent to all the clients at the end of the tick
  * 
- * @param client_socket
- * @param player 
- * @param map 
- * @param player_id
- * @return void
- */
-void initPlayer(Player *player, Map *map, int *bomber_assigned, int *mine_clearer_assigned) {
-    // Assign roles based on counters
-    if (*bomber_assigned == 0) {
-        player->role = BOMBER;
-        player->x = 1; // Initial position for BOMBER
-        player->y = 1;
-        (*bomber_assigned)++;
-    } else if (*mine_clearer_assigned == 0) {
-        player->role = MINE_CLEARER;
-        player->x = map->width - 1; // Initial position for MINE_CLEARER
-        player->y = map->height - 1;
-        (*mine_clearer_assigned)++;
-    }
-
-    // Ensure the player is not placed on a wall
-    while (map->cells[player->y * map->width + player->x] == WALL) {
-        if (player->role == BOMBER) {
-            player->x++;
-            if (player->x >= map->width) {
-                player->x = 1;
-                player->y++;
-            }
-        } else {
-            player->x--;
-            if (player->x < 0) {
-                player->x = map->width - 2;
-                player->y--;
-            }
-        }
+ * @param room 
+ * @param type 
+ * @param quoi 
+ * @return void
+ */
+void emitUpdate(room_t *room, msg_type_t type, const void *quoi) {
+    traceMutexLock(&room->mutex, "lock_wait room");
+    if (room->update != NULL && MAX_FRAME - room->update->len < messageBound(type, quoi)) {
+        flushUpdate(room);
+    }
+    if (room->update == NULL) {
+        room->update = poolGet(&room->pool);
     }
+    if (room->update != NULL) {
+        room->update->len += encodeMessage(room->update->data + room->update->len, type, quoi);
+    }
+    pthread_mutex_unlock(&room->mutex);
+}
 
-    printf("Player initialized at position (%d, %d) with role %s\n", player->x, player->y, player->role == BOMBER ? "BOMBER" : "MINE_CLEARER");
+/**
+ * function emitText
+ * @brief Add a text to the update of the current tick
+ * 
+ * @param room 
+ * @param text 
+ * @return void
+ */
+void emitText(room_t *room, const char *text) {
+    message_t message;
+    size_t len = strnlen(text, MAX_BUFFER - 1);
+    memcpy(message.buffer, text, len);
+    message.buffer[len] = '\0';
+    emitUpdate(room, MSG_TEXT, &message);
 }
 
 /**
- * function setSpecialPoint
- * @brief Set a special point on the map
+ * function flushUpdate
+ * @brief Send the update of the current tick to all the clients: its frames go out together (the mutex of the room must be held)
  * 
- * @param map 
- * @param x 
- * @param y 
- * @param state 
+ * @param room 
  * @return void
  */
-void setSpecialPoint(Map *map, int x, int y, int state) {
-    if (x >= 0 && x < map->width && y >= 0 && y < map->height) {
-        map->cells[y * map->width + x] = state;
+void flushUpdate(room_t *room) {
+    if (room->update == NULL) {
+        return;
+    }
+    sendToClients(room, room->update);
+    queueSpectators(room, room->update);
+    frameRelease(room->update);
+    room->update = NULL;
+}
+
+/**
+ * function main
+ * @brief Main function to start the server
+ * 
+ * @return int
+ */
+int main() {
+    // SIGINT is blocked before any thread starts, all of them inherit the mask: signalThread waits for it
+    static sigset_t shutdown_signals;
+    sigemptyset(&shutdown_signals);
+    sigaddset(&shutdown_signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &shutdown_signals, NULL);
+
+    // Start the background log writer
+    logInit(NULL);
+
+    // Span tracing, enabled when BOMBO2I_TRACE gives the output file
+    traceInit(NULL);
+    traceThreadName("main");
+
+    // Handle ctrl+c, a dropped client must not kill the server
+    pthread_t signal_thread;
+    if (pthread_create(&signal_thread, NULL, signalThread, &shutdown_signals) != 0) {
+        LOG_WARN("No signal thread, ctrl+c stops the server without flushing the logs");
+        pthread_sigmask(SIG_UNBLOCK, &shutdown_signals, NULL);
+    } else {
+        pthread_detach(signal_thread);
     }
-}
\ No newline at end of file
+    signal(SIGUSR1, handle_sigusr1);
+    signal(SIGPIPE, SIG_IGN);
+
+    const char *address = getenv("BOMBO2I_LISTEN");
+    if (address == NULL || address[0] == '\0') {
+        address = ADDRESS_SERVER;
+    }
+
+    // One worker per CPU by default (BOMBO2I_WORKERS), pinned on it with BOMBO2I_PIN=1
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) {
+        cpus = 1;
+    }
+    const char *env = getenv("BOMBO2I_WORKERS");
+    worker_count = env != NULL && atoi(env) > 0 ? atoi(env) : cpus;
+    if (worker_count > MAX_WORKERS) {
+        worker_count = MAX_WORKERS;
+    }
+    env = getenv("BOMBO2I_PIN");
+    int pin = env != NULL && strcmp(env, "1") == 0;
+
+    // Rate limits of the clients, and the descriptors left to the new sessions
+    env = getenv("BOMBO2I_RATE_LIMIT");
+    rate_limit = env == NULL || strcmp(env, "0") != 0;
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur != RLIM_INFINITY && files.rlim_cur < (rlim_t)(1 << 30)) {
+        admission.fd_budget = (int)files.rlim_cur - FD_RESERVE;
+    }
+
+    // Hot restart: with BOMBO2I_TAKEOVER=1 the listening sockets and the matches come from the running server
+    const char *handoff_path = getenv("BOMBO2I_HANDOFF");
+    if (handoff_path == NULL) {
+        handoff_path = HANDOFF_PATH;
+    }
+    int takeover = -1;
+    env = getenv("BOMBO2I_TAKEOVER");
+    if (env != NULL && strcmp(env, "1") == 0) {
+        takeover = handoffConnect(handoff_path);
+        if (takeover < 0 || takeListeners(takeover) < 0) {
+            LOG_ERROR("Could not take the running server over on %s", handoff_path);
+            return 1;
+        }
+    }
+
+    // Every worker has its own listening socket on the port, the kernel spreads the connections between them
+    for (int w = 0; w < worker_count; w++) {
+        workers[w].id = w;
+        workers[w].cpu = pin ? w % cpus : -1;
+        workers[w].accept_ring.fd = -1;
+        workers[w].rooms = &rooms[w * ROOMS_PER_WORKER];
+        if (takeover >= 0) {
+            continue;
+        }
+        workers[w].local_socket.fd = -1;
+        workers[w].server_socket = creerSocketEcoute((char *)address, PORT_SERVER);
+        if (workers[w].server_socket.fd < 0) {
+            if (w == 0) {
+                perror("Failed to create server socket");
+                return 1;
+            }
+            LOG_WARN("Only %d workers could listen on the port", w);
+            worker_count = w;
+            break;
+        }
+    }
+
+    // Clients on the same host connect through shared memory (BOMBO2I_SHM gives the socket path, empty to disable)
+    const char *local_path = getenv("BOMBO2I_SHM");
+    if (local_path == NULL) {
+        local_path = SHM_SOCKET_PATH;
+    }
+    if (local_path[0] != '\0' && takeover < 0) {
+        workers[0].local_socket = shmListen(local_path);
+        if (workers[0].local_socket.fd >= 0) {
+            LOG_INFO("Local clients accepted on %s", local_path);
+        }
+    }
+
+    // Maps of the matches, drawn in turn from the generators of BOMBO2I_MAPS (grid by default)
+    mapPoolInit(&map_pool, getenv("BOMBO2I_MAPS"));
+    if (mapPoolStart(&map_pool) != 0) {
+        LOG_WARN("The maps are generated when the matches start");
+    }
+
+    // Rooms of the workers, each with its map (the session tokens carry the index of their room)
+    for (int r = 0; r < worker_count * ROOMS_PER_WORKER; r++) {
+        room_t *room = &rooms[r];
+        room->id = r;
+        room->worker = &workers[r / ROOMS_PER_WORKER];
+        pthread_mutex_init(&room->mutex, NULL);
+        pthread_cond_init(&room->resume_cond, NULL);
+        pthread_mutex_init(&room->game_state.mutex, NULL);
+        pthread_cond_init(&room->game_state.cond, NULL);
+        room->game_state.journal.fd = -1;
+        room->send_ring.fd = -1;
+        poolInit(&room->pool);
+        room->map = map_new(MAX_MAP_WIDTH, MAX_MAP_HEIGHT);
+        prepareMap(room);
+    }
+
+    // I/O backend: blocking sockets by default, io_uring with BOMBO2I_IO=uring when the kernel allows it
+    const char *io = getenv("BOMBO2I_IO");
+    if (io != NULL && strcmp(io, "uring") == 0) {
+        use_uring = 1;
+        for (int w = 0; w < worker_count && use_uring; w++) {
+            use_uring = uringInit(&workers[w].accept_ring, URING_ENTRIES, 0) == 0;
+        }
+        for (int r = 0; r < worker_count * ROOMS_PER_WORKER && use_uring; r++) {
+            use_uring = uringInit(&rooms[r].send_ring, URING_ENTRIES, 0) == 0;
+        }
+        if (use_uring) {
+            LOG_INFO("I/O backend: io_uring");
+        } else {
+            for (int w = 0; w < worker_count; w++) {
+                uringClose(&workers[w].accept_ring);
+            }
+            for (int r = 0; r < worker_count * ROOMS_PER_WORKER; r++) {
+                uringClose(&rooms[r].send_ring);
+            }
+            LOG_WARN("io_uring is not available, blocking sockets are used");
+        }
+    }
+
+    // UDP channel next to the TCP connections, for the positions of the players
+    // The threads reading the sockets are counted as they are created, a handoff waits for all of them
+    if (takeover < 0) {
+        channel_socket = channelSocket(address, PORT_SERVER);
+    }
+    pthread_t channel_thread;
+    handoffCount(1);
+    if (channel_socket.fd < 0 || pthread_create(&channel_thread, NULL, channelThread, NULL) != 0) {
+        LOG_WARN("No UDP channel, the players won't see each other");
+        handoffCount(-1);
+    } else {
+        pthread_detach(channel_thread);
+    }
+
+    // Bots for a player waiting alone (after BOMBO2I_BOT_WAIT seconds), and matches of bots only
+    env = getenv("BOMBO2I_BOT_WAIT");
+    if (env != NULL && env[0] != '\0') {
+        bot_wait_ns = atoll(env) * 1000000000LL;
+    }
+    env = getenv("BOMBO2I_BOT_MATCHES");
+    bot_matches = env != NULL ? atoi(env) : 0;
+    if (bot_matches > 0) {
+        pthread_t bot_thread;
+        handoffCount(1);
+        if (pthread_create(&bot_thread, NULL, botThread, NULL) != 0) {
+            LOG_WARN("No bot thread, the matches wait for their players");
+            handoffCount(-1);
+        } else {
+            pthread_detach(bot_thread);
+        }
+    }
+
+    // The players are paired by a thread of their own, the workers only accept them
+    sem_init(&matchmaker.wake, 0, 0);
+    pthread_t matchmaker_thread;
+    handoffCount(1);
+    if (pthread_create(&matchmaker_thread, NULL, matchmakerThread, NULL) != 0) {
+        perror("Failed to create matchmaker thread");
+        return 1;
+    }
+    pthread_detach(matchmaker_thread);
+
+    pthread_t spectator_thread;
+    handoffCount(1);
+    if (pthread_create(&spectator_thread, NULL, spectatorThread, NULL) != 0) {
+        LOG_WARN("No spectator thread, the spectators won't get the updates");
+        handoffCount(-1);
+    } else {
+        pthread_detach(spectator_thread);
+    }
+
+    // Each worker hands the connections it accepts to its handshake thread, which reads their hellos
+    for (int w = 0; w < worker_count; w++) {
+        handshake_t *handshake = &workers[w].handshake;
+        pthread_mutex_init(&handshake->mutex, NULL);
+        handshake->event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        pthread_t handshake_thread;
+        handoffCount(1);
+        if (handshake->event < 0 || pthread_create(&handshake_thread, NULL, handshakeThread, &workers[w]) != 0) {
+            perror("Failed to create handshake thread");
+            return 1;
+        }
+        pthread_detach(handshake_thread);
+    }
+
+    // The matches of the previous server go on here, it exits once they run
+    if (takeover >= 0) {
+        int taken = takeMatches(takeover);
+        if (taken < 0) {
+            LOG_ERROR("The handoff was interrupted, the previous server keeps running");
+            return 1;
+        }
+        handoff_type_t done = HANDOFF_DONE;
+        handoffSend(takeover, &done, sizeof done, NULL, 0);
+        close(takeover);
+        LOG_INFO("Took over %d matches from the previous server", taken);
+    }
+    // An empty BOMBO2I_HANDOFF disables the hot restart
+    if (handoff_path[0] != '\0') {
+        startHandoff(handoff_path);
+    }
+
+    // Message to indicate the server is running and listening for clients
+    LOG_INFO("Server running on %s:%d with %d workers and listening for clients...", address, PORT_SERVER, worker_count);
+
+    // The main thread is the worker 0
+    handoffCount(worker_count);
+    for (int w = 1; w < worker_count; w++) {
+        pthread_t worker_thread;
+        if (pthread_create(&worker_thread, NULL, workerThread, &workers[w]) != 0) {
+            perror("Failed to create worker thread");
+            handoffCount(-1);
+            continue;
+        }
+        pthread_detach(worker_thread);
+    }
+    workerThread(&workers[0]);
+
+    traceDump();
+    logShutdown();
+    return 0;
+}
+
+/**
+ * function workerThread
+ * @brief Accept the clients of a worker and hand them to its handshake thread, the worker never waits for a client.
+ *        The matches run in their own thread and the matchmaker pairs the players: the worker keeps accepting
+ * 
+ * @param arg (worker_t *)
+ * @return void* 
+ */
+void *workerThread(void *arg) {
+    worker_t *worker = (worker_t *)arg;
+    traceThreadName("worker");
+    pinWorker(worker);
+
+    while (1) {
+        TRACE_BEGIN(accept_span, "accept");
+        socket_t client_socket = acceptClient(worker);
+        TRACE_END(accept_span);
+        if (client_socket.fd < 0) {
+            perror("Failed to accept client connection");
+            continue;
+        }
+        if (handshakeAdd(worker, &client_socket) < 0) {
+            LOG_WARN("Client %d refused, too many connections wait for their hello", client_socket.fd);
+            fermerSocket(&client_socket);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * function pinWorker
+ * @brief Pin the calling thread on the CPU of a worker (BOMBO2I_PIN=1)
+ * 
+ * @param worker 
+ * @return void
+ */
+void pinWorker(worker_t *worker) {
+    if (worker->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(worker->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof set, &set) != 0) {
+            LOG_WARN("Worker %d could not be pinned on CPU %d", worker->id, worker->cpu);
+        }
+    }
+}
+
+/**
+ * function handshakeAdd
+ * @brief Give a new connection to the handshake thread of its worker
+ * 
+ * @param worker 
+ * @param sock 
+ * @return int (0 on success, -1 if too many connections wait for their hello)
+ */
+int handshakeAdd(worker_t *worker, socket_t *sock) {
+    handshake_t *handshake = &worker->handshake;
+    pthread_mutex_lock(&handshake->mutex);
+    if (handshake->count == MAX_HANDSHAKES) {
+        pthread_mutex_unlock(&handshake->mutex);
+        return -1;
+    }
+    handshake->incoming[handshake->incoming_count++] = *sock;
+    handshake->count++;
+    pthread_mutex_unlock(&handshake->mutex);
+    uint64_t one = 1;
+    if (write(handshake->event, &one, sizeof one) < 0) {
+        LOG_WARN("Could not wake the handshake thread of worker %d", worker->id);
+    }
+    return 0;
+}
+
+/**
+ * function handshakeThread
+ * @brief Read the hellos of the connections of a worker as their bytes arrive, in one poll set:
+ *        a client slow to send its hello delays no other. A hello not complete in time closes its connection.
+ * 
+ * @param arg (worker_t *)
+ * @return void*
+ */
+void *handshakeThread(void *arg) {
+    worker_t *worker = (worker_t *)arg;
+    handshake_t *handshake = &worker->handshake;
+    traceThreadName("handshake");
+    pinWorker(worker);
+    struct pollfd pfds[2 + MAX_HANDSHAKES];
+
+    while (1) {
+        // Connections accepted since the last round
+        long long now = nowNs();
+        pthread_mutex_lock(&handshake->mutex);
+        for (int i = 0; i < handshake->incoming_count; i++) {
+            int p = handshake->pending_count++;
+            handshake->pending[p] = handshake->incoming[i];
+            memset(&handshake->readers[p], 0, sizeof(hello_reader_t));
+            handshake->deadlines[p] = now + HELLO_TIMEOUT_MS * 1000000LL;
+            handshake->ready[p] = 1;
+        }
+        handshake->incoming_count = 0;
+        pthread_mutex_unlock(&handshake->mutex);
+
+        // Read what arrived of each hello: a complete one is answered, a late one closed
+        int timeout = -1;
+        for (int p = 0; p < handshake->pending_count;) {
+            session_hello_t hello;
+            int sts = handshake->ready[p] ? readHello(&handshake->pending[p], &handshake->readers[p], &hello) : 0;
+            handshake->ready[p] = 0;
+            if (sts == 0 && now < handshake->deadlines[p]) {
+                int left = (int)((handshake->deadlines[p] - now) / 1000000) + 1;
+                if (timeout < 0 || left < timeout) {
+                    timeout = left;
+                }
+                p++;
+                continue;
+            }
+
+            socket_t client_socket = handshake->pending[p];
+            int last = --handshake->pending_count;
+            handshake->pending[p] = handshake->pending[last];
+            handshake->readers[p] = handshake->readers[last];
+            handshake->deadlines[p] = handshake->deadlines[last];
+            handshake->ready[p] = handshake->ready[last];
+            pthread_mutex_lock(&handshake->mutex);
+            handshake->count--;
+            pthread_mutex_unlock(&handshake->mutex);
+            if (sts > 0) {
+                TRACE_BEGIN(hello_span, "hello");
+                admitClient(worker, &client_socket, &hello);
+                TRACE_END(hello_span);
+            } else {
+                LOG_WARN("Client %d sent no valid hello, connection closed", client_socket.fd);
+                fermerSocket(&client_socket);
+            }
+        }
+
+        pfds[0] = (struct pollfd){ .fd = handshake->event, .events = POLLIN };
+        pfds[1] = (struct pollfd){ .fd = handoff_event, .events = POLLIN };
+        for (int p = 0; p < handshake->pending_count; p++) {
+            pfds[2 + p] = (struct pollfd){ .fd = socketPollFd(&handshake->pending[p]), .events = POLLIN };
+        }
+        if (poll(pfds, 2 + handshake->pending_count, timeout) < 0) {
+            continue;
+        }
+        for (int p = 0; p < handshake->pending_count; p++) {
+            handshake->ready[p] = pfds[2 + p].revents != 0;
+        }
+        if (pfds[0].revents & POLLIN) {
+            uint64_t value;
+            if (read(handshake->event, &value, sizeof value) < 0) {
+                LOG_WARN("Could not reset the handshake event of worker %d", worker->id);
+            }
+        }
+        // A handoff: the connections without a session stay here, they are closed if the next server takes over
+        if (pfds[1].revents & POLLIN) {
+            parkThread();
+        }
+    }
+    return NULL;
+}
+
+/**
+ * function admitClient
+ * @brief Answer the hello of a new connection: resume of a session, spectator or matchmaking
+ * 
+ * @param worker (worker that accepted the connection, its rooms are preferred for the match)
+ * @param client_socket 
+ * @param hello 
+ * @return void
+ */
+void admitClient(worker_t *worker, socket_t *client_socket, const session_hello_t *hello) {
+    // A spectator watches a running match, it takes no slot
+    if (hello->flags & SESSION_SPECTATE) {
+        if (admissionFull(client_socket) || addSpectator(client_socket, hello->token) < 0) {
+            LOG_INFO("Client %d has no match to watch", client_socket->fd);
+            sendHello(client_socket, 0, SESSION_FULL);
+            fermerSocket(client_socket);
+        }
+        return;
+    }
+    if (hello->token != 0) {
+        // A token unknown or no longer resumable is answered with no token
+        if (resumeSession(client_socket, hello->token) < 0) {
+            LOG_INFO("Client %d can't resume its session", client_socket->fd);
+            sendHello(client_socket, 0, 0);
+            fermerSocket(client_socket);
+        }
+        return;
+    }
+
+    // The matchmaker places the new player
+    if (admissionFull(client_socket)) {
+        LOG_WARN("Player %d refused, the server is near its descriptor limit", client_socket->fd);
+        sendHello(client_socket, 0, SESSION_FULL);
+        fermerSocket(client_socket);
+    } else if (queuePlayer(worker, client_socket, hello->flags) < 0) {
+        LOG_INFO("Player %d refused, too many players are waiting", client_socket->fd);
+        sendHello(client_socket, 0, SESSION_FULL);
+        fermerSocket(client_socket);
+    }
+}
+
+// --- Admission control and rate limits ---
+
+/**
+ * function sessionLimits
+ * @brief Give a new session its limits: positions on the UDP channel, bombs and deactivations
+ * 
+ * @param session 
+ * @param now 
+ * @return void
+ */
+void sessionLimits(session_slot_t *session, long long now) {
+    bucketInit(&session->positions, rate_limit ? POSITION_RATE_MS * 1000000LL : 0, POSITION_BURST, now);
+    bucketInit(&session->bombs, rate_limit ? BOMB_RATE_MS * 1000000LL : 0, ACTION_BURST, now);
+    bucketInit(&session->deactivations, rate_limit ? DEACTIVATE_RATE_MS * 1000000LL : 0, ACTION_BURST, now);
+}
+
+/**
+ * function admissionFull
+ * @brief Check if a new session must be refused: the descriptors left are kept for the running matches.
+ *        The kernel gives the lowest free descriptor, a high one means that few are left.
+ * 
+ * @param sock (connection of the new client)
+ * @return int (1 if the session is refused)
+ */
+int admissionFull(const socket_t *sock) {
+    return sock->fd >= admission.fd_budget;
+}
+
+/**
+ * function admissionTick
+ * @brief Count a tick of a room, and tell at the end of each window if too many ticks started late
+ * 
+ * @param lag (delay between the planned start of the tick and its start, ns)
+ * @param now 
+ * @return void
+ */
+void admissionTick(long long lag, long long now) {
+    __atomic_add_fetch(&admission.ticks, 1, __ATOMIC_RELAXED);
+    if (lag > 1000000000LL / TICK_HZ / 2) {
+        __atomic_add_fetch(&admission.late, 1, __ATOMIC_RELAXED);
+    }
+    long long window = __atomic_load_n(&admission.window, __ATOMIC_RELAXED);
+    if (now - window < ADMISSION_WINDOW_MS * 1000000LL
+        || !__atomic_compare_exchange_n(&admission.window, &window, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return;
+    }
+    // Only the tick that closed the window gets here
+    int ticks = __atomic_exchange_n(&admission.ticks, 0, __ATOMIC_RELAXED);
+    int late = __atomic_exchange_n(&admission.late, 0, __ATOMIC_RELAXED);
+    int overloaded = late * 100 > ticks * TICK_LATE_PERCENT;
+    if (overloaded != __atomic_load_n(&admission.overloaded, __ATOMIC_RELAXED)) {
+        if (overloaded) {
+            LOG_WARN("%d of %d ticks started late, the new matches wait", late, ticks);
+        } else {
+            LOG_INFO("The ticks are on time again, the new matches start");
+        }
+    }
+    __atomic_store_n(&admission.overloaded, overloaded, __ATOMIC_RELAXED);
+}
+
+/**
+ * function admissionOverloaded
+ * @brief Check if the CPU keeps up with the running matches, the new ones wait otherwise.
+ *        Without a tick for two windows (no match left), the server is not overloaded.
+ * 
+ * @param now 
+ * @return int (1 if the new matches must wait)
+ */
+int admissionOverloaded(long long now) {
+    return __atomic_load_n(&admission.overloaded, __ATOMIC_RELAXED)
+        && now - __atomic_load_n(&admission.window, __ATOMIC_RELAXED) < 2 * ADMISSION_WINDOW_MS * 1000000LL;
+}
+
+// --- Matchmaking ---
+
+/**
+ * function queuePlayer
+ * @brief Queue a new player for the matchmaker, without a lock: it is told to wait, its session comes with its room
+ * 
+ * @param worker 
+ * @param sock 
+ * @param flags (flags of its hello, SESSION_BOMBER or SESSION_MINE_CLEARER for the role it asks for)
+ * @return int (0 if the player was queued or dropped, -1 if too many players are waiting)
+ */
+int queuePlayer(worker_t *worker, socket_t *sock, unsigned int flags) {
+    if (__atomic_add_fetch(&matchmaker.queued, 1, __ATOMIC_RELAXED) > MAX_WAITING) {
+        __atomic_sub_fetch(&matchmaker.queued, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    waiting_t *player = malloc(sizeof(waiting_t));
+    if (player == NULL || sendHello(sock, 0, SESSION_QUEUED) < 0) {
+        free(player);
+        fermerSocket(sock);
+        __atomic_sub_fetch(&matchmaker.queued, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    player->sock = *sock;
+    player->worker = worker;
+    player->role = flags & SESSION_BOMBER ? BOMBER : flags & SESSION_MINE_CLEARER ? MINE_CLEARER : -1;
+    player->since = nowNs();
+    pushWaiting(player);
+    sem_post(&matchmaker.wake);
+    return 0;
+}
+
+/**
+ * function pushWaiting
+ * @brief Push a waiting player on the incoming list of the matchmaker, without a lock (any thread)
+ * 
+ * @param player 
+ * @return void
+ */
+void pushWaiting(waiting_t *player) {
+    player->next = __atomic_load_n(&matchmaker.incoming, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&matchmaker.incoming, &player->next, player, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+}
+
+/**
+ * function placePlayers
+ * @brief Place players in a free room, the rooms of the worker of the first one first, and start its match.
+ *        A player plays the role of its slot (slot 0 for the Bomber), the slots without a player go to bots.
+ * 
+ * @param players (MAX_CLIENTS players, in the order of their slots, NULL for a bot)
+ * @return room_t* (NULL if all the rooms are playing)
+ */
+room_t *placePlayers(waiting_t **players) {
+    unsigned long long tokens[MAX_CLIENTS] = { 0 };
+    int count = 0, first = 0;
+    for (int slot = MAX_CLIENTS - 1; slot >= 0; slot--) {
+        if (players[slot] != NULL) {
+            count++;
+            first = players[slot]->worker->id * ROOMS_PER_WORKER;
+        }
+    }
+    int total = worker_count * ROOMS_PER_WORKER;
+    room_t *room = NULL;
+    for (int n = 0; n < total && room == NULL; n++) {
+        room_t *candidate = &rooms[(first + n) % total];
+        traceMutexLock(&candidate->mutex, "lock_wait room");
+        if (candidate->match_running || candidate->connected_clients != 0) {
+            pthread_mutex_unlock(&candidate->mutex);
+            continue;
+        }
+        room = candidate;
+        for (int slot = 0; slot < MAX_CLIENTS; slot++) {
+            if (players[slot] == NULL) {
+                continue;
+            }
+            // The tokens are unique to the room, which stays found from a token without looking at the others
+            do {
+                tokens[slot] = (newSessionToken() & ~((1ull << TOKEN_ROOM_BITS) - 1)) | (unsigned long long)room->id;
+            } while (tokens[slot] >> TOKEN_ROOM_BITS == 0);
+            room->client_sockets[slot] = players[slot]->sock;
+            room->sessions[slot].token = tokens[slot];
+            room->sessions[slot].connected = 1;
+            channelPeerInit(&room->sessions[slot].peer, NULL, tokens[slot]);
+            sessionLimits(&room->sessions[slot], nowNs());
+        }
+        room->connected_clients = count;
+        if (count < MAX_CLIENTS && addBots(room) < 0) {
+            memset(room->sessions, 0, sizeof(room->sessions));
+            memset(room->client_sockets, 0, sizeof(room->client_sockets));
+            room->connected_clients = 0;
+            pthread_mutex_unlock(&room->mutex);
+            return NULL;
+        }
+        room->match_running = 1;
+        pthread_mutex_unlock(&room->mutex);
+    }
+    if (room == NULL) {
+        return NULL;
+    }
+
+    // Give the players their session token, then the welcome message
+    unsigned char frame[MAX_FRAME];
+    size_t len = encodeText(frame, "\t💣Welcome to Bombo2I!💣\n");
+    for (int slot = 0; slot < MAX_CLIENTS; slot++) {
+        if (players[slot] != NULL) {
+            LOG_INFO("Player connected (id=%d, room %d)", players[slot]->sock.fd, room->id);
+            sendHello(&players[slot]->sock, tokens[slot], 0);
+            envoyerOctets(&players[slot]->sock, frame, len);
+        }
+    }
+    startMatch(room);
+    return room;
+}
+
+/**
+ * function canPair
+ * @brief Check if two waiting players can play together: different roles asked for,
+ *        unless one of them asked for none or waited for more than MATCH_RELAX_MS
+ * 
+ * @param a 
+ * @param b 
+ * @param now 
+ * @return int
+ */
+static int canPair(const waiting_t *a, const waiting_t *b, long long now) {
+    return a->role < 0 || b->role < 0 || a->role != b->role || now - a->since >= MATCH_RELAX_MS * 1000000LL;
+}
+
+/**
+ * function matchmakerThread
+ * @brief Pair the waiting players in the order they arrived, by the roles they asked for, and place them in rooms.
+ *        A player waiting alone for BOMBO2I_BOT_WAIT seconds plays against bots. The players who hang up are dropped.
+ * 
+ * @param arg (unused)
+ * @return void* 
+ */
+void *matchmakerThread(void *arg) {
+    traceThreadName("matchmaker");
+    waiting_t **waiting = matchmaker.waiting;
+    while (1) {
+        int count = matchmaker.count;
+        if (count == 0) {
+            sem_wait(&matchmaker.wake);
+        } else {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += MATCH_CHECK_MS * 1000000L;
+            ts.tv_sec += ts.tv_nsec / 1000000000L;
+            ts.tv_nsec %= 1000000000L;
+            sem_timedwait(&matchmaker.wake, &ts);
+        }
+        // During a handoff the waiting players are passed to the next server
+        if (__atomic_load_n(&handoff_active, __ATOMIC_ACQUIRE)) {
+            parkThread();
+            continue;
+        }
+
+        // The players pushed since the last round, the stack gives them newest first
+        waiting_t *player = __atomic_exchange_n(&matchmaker.incoming, NULL, __ATOMIC_ACQUIRE);
+        int pushed = 0;
+        for (waiting_t *p = player; p != NULL; p = p->next) {
+            pushed++;
+        }
+        for (int k = count + pushed - 1; player != NULL; player = player->next) {
+            waiting[k--] = player;
+        }
+        count += pushed;
+
+        // Drop the players who left while waiting
+        int kept = 0;
+        for (int i = 0; i < count; i++) {
+            struct pollfd pfd = { .fd = waiting[i]->sock.fd, .events = POLLRDHUP };
+            if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR))) {
+                LOG_INFO("Player %d left before its match", waiting[i]->sock.fd);
+                fermerSocket(&waiting[i]->sock);
+                free(waiting[i]);
+                __atomic_sub_fetch(&matchmaker.queued, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+            waiting[kept++] = waiting[i];
+        }
+        count = kept;
+
+        // Pair the oldest players first, with the first opponent that suits them. While the CPU
+        // does not keep up with the running matches, the players wait for them to end
+        long long now = nowNs();
+        for (int i = 0; i < count && !admissionOverloaded(now); i++) {
+            int j = i + 1;
+            while (j < count && !canPair(waiting[i], waiting[j], now)) {
+                j++;
+            }
+            int alone = j == count;
+            if (alone && (bot_wait_ns < 0 || now - waiting[i]->since < bot_wait_ns)) {
+                continue;
+            }
+            // The slot 0 plays the Bomber, a bot takes the slot left to a player waiting alone
+            waiting_t *players[MAX_CLIENTS] = { NULL };
+            int slot = waiting[i]->role == MINE_CLEARER || (!alone && waiting[j]->role == BOMBER);
+            players[slot] = waiting[i];
+            if (!alone) {
+                players[!slot] = waiting[j];
+            }
+            room_t *room = placePlayers(players);
+            if (room == NULL) {
+                // Every room is playing, the players wait for the next free one
+                break;
+            }
+            if (alone) {
+                LOG_INFO("Bots join the player waiting alone, game starting in room %d...", room->id);
+            } else {
+                LOG_INFO("All players connected! Game starting in room %d...", room->id);
+                free(waiting[j]);
+                memmove(&waiting[j], &waiting[j + 1], (count - j - 1) * sizeof(waiting_t *));
+                count--;
+            }
+            free(waiting[i]);
+            memmove(&waiting[i], &waiting[i + 1], (count - i - 1) * sizeof(waiting_t *));
+            count--;
+            i--;
+            __atomic_sub_fetch(&matchmaker.queued, alone ? 1 : 2, __ATOMIC_RELAXED);
+        }
+        matchmaker.count = count;
+    }
+    return NULL;
+}
+
+/**
+ * function startMatch
+ * @brief Start the match of a full room, on the CPU of the worker owning the room
+ * 
+ * @param room 
+ * @return void
+ */
+void startMatch(room_t *room) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    // The threads of the match inherit the CPU of their creator
+    if (room->worker->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(room->worker->cpu, &set);
+        pthread_attr_setaffinity_np(&attr, sizeof set, &set);
+    }
+    // A handoff waits until the match has started its client threads
+    handoffCount(1);
+    pthread_t match_thread;
+    if (pthread_create(&match_thread, &attr, runMatch, room) != 0) {
+        perror("Failed to create match thread");
+        handoffCount(-1);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+/**
+ * function runMatch
+ * @brief Play the match of a room with its connected clients, then reset the room for the next one
+ * 
+ * @param arg (room_t *)
+ * @return void* 
+ */
+void *runMatch(void *arg) {
+    room_t *room = (room_t *)arg;
+    Map *map = room->map;
+    traceThreadName("match");
+
+    // Send the map to all clients and initialize the players (a restored match already has them)
+    int restored = room->restored;
+    if (!restored) {
+        sendMap(room->client_sockets, MAX_CLIENTS, map);
+        openJournal(room);
+    }
+    // The spectators of the previous match get the new map
+    traceMutexLock(&room->mutex, "lock_wait room");
+    if (room->spectators != NULL) {
+        memset(room->spectators->actor_x, 0xFF, sizeof(room->spectators->actor_x));
+        room->spectators->resync = 1;
+    }
+    pthread_mutex_unlock(&room->mutex);
+
+    // Create a thread for each client, they only queue the requests of their player.
+    // The count holds one more until they are all created: a client leaving at once does not end the match
+    pthread_t threads[MAX_CLIENTS];
+    int started[MAX_CLIENTS] = { 0 };
+    int created = 0;
+    room->live_clients = 1;
+    if (!restored) {
+        memset(room->inputs, 0, sizeof(room->inputs));
+        memset(room->hint_pending, 0, sizeof(room->hint_pending));
+        traceMutexLock(&room->mutex, "lock_wait room");
+        entitiesReset(&room->entities);
+        pthread_mutex_unlock(&room->mutex);
+    }
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (!restored) {
+            Player player;
+            initPlayer(&player, map, &room->roles_assigned[BOMBER], &room->roles_assigned[MINE_CLEARER]);
+            journalAppend(&room->game_state.journal, JOURNAL_ROLE, i, player.role, player.x, player.y, 0);
+            // The players are added in the order of the slots, the id of a player is its slot
+            traceMutexLock(&room->mutex, "lock_wait room");
+            entityAddPlayer(&room->entities, &player);
+            pthread_mutex_unlock(&room->mutex);
+            // A bot has no client thread, it plays in the ticks of the room
+            if (isBot(room, i)) {
+                botInit(&room->bots[i], player.role, room->game_state.seed + i);
+                continue;
+            }
+        } else if (isBot(room, i)) {
+            continue;
+        }
+        client_data_t *client_data = malloc(sizeof(client_data_t));
+        client_data->client_socket = room->client_sockets[i];
+        client_data->room = room;
+        client_data->slot = i;
+        client_data->restored = restored;
+        if (restored && client_data->client_socket.fd == 0) {
+            // Handed over disconnected: the thread waits for the player to resume its session
+            client_data->client_socket.fd = -1;
+        }
+        int reading = client_data->client_socket.shm == NULL && client_data->client_socket.fd >= 0;
+        if (reading) {
+            handoffCount(1);
+        }
+        __atomic_add_fetch(&room->live_clients, 1, __ATOMIC_RELAXED);
+        if (pthread_create(&threads[i], NULL, handleClient, client_data) != 0) {
+            perror("Failed to create client thread");
+            __atomic_sub_fetch(&room->live_clients, 1, __ATOMIC_RELAXED);
+            free(client_data);
+            if (reading) {
+                handoffCount(-1);
+            }
+            continue;
+        }
+        started[i] = 1;
+        created++;
+    }
+    // A match of bots only has no client to wait for
+    if (created > 0 || room->bots == NULL) {
+        leaveMatch(room);
+    } else {
+        room->live_clients = 0;
+    }
+    room->restored = 0;
+    // The client threads are counted, a handoff can stop them
+    handoffCount(-1);
+
+    // The game advances at a fixed rate, a late tick is run at once but the delay is not accumulated
+    const long long period = 1000000000LL / TICK_HZ;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!__atomic_load_n(&room->game_state.gameEnded, __ATOMIC_ACQUIRE)) {
+        next.tv_nsec += period;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        long long now = nowNs();
+        admissionTick(now - ((long long)next.tv_sec * 1000000000LL + next.tv_nsec), now);
+        roomTick(room);
+        if (nowNs() - ((long long)next.tv_sec * 1000000000LL + next.tv_nsec) > period * TICK_HZ) {
+            clock_gettime(CLOCK_MONOTONIC, &next);
+        }
+    }
+
+    // Wait for all threads to finish
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+        // Reset the roles_assigned counter
+        room->roles_assigned[i] = 0;
+    }
+
+    // The match is over, its journal is complete
+    journalClose(&room->game_state.journal);
+
+    // Reset the game state
+    room->game_state.bombCount = 0;
+    room->game_state.deactivatedBombCount = 0;
+    room->game_state.start_time = 0;
+    room->game_state.gameEnded = 0;
+    // Reset the map for the next game
+    prepareMap(room);
+
+    // Free the sessions, the room accepts the players of the next match
+    traceMutexLock(&room->mutex, "lock_wait room");
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        flushClient(room, i);
+        if (room->bots != NULL) {
+            room->bots[i].active = 0;
+        }
+        memset(&room->sessions[i], 0, sizeof(session_slot_t));
+        room->client_sockets[i].fd = 0;
+        room->client_sockets[i].shm = NULL;
+    }
+    room->connected_clients = 0;
+    room->match_running = 0;
+    pthread_mutex_unlock(&room->mutex);
+    return NULL;
+}
+
+/**
+ * function resumeSession
+ * @brief Give a reconnected client its place back in the running match, whichever worker accepted it.
+ *        The client keeps its map: it receives its player and the bombs, then the updates resume.
+ * 
+ * @param sock 
+ * @param token 
+ * @return int (0 if the session was resumed, -1 if the token matches no dropped player)
+ */
+int resumeSession(socket_t *sock, unsigned long long token) {
+    int id = (int)(token & ((1ull << TOKEN_ROOM_BITS) - 1));
+    if (id >= worker_count * ROOMS_PER_WORKER) {
+        return -1;
+    }
+    room_t *room = &rooms[id];
+    // The game is frozen while the client catches up, so it misses no update
+    traceMutexLock(&room->game_state.mutex, "lock_wait game_state");
+    traceMutexLock(&room->mutex, "lock_wait room");
+    int slot = -1;
+    for (int i = 0; i < MAX_CLIENTS && room->match_running; i++) {
+        if (room->sessions[i].token == token && !room->sessions[i].connected && i < room->entities.players.count) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot == -1) {
+        pthread_mutex_unlock(&room->mutex);
+        pthread_mutex_unlock(&room->game_state.mutex);
+        return -1;
+    }
+
+    // The bombs are sent as the usual updates, the client applies them like the others
+    unsigned char frames[MAX_BOMBS * (FRAME_HEADER_SIZE + 15)];
+    size_t len = 0;
+    const bomb_store_t *bombs = &room->entities.bombs;
+    for (int i = 0; i < bombs->count; i++) {
+        Point bomb = { bombs->x[i], bombs->y[i], bombs->state[i] };
+        len += encodeMessage(frames + len, MSG_POINT, &bomb);
+    }
+    Point player = { room->entities.players.x[slot], room->entities.players.y[slot], room->entities.players.role[slot] };
+    if (sendHello(sock, token, SESSION_RESUMED) < 0
+        || envoyer(sock, MSG_PLAYER, &player) < 0
+        || envoyerOctets(sock, frames, len) < 0) {
+        LOG_WARN("Player %d lost the connection while resuming its session", slot);
+        fermerSocket(sock);
+    } else {
+        room->client_sockets[slot] = *sock;
+        room->sessions[slot].connected = 1;
+        pthread_cond_broadcast(&room->resume_cond);
+        LOG_INFO("Player %d resumed its session (id=%d)", slot, sock->fd);
+    }
+    pthread_mutex_unlock(&room->mutex);
+    pthread_mutex_unlock(&room->game_state.mutex);
+    return 0;
+}
+
+/**
+ * function waitForResume
+ * @brief Close the socket of a dropped player and wait for it to resume its session
+ * 
+ * @param room 
+ * @param slot 
+ * @param sock (socket of the player, replaced by the new one)
+ * @return int (0 if the session was resumed, -1 if the delay expired or the game ended)
+ */
+int waitForResume(room_t *room, int slot, socket_t *sock) {
+    traceMutexLock(&room->mutex, "lock_wait room");
+    fermerSocket(sock);
+    room->client_sockets[slot].fd = 0;
+    room->client_sockets[slot].shm = NULL;
+    room->sessions[slot].connected = 0;
+
+    time_t deadline = time(NULL) + RESUME_TIMEOUT_S;
+    while (!room->sessions[slot].connected && !room->game_state.gameEnded && time(NULL) < deadline) {
+        // Wake up every second to see the end of the game
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += 1;
+        pthread_cond_timedwait(&room->resume_cond, &room->mutex, &ts);
+    }
+    int resumed = room->sessions[slot].connected;
+    if (resumed) {
+        *sock = room->client_sockets[slot];
+    }
+    pthread_mutex_unlock(&room->mutex);
+    return resumed ? 0 : -1;
+}
+
+/**
+ * function channelThread
+ * @brief Receive the positions of the players on the UDP channel and forward them to the other players
+ *        of their room. A stale position is dropped, the acks and the reliable messages are sent again from here.
+ * 
+ * @param arg (unused)
+ * @return void* 
+ */
+void *channelThread(void *arg) {
+    traceThreadName("channel");
+    channel_packet_t packet;
+    struct sockaddr_in from;
+
+    while (1) {
+        struct pollfd pfds[2] = {
+            { .fd = channel_socket.fd, .events = POLLIN },
+            { .fd = handoff_event, .events = POLLIN }
+        };
+        if (poll(pfds, 2, CHANNEL_ACK_MS) > 0 && (pfds[1].revents & POLLIN)) {
+            parkThread();
+            continue;
+        }
+
+        while (channelReceive(&channel_socket, &packet, &from) > 0) {
+            // The session token tells the room and the player, its address is the last one it used
+            int id = (int)(packet.header.token & ((1ull << TOKEN_ROOM_BITS) - 1));
+            if (id >= worker_count * ROOMS_PER_WORKER) {
+                continue;
+            }
+            room_t *room = &rooms[id];
+            traceMutexLock(&room->mutex, "lock_wait room");
+            channelPacket(room, &packet, &from);
+            pthread_mutex_unlock(&room->mutex);
+        }
+        for (int r = 0; r < worker_count * ROOMS_PER_WORKER; r++) {
+            room_t *room = &rooms[r];
+            traceMutexLock(&room->mutex, "lock_wait room");
+            for (int i = 0; i < MAX_CLIENTS; i++) {
+                if (room->sessions[i].token != 0) {
+                    channelUpdate(&channel_socket, &room->sessions[i].peer);
+                }
+            }
+            pthread_mutex_unlock(&room->mutex);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * function channelPacket
+ * @brief Handle a packet of the UDP channel sent by a player of a room (the mutex of the room must be held)
+ * 
+ * @param room 
+ * @param packet 
+ * @param from (address of the player)
+ * @return void
+ */
+void channelPacket(room_t *room, channel_packet_t *packet, struct sockaddr_in *from) {
+    int slot = -1;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (room->sessions[i].token != 0 && room->sessions[i].token == packet->header.token) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot == -1) {
+        return;
+    }
+    channel_peer_t *peer = &room->sessions[slot].peer;
+    peer->addr = *from;
+    peer->known = 1;
+    if (!channelAccept(peer, packet)) {
+        return;
+    }
+
+    if (packet->header.type == CHANNEL_JOIN) {
+        LOG_DEBUG("Player %d of room %d joined the UDP channel", slot, room->id);
+    } else if (packet->header.type == CHANNEL_POSITION && slot < room->entities.players.count) {
+        // The positions past the limit are dropped like the stale ones, the next one catches up
+        if (!bucketTake(&room->sessions[slot].positions, nowNs())) {
+            return;
+        }
+        Point point;
+        if (decodePayload(MSG_POINT, packet->payload, packet->header.len, &point) < 0) {
+            return;
+        }
+        movePlayerTo(room, slot, point);
+    }
+}
+
+/**
+ * function movePlayerTo
+ * @brief Move a player to the position its client sent, if it can reach it, and forward it (the mutex of the room must be held)
+ * 
+ * @param room 
+ * @param slot 
+ * @param point (position of the player)
+ * @return int (1 if the player moved, 0 if the cell is not accessible)
+ */
+int movePlayerTo(room_t *room, int slot, Point point) {
+    if (!isAccessible(&room->regions, point.x, point.y)) {
+        return 0;
+    }
+    room->entities.players.x[slot] = point.x;
+    room->entities.players.y[slot] = point.y;
+    forwardPosition(room, slot);
+    return 1;
+}
+
+/**
+ * function forwardPosition
+ * @brief Send the position of a player to the other players of its room on the UDP channel (the mutex of the room must be held)
+ * 
+ * @param room 
+ * @param slot 
+ * @return void
+ */
+void forwardPosition(room_t *room, int slot) {
+    Point point = { room->entities.players.x[slot], room->entities.players.y[slot], room->entities.players.role[slot] };
+    unsigned char payload[CHANNEL_MAX_PAYLOAD];
+    size_t len = encodePayload(payload, MSG_POINT, &point);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (i != slot && room->sessions[i].token != 0) {
+            channelSend(&channel_socket, &room->sessions[i].peer, CHANNEL_POSITION, payload, len, 0);
+        }
+    }
+}
+
+// --- Bots ---
+
+/**
+ * function isBot
+ * @brief Check if a slot of a room is played by a bot
+ * 
+ * @param room 
+ * @param slot 
+ * @return int
+ */
+int isBot(room_t *room, int slot) {
+    return room->bots != NULL && room->bots[slot].active;
+}
+
+/**
+ * function addBots
+ * @brief Give the slots of a room without a player (no session token) to bots and start its match:
+ *        a bot is a player without a socket or a session token (the mutex of the room must be held)
+ * 
+ * @param room 
+ * @return int (number of bots added, -1 if they could not be allocated)
+ */
+int addBots(room_t *room) {
+    if (room->bots == NULL) {
+        room->bots = calloc(MAX_CLIENTS, sizeof(bot_t));
+        if (room->bots == NULL) {
+            LOG_ERROR("Could not allocate the bots of room %d", room->id);
+            return -1;
+        }
+    }
+    int added = 0;
+    for (int slot = 0; slot < MAX_CLIENTS; slot++) {
+        if (room->sessions[slot].token != 0) {
+            continue;
+        }
+        room->bots[slot].active = 1;
+        room->client_sockets[slot].fd = 0;
+        room->client_sockets[slot].shm = NULL;
+        memset(&room->sessions[slot], 0, sizeof(session_slot_t));
+        room->sessions[slot].connected = 1;
+        added++;
+    }
+    room->connected_clients = MAX_CLIENTS;
+    room->match_running = 1;
+    return added;
+}
+
+/**
+ * function botsTick
+ * @brief Play the bots of a room for one tick (the mutex of the game must be held). Their searches share
+ *        a budget of cells per tick, a match with bots costs a bounded time to the CPU of its worker.
+ * 
+ * @param room 
+ * @return void
+ */
+void botsTick(room_t *room) {
+    if (room->bots == NULL) {
+        return;
+    }
+    int count = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        count += room->bots[i].active;
+    }
+    if (count == 0) {
+        return;
+    }
+    TRACE_BEGIN(bots_span, "bots");
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (!room->bots[i].active) {
+            continue;
+        }
+        // Only the tick moves a bot: its position is read without the mutex of the room
+        int budget = BOT_NODES_PER_TICK / count;
+        int x = room->entities.players.x[i], y = room->entities.players.y[i];
+        input_t input;
+        switch (botTick(&room->bots[i], room->map, &x, &y, &budget, &input.point)) {
+            case BOT_MOVED:
+                traceMutexLock(&room->mutex, "lock_wait room");
+                room->entities.players.x[i] = x;
+                room->entities.players.y[i] = y;
+                forwardPosition(room, i);
+                pthread_mutex_unlock(&room->mutex);
+                break;
+            case BOT_REQUEST:
+                input.time_ns = nowNs();
+                inputPush(&room->inputs[i], &input);
+                break;
+            default:
+                break;
+        }
+    }
+    TRACE_END(bots_span);
+}
+
+/**
+ * function startBots
+ * @brief Start a match of bots only in a free room, the first free room of the workers in turn
+ * 
+ * @return room_t* (room of the match, NULL if all the rooms are taken)
+ */
+static room_t *startBots(void) {
+    static int next = 0;
+    int count = worker_count * ROOMS_PER_WORKER;
+    for (int n = 0; n < count; n++) {
+        room_t *room = &rooms[(next + n) % count];
+        traceMutexLock(&room->mutex, "lock_wait room");
+        int started = !room->match_running && room->connected_clients == 0 && addBots(room) > 0;
+        pthread_mutex_unlock(&room->mutex);
+        if (started) {
+            next = (next + n + 1) % count;
+            return room;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * function botThread
+ * @brief Keep the matches of bots only running
+ * 
+ * @param arg (unused)
+ * @return void* 
+ */
+void *botThread(void *arg) {
+    traceThreadName("bots");
+    while (1) {
+        struct timespec ts = { 0, BOT_CHECK_MS * 1000000L };
+        nanosleep(&ts, NULL);
+        if (__atomic_load_n(&handoff_active, __ATOMIC_ACQUIRE)) {
+            parkThread();
+            continue;
+        }
+
+        // The rooms are taken under their mutex, like the rooms of the players by the matchmaker
+        int running = 0;
+        for (int r = 0; r < worker_count * ROOMS_PER_WORKER && bot_matches > 0; r++) {
+            traceMutexLock(&rooms[r].mutex, "lock_wait room");
+            int bots_only = rooms[r].match_running;
+            for (int i = 0; i < MAX_CLIENTS && bots_only; i++) {
+                bots_only = isBot(&rooms[r], i);
+            }
+            running += bots_only;
+            pthread_mutex_unlock(&rooms[r].mutex);
+        }
+        room_t *room;
+        while (running < bot_matches && !admissionOverloaded(nowNs()) && (room = startBots()) != NULL) {
+            LOG_DEBUG("Match of bots starting in room %d", room->id);
+            startMatch(room);
+            running++;
+        }
+    }
+    return NULL;
+}
+
+// --- Spectators ---
+
+/**
+ * function wakeSpectators
+ * @brief Wake the spectator thread up, updates or spectators are waiting
+ * 
+ * @return void
+ */
+static void wakeSpectators(void) {
+    pthread_mutex_lock(&spectator_mutex);
+    spectator_work = 1;
+    pthread_cond_signal(&spectator_cond);
+    pthread_mutex_unlock(&spectator_mutex);
+}
+
+/**
+ * function addSpectator
+ * @brief Add a spectator to a running match. It gets the room in its hello, then a keyframe from the spectator thread.
+ * 
+ * @param sock 
+ * @param room_id (room + 1, 0 for the first running match)
+ * @return int (0 if the spectator was added or dropped, -1 if there is no match to watch)
+ */
+int addSpectator(socket_t *sock, unsigned long long room_id) {
+    int count = worker_count * ROOMS_PER_WORKER;
+    if (room_id > (unsigned long long)count) {
+        return -1;
+    }
+    for (int r = room_id != 0 ? (int)room_id - 1 : 0; r < count; r++) {
+        room_t *room = &rooms[r];
+        traceMutexLock(&room->mutex, "lock_wait room");
+        if (room->match_running && room->spectators == NULL) {
+            __atomic_store_n(&room->spectators, calloc(1, sizeof(spectators_t)), __ATOMIC_RELEASE);
+        }
+        spectators_t *spectators = room->spectators;
+        if (!room->match_running || spectators == NULL || spectators->viewers == MAX_SPECTATORS) {
+            pthread_mutex_unlock(&room->mutex);
+            if (room_id != 0) {
+                return -1;
+            }
+            continue;
+        }
+        // The hello goes first, the keyframe can follow at any time once the spectator is added
+        if (sendHello(sock, (unsigned long long)room->id + 1, SESSION_SPECTATE) < 0) {
+            fermerSocket(sock);
+        } else {
+            spectators->joining[spectators->joining_count++] = *sock;
+            spectators->viewers++;
+            LOG_INFO("Spectator %d watches room %d (%d spectators)", sock->fd, room->id, spectators->viewers);
+        }
+        pthread_mutex_unlock(&room->mutex);
+        wakeSpectators();
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * function queueSpectators
+ * @brief Queue an update of the players for the spectators, the frame is shared (the mutex of the room must be held).
+ *        When the spectator thread is too far behind, the queued updates are dropped for a keyframe.
+ * 
+ * @param room 
+ * @param frame 
+ * @return void
+ */
+void queueSpectators(room_t *room, frame_buf_t *frame) {
+    spectators_t *spectators = room->spectators;
+    if (spectators == NULL || spectators->viewers == 0) {
+        return;
+    }
+    if (spectators->resync) {
+        // The keyframe to come holds this update
+    } else if (spectators->count == SPECTATOR_QUEUE) {
+        for (int i = 0; i < spectators->count; i++) {
+            frameRelease(spectators->queue[(spectators->head + i) % SPECTATOR_QUEUE]);
+        }
+        spectators->count = 0;
+        spectators->resync = 1;
+        LOG_WARN("Spectators of room %d are too far behind, they get a keyframe", room->id);
+    } else {
+        spectators->queue[(spectators->head + spectators->count++) % SPECTATOR_QUEUE] = frameRetain(frame);
+    }
+    wakeSpectators();
+}
+
+/**
+ * function queueActors
+ * @brief Queue the positions of the players that moved since the last tick for the spectators (the mutex of the room must be held)
+ * 
+ * @param room 
+ * @return void
+ */
+void queueActors(room_t *room) {
+    spectators_t *spectators = room->spectators;
+    if (spectators == NULL || spectators->viewers == 0) {
+        return;
+    }
+    const player_store_t *players = &room->entities.players;
+    frame_buf_t *frame = NULL;
+    for (int i = 0; i < players->count && i < MAX_CLIENTS; i++) {
+        if (players->x[i] == spectators->actor_x[i] && players->y[i] == spectators->actor_y[i]) {
+            continue;
+        }
+        if (frame == NULL && (frame = poolGet(&room->pool)) == NULL) {
+            return;
+        }
+        actor_t actor = { i, players->x[i], players->y[i], players->role[i] };
+        frame->len += encodeMessage(frame->data + frame->len, MSG_ACTOR, &actor);
+        spectators->actor_x[i] = players->x[i];
+        spectators->actor_y[i] = players->y[i];
+    }
+    if (frame != NULL) {
+        queueSpectators(room, frame);
+        frameRelease(frame);
+    }
+}
+
+/**
+ * function encodeKeyframe
+ * @brief Encode the state of a match for the spectators: the map (bombs included) and the players
+ *        (the mutexes of the game and of the room must be held)
+ * 
+ * @param room 
+ * @return frame_buf_t* (NULL if the pool is exhausted)
+ */
+static frame_buf_t *encodeKeyframe(room_t *room) {
+    frame_buf_t *frame = poolGet(&room->pool);
+    if (frame == NULL) {
+        return NULL;
+    }
+    frame->len = encodeMessage(frame->data, MSG_MAP, room->map);
+    const player_store_t *players = &room->entities.players;
+    for (int i = 0; i < players->count; i++) {
+        actor_t actor = { i, players->x[i], players->y[i], players->role[i] };
+        if (MAX_FRAME - frame->len < messageBound(MSG_ACTOR, &actor)) {
+            break;
+        }
+        frame->len += encodeMessage(frame->data + frame->len, MSG_ACTOR, &actor);
+    }
+    return frame;
+}
+
+/**
+ * function sendSpectator
+ * @brief Send a frame to a spectator without waiting: a spectator that can't take it at once is too slow
+ * 
+ * @param sock 
+ * @param frame 
+ * @return int (1 if the frame was sent, 0 if the spectator must be dropped)
+ */
+static int sendSpectator(socket_t *sock, const frame_buf_t *frame) {
+    if (frame == NULL) {
+        return 0;
+    }
+    if (sock->shm != NULL) {
+        return shmTryWrite(sock->shm, frame->data, frame->len) == (ssize_t)frame->len;
+    }
+    return send(sock->fd, frame->data, frame->len, MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t)frame->len;
+}
+
+/**
+ * function serveSpectators
+ * @brief Send the queued updates of a room to its spectators, and a keyframe to the ones joining
+ * 
+ * @param room 
+ * @param spectators 
+ * @return void
+ */
+static void serveSpectators(room_t *room, spectators_t *spectators) {
+    frame_buf_t *frames[SPECTATOR_QUEUE];
+    socket_t joining[MAX_SPECTATORS];
+    int joining_count = 0, resync = 0;
+    frame_buf_t *keyframe = NULL;
+
+    traceMutexLock(&room->mutex, "lock_wait room");
+    int need_keyframe = spectators->joining_count > 0 || spectators->resync;
+    pthread_mutex_unlock(&room->mutex);
+    // The keyframe and the updates queued before it are taken together: no tick runs in between
+    if (need_keyframe) {
+        traceMutexLock(&room->game_state.mutex, "lock_wait game_state");
+    }
+    traceMutexLock(&room->mutex, "lock_wait room");
+    int count = spectators->count;
+    for (int i = 0; i < count; i++) {
+        frames[i] = spectators->queue[(spectators->head + i) % SPECTATOR_QUEUE];
+    }
+    spectators->head = (spectators->head + count) % SPECTATOR_QUEUE;
+    spectators->count = 0;
+    if (need_keyframe) {
+        resync = spectators->resync;
+        spectators->resync = 0;
+        joining_count = spectators->joining_count;
+        memcpy(joining, spectators->joining, joining_count * sizeof(socket_t));
+        spectators->joining_count = 0;
+        keyframe = encodeKeyframe(room);
+    }
+    pthread_mutex_unlock(&room->mutex);
+    if (need_keyframe) {
+        pthread_mutex_unlock(&room->game_state.mutex);
+    }
+
+    TRACE_BEGIN(fanout_span, "spectators");
+    int dropped = 0;
+    for (int i = 0; i < spectators->watching_count; ) {
+        int sent = 1;
+        if (resync) {
+            sent = sendSpectator(&spectators->watching[i], keyframe);
+        }
+        for (int f = 0; f < count && sent && !resync; f++) {
+            sent = sendSpectator(&spectators->watching[i], frames[f]);
+        }
+        if (!sent) {
+            LOG_INFO("Spectator %d of room %d dropped", spectators->watching[i].fd, room->id);
+            fermerSocket(&spectators->watching[i]);
+            spectators->watching[i] = spectators->watching[--spectators->watching_count];
+            dropped++;
+            continue;
+        }
+        i++;
+    }
+    for (int j = 0; j < joining_count; j++) {
+        if (sendSpectator(&joining[j], keyframe)) {
+            spectators->watching[spectators->watching_count++] = joining[j];
+        } else {
+            fermerSocket(&joining[j]);
+            dropped++;
+        }
+    }
+    TRACE_END(fanout_span);
+
+    traceMutexLock(&room->mutex, "lock_wait room");
+    for (int i = 0; i < count; i++) {
+        frameRelease(frames[i]);
+    }
+    frameRelease(keyframe);
+    spectators->viewers -= dropped;
+    pthread_mutex_unlock(&room->mutex);
+}
+
+/**
+ * function spectatorThread
+ * @brief Send the updates of the rooms to their spectators. The thread runs at a lower priority than the
+ *        matches, and a tick only queues a reference on its update: the spectators don't delay the players.
+ * 
+ * @param arg (unused)
+ * @return void* 
+ */
+void *spectatorThread(void *arg) {
+    traceThreadName("spectators");
+    if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), SPECTATOR_NICE) != 0) {
+        LOG_WARN("The spectator thread runs at the priority of the matches");
+    }
+    while (1) {
+        pthread_mutex_lock(&spectator_mutex);
+        while (!spectator_work && !__atomic_load_n(&handoff_active, __ATOMIC_ACQUIRE)) {
+            pthread_cond_wait(&spectator_cond, &spectator_mutex);
+        }
+        spectator_work = 0;
+        pthread_mutex_unlock(&spectator_mutex);
+        // During a handoff the spectators are passed to the next server, the updates queued are dropped
+        if (__atomic_load_n(&handoff_active, __ATOMIC_ACQUIRE)) {
+            parkThread();
+            wakeSpectators();
+            continue;
+        }
+
+        for (int r = 0; r < worker_count * ROOMS_PER_WORKER; r++) {
+            spectators_t *spectators = __atomic_load_n(&rooms[r].spectators, __ATOMIC_ACQUIRE);
+            if (spectators != NULL) {
+                serveSpectators(&rooms[r], spectators);
+            }
+        }
+    }
+    return NULL;
+}
+
+// --- Hot restart ---
+
+/**
+ * function handoffCount
+ * @brief Count the threads reading the sockets, a handoff waits until all of them are parked
+ * 
+ * @param delta (threads created or ended)
+ * @return void
+ */
+void handoffCount(int delta) {
+    pthread_mutex_lock(&handoff_mutex);
+    handoff_threads += delta;
+    pthread_cond_broadcast(&handoff_cond);
+    pthread_mutex_unlock(&handoff_mutex);
+}
+
+/**
+ * function parkThread
+ * @brief Park a thread reading the sockets while a handoff runs. It returns if the handoff failed,
+ *        the process exits if it succeeded.
+ * 
+ * @return void
+ */
+void parkThread(void) {
+    pthread_mutex_lock(&handoff_mutex);
+    handoff_parked++;
+    pthread_cond_broadcast(&handoff_cond);
+    while (handoff_active) {
+        pthread_cond_wait(&handoff_cond, &handoff_mutex);
+    }
+    handoff_parked--;
+    pthread_mutex_unlock(&handoff_mutex);
+}
+
+/**
+ * function resumeThreads
+ * @brief Let the parked threads go on after a failed handoff
+ * 
+ * @return void
+ */
+static void resumeThreads(void) {
+    unsigned long long value;
+    if (read(handoff_event, &value, sizeof value) < 0) {
+        LOG_WARN("Could not reset the handoff event");
+    }
+    pthread_mutex_lock(&handoff_mutex);
+    __atomic_store_n(&handoff_active, 0, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&handoff_cond);
+    pthread_mutex_unlock(&handoff_mutex);
+}
+
+/**
+ * function startHandoff
+ * @brief Wait for the next server on a UNIX socket, it takes the sockets and the matches over (BOMBO2I_TAKEOVER=1)
+ * 
+ * @param path (UNIX socket)
+ * @return int (0 if the next server can take over, -1 otherwise)
+ */
+int startHandoff(const char *path) {
+    // The sockets read through io_uring have receptions in flight, they can't be passed between two requests
+    if (use_uring) {
+        LOG_WARN("No hot restart with io_uring");
+        return -1;
+    }
+    handoff_event = eventfd(0, EFD_CLOEXEC);
+    handoff_listener = handoffListen(path);
+    pthread_t handoff_thread;
+    if (handoff_event < 0 || handoff_listener.fd < 0 || pthread_create(&handoff_thread, NULL, handoffThread, NULL) != 0) {
+        LOG_WARN("No hot restart, the next server can't take over on %s", path);
+        return -1;
+    }
+    pthread_detach(handoff_thread);
+    LOG_INFO("The next server takes over on %s", path);
+    return 0;
+}
+
+/**
+ * function handoffThread
+ * @brief Hand the server over to the next one that connects
+ * 
+ * @param arg (unused)
+ * @return void* 
+ */
+void *handoffThread(void *arg) {
+    traceThreadName("handoff");
+    while (1) {
+        int fd = handoffAccept(handoff_listener);
+        if (fd < 0) {
+            continue;
+        }
+        LOG_INFO("The next server takes over");
+        if (handOver(fd) < 0) {
+            LOG_WARN("Handoff failed, the server keeps running");
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+/**
+ * function encodeRoom
+ * @brief Write the record of a running match (the mutexes of the room must be held)
+ * 
+ * @param room 
+ * @param record (HANDOFF_MAX_RECORD bytes)
+ * @param fds (descriptors passed with the record)
+ * @param count (number of descriptors)
+ * @return size_t (size of the record)
+ */
+static size_t encodeRoom(room_t *room, unsigned char *record, int *fds, int *count) {
+    handoff_room_t *h = (handoff_room_t *)record;
+    memset(h, 0, sizeof *h);
+    h->type = HANDOFF_ROOM;
+    h->id = room->id;
+    *count = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        h->sessions[i] = room->sessions[i];
+        if (isBot(room, i)) {
+            h->bots |= 1 << i;
+        } else if (room->sessions[i].connected && room->client_sockets[i].shm == NULL && room->client_sockets[i].fd > 0) {
+            h->sockets |= 1 << i;
+            fds[(*count)++] = room->client_sockets[i].fd;
+        } else {
+            // Local players reconnect to the next server and resume their session
+            h->sessions[i].connected = 0;
+        }
+        h->x[i] = room->entities.players.x[i];
+        h->y[i] = room->entities.players.y[i];
+        h->role[i] = room->entities.players.role[i];
+        h->cooldown[i] = room->entities.players.cooldown[i];
+    }
+    memcpy(h->inputs, room->inputs, sizeof h->inputs);
+    memcpy(h->hint_pending, room->hint_pending, sizeof h->hint_pending);
+
+    // The next server goes on writing the journal, the records written so far are kept
+    journal_t *journal = &room->game_state.journal;
+    if (journal->fd >= 0) {
+        journalSync(journal);
+        h->journal = 1;
+        h->journal_used = journal->used;
+        h->journal_start = journal->start;
+        fds[(*count)++] = journal->fd;
+    }
+    h->bombCount = room->game_state.bombCount;
+    h->deactivatedBombCount = room->game_state.deactivatedBombCount;
+    h->start_time = (long long)room->game_state.start_time;
+    h->seed = room->game_state.seed;
+    h->generator = room->game_state.generator;
+    h->width = room->map->width;
+    h->height = room->map->height;
+
+    const bomb_store_t *bombs = &room->entities.bombs;
+    h->bomb_count = bombs->count;
+    handoff_bomb_t *bomb = (handoff_bomb_t *)(h + 1);
+    for (int i = 0; i < bombs->count; i++) {
+        bomb[i] = (handoff_bomb_t){ bombs->x[i], bombs->y[i], bombs->state[i], bombs->timer[i] };
+    }
+    unsigned char *cells = (unsigned char *)(bomb + bombs->count);
+    for (int i = 0; i < h->width * h->height; i++) {
+        cells[i] = (unsigned char)room->map->cells[i];
+    }
+    return (size_t)(cells - record) + (size_t)(h->width * h->height);
+}
+
+/**
+ * function sendSockets
+ * @brief Send connections in records of HANDOFF_MAX_FDS descriptors at most, the local ones are left out
+ * 
+ * @param fd (handoff socket)
+ * @param record (HANDOFF_MAX_RECORD bytes)
+ * @param type (HANDOFF_WAITING or HANDOFF_SPECTATORS)
+ * @param room (room of the spectators)
+ * @param socks 
+ * @param players (waiting players, NULL for spectators)
+ * @param count 
+ * @return int (0 on success, -1 on error)
+ */
+static int sendSockets(int fd, unsigned char *record, int type, int room, socket_t *socks, waiting_t **players, int count) {
+    int fds[HANDOFF_MAX_FDS];
+    int i = 0;
+    while (i < count) {
+        handoff_waiting_t *waiting = (handoff_waiting_t *)record;
+        handoff_spectators_t *spectators = (handoff_spectators_t *)record;
+        memset(record, 0, sizeof(handoff_waiting_t));
+        int n = 0;
+        for (; i < count && n < HANDOFF_MAX_FDS; i++) {
+            socket_t *sock = players != NULL ? &players[i]->sock : &socks[i];
+            if (sock->shm != NULL) {
+                continue;
+            }
+            if (players != NULL) {
+                waiting->role[n] = players[i]->role;
+                waiting->since[n] = players[i]->since;
+            }
+            fds[n++] = sock->fd;
+        }
+        if (n == 0) {
+            break;
+        }
+        size_t len;
+        if (type == HANDOFF_WAITING) {
+            waiting->type = type;
+            waiting->count = n;
+            len = sizeof *waiting;
+        } else {
+            spectators->type = type;
+            spectators->room = room;
+            spectators->count = n;
+            len = sizeof *spectators;
+        }
+        if (handoffSend(fd, record, len, fds, n) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * function handOver
+ * @brief Hand the listening sockets, the running matches, the waiting players and the spectators over to the
+ *        next server, then exit. The threads reading the sockets are parked and the matches frozen meanwhile:
+ *        the clients keep their connections and miss no update.
+ * 
+ * @param fd (handoff socket of the next server)
+ * @return int (-1 if the handoff failed, the server goes on; it does not return otherwise)
+ */
+int handOver(int fd) {
+    // Park the threads reading the sockets, between two requests
+    pthread_mutex_lock(&handoff_mutex);
+    __atomic_store_n(&handoff_active, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&handoff_mutex);
+    unsigned long long one = 1;
+    if (write(handoff_event, &one, sizeof one) < 0) {
+        LOG_WARN("Could not signal the handoff");
+    }
+    sem_post(&matchmaker.wake);
+    wakeSpectators();
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += HANDOFF_PARK_MS * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    pthread_mutex_lock(&handoff_mutex);
+    while (handoff_parked < handoff_threads && pthread_cond_timedwait(&handoff_cond, &handoff_mutex, &deadline) == 0) {
+    }
+    int busy = handoff_threads - handoff_parked;
+    pthread_mutex_unlock(&handoff_mutex);
+    if (busy > 0) {
+        LOG_WARN("%d threads did not stop for the handoff", busy);
+        resumeThreads();
+        return -1;
+    }
+
+    // Freeze the matches: no tick, no send until the next server runs them
+    int total = worker_count * ROOMS_PER_WORKER;
+    for (int r = 0; r < total; r++) {
+        traceMutexLock(&rooms[r].game_state.mutex, "lock_wait game_state");
+        traceMutexLock(&rooms[r].mutex, "lock_wait room");
+    }
+
+    unsigned char *record = malloc(HANDOFF_MAX_RECORD);
+    int fds[HANDOFF_MAX_FDS];
+    int count = 0, sent = 0;
+    int sts = record != NULL && worker_count + 2 <= HANDOFF_MAX_FDS ? 0 : -1;
+
+    handoff_listeners_t listeners = { HANDOFF_LISTENERS, HANDOFF_VERSION, worker_count, channel_socket.fd >= 0, workers[0].local_socket.fd >= 0 };
+    if (sts == 0) {
+        for (int w = 0; w < worker_count; w++) {
+            fds[count++] = workers[w].server_socket.fd;
+        }
+        if (listeners.channel) {
+            fds[count++] = channel_socket.fd;
+        }
+        if (listeners.local) {
+            fds[count++] = workers[0].local_socket.fd;
+        }
+        sts = handoffSend(fd, &listeners, sizeof listeners, fds, count);
+    }
+
+    // The matches, with the players connected over TCP; a match ending now is finished here
+    for (int r = 0; r < total && sts == 0; r++) {
+        room_t *room = &rooms[r];
+        if (!room->match_running || room->game_state.gameEnded || room->entities.players.count != MAX_CLIENTS) {
+            continue;
+        }
+        size_t len = encodeRoom(room, record, fds, &count);
+        sts = handoffSend(fd, record, len, fds, count);
+        if (sts == 0 && room->spectators != NULL) {
+            spectators_t *spectators = room->spectators;
+            sts = sendSockets(fd, record, HANDOFF_SPECTATORS, room->id, spectators->joining, NULL, spectators->joining_count);
+            if (sts == 0) {
+                sts = sendSockets(fd, record, HANDOFF_SPECTATORS, room->id, spectators->watching, NULL, spectators->watching_count);
+            }
+        }
+        sent++;
+    }
+
+    // The waiting players, the ones pushed since the last round of the matchmaker after the others
+    waiting_t *player = __atomic_exchange_n(&matchmaker.incoming, NULL, __ATOMIC_ACQUIRE);
+    int pushed = 0;
+    for (waiting_t *p = player; p != NULL; p = p->next) {
+        pushed++;
+    }
+    for (int k = matchmaker.count + pushed - 1; player != NULL; player = player->next) {
+        matchmaker.waiting[k--] = player;
+    }
+    matchmaker.count += pushed;
+    if (sts == 0) {
+        sts = sendSockets(fd, record, HANDOFF_WAITING, -1, NULL, matchmaker.waiting, matchmaker.count);
+    }
+
+    handoff_type_t end = HANDOFF_END;
+    if (sts == 0) {
+        sts = handoffSend(fd, &end, sizeof end, NULL, 0);
+    }
+
+    // The next server runs the matches: this one exits without closing anything
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    if (sts == 0 && poll(&pfd, 1, HANDOFF_DONE_MS) > 0
+        && handoffReceive(fd, record, fds, &count) >= (ssize_t)sizeof(handoff_type_t)
+        && *(handoff_type_t *)record == HANDOFF_DONE) {
+        LOG_INFO("Handed %d matches and %d waiting players over to the next server, exiting", sent, matchmaker.count);
+        traceDump();
+        logShutdown();
+        _exit(0);
+    }
+
+    free(record);
+    for (int r = total - 1; r >= 0; r--) {
+        pthread_mutex_unlock(&rooms[r].mutex);
+        pthread_mutex_unlock(&rooms[r].game_state.mutex);
+    }
+    resumeThreads();
+    return -1;
+}
+
+/**
+ * function takeListeners
+ * @brief Take the listening sockets of the previous server (BOMBO2I_TAKEOVER=1), instead of opening them
+ * 
+ * @param fd (handoff socket)
+ * @return int (0 on success, -1 on error)
+ */
+int takeListeners(int fd) {
+    unsigned char *record = malloc(HANDOFF_MAX_RECORD);
+    int fds[HANDOFF_MAX_FDS];
+    int count = 0;
+    ssize_t len = record != NULL ? handoffReceive(fd, record, fds, &count) : -1;
+    handoff_listeners_t *listeners = (handoff_listeners_t *)record;
+    if (len < (ssize_t)sizeof *listeners || listeners->type != HANDOFF_LISTENERS || listeners->version != HANDOFF_VERSION
+        || listeners->workers < 1 || listeners->workers > MAX_WORKERS
+        || count != listeners->workers + listeners->channel + listeners->local) {
+        LOG_ERROR("The running server sent no listening sockets");
+        for (int i = 0; i < count; i++) {
+            close(fds[i]);
+        }
+        free(record);
+        return -1;
+    }
+
+    int n = 0;
+    worker_count = listeners->workers;
+    for (int w = 0; w < worker_count; w++) {
+        memset(&workers[w].server_socket, 0, sizeof(socket_t));
+        workers[w].server_socket.mode = SOCK_STREAM;
+        workers[w].server_socket.fd = fds[n++];
+        workers[w].local_socket.fd = -1;
+    }
+    memset(&channel_socket, 0, sizeof(socket_t));
+    channel_socket.mode = SOCK_DGRAM;
+    channel_socket.fd = listeners->channel ? fds[n++] : -1;
+    if (listeners->local) {
+        memset(&workers[0].local_socket, 0, sizeof(socket_t));
+        workers[0].local_socket.mode = SOCK_STREAM;
+        workers[0].local_socket.fd = fds[n++];
+    }
+    LOG_INFO("Took the %d listening sockets of the running server", count);
+    free(record);
+    return 0;
+}
+
+/**
+ * function restoreRoom
+ * @brief Restore a match of the previous server in its room, it starts once everything was received
+ * 
+ * @param h (record of the match)
+ * @param len (size of the record)
+ * @param fds (descriptors of the record)
+ * @param count 
+ * @return room_t* (NULL if the record is not valid)
+ */
+static room_t *restoreRoom(const handoff_room_t *h, size_t len, const int *fds, int count) {
+    int expected = h->journal;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        expected += (h->sockets >> i) & 1;
+    }
+    if (len < sizeof *h || h->id < 0 || h->id >= worker_count * ROOMS_PER_WORKER || count != expected
+        || h->bomb_count < 0 || h->bomb_count > MAX_BOMBS || h->width < 1 || h->width > MAX_MAP_WIDTH
+        || h->height < 1 || h->height > MAX_MAP_HEIGHT
+        || len != sizeof *h + h->bomb_count * sizeof(handoff_bomb_t) + (size_t)(h->width * h->height)) {
+        return NULL;
+    }
+    room_t *room = &rooms[h->id];
+    const handoff_bomb_t *bombs = (const handoff_bomb_t *)(h + 1);
+    const unsigned char *cells = (const unsigned char *)(bombs + h->bomb_count);
+
+    traceMutexLock(&room->game_state.mutex, "lock_wait game_state");
+    traceMutexLock(&room->mutex, "lock_wait room");
+    room->map->width = h->width;
+    room->map->height = h->height;
+    for (int i = 0; i < h->width * h->height; i++) {
+        room->map->cells[i] = cells[i];
+    }
+    regionsBuild(&room->regions, room->map);
+    room->game_state.bombCount = h->bombCount;
+    room->game_state.deactivatedBombCount = h->deactivatedBombCount;
+    room->game_state.start_time = (time_t)h->start_time;
+    room->game_state.seed = h->seed;
+    room->game_state.generator = h->generator;
+    room->game_state.gameEnded = 0;
+
+    entitiesReset(&room->entities);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        Player player = { h->x[i], h->y[i], (Role)h->role[i] };
+        entityAddPlayer(&room->entities, &player);
+        room->entities.players.cooldown[i] = h->cooldown[i];
+        room->roles_assigned[i] = 1;
+    }
+    for (int i = 0; i < h->bomb_count; i++) {
+        int id = entityAddBomb(&room->entities, bombs[i].x, bombs[i].y);
+        if (id >= 0) {
+            room->entities.bombs.state[id] = bombs[i].state;
+            room->entities.bombs.timer[id] = bombs[i].timer;
+        }
+    }
+    memcpy(room->sessions, h->sessions, sizeof room->sessions);
+    memcpy(room->inputs, h->inputs, sizeof room->inputs);
+    memcpy(room->hint_pending, h->hint_pending, sizeof room->hint_pending);
+
+    int n = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        memset(&room->client_sockets[i], 0, sizeof(socket_t));
+        room->client_sockets[i].mode = SOCK_STREAM;
+        if ((h->sockets >> i) & 1) {
+            room->client_sockets[i].fd = fds[n++];
+        }
+    }
+    if (h->journal) {
+        journalAdopt(&room->game_state.journal, fds[n++], h->journal_used, h->journal_start);
+    }
+
+    // The bots search their paths again, a Bomber bot places the bombs left
+    if (h->bots != 0 && room->bots == NULL) {
+        room->bots = calloc(MAX_CLIENTS, sizeof(bot_t));
+    }
+    for (int i = 0; i < MAX_CLIENTS && room->bots != NULL; i++) {
+        if ((h->bots >> i) & 1) {
+            botInit(&room->bots[i], (Role)h->role[i], h->seed + i);
+            room->bots[i].requests = h->role[i] == BOMBER ? h->bombCount : 0;
+        }
+    }
+    room->restored = 1;
+    room->connected_clients = MAX_CLIENTS;
+    room->match_running = 1;
+    pthread_mutex_unlock(&room->mutex);
+    pthread_mutex_unlock(&room->game_state.mutex);
+    return room;
+}
+
+/**
+ * function takeMatches
+ * @brief Take the matches, the spectators and the waiting players of the previous server over, then start the matches
+ * 
+ * @param fd (handoff socket)
+ * @return int (number of matches taken, -1 if the handoff was interrupted)
+ */
+int takeMatches(int fd) {
+    unsigned char *record = malloc(HANDOFF_MAX_RECORD);
+    int fds[HANDOFF_MAX_FDS];
+    int count = 0, taken = 0, waiting = 0;
+    room_t *restored[MAX_ROOMS];
+    ssize_t len = -1;
+    while (record != NULL && (len = handoffReceive(fd, record, fds, &count)) >= (ssize_t)sizeof(int)) {
+        int type = *(int *)record;
+        if (type == HANDOFF_END) {
+            break;
+        }
+        int used = 0;
+        if (type == HANDOFF_ROOM) {
+            room_t *room = restoreRoom((handoff_room_t *)record, (size_t)len, fds, count);
+            if (room != NULL) {
+                restored[taken++] = room;
+                used = count;
+            } else {
+                LOG_WARN("Match record of %zd bytes dropped", len);
+            }
+        } else if (type == HANDOFF_SPECTATORS && len == sizeof(handoff_spectators_t)) {
+            handoff_spectators_t *h = (handoff_spectators_t *)record;
+            if (h->room >= 0 && h->room < worker_count * ROOMS_PER_WORKER) {
+                room_t *room = &rooms[h->room];
+                traceMutexLock(&room->mutex, "lock_wait room");
+                if (room->spectators == NULL) {
+                    __atomic_store_n(&room->spectators, calloc(1, sizeof(spectators_t)), __ATOMIC_RELEASE);
+                }
+                spectators_t *spectators = room->spectators;
+                // They join again: the keyframe gives them the match as it is now
+                for (; spectators != NULL && used < count && spectators->viewers < MAX_SPECTATORS; used++) {
+                    socket_t sock = { .fd = fds[used], .mode = SOCK_STREAM };
+                    spectators->joining[spectators->joining_count++] = sock;
+                    spectators->viewers++;
+                }
+                pthread_mutex_unlock(&room->mutex);
+            }
+        } else if (type == HANDOFF_WAITING && len == sizeof(handoff_waiting_t)) {
+            handoff_waiting_t *h = (handoff_waiting_t *)record;
+            for (; used < count && used < h->count; used++) {
+                waiting_t *player = malloc(sizeof(waiting_t));
+                if (player == NULL) {
+                    break;
+                }
+                memset(&player->sock, 0, sizeof(socket_t));
+                player->sock.fd = fds[used];
+                player->sock.mode = SOCK_STREAM;
+                player->worker = &workers[0];
+                player->role = h->role[used];
+                player->since = h->since[used];
+                // The matchmaker already runs: the players are pushed like the workers push theirs
+                __atomic_add_fetch(&matchmaker.queued, 1, __ATOMIC_RELAXED);
+                pushWaiting(player);
+                waiting++;
+            }
+        }
+        for (int i = used; i < count; i++) {
+            close(fds[i]);
+        }
+    }
+    int ended = record != NULL && len >= (ssize_t)sizeof(int);
+    free(record);
+    if (!ended) {
+        return -1;
+    }
+
+    LOG_INFO("%d players wait for an opponent", waiting);
+    sem_post(&matchmaker.wake);
+    for (int i = 0; i < taken; i++) {
+        startMatch(restored[i]);
+    }
+    return taken;
+}
+
+// --- Journal functions ---
+
+/**
+ * function prepareMap
+ * @brief Take the map of the next match of a room from the map pool, its generator and seed are kept for the journal.
+ *        The two players must be able to reach each other: a map whose spawns are apart is never given to a room
+ * 
+ * @param room 
+ * @return void
+ */
+void prepareMap(room_t *room) {
+    pooled_map_t next;
+    for (;;) {
+        mapPoolTake(&map_pool, &next);
+        int bx, by, cx, cy;
+        spawnPosition(&next.map, BOMBER, &bx, &by);
+        spawnPosition(&next.map, MINE_CLEARER, &cx, &cy);
+        if (sameRegion(&next.regions, bx, by, cx, cy)) {
+            break;
+        }
+        LOG_ERROR("Map %s of seed %u has its spawns in two regions, the next one is taken", generatorName(next.generator), next.seed);
+    }
+    LOG_DEBUG("Room %d gets a %s map of seed %u (%llu maps generated on demand)", room->id, generatorName(next.generator), next.seed, __atomic_load_n(&map_pool.misses, __ATOMIC_RELAXED));
+    traceMutexLock(&room->mutex, "lock_wait room");
+    *room->map = next.map;
+    room->game_state.seed = next.seed;
+    room->game_state.generator = next.generator;
+    room->regions = next.regions;
+    pthread_mutex_unlock(&room->mutex);
+}
+
+/**
+ * function openJournal
+ * @brief Open the journal of the match starting now in a room and record its map seed
+ * 
+ * @param room 
+ * @return void
+ */
+void openJournal(room_t *room) {
+    const char *dir = getenv("BOMBO2I_JOURNAL_DIR");
+    if (dir == NULL) {
+        dir = JOURNAL_DIR;
+    }
+    // An empty directory disables the journal
+    if (dir[0] == '\0') {
+        return;
+    }
+    mkdir(dir, 0755);
+
+    char path[512];
+    snprintf(path, sizeof path, "%s/match_%ld_%u.bin", dir, (long)time(NULL), room->game_state.seed);
+    if (journalOpen(&room->game_state.journal, path) < 0) {
+        LOG_WARN("Could not open the journal %s, the match is not recorded", path);
+        return;
+    }
+    journalAppend(&room->game_state.journal, JOURNAL_MAP_GENERATOR, -1, room->game_state.generator, 0, 0, 0);
+    journalAppend(&room->game_state.journal, JOURNAL_MAP_SEED, -1, (int)room->game_state.seed, MAX_MAP_WIDTH, MAX_MAP_HEIGHT, (int)mapChecksum(room->map));
+    LOG_INFO("Recording the match in %s", path);
+}
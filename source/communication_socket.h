@@ -1,19 +1,75 @@
 #include "../library/data.h"
 #include "../library/session.h"
+#include "../library/log.h"
+#include "../library/trace.h"
+#include "../library/journal.h"
+#include "../library/channel.h"
+#include "../library/shm.h"
+#include "../library/uring.h"
+#include "../library/pool.h"
+#include "../library/handoff.h"
+#include "../library/ratelimit.h"
+#include <linux/io_uring.h>
+#include "game.h"
+#include "entity.h"
+#include "blast.h"
+#include "mapgen.h"
+#include "bot.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sched.h>
+#include <semaphore.h>
 
 // --- Constants ---
 #define PORT_SERVER 8080
-#define ADDRESS_SERVER "192.168.144.100"
-//#define ADDRESS_SERVER "0.0.0.0"
+#ifndef ADDRESS_SERVER
+#define ADDRESS_SERVER "192.168.144.100" // Or "any", overridden by BOMBO2I_LISTEN
+#endif
 #define MAX_CLIENTS 2
 #define BUFFER_SIZE 1024
-#define BOMB_COUNT 5
+#define JOURNAL_DIR "journals" // Overridden by BOMBO2I_JOURNAL_DIR
+#define HELLO_TIMEOUT_MS 2000  // A client must send its hello within this delay
+#define MAX_HANDSHAKES 256     // Connections of a worker waiting for their hello, the next ones are closed
+#define RESUME_TIMEOUT_S 30    // A dropped player can resume its session during this delay
+#define MAX_WORKERS 64         // Accept threads, one per CPU by default (BOMBO2I_WORKERS)
+#define ROOMS_PER_WORKER 4     // Matches a worker can run at the same time
+#define MAX_ROOMS (MAX_WORKERS * ROOMS_PER_WORKER)
+#define TOKEN_ROOM_BITS 16     // The low bits of a session token give its room
+#define TICK_HZ 30             // Simulation steps of a room per second
+#define INPUT_QUEUE_SIZE 64    // Pending requests of a player (power of two)
+#define COUNTDOWN_TICKS (60 * TICK_HZ) // The Bomber wins when the bombs are still active after this delay
+#define BOT_CHECK_MS 250       // Period of the checks of the bot matches
+#define MAX_WAITING 1024       // Players waiting for an opponent, the next ones are refused
+#define MATCH_CHECK_MS 250     // Period of the checks of the waiting players (hang ups, waits too long)
+#define MATCH_RELAX_MS 3000    // A player waiting longer takes any opponent, whatever the roles asked for
+#define HANDOFF_VERSION 1      // Version of the hot restart records, both servers must agree on it
+#define HANDOFF_PARK_MS 2000   // The threads reading the sockets must stop within this delay for a handoff
+#define HANDOFF_DONE_MS 5000   // The next server must take the matches over within this delay
+#define MAX_SPECTATORS 256     // Spectators of a room
+#define SPECTATOR_QUEUE 64     // Updates of a room waiting for the spectator thread
+#define SPECTATOR_NICE 10      // The spectator thread runs behind the matches
+#define REQUEST_RATE_MS 50     // Messages of a connection: one per 50 ms on average (BOMBO2I_RATE_LIMIT=0 to disable the limits)
+#define REQUEST_BURST 20
+#define REQUEST_KICK 200       // Messages dropped in a row before the connection is closed
+#define POSITION_RATE_MS 16    // Positions of a player on the UDP channel, about 60 per second
+#define POSITION_BURST 30
+#define BOMB_RATE_MS 5000      // A bomb every 5 s and a deactivation every 4 s, as the client waits
+#define DEACTIVATE_RATE_MS 4000
+#define ACTION_BURST 2         // Two requests can arrive closer than their delay through the network
+#define FD_RESERVE 64          // Descriptors kept for the running matches, the new sessions are refused past them
+#define ADMISSION_WINDOW_MS 1000 // Ticks counted together to tell if the CPU keeps up
+#define TICK_LATE_PERCENT 20   // New matches wait while more ticks than this start half a period late
 
 // --- Structures ---
 // typedef struct {
@@ -22,55 +78,277 @@
 //     int cells[MAX_MAP_SIZE];
 // } Map;
 
-typedef enum {
-    WALL,
-    PATH,
-    BOMB,
-    DEACTIVATED_BOMB,
-} Cell;
 
-typedef enum {
-    MOVE_UP,
-    MOVE_DOWN,
-    MOVE_LEFT,
-    MOVE_RIGHT,
-    PLACE_BOMB,
-    DEACTIVATE_BOMB
-} Action;
+// Session of a player in the match, kept while the player is disconnected
+typedef struct {
+    unsigned long long token;
+    int connected;
+    channel_peer_t peer;    // UDP channel of the player (positions)
+    token_bucket_t positions;       // Limits of the player, kept when it resumes its session
+    token_bucket_t bombs;           // Taken by the tick, for the requests it accepts
+    token_bucket_t deactivations;
+} session_slot_t;
 
-typedef enum {
-    BOMBER,
-    MINE_CLEARER
-} Role;
+typedef struct {
+    int bombCount;
+    int deactivatedBombCount;
+    time_t start_time;
+    int gameEnded;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned int seed;
+    int generator;          // Generator of the map (generator_id_t)
+    journal_t journal;
+} game_state_t;
 
+// Request of a player, stamped when it is read
 typedef struct {
-    int x;
-    int y;
-    Role role;
-} Player;
+    Point point;
+    long long time_ns;
+} input_t;
 
+// Requests of a player waiting for the next tick: written by its client thread, read by the tick
 typedef struct {
-    socket_t client_socket;
+    unsigned int head;                      // Next input written
+    unsigned int tail;                      // Next input read
+    input_t inputs[INPUT_QUEUE_SIZE];
+} input_queue_t;
+
+// Spectators of a room: they get a keyframe when they join, then the updates of the players. The tick only queues
+// a reference on each update, the spectator thread sends it to all of them.
+typedef struct {
+    int viewers;                            // Spectators joining or watching, protected by the mutex of the room
+    socket_t joining[MAX_SPECTATORS];       // Waiting for their keyframe, protected by the mutex of the room
+    int joining_count;
+    socket_t watching[MAX_SPECTATORS];      // Spectator thread only
+    int watching_count;
+    frame_buf_t *queue[SPECTATOR_QUEUE];    // Updates not sent yet, protected by the mutex of the room
+    int head;
+    int count;
+    int resync;                             // Updates were dropped or the map changed: everyone gets a keyframe
+    int actor_x[MAX_CLIENTS];               // Positions of the players last sent (tick only)
+    int actor_y[MAX_CLIENTS];
+} spectators_t;
+
+typedef struct worker_s worker_t;
+
+// Match of MAX_CLIENTS players, owned by the worker that opened it: its threads run on the CPU of the worker
+typedef struct {
+    int id;                                 // Index in the rooms, also in the low bits of its tokens
+    worker_t *worker;
+    socket_t client_sockets[MAX_CLIENTS];
+    pthread_mutex_t mutex;                  // Sockets and sessions of the room
+    pthread_cond_t resume_cond;
+    session_slot_t sessions[MAX_CLIENTS];
+    int roles_assigned[MAX_CLIENTS];        // 0 = not assigned, 1 = assigned
+    int connected_clients;
+    int match_running;
+    game_state_t game_state;
     Map *map;
-    Player *player;
+    regions_t regions;                      // Regions of the map, protected by mutex
+    entities_t entities;                    // Players (positions under mutex, the rest under the game mutex) and bombs
+    uring_t send_ring;                      // Sends with io_uring, protected by mutex
+    frame_buf_t *in_flight[MAX_CLIENTS];    // Send of each client not completed yet (io_uring)
+    frame_pool_t pool;                      // Outgoing frames, protected by mutex
+    input_queue_t inputs[MAX_CLIENTS];      // Requests of each player for the next tick
+    int hint_pending[MAX_CLIENTS];          // A hint is sent to the player after the update of the tick
+    frame_buf_t *update;                    // Messages of the current tick, sent together, protected by mutex
+    bot_t *bots;                            // MAX_CLIENTS bots, allocated with the first one (NULL before)
+    int restored;                           // The match was taken over from the previous server (hot restart)
+    int live_clients;                       // Client threads of the match still running (atomic)
+    spectators_t *spectators;               // Allocated with the first spectator (NULL before)
+} room_t;
+
+// Accept thread with its own listening socket on the port (SO_REUSEPORT)
+// Connections accepted by a worker and waiting for their hello: the worker adds them and goes back to accepting,
+// its handshake thread reads the hellos as their bytes arrive
+typedef struct {
+    pthread_mutex_t mutex;
+    int event;                              // eventfd woken when a connection is added
+    socket_t incoming[MAX_HANDSHAKES];      // Added by the worker, protected by mutex
+    int incoming_count;
+    int count;                              // Connections added and not answered yet, protected by mutex
+    socket_t pending[MAX_HANDSHAKES];       // Handshake thread only
+    hello_reader_t readers[MAX_HANDSHAKES];
+    long long deadlines[MAX_HANDSHAKES];
+    int ready[MAX_HANDSHAKES];              // Bytes may have arrived since the last read
+    int pending_count;
+} handshake_t;
+
+struct worker_s {
+    int id;
+    int cpu;                                // CPU the worker and its rooms run on, -1 if not pinned
+    socket_t server_socket;
+    socket_t local_socket;                  // Shared memory clients, worker 0 only (fd -1 otherwise)
+    uring_t accept_ring;
+    int tcp_armed;                          // Multishot requests of accept_ring
+    int local_armed;
+    room_t *rooms;                          // ROOMS_PER_WORKER rooms
+    handshake_t handshake;
+};
+
+typedef struct {
+    socket_t client_socket;
+    room_t *room;
+    int slot;
+    int restored;                           // The client already has its player (hot restart)
 } client_data_t;
 
+// Player waiting for an opponent
+typedef struct waiting_s {
+    socket_t sock;
+    worker_t *worker;                       // Worker that accepted it, its rooms are tried first
+    int role;                               // Role asked for (BOMBER or MINE_CLEARER), -1 for any
+    long long since;
+    struct waiting_s *next;
+} waiting_t;
+
+// Matchmaking: the workers push their players without a lock, a single thread pairs them into the rooms
+typedef struct {
+    waiting_t *incoming;                    // Pushed by the workers (lock-free stack), taken all at once by the thread
+    sem_t wake;
+    int queued;                             // Players pushed and not placed yet, bounded by MAX_WAITING
+    waiting_t *waiting[MAX_WAITING];        // Players not paired yet, in the order they arrived (matchmaker thread only)
+    int count;
+} matchmaker_t;
+
+// Admission control: the new sessions are refused near the descriptor limit, the new matches wait
+// while the ticks of the running ones start late (the CPU does not keep up)
+typedef struct {
+    int fd_budget;                          // Highest descriptor a new session can get
+    long long window;                       // Start of the window of ticks (ns)
+    int ticks;                              // Ticks of all the rooms in the window
+    int late;                               // Ticks that started more than half a period late
+    int overloaded;                         // Result of the last window
+} admission_t;
+
+// Records of a hot restart, sent in this order on the handoff socket
+typedef enum {
+    HANDOFF_LISTENERS = 1,  // Listening sockets (fds: the workers, then the UDP channel and the local socket when passed)
+    HANDOFF_ROOM,           // Match running (fds: its players connected over TCP, then its journal when passed)
+    HANDOFF_WAITING,        // Players waiting for an opponent (fds: their connections)
+    HANDOFF_SPECTATORS,     // Spectators of a room (fds: their connections)
+    HANDOFF_END,            // Everything was sent, the next server answers with HANDOFF_DONE once it runs the matches
+    HANDOFF_DONE
+} handoff_type_t;
+
+typedef struct {
+    int type;
+    int version;
+    int workers;
+    int channel;            // 1 if the UDP channel is passed
+    int local;              // 1 if the local socket is passed
+} handoff_listeners_t;
+
+typedef struct {
+    int x;
+    int y;
+    int state;
+    int timer;
+} handoff_bomb_t;
+
+// Room of a running match: its sessions, players, bombs and map. The local players can't be passed,
+// they are handed over disconnected and resume their session.
 typedef struct {
+    int type;
+    int id;
+    int sockets;                            // Bit i: the connection of the slot i is passed
+    int bots;                               // Bit i: the slot i is a bot
+    int journal;                            // 1 if the journal is passed
+    size_t journal_used;
+    unsigned long long journal_start;
+    session_slot_t sessions[MAX_CLIENTS];
+    input_queue_t inputs[MAX_CLIENTS];
+    int hint_pending[MAX_CLIENTS];
+    int x[MAX_CLIENTS];
+    int y[MAX_CLIENTS];
+    int role[MAX_CLIENTS];
+    int cooldown[MAX_CLIENTS];
     int bombCount;
     int deactivatedBombCount;
-    time_t start_time;
-    int gameEnded;
-    pthread_mutex_t mutex;
-    pthread_cond_t cond;
-} game_state_t;
+    long long start_time;
+    unsigned int seed;
+    int generator;
+    int width;
+    int height;
+    int bomb_count;                         // Followed by the bombs (handoff_bomb_t), then the cells (one byte each)
+} handoff_room_t;
+
+typedef struct {
+    int type;
+    int count;
+    int role[HANDOFF_MAX_FDS];
+    long long since[HANDOFF_MAX_FDS];
+} handoff_waiting_t;
+
+typedef struct {
+    int type;
+    int room;
+    int count;
+} handoff_spectators_t;
 
 // --- Functions ---
+void *workerThread(void *arg);
+void pinWorker(worker_t *worker);
+int handshakeAdd(worker_t *worker, socket_t *sock);
+void *handshakeThread(void *arg);
+void admitClient(worker_t *worker, socket_t *client_socket, const session_hello_t *hello);
 void *handleClient(void *socket_desc);
-void *countdownMonitor(void *arg);
-Map* map_new(int width, int height);
-void generateMap(Map *map);
-void sendMap(socket_t client_sockets[], int num_clients, Map *map) ;
-void setSpecialPoint(Map *map, int x, int y, int state);
-void broadcastPoint(Point point); 
-void broadcastMessage(const char *message);
-void initPlayer(Player *player, Map *map, int *bomber_assigned, int *mine_clearer_assigned);
+void *runMatch(void *arg);
+int queuePlayer(worker_t *worker, socket_t *sock, unsigned int flags);
+void pushWaiting(waiting_t *player);
+room_t *placePlayers(waiting_t **players);
+void *matchmakerThread(void *arg);
+void startMatch(room_t *room);
+void leaveMatch(room_t *room);
+void releaseClient(room_t *room, int slot, socket_t *sock);
+socket_t acceptClient(worker_t *worker);
+socket_t acceptClientUring(worker_t *worker);
+int readRequest(uring_stream_t *stream, socket_t *sock, message_u *request);
+size_t encodeText(unsigned char *frame, const char *text);
+void openRequestStream(uring_stream_t *stream, socket_t *sock);
+void sendToClients(room_t *room, frame_buf_t *frame);
+void sendToClient(room_t *room, int slot, frame_buf_t *frame);
+int queueSend(room_t *room, int slot, frame_buf_t *frame);
+void submitSends(room_t *room);
+void flushClient(room_t *room, int slot);
+void completeSend(room_t *room, const uring_cqe_t *cqe);
+int resumeSession(socket_t *sock, unsigned long long token);
+int waitForResume(room_t *room, int slot, socket_t *sock);
+void *channelThread(void *arg);
+void channelPacket(room_t *room, channel_packet_t *packet, struct sockaddr_in *from);
+void forwardPosition(room_t *room, int slot);
+int movePlayerTo(room_t *room, int slot, Point point);
+long long nowNs(void);
+int inputPush(input_queue_t *queue, const input_t *input);
+input_t *inputPeek(input_queue_t *queue);
+void inputPop(input_queue_t *queue);
+void roomTick(room_t *room);
+void applyInput(room_t *room, int slot, Point point);
+int takeAction(room_t *room, int slot, token_bucket_t *bucket);
+int detonateBombs(room_t *room);
+void emitUpdate(room_t *room, msg_type_t type, const void *quoi);
+void emitText(room_t *room, const char *text);
+void sendText(room_t *room, int slot, const char *text);
+void flushUpdate(room_t *room);
+int isBot(room_t *room, int slot);
+int addBots(room_t *room);
+void botsTick(room_t *room);
+void *botThread(void *arg);
+int addSpectator(socket_t *sock, unsigned long long room_id);
+void queueSpectators(room_t *room, frame_buf_t *frame);
+void queueActors(room_t *room);
+void *spectatorThread(void *arg);
+void prepareMap(room_t *room);
+void sessionLimits(session_slot_t *session, long long now);
+int admissionFull(const socket_t *sock);
+void admissionTick(long long lag, long long now);
+int admissionOverloaded(long long now);
+int startHandoff(const char *path);
+void handoffCount(int delta);
+void parkThread(void);
+void *handoffThread(void *arg);
+int handOver(int fd);
+int takeListeners(int fd);
+int takeMatches(int fd);
+void openJournal(room_t *room);
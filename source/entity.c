@@ -0,0 +1,281 @@
+#include "entity.h"
+
+/**
+ * function entitiesReset
+ * @brief Empty the entity store of a match
+ *
+ * @param entities
+ * @return void
+ */
+void entitiesReset(entities_t *entities) {
+    entities->players.count = 0;
+    entities->bombs.count = 0;
+    memset(entities->bombs.cell, 0xFF, sizeof(entities->bombs.cell)); // BOMB_NONE
+    memset(entities->bombs.bucket_count, 0, sizeof(entities->bombs.bucket_count));
+}
+
+/**
+ * function bucketOf
+ * @brief Get the bucket of the bomb grid holding a cell
+ *
+ * @param x
+ * @param y
+ * @return int
+ */
+static int bucketOf(int x, int y) {
+    return (y >> BUCKET_SHIFT) * BUCKETS_X + (x >> BUCKET_SHIFT);
+}
+
+/**
+ * function distance
+ * @brief Get the number of moves between two cells, walls ignored
+ *
+ * @param x1
+ * @param y1
+ * @param x2
+ * @param y2
+ * @return int
+ */
+static int distance(int x1, int y1, int x2, int y2) {
+    return abs(x1 - x2) + abs(y1 - y2);
+}
+
+/**
+ * function entityAddPlayer
+ * @brief Add a player to the store
+ *
+ * @param entities
+ * @param player (position and role)
+ * @return int (id of the player, -1 if the store is full)
+ */
+int entityAddPlayer(entities_t *entities, const Player *player) {
+    player_store_t *players = &entities->players;
+    if (players->count == MAX_PLAYERS) {
+        return -1;
+    }
+    int id = players->count++;
+    players->x[id] = player->x;
+    players->y[id] = player->y;
+    players->role[id] = player->role;
+    players->cooldown[id] = 0;
+    return id;
+}
+
+/**
+ * function entityPlayer
+ * @brief Gather the fields of a player, for the functions of the game working on a Player
+ *
+ * @param entities
+ * @param id
+ * @return Player
+ */
+Player entityPlayer(const entities_t *entities, int id) {
+    Player player = { entities->players.x[id], entities->players.y[id], (Role)entities->players.role[id] };
+    return player;
+}
+
+/**
+ * function entityAddBomb
+ * @brief Add a bomb placed on a cell, it does not count down until the bombs are armed.
+ *        A bomb placed again on its cell is the same bomb, active again.
+ *
+ * @param entities
+ * @param x
+ * @param y
+ * @return int (id of the bomb, -1 if the cell is out of the map or the store is full)
+ */
+int entityAddBomb(entities_t *entities, int x, int y) {
+    bomb_store_t *bombs = &entities->bombs;
+    int id = entityFindBomb(entities, x, y);
+    if (id == BOMB_NONE) {
+        if (x < 0 || x >= MAX_MAP_WIDTH || y < 0 || y >= MAX_MAP_HEIGHT || bombs->count == MAX_BOMBS) {
+            return -1;
+        }
+        id = bombs->count++;
+        bombs->x[id] = x;
+        bombs->y[id] = y;
+        int bucket = bucketOf(x, y);
+        bombs->slot[id] = bombs->bucket_count[bucket];
+        bombs->bucket[bucket][bombs->bucket_count[bucket]++] = id;
+        bombs->cell[y * MAX_MAP_WIDTH + x] = id;
+    }
+    bombs->state[id] = BOMB;
+    bombs->timer[id] = BOMB_TIMER_NONE;
+    return id;
+}
+
+/**
+ * function entityFindBomb
+ * @brief Find the bomb on a cell
+ *
+ * @param entities
+ * @param x
+ * @param y
+ * @return int (id of the bomb, BOMB_NONE if there is none)
+ */
+int entityFindBomb(const entities_t *entities, int x, int y) {
+    if (x < 0 || x >= MAX_MAP_WIDTH || y < 0 || y >= MAX_MAP_HEIGHT) {
+        return BOMB_NONE;
+    }
+    return entities->bombs.cell[y * MAX_MAP_WIDTH + x];
+}
+
+/**
+ * function entityRemoveBomb
+ * @brief Remove a bomb from the store, the last bomb takes its id
+ *
+ * @param entities
+ * @param id
+ * @return void
+ */
+void entityRemoveBomb(entities_t *entities, int id) {
+    bomb_store_t *bombs = &entities->bombs;
+    int bucket = bucketOf(bombs->x[id], bombs->y[id]);
+    int moved = bombs->bucket[bucket][--bombs->bucket_count[bucket]];
+    bombs->bucket[bucket][bombs->slot[id]] = moved;
+    bombs->slot[moved] = bombs->slot[id];
+    bombs->cell[bombs->y[id] * MAX_MAP_WIDTH + bombs->x[id]] = BOMB_NONE;
+
+    int last = --bombs->count;
+    if (id != last) {
+        bombs->x[id] = bombs->x[last];
+        bombs->y[id] = bombs->y[last];
+        bombs->state[id] = bombs->state[last];
+        bombs->timer[id] = bombs->timer[last];
+        bombs->slot[id] = bombs->slot[last];
+        bombs->bucket[bucketOf(bombs->x[id], bombs->y[id])][bombs->slot[id]] = id;
+        bombs->cell[bombs->y[id] * MAX_MAP_WIDTH + bombs->x[id]] = id;
+    }
+}
+
+/**
+ * function entityNearestBombs
+ * @brief Find the bombs of a state nearest to a cell. The buckets are visited in rings around the cell,
+ *        until the next ring is farther than the k bombs found.
+ *
+ * @param entities
+ * @param x
+ * @param y
+ * @param state (BOMB or DEACTIVATED_BOMB, -1 for both)
+ * @param k
+ * @param ids (k ids, nearest first)
+ * @return int (number of bombs found, less than k if the map holds less)
+ */
+int entityNearestBombs(const entities_t *entities, int x, int y, int state, int k, int ids[]) {
+    const bomb_store_t *bombs = &entities->bombs;
+    int dist[k > 0 ? k : 1];
+    int found = 0;
+    int bx = x >> BUCKET_SHIFT, by = y >> BUCKET_SHIFT;
+    int max_ring = BUCKETS_X > BUCKETS_Y ? BUCKETS_X : BUCKETS_Y;
+
+    for (int ring = 0; ring <= max_ring && k > 0; ring++) {
+        // A bomb of this ring is at least this far
+        if (found == k && dist[k - 1] <= (ring - 1) * BUCKET_SIZE) {
+            break;
+        }
+        for (int cy = by - ring; cy <= by + ring; cy++) {
+            if (cy < 0 || cy >= BUCKETS_Y) {
+                continue;
+            }
+            // Inside the ring only its left and right buckets
+            int step = (cy == by - ring || cy == by + ring) ? 1 : 2 * ring;
+            for (int cx = bx - ring; cx <= bx + ring; cx += step) {
+                if (cx < 0 || cx >= BUCKETS_X) {
+                    continue;
+                }
+                int bucket = cy * BUCKETS_X + cx;
+                for (int i = 0; i < bombs->bucket_count[bucket]; i++) {
+                    int id = bombs->bucket[bucket][i];
+                    if (state >= 0 && bombs->state[id] != state) {
+                        continue;
+                    }
+                    int d = distance(x, y, bombs->x[id], bombs->y[id]);
+                    if (found == k && d >= dist[k - 1]) {
+                        continue;
+                    }
+                    // Insertion in the k nearest, sorted by distance
+                    int j = found < k ? found++ : k - 1;
+                    while (j > 0 && dist[j - 1] > d) {
+                        dist[j] = dist[j - 1];
+                        ids[j] = ids[j - 1];
+                        j--;
+                    }
+                    dist[j] = d;
+                    ids[j] = id;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+/**
+ * function entityBombsInRadius
+ * @brief Find the bombs within a number of moves of a cell, walls ignored
+ *
+ * @param entities
+ * @param x
+ * @param y
+ * @param radius
+ * @param ids (ids of the bombs found)
+ * @param max (size of ids)
+ * @return int (number of bombs found, at most max)
+ */
+int entityBombsInRadius(const entities_t *entities, int x, int y, int radius, int ids[], int max) {
+    const bomb_store_t *bombs = &entities->bombs;
+    int found = 0;
+    int x0 = x - radius < 0 ? 0 : (x - radius) >> BUCKET_SHIFT;
+    int y0 = y - radius < 0 ? 0 : (y - radius) >> BUCKET_SHIFT;
+    int x1 = (x + radius) >> BUCKET_SHIFT, y1 = (y + radius) >> BUCKET_SHIFT;
+    for (int cy = y0; cy <= y1 && cy < BUCKETS_Y; cy++) {
+        for (int cx = x0; cx <= x1 && cx < BUCKETS_X; cx++) {
+            int bucket = cy * BUCKETS_X + cx;
+            for (int i = 0; i < bombs->bucket_count[bucket] && found < max; i++) {
+                int id = bombs->bucket[bucket][i];
+                if (distance(x, y, bombs->x[id], bombs->y[id]) <= radius) {
+                    ids[found++] = id;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+/**
+ * function entityArmBombs
+ * @brief Start the countdown of all the active bombs
+ *
+ * @param entities
+ * @param ticks (ticks before they explode)
+ * @return void
+ */
+void entityArmBombs(entities_t *entities, int ticks) {
+    bomb_store_t *bombs = &entities->bombs;
+    for (int i = 0; i < bombs->count; i++) {
+        bombs->timer[i] = bombs->state[i] == BOMB ? ticks : BOMB_TIMER_NONE;
+    }
+}
+
+/**
+ * function entitiesTick
+ * @brief Advance the cooldowns of the players and the timers of the bombs by one tick.
+ *        The loops run over contiguous arrays without branches, so the compiler vectorises them.
+ *
+ * @param entities
+ * @return int (number of active bombs whose timer expired at this tick)
+ */
+int entitiesTick(entities_t *entities) {
+    player_store_t *players = &entities->players;
+    for (int i = 0; i < players->count; i++) {
+        players->cooldown[i] -= players->cooldown[i] > 0;
+    }
+
+    bomb_store_t *bombs = &entities->bombs;
+    int exploded = 0;
+    for (int i = 0; i < bombs->count; i++) {
+        int counting = (bombs->timer[i] > 0) & (bombs->state[i] == BOMB);
+        bombs->timer[i] -= counting;
+        exploded += counting & (bombs->timer[i] == 0);
+    }
+    return exploded;
+}
@@ -0,0 +1,58 @@
+#ifndef ENTITY_H
+#define ENTITY_H
+
+#include "game.h"
+
+// --- Constants ---
+#define MAX_PLAYERS 64          // Players of a match the store can hold
+#define MAX_BOMBS 512           // Bombs of a match the store can hold
+#define BOMB_COOLDOWN_TICKS 1   // Ticks a player waits between two bomb requests
+#define BOMB_TIMER_NONE -1      // Timer of a bomb that does not count down
+#define BUCKET_SHIFT 3          // Buckets of the bomb grid are 8x8 cells
+#define BUCKET_SIZE (1 << BUCKET_SHIFT)
+#define BUCKETS_X ((MAX_MAP_WIDTH + BUCKET_SIZE - 1) >> BUCKET_SHIFT)
+#define BUCKETS_Y ((MAX_MAP_HEIGHT + BUCKET_SIZE - 1) >> BUCKET_SHIFT)
+#define BOMB_NONE -1            // No bomb on a cell
+
+// --- Structures ---
+// Players of a match, one array per field: the index of a player is its slot in the room
+typedef struct {
+    int count;
+    int x[MAX_PLAYERS];
+    int y[MAX_PLAYERS];
+    int role[MAX_PLAYERS];
+    int cooldown[MAX_PLAYERS];  // Ticks before the next bomb request of the player
+} player_store_t;
+
+// Bombs of a match, one array per field, at most one per cell. The arrays stay dense: a bomb removed is
+// replaced by the last one. A grid indexes them by cell and by bucket of cells for the spatial queries.
+typedef struct {
+    int count;
+    int x[MAX_BOMBS];
+    int y[MAX_BOMBS];
+    int state[MAX_BOMBS];       // BOMB or DEACTIVATED_BOMB
+    int timer[MAX_BOMBS];       // Ticks before the bomb explodes, BOMB_TIMER_NONE if it is not counting down
+    short slot[MAX_BOMBS];      // Index of the bomb in the list of its bucket
+    short cell[MAX_MAP_SIZE];   // Bomb of each cell (x + y * MAX_MAP_WIDTH), BOMB_NONE if there is none
+    short bucket_count[BUCKETS_X * BUCKETS_Y];
+    short bucket[BUCKETS_X * BUCKETS_Y][BUCKET_SIZE * BUCKET_SIZE];
+} bomb_store_t;
+
+typedef struct {
+    player_store_t players;
+    bomb_store_t bombs;
+} entities_t;
+
+// --- Functions ---
+void entitiesReset(entities_t *entities);
+int entityAddPlayer(entities_t *entities, const Player *player);
+Player entityPlayer(const entities_t *entities, int id);
+int entityAddBomb(entities_t *entities, int x, int y);
+int entityFindBomb(const entities_t *entities, int x, int y);
+void entityRemoveBomb(entities_t *entities, int id);
+int entityNearestBombs(const entities_t *entities, int x, int y, int state, int k, int ids[]);
+int entityBombsInRadius(const entities_t *entities, int x, int y, int radius, int ids[], int max);
+void entityArmBombs(entities_t *entities, int ticks);
+int entitiesTick(entities_t *entities);
+
+#endif // ENTITY_H
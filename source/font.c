@@ -0,0 +1,129 @@
+#include "font.h"
+#include <stdlib.h>
+
+/**
+ * function fontGlyph
+ * @brief Get the glyph of a character, '?' for a character out of the atlas
+ *
+ * @param atlas
+ * @param c
+ * @return const font_glyph_t*
+ */
+static const font_glyph_t *fontGlyph(const font_atlas_t *atlas, char c) {
+    unsigned char code = (unsigned char)c;
+    if (code < FONT_FIRST_CHAR || code > FONT_LAST_CHAR) {
+        code = '?';
+    }
+    return &atlas->glyphs[code - FONT_FIRST_CHAR];
+}
+
+/**
+ * function fontOpen
+ * @brief Create the textures of the font from the atlas embedded at build time: no file and no TrueType to load
+ *
+ * @param renderer
+ * @return font_t* (NULL on error, see SDL_GetError)
+ */
+font_t *fontOpen(SDL_Renderer *renderer) {
+    font_t *font = calloc(1, sizeof(font_t));
+    if (font == NULL) {
+        return NULL;
+    }
+    for (int size = 0; size < FONT_SIZE_COUNT; size++) {
+        const font_atlas_t *atlas = &font_atlas[size];
+        Uint32 *pixels = malloc((size_t)atlas->width * atlas->rows * sizeof(Uint32));
+        if (pixels == NULL) {
+            fontClose(font);
+            return NULL;
+        }
+
+        // A white glyph on a transparent background, its color is given when it is drawn
+        int pitch = (atlas->width + 7) / 8;
+        for (int y = 0; y < atlas->rows; y++) {
+            for (int x = 0; x < atlas->width; x++) {
+                int set = atlas->bitmap[y * pitch + x / 8] & (0x80 >> (x % 8));
+                pixels[y * atlas->width + x] = set ? 0xFFFFFFFF : 0x00FFFFFF;
+            }
+        }
+        SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, atlas->width, atlas->rows);
+        if (texture == NULL || SDL_UpdateTexture(texture, NULL, pixels, atlas->width * sizeof(Uint32)) != 0) {
+            free(pixels);
+            if (texture != NULL) {
+                SDL_DestroyTexture(texture);
+            }
+            fontClose(font);
+            return NULL;
+        }
+        free(pixels);
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+        font->textures[size] = texture;
+    }
+    return font;
+}
+
+/**
+ * function fontClose
+ * @brief Destroy the textures of the font
+ *
+ * @param font
+ * @return void
+ */
+void fontClose(font_t *font) {
+    if (font == NULL) {
+        return;
+    }
+    for (int size = 0; size < FONT_SIZE_COUNT; size++) {
+        if (font->textures[size] != NULL) {
+            SDL_DestroyTexture(font->textures[size]);
+        }
+    }
+    free(font);
+}
+
+/**
+ * function fontMeasure
+ * @brief Measure a text, from the metrics of the atlas
+ *
+ * @param size (font_size_t)
+ * @param text
+ * @param width
+ * @param height (height of a line)
+ * @return void
+ */
+void fontMeasure(int size, const char *text, int *width, int *height) {
+    const font_atlas_t *atlas = &font_atlas[size];
+    *width = 0;
+    for (const char *c = text; *c != '\0'; c++) {
+        *width += fontGlyph(atlas, *c)->advance;
+    }
+    *height = atlas->height;
+}
+
+/**
+ * function fontDraw
+ * @brief Draw a text, its glyphs copied from the texture of its size
+ *
+ * @param renderer
+ * @param font
+ * @param size (font_size_t)
+ * @param text
+ * @param x (left of the text)
+ * @param y (top of the line)
+ * @param color
+ * @return void
+ */
+void fontDraw(SDL_Renderer *renderer, font_t *font, int size, const char *text, int x, int y, SDL_Color color) {
+    const font_atlas_t *atlas = &font_atlas[size];
+    SDL_Texture *texture = font->textures[size];
+    SDL_SetTextureColorMod(texture, color.r, color.g, color.b);
+    SDL_SetTextureAlphaMod(texture, color.a);
+    for (const char *c = text; *c != '\0'; c++) {
+        const font_glyph_t *glyph = fontGlyph(atlas, *c);
+        if (glyph->width > 0 && glyph->height > 0) {
+            SDL_Rect source = { glyph->x, glyph->y, glyph->width, glyph->height };
+            SDL_Rect target = { x + glyph->left, y + atlas->ascent - glyph->top, glyph->width, glyph->height };
+            SDL_RenderCopy(renderer, texture, &source, &target);
+        }
+        x += glyph->advance;
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include <SDL2/SDL.h>
+#include "font_atlas.h"
+
+// --- Structures ---
+// Font drawn from the atlas embedded in the client: a texture per size, the glyphs are copied from it
+typedef struct {
+    SDL_Texture *textures[FONT_SIZE_COUNT];
+} font_t;
+
+// --- Functions ---
+font_t *fontOpen(SDL_Renderer *renderer);
+void fontClose(font_t *font);
+void fontMeasure(int size, const char *text, int *width, int *height);
+void fontDraw(SDL_Renderer *renderer, font_t *font, int size, const char *text, int x, int y, SDL_Color color);
+
+#endif // FONT_H
@@ -0,0 +1,39 @@
+#ifndef FONT_ATLAS_H
+#define FONT_ATLAS_H
+
+// --- Constants ---
+#define FONT_FIRST_CHAR 32  // Characters of the atlas: the printable ASCII characters
+#define FONT_LAST_CHAR 126
+#define FONT_CHARS (FONT_LAST_CHAR - FONT_FIRST_CHAR + 1)
+#define FONT_ATLAS_WIDTH 512 // Width of the bitmap of a size, the glyphs are placed in rows
+
+// Sizes of the font in the atlas, the makefile gives their pixels to fontatlas in this order
+typedef enum {
+    FONT_SMALL,         // 12 pixels: coordinates of the map
+    FONT_LARGE,         // 26 pixels: messages
+    FONT_SIZE_COUNT
+} font_size_t;
+
+// --- Structures ---
+// Glyph in the bitmap of its size
+typedef struct {
+    short x, y;             // Position in the bitmap
+    short width, height;
+    short left, top;        // Offset of the bitmap from the pen, top above the baseline
+    short advance;          // Move of the pen to the next glyph
+} font_glyph_t;
+
+// Size of the font rasterised at build time, 1 bit per pixel
+typedef struct {
+    int pixels;                     // Size of the font
+    int ascent;                     // Pixels above the baseline
+    int height;                     // Height of a line
+    int width, rows;                // Size of the bitmap
+    const unsigned char *bitmap;    // Rows of (width + 7) / 8 bytes, the leftmost pixel in the most significant bit
+    font_glyph_t glyphs[FONT_CHARS];
+} font_atlas_t;
+
+// Generated by fontatlas from ressources/Minecraft.ttf (font_data.c)
+extern const font_atlas_t font_atlas[FONT_SIZE_COUNT];
+
+#endif // FONT_ATLAS_H
@@ -0,0 +1,187 @@
+#include "font_atlas.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+// --- Structures ---
+// Glyph rendered by FreeType, before it is placed in the bitmap
+typedef struct {
+    font_glyph_t glyph;
+    int pitch;
+    unsigned char *bits;    // 1 bit per pixel, rows of pitch bytes
+} raster_t;
+
+/**
+ * function rasterise
+ * @brief Render the glyphs of a size, monochrome as TTF_RenderText_Solid drew them, and place them in rows
+ *
+ * @param face
+ * @param pixels (size of the font)
+ * @param atlas (metrics filled, its bitmap is set by the caller)
+ * @param rasters (glyphs rendered, FONT_CHARS)
+ * @return int (0 on success, -1 on error)
+ */
+static int rasterise(FT_Face face, int pixels, font_atlas_t *atlas, raster_t *rasters) {
+    // At 72 dpi, as SDL_ttf opens a font: a point is a pixel
+    if (FT_Set_Char_Size(face, 0, pixels * 64, 72, 72) != 0) {
+        fprintf(stderr, "Could not set the size %d\n", pixels);
+        return -1;
+    }
+    atlas->pixels = pixels;
+    atlas->ascent = (int)((face->size->metrics.ascender + 63) >> 6);
+    atlas->height = atlas->ascent - (int)(face->size->metrics.descender >> 6);
+    atlas->width = FONT_ATLAS_WIDTH;
+
+    int x = 0, y = 0, row_height = 0;
+    for (int c = FONT_FIRST_CHAR; c <= FONT_LAST_CHAR; c++) {
+        if (FT_Load_Char(face, c, FT_LOAD_RENDER | FT_LOAD_TARGET_MONO) != 0) {
+            fprintf(stderr, "Could not render '%c' at %d pixels\n", c, pixels);
+            return -1;
+        }
+        FT_GlyphSlot slot = face->glyph;
+        raster_t *raster = &rasters[c - FONT_FIRST_CHAR];
+        font_glyph_t *glyph = &raster->glyph;
+        glyph->width = slot->bitmap.width;
+        glyph->height = slot->bitmap.rows;
+        glyph->left = slot->bitmap_left;
+        glyph->top = slot->bitmap_top;
+        glyph->advance = (short)((slot->advance.x + 32) >> 6);
+        raster->pitch = slot->bitmap.pitch < 0 ? -slot->bitmap.pitch : slot->bitmap.pitch;
+        raster->bits = malloc((size_t)raster->pitch * glyph->height + 1);
+        if (raster->bits == NULL || glyph->width > FONT_ATLAS_WIDTH) {
+            fprintf(stderr, "Could not keep '%c' at %d pixels\n", c, pixels);
+            return -1;
+        }
+        memcpy(raster->bits, slot->bitmap.buffer, (size_t)raster->pitch * glyph->height);
+
+        // A pixel between the glyphs, the next row once this one is full
+        if (x + glyph->width > FONT_ATLAS_WIDTH) {
+            x = 0;
+            y += row_height + 1;
+            row_height = 0;
+        }
+        glyph->x = x;
+        glyph->y = y;
+        x += glyph->width + 1;
+        if (glyph->height > row_height) {
+            row_height = glyph->height;
+        }
+    }
+    atlas->rows = y + row_height;
+    return 0;
+}
+
+/**
+ * function writeAtlas
+ * @brief Copy the glyphs of a size into its bitmap and write it as a C array
+ *
+ * @param out
+ * @param atlas
+ * @param rasters
+ * @return int (0 on success, -1 on error)
+ */
+static int writeAtlas(FILE *out, const font_atlas_t *atlas, raster_t *rasters) {
+    int pitch = (atlas->width + 7) / 8;
+    size_t size = (size_t)pitch * atlas->rows;
+    unsigned char *bitmap = calloc(size + 1, 1);
+    if (bitmap == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < FONT_CHARS; i++) {
+        const font_glyph_t *glyph = &rasters[i].glyph;
+        for (int gy = 0; gy < glyph->height; gy++) {
+            for (int gx = 0; gx < glyph->width; gx++) {
+                if (rasters[i].bits[gy * rasters[i].pitch + gx / 8] & (0x80 >> (gx % 8))) {
+                    int bx = glyph->x + gx, by = glyph->y + gy;
+                    bitmap[by * pitch + bx / 8] |= 0x80 >> (bx % 8);
+                }
+            }
+        }
+    }
+
+    fprintf(out, "\n// %d pixels: %dx%d\nstatic const unsigned char bitmap_%d[%zu] = {", atlas->pixels, atlas->width, atlas->rows, atlas->pixels, size);
+    for (size_t i = 0; i < size; i++) {
+        fprintf(out, "%s0x%02x,", i % 16 == 0 ? "\n    " : " ", bitmap[i]);
+    }
+    fprintf(out, "\n};\n");
+    free(bitmap);
+    return 0;
+}
+
+/**
+ * function writeMetrics
+ * @brief Write the metrics of a size, an element of font_atlas
+ *
+ * @param out
+ * @param atlas
+ * @param rasters
+ * @return void
+ */
+static void writeMetrics(FILE *out, const font_atlas_t *atlas, const raster_t *rasters) {
+    fprintf(out, "    { %d, %d, %d, %d, %d, bitmap_%d, {\n", atlas->pixels, atlas->ascent, atlas->height, atlas->width, atlas->rows, atlas->pixels);
+    for (int i = 0; i < FONT_CHARS; i++) {
+        const font_glyph_t *glyph = &rasters[i].glyph;
+        int c = FONT_FIRST_CHAR + i;
+        fprintf(out, "        { %d, %d, %d, %d, %d, %d, %d }, // %s%c%s\n", glyph->x, glyph->y, glyph->width, glyph->height,
+                glyph->left, glyph->top, glyph->advance, c == '\\' ? "backslash" : "'", c == '\\' ? ' ' : c, c == '\\' ? "" : "'");
+    }
+    fprintf(out, "    } },\n");
+}
+
+/**
+ * function main
+ * @brief Rasterise a TrueType font at the sizes of font_size_t into font_atlas, written as a C file embedded in the client
+ *
+ * @return int
+ */
+int main(int argc, char *argv[]) {
+    if (argc != 3 + FONT_SIZE_COUNT) {
+        fprintf(stderr, "usage: %s <font.ttf> <output.c> <pixels>... (%d sizes)\n", argv[0], FONT_SIZE_COUNT);
+        return 1;
+    }
+
+    FT_Library library;
+    FT_Face face;
+    if (FT_Init_FreeType(&library) != 0 || FT_New_Face(library, argv[1], 0, &face) != 0) {
+        fprintf(stderr, "Could not open the font %s\n", argv[1]);
+        return 1;
+    }
+
+    static font_atlas_t atlases[FONT_SIZE_COUNT];
+    static raster_t rasters[FONT_SIZE_COUNT][FONT_CHARS];
+    for (int s = 0; s < FONT_SIZE_COUNT; s++) {
+        int pixels = atoi(argv[3 + s]);
+        if (pixels <= 0 || rasterise(face, pixels, &atlases[s], rasters[s]) < 0) {
+            return 1;
+        }
+    }
+
+    FILE *out = fopen(argv[2], "w");
+    if (out == NULL) {
+        perror(argv[2]);
+        return 1;
+    }
+    fprintf(out, "// Generated by fontatlas from %s, do not edit\n#include \"font_atlas.h\"\n", argv[1]);
+    for (int s = 0; s < FONT_SIZE_COUNT; s++) {
+        if (writeAtlas(out, &atlases[s], rasters[s]) < 0) {
+            fclose(out);
+            return 1;
+        }
+    }
+    fprintf(out, "\nconst font_atlas_t font_atlas[FONT_SIZE_COUNT] = {\n");
+    for (int s = 0; s < FONT_SIZE_COUNT; s++) {
+        writeMetrics(out, &atlases[s], rasters[s]);
+    }
+    fprintf(out, "};\n");
+
+    int failed = ferror(out);
+    if (fclose(out) != 0 || failed) {
+        fprintf(stderr, "Could not write %s\n", argv[2]);
+        return 1;
+    }
+    FT_Done_Face(face);
+    FT_Done_FreeType(library);
+    return 0;
+}
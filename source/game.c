@@ -0,0 +1,494 @@
+#include "game.h"
+
+// --- Map functions ---
+
+/**
+ * function map_new
+ * @brief Create a new map
+ * 
+ * @param width 
+ * @param height 
+ * @return Map*
+ */
+Map* map_new(int width, int height) {
+    Map *map = malloc(sizeof(Map));
+    if (map == NULL) {
+        fprintf(stderr, "Could not allocate memory for map\n");
+        exit(1);
+    }
+    map->width = width;
+    map->height = height;
+    for (int i = 0; i < width * height; i++) {
+        map->cells[i] = WALL;
+    }
+    return map;
+}
+
+/**
+ * function generateMap
+ * @brief Generate a map with multiple paths (and on some paths no walls)
+ * 
+ * @param map 
+ * @return void
+ */
+void generateMap(Map *map) {
+    // Initialize the map with walls
+    for (int y = 0; y < map->height; y++) {
+        for (int x = 0; x < map->width; x++) {
+            map->cells[y * map->width + x] = WALL;
+        }
+    }
+
+    // Create multiple paths by carving out a grid-like pattern
+    for (int y = 1; y < map->height; y += 2) {
+        for (int x = 1; x < map->width; x += 2) {
+            map->cells[y * map->width + x] = PATH;
+            if (x + 1 < map->width) {
+                map->cells[y * map->width + x + 1] = PATH; // carve right
+            }
+            if (y + 1 < map->height) {
+                map->cells[(y + 1) * map->width + x] = PATH; // carve down
+            }
+        }
+    }
+
+    // Create open areas without walls
+    for (int y = 3; y < map->height; y += 4) {
+        for (int x = 3; x < map->width; x += 4) {
+            map->cells[y * map->width + x] = PATH;
+            if (x + 1 < map->width) {
+                map->cells[y * map->width + x + 1] = PATH; // open right
+            }
+            if (y + 1 < map->height) {
+                map->cells[(y + 1) * map->width + x] = PATH; // open down
+            }
+            if (x - 1 > 0) {
+                map->cells[y * map->width + x - 1] = PATH; // open left
+            }
+            if (y - 1 > 0) {
+                map->cells[(y - 1) * map->width + x] = PATH; // open up
+            }
+        }
+    }
+
+    // Add some random obstacles 
+    for (int y = 1; y < map->height; y++) {
+        for (int x = 1; x < map->width; x++) {
+            if (map->cells[y * map->width + x] == PATH && rand() % 100 < 4) {
+                map->cells[y * map->width + x] = WALL;
+            }
+        }
+    }
+}
+
+/**
+ * function setSpecialPoint
+ * @brief Set a special point on the map
+ * 
+ * @param map 
+ * @param x 
+ * @param y 
+ * @param state 
+ * @return void
+ */
+void setSpecialPoint(Map *map, int x, int y, int state) {
+    if (x >= 0 && x < map->width && y >= 0 && y < map->height) {
+        map->cells[y * map->width + x] = state;
+        LOG_DEBUG("Cell (%d, %d) set to %d", x, y, state);
+    }
+}
+
+/**
+ * function applyBlast
+ * @brief Turn the cells destroyed by a blast into paths (server and client)
+ *
+ * @param map
+ * @param delta
+ * @return void
+ */
+void applyBlast(Map *map, const blast_t *delta) {
+    for (int i = 0; i < delta->rows; i++) {
+        int y = delta->top + i;
+        unsigned long long mask = delta->masks[i];
+        if (y < 0 || y >= map->height) {
+            continue;
+        }
+        while (mask != 0) {
+            int x = __builtin_ctzll(mask);
+            mask &= mask - 1;
+            if (x < map->width && map->cells[y * map->width + x] != WALL) {
+                map->cells[y * map->width + x] = PATH;
+            }
+        }
+    }
+}
+
+/**
+ * function isAccessible
+ * @brief Check if a cell can be reached from the rest of the map, i.e. it is in the largest region
+ * 
+ * @param regions (built from the map with regionsBuild)
+ * @param x 
+ * @param y 
+ * @return int
+ */
+int isAccessible(regions_t *regions, int x, int y) {
+    // Check if the coordinates are within the map boundaries
+    if (x < 0 || x >= regions->width || y < 0 || y >= regions->height) {
+        return 0;
+    }
+    int cell = y * regions->width + x;
+    return regions->parent[cell] >= 0 && regionsFind(regions, cell) == regionsFind(regions, regions->main);
+}
+
+/**
+ * function regionsUnion
+ * @brief Merge the regions of two open cells
+ * 
+ * @param regions 
+ * @param a 
+ * @param b 
+ * @return void
+ */
+static void regionsUnion(regions_t *regions, int a, int b) {
+    a = regionsFind(regions, a);
+    b = regionsFind(regions, b);
+    if (a == b) {
+        return;
+    }
+    // The smaller tree goes under the larger one
+    if (regions->size[a] < regions->size[b]) {
+        int swap = a;
+        a = b;
+        b = swap;
+    }
+    regions->parent[b] = a;
+    regions->size[a] += regions->size[b];
+    regions->count--;
+    if (regions->size[a] > regions->size[regionsFind(regions, regions->main)]) {
+        regions->main = a;
+    }
+}
+
+/**
+ * function regionsBuild
+ * @brief Group the cells of a map that are not walls by the paths between them
+ * 
+ * @param regions 
+ * @param map 
+ * @return void
+ */
+void regionsBuild(regions_t *regions, const Map *map) {
+    TRACE_BEGIN(span, "regionsBuild");
+    regions->width = map->width;
+    regions->height = map->height;
+    regions->count = 0;
+    regions->main = 0;
+    for (int i = 0; i < map->width * map->height; i++) {
+        int open = map->cells[i] != WALL;
+        regions->parent[i] = open ? i : -1;
+        regions->size[i] = open;
+        regions->count += open;
+        if (open && regions->size[regions->main] == 0) {
+            regions->main = i;
+        }
+    }
+    // Each open cell is merged with its right and lower neighbours
+    for (int y = 0; y < map->height; y++) {
+        for (int x = 0; x < map->width; x++) {
+            int cell = y * map->width + x;
+            if (regions->parent[cell] < 0) {
+                continue;
+            }
+            if (x + 1 < map->width && regions->parent[cell + 1] >= 0) {
+                regionsUnion(regions, cell, cell + 1);
+            }
+            if (y + 1 < map->height && regions->parent[cell + map->width] >= 0) {
+                regionsUnion(regions, cell, cell + map->width);
+            }
+        }
+    }
+    TRACE_END(span);
+}
+
+/**
+ * function regionsFind
+ * @brief Get the root of the region of an open cell, the path to it is halved on the way
+ * 
+ * @param regions 
+ * @param cell 
+ * @return int
+ */
+int regionsFind(regions_t *regions, int cell) {
+    while (regions->parent[cell] != cell) {
+        regions->parent[cell] = regions->parent[regions->parent[cell]];
+        cell = regions->parent[cell];
+    }
+    return cell;
+}
+
+/**
+ * function sameRegion
+ * @brief Check if a path links two cells
+ * 
+ * @param regions 
+ * @param x1 
+ * @param y1 
+ * @param x2 
+ * @param y2 
+ * @return int
+ */
+int sameRegion(regions_t *regions, int x1, int y1, int x2, int y2) {
+    if (x1 < 0 || x1 >= regions->width || y1 < 0 || y1 >= regions->height
+        || x2 < 0 || x2 >= regions->width || y2 < 0 || y2 >= regions->height) {
+        return 0;
+    }
+    int a = y1 * regions->width + x1, b = y2 * regions->width + x2;
+    return regions->parent[a] >= 0 && regions->parent[b] >= 0 && regionsFind(regions, a) == regionsFind(regions, b);
+}
+
+/**
+ * function regionsUpdate
+ * @brief Update the regions after a cell of the map changed. A cell that opens joins the regions of its
+ *        neighbours at once; a new wall may split a region, the regions are then built again.
+ * 
+ * @param regions 
+ * @param map (already changed)
+ * @param x 
+ * @param y 
+ * @return void
+ */
+void regionsUpdate(regions_t *regions, const Map *map, int x, int y) {
+    if (x < 0 || x >= map->width || y < 0 || y >= map->height) {
+        return;
+    }
+    int cell = y * map->width + x;
+    int open = map->cells[cell] != WALL;
+    if (open == (regions->parent[cell] >= 0)) {
+        return;
+    }
+    if (!open) {
+        regionsBuild(regions, map);
+        return;
+    }
+    regions->parent[cell] = cell;
+    regions->size[cell] = 1;
+    regions->count++;
+    if (regions->parent[regions->main] < 0) {
+        regions->main = cell;
+    }
+    static const int dx[4] = { -1, 1, 0, 0 }, dy[4] = { 0, 0, -1, 1 };
+    for (int i = 0; i < 4; i++) {
+        int nx = x + dx[i], ny = y + dy[i];
+        if (nx >= 0 && nx < map->width && ny >= 0 && ny < map->height && regions->parent[ny * map->width + nx] >= 0) {
+            regionsUnion(regions, cell, ny * map->width + nx);
+        }
+    }
+}
+
+/**
+ * function sendMap
+ * @brief Send the map to all clients
+ * 
+ * @param client_socket 
+ * @param num_clients
+ * @param map 
+ * @return void
+ */
+void sendMap(socket_t client_sockets[], int num_clients, Map *map) {
+    TRACE_BEGIN(span, "sendMap");
+    // Encoded once for all the clients
+    unsigned char frame[MAX_FRAME];
+    size_t len = encodeMessage(frame, MSG_MAP, map);
+
+    for (int i = 0; i < num_clients; i++) {
+        LOG_DEBUG("Sending map to client %d", client_sockets[i].fd);
+        if (client_sockets[i].fd != 0) {
+            if (envoyerOctets(&client_sockets[i], frame, len) < 0) {
+                perror("Failed to send map");
+            }
+        }
+    }
+    TRACE_END(span);
+}
+
+/**
+ * function receiveMap
+ * @brief Receive the map sent by the server with sendMap, decoded into the map as it arrives
+ * 
+ * @param sock 
+ * @param map 
+ * @param rows (called when rows are complete, they can be drawn before the rest arrives; NULL if not needed)
+ * @param arg (argument of rows)
+ * @return int (0 on success, -1 on error)
+ */
+int receiveMap(socket_t *sock, Map *map, map_rows_t rows, void *arg) {
+    TRACE_BEGIN(span, "receiveMap");
+    // The dimensions are checked by the decoder
+    if (recevoirMap(sock, map, rows, arg) < 0) {
+        fprintf(stderr, "Failed to receive the map\n");
+        TRACE_END(span);
+        return -1;
+    }
+    LOG_INFO("Map received, width: %d, height: %d", map->width, map->height);
+    TRACE_END(span);
+    return 0;
+}
+
+/**
+ * function mapChecksum
+ * @brief Compute a FNV-1a checksum of the map cells (used to check that a map is regenerated identically)
+ * 
+ * @param map 
+ * @return unsigned int
+ */
+unsigned int mapChecksum(const Map *map) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < map->width * map->height; i++) {
+        hash = (hash ^ (unsigned int)map->cells[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// --- Player functions ---
+
+/**
+ * function initPlayer
+ * @brief Initialize the player position and role
+ * 
+ * @param client_socket
+ * @param player 
+ * @param map 
+ * @param player_id
+ * @return void
+ */
+void initPlayer(Player *player, Map *map, int *bomber_assigned, int *mine_clearer_assigned) {
+    // Assign roles based on counters
+    if (*bomber_assigned == 0) {
+        player->role = BOMBER;
+        (*bomber_assigned)++;
+    } else if (*mine_clearer_assigned == 0) {
+        player->role = MINE_CLEARER;
+        (*mine_clearer_assigned)++;
+    }
+    spawnPosition(map, player->role, &player->x, &player->y);
+
+    LOG_INFO("Player initialized at position (%d, %d) with role %s", player->x, player->y, player->role == BOMBER ? "BOMBER" : "MINE_CLEARER");
+}
+
+/**
+ * function spawnPosition
+ * @brief Get the cell where a role starts: the first cell that is not a wall from its corner
+ * 
+ * @param map 
+ * @param role 
+ * @param x 
+ * @param y 
+ * @return void
+ */
+void spawnPosition(const Map *map, Role role, int *x, int *y) {
+    if (role == BOMBER) {
+        *x = 1; // Initial position for BOMBER
+        *y = 1;
+    } else {
+        *x = map->width - 1; // Initial position for MINE_CLEARER
+        *y = map->height - 1;
+    }
+
+    // Ensure the player is not placed on a wall
+    while (map->cells[*y * map->width + *x] == WALL) {
+        if (role == BOMBER) {
+            (*x)++;
+            if (*x >= map->width) {
+                *x = 1;
+                (*y)++;
+            }
+        } else {
+            (*x)--;
+            if (*x < 0) {
+                *x = map->width - 2;
+                (*y)--;
+            }
+        }
+    }
+}
+
+/**
+ * function handleInput
+ * @brief Handle the input from the user
+ * 
+ * @param player 
+ * @param map 
+ * @param event 
+ * @return void
+ */
+void handleInput(Player *player, Map *map, int action) {
+    switch (action) {
+        case MOVE_UP:
+            movePlayer(player, map, 0, -1);
+            break;
+        case MOVE_DOWN:
+            movePlayer(player, map, 0, 1);
+            break;
+        case MOVE_LEFT:
+            movePlayer(player, map, -1, 0);
+            break;
+        case MOVE_RIGHT:
+            movePlayer(player, map, 1, 0);
+            break;
+    }
+}
+
+/**
+ * function movePlayer
+ * @brief Move the player on the map with the arrow keys or gpio buttons
+ * 
+ * @param map
+ * @param player
+ * @param dx
+ * @param dy
+ * @return void
+ */
+void movePlayer(Player *player, Map *map, int dx, int dy) {
+    int newX = player->x + dx;
+    int newY = player->y + dy;
+
+    // Check if the new position is within the map boundaries and is not a wall
+    if (newX >= 0 && newX < map->width && newY >= 0 && newY < map->height && map->cells[newY * map->width + newX] != WALL) {
+        player->x = newX;
+        player->y = newY;
+    }
+}
+
+/**
+ * function applyRequest
+ * @brief Apply the bomb request of a player on the map (server rules, also used by the replay).
+ *        A bomb is placed by the Bomber only, and deactivated by the Mine clearer only
+ * 
+ * @param map 
+ * @param player 
+ * @param state (BOMB to place a bomb, DEACTIVATED_BOMB to deactivate one)
+ * @param bombCount 
+ * @param deactivatedBombCount 
+ * @return int (resulting state of the cell, -1 if the request is rejected)
+ */
+int applyRequest(Map *map, Player *player, int state, int *bombCount, int *deactivatedBombCount) {
+    switch (state) {
+        case BOMB:
+            if (player->role != BOMBER || *bombCount >= BOMB_COUNT) {
+                return -1;
+            }
+            setSpecialPoint(map, player->x, player->y, BOMB);
+            (*bombCount)++;
+            return BOMB;
+        case DEACTIVATED_BOMB:
+            if (player->role != MINE_CLEARER) {
+                return -1;
+            }
+            setSpecialPoint(map, player->x, player->y, DEACTIVATED_BOMB);
+            (*deactivatedBombCount)++;
+            return DEACTIVATED_BOMB;
+        default:
+            return -1;
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include "../library/data.h"
+#include "../library/session.h"
+#include "../library/log.h"
+#include "../library/trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --- Constants ---
+#define BOMB_COUNT 5
+
+// --- Structures ---
+typedef enum {
+    WALL,
+    PATH,
+    BOMB,
+    DEACTIVATED_BOMB,
+} Cell;
+
+typedef enum {
+    MOVE_UP,
+    MOVE_DOWN,
+    MOVE_LEFT,
+    MOVE_RIGHT,
+    PLACE_BOMB,
+    DEACTIVATE_BOMB
+} Action;
+
+typedef enum {
+    BOMBER,
+    MINE_CLEARER
+} Role;
+
+typedef struct {
+    int x;
+    int y;
+    Role role;
+} Player;
+
+// Regions of the map: the cells that are not walls, grouped by the paths between them (union-find)
+typedef struct {
+    int width;
+    int height;
+    int parent[MAX_MAP_SIZE];   // Parent of each cell in its tree, -1 for a wall
+    int size[MAX_MAP_SIZE];     // Cells of the region, for the root of a tree
+    int count;                  // Number of regions
+    int main;                   // Root of the largest region
+} regions_t;
+
+// --- Functions ---
+// Map functions, shared by the server and the client
+Map* map_new(int width, int height);
+void generateMap(Map *map);
+void setSpecialPoint(Map *map, int x, int y, int state);
+void applyBlast(Map *map, const blast_t *delta);
+int isAccessible(regions_t *regions, int x, int y);
+void regionsBuild(regions_t *regions, const Map *map);
+int regionsFind(regions_t *regions, int cell);
+int sameRegion(regions_t *regions, int x1, int y1, int x2, int y2);
+void regionsUpdate(regions_t *regions, const Map *map, int x, int y);
+void sendMap(socket_t client_sockets[], int num_clients, Map *map);
+int receiveMap(socket_t *sock, Map *map, map_rows_t rows, void *arg);
+unsigned int mapChecksum(const Map *map);
+
+// Player functions
+void initPlayer(Player *player, Map *map, int *bomber_assigned, int *mine_clearer_assigned);
+void spawnPosition(const Map *map, Role role, int *x, int *y);
+void handleInput(Player *player, Map *map, int action);
+void movePlayer(Player *player, Map *map, int dx, int dy);
+int applyRequest(Map *map, Player *player, int state, int *bombCount, int *deactivatedBombCount);
+
+#endif // GAME_H
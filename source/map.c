@@ -1,9 +1,19 @@
+#define _GNU_SOURCE
 #include "map.h"
 
 // --- Global variables ---
 pthread_mutex_t map_mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t renderer_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t socket_mutex = PTHREAD_MUTEX_INITIALIZER; // Held to send, or to replace the socket on a resume
 int fd; // File descriptor for the I2C bus
+// --- UDP channel (positions) ---
+pthread_mutex_t channel_mutex = PTHREAD_MUTEX_INITIALIZER;
+socket_t channel_socket = { .fd = -1 };
+channel_peer_t channel_peer;
+Player opponent;
+int opponent_known = 0;
+regions_t map_regions; // Regions of the map, protected by map_mutex
+int spectating = 0; // The client watches a match, it sends nothing
 
 /**
  * function main
@@ -12,99 +22,46 @@ int fd; // File descriptor for the I2C bus
  * @return int
  */
 int main() {
-    socket_t sock = createAndConnectToServer();
-    if(sock.fd == -1) {
-        printf("Could not connect to the server\n");
-        return 1;
-    }
+    long long launch = monotonicNs();
 
-    // Receive the welcome message from the server
-    message_t welcome_message;
-    recevoir(&sock, &welcome_message, deserial_string);
-    printf("%s", welcome_message.buffer);
+    // Start the background log writer
+    logInit(NULL);
 
-    // Initialize the random number generator
-    srand(time(NULL));
-    Map *map = map_new(MAX_MAP_WIDTH, MAX_MAP_HEIGHT);
+    // Span tracing, enabled when BOMBO2I_TRACE gives the output file
+    traceInit(NULL);
+    traceThreadName("main");
 
-    // Receive map dimensions from server
-    int map_size[2];
-    ssize_t bytes_received = recv(sock.fd, map_size, 2 * sizeof(int), 0);
-    if (bytes_received != 2 * sizeof(int)) {
-        perror("Failed to receive map dimensions");
-        exit(EXIT_FAILURE);
-    }
-    map->width = map_size[0];
-    map->height = map_size[1];
-    printf("Map received, width: %d, height: %d\n", map->width, map->height);
+    // A send on a dropped connection must not kill the client, the session is resumed instead
+    signal(SIGPIPE, SIG_IGN);
 
-    // Allocate memory for received cells
-    int *received_cells = (int *)malloc(map->width * map->height * sizeof(int));
-    if (received_cells == NULL) {
-        perror("Failed to allocate memory for received cells");
-        exit(EXIT_FAILURE);
-    }
-
-    // Receive map cells from server
-    size_t total_bytes = map->width * map->height * sizeof(int);
-    size_t total_received = 0;
-    while (total_received < total_bytes) {
-        bytes_received = recv(sock.fd, ((char*)received_cells) + total_received, total_bytes - total_received, 0);
-        if (bytes_received < 0) {
-            perror("Failed to receive map cells");
-            free(received_cells);
-            exit(EXIT_FAILURE);
-        }
-        if (bytes_received == 0) {
-            printf("Connection closed by server.\n");
-            free(received_cells);
-            exit(EXIT_FAILURE);
-        }
-        total_received += bytes_received;
-    }
-
-    // Debug: Verify the received cells
-    printf("Received cells:\n");
-    for (int i = 0; i < map->width * map->height; i++) {
-        printf("%d ", received_cells[i]);
+    // The network and the GPIO/I2C bus are set up in the background while SDL opens the window
+    pthread_t hardware_thread;
+    int hardware_started = pthread_create(&hardware_thread, NULL, setupHardware, NULL) == 0;
+    if (!hardware_started) {
+        setupHardware(NULL);
     }
-    printf("\n");
-
-    // Copy received cells to map->cells
-    memcpy(map->cells, received_cells, map->width * map->height * sizeof(int));
 
-    // Debug: Verify the map cells
-    printf("Map cells:\n");
-    for (int i = 0; i < map->width * map->height; i++) {
-        printf("%d ", map->cells[i]);
+    // BOMBO2I_SPECTATE watches a match instead of playing: the number of its room, or any other value for the first one
+    startup_t startup = { .sock = { .fd = -1 } };
+    const char *spectate = getenv("BOMBO2I_SPECTATE");
+    if (spectate != NULL) {
+        spectating = 1;
+        startup.room = strtoull(spectate, NULL, 10);
     }
-    printf("\n");
 
-    // Free allocated memory for received cells
-    free(received_cells);
-    sleep(3);
-
-    // Receive the player role from the server
-    Player player;
-    ssize_t received_bytes = recv(sock.fd, &player, sizeof(Player), 0);
-    if (received_bytes <= 0) {
-        perror("Failed to receive player data");
-        // Handle error appropriately
-    } else if (received_bytes != sizeof(Player)) {
-        fprintf(stderr, "Partial player data received\n");
-        // Handle error appropriately
+    // BOMBO2I_ROLE asks for a role ("bomber" or "clearer"), the server pairs the players accordingly
+    const char *role = getenv("BOMBO2I_ROLE");
+    startup.flags = spectating ? SESSION_SPECTATE : 0;
+    if (role != NULL && strcmp(role, "bomber") == 0) {
+        startup.flags |= SESSION_BOMBER;
+    } else if (role != NULL && strcmp(role, "clearer") == 0) {
+        startup.flags |= SESSION_MINE_CLEARER;
     }
-    
-    printf("You are a %s\n", player.role == BOMBER ? "bomber" : "mine clearer");
-    sleep(1);
+    pthread_t connect_thread;
+    int connect_started = pthread_create(&connect_thread, NULL, connectToServer, &startup) == 0;
 
-    // Initialize GPIO pins
-    wiringPiSetup();
-    setupButtonMatrix();
-    fd = wiringPiI2CSetup(0x70); // Initialize the I2C bus for the 7-segment display
-    initHT16K33(fd);
-
-    // Initialize SDL
+    // SDL stays on the main thread
+    TRACE_BEGIN(sdl_span, "startup_sdl");
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         fprintf(stderr, "Could not initialize SDL: %s\n", SDL_GetError());
         return 1;
@@ -118,61 +75,136 @@ int main() {
         return 1;
     }
 
-    // Initialize SDL_ttf (font rendering library)
-    if (TTF_Init() == -1) {
-        fprintf(stderr, "Could not initialize SDL_ttf: %s\n", TTF_GetError());
+    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    if (!renderer) {
+        SDL_DestroyWindow(window);
+        fprintf(stderr, "Could not create renderer: %s\n", SDL_GetError());
         SDL_Quit();
         return 1;
     }
 
-    TTF_Font *font = TTF_OpenFont("../ressources/Minecraft.ttf", 12);
+    // The font is embedded in the client, rasterised at build time
+    font_t *font = fontOpen(renderer);
     if (!font) {
-        fprintf(stderr, "Could not load font: %s\n", TTF_GetError());
-        TTF_Quit();
+        fprintf(stderr, "Could not load font: %s\n", SDL_GetError());
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
         SDL_Quit();
         return 1;
     }
 
-    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-    if (!renderer) {
+    TRACE_END(sdl_span);
+    long long window_ready = monotonicNs();
+
+    // Wait for the session
+    if (connect_started) {
+        pthread_join(connect_thread, NULL);
+    } else {
+        connectToServer(&startup);
+    }
+    if (startup.status < 0) {
+        fontClose(font);
+        SDL_DestroyRenderer(renderer);
         SDL_DestroyWindow(window);
-        fprintf(stderr, "Could not create renderer: %s\n", SDL_GetError());
         SDL_Quit();
+        traceDump();
+        logShutdown();
         return 1;
     }
+    socket_t sock = startup.sock;
+    session_hello_t hello = startup.hello;
+    long long connected = monotonicNs();
+
+    // Initialize the random number generator
+    srand(time(NULL));
+    Map *map = map_new(MAX_MAP_WIDTH, MAX_MAP_HEIGHT);
+
+    // Receive the map from the server, decoded into the map: its rows are drawn as they arrive
+    TRACE_BEGIN(map_span, "startup_map");
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    SDL_RenderClear(renderer);
+    SDL_RenderPresent(renderer);
+    map_view_t view = { renderer, font };
+    if (receiveMap(&sock, map, drawReceivedRows, &view) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    regionsBuild(&map_regions, map);
+    TRACE_END(map_span);
+    long long map_ready = monotonicNs();
+
+    // Receive the player role from the server, a spectator gets the players with the updates
+    Player player = { 0 };
+    message_u message;
+    if (spectating) {
+        LOG_INFO("You watch the match of room %llu", hello.token);
+    } else if (recevoir(&sock, &message) != MSG_PLAYER) {
+        perror("Failed to receive player data");
+        // Handle error appropriately
+    } else {
+        player.x = message.player.x;
+        player.y = message.player.y;
+        player.role = message.player.state;
+    }
+    if (!spectating) {
+        LOG_INFO("You are a %s", player.role == BOMBER ? "bomber" : "mine clearer");
+    }
+
+    // The buttons and the display are needed from the first frame
+    if (hardware_started) {
+        pthread_join(hardware_thread, NULL);
+    }
 
     // Render game elements
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
     SDL_RenderClear(renderer);
     drawMap(renderer, map, font);
+    renderOpponent(renderer);
     renderPlayer(renderer, &player);
     SDL_RenderPresent(renderer);
 
+    // Time to the first playable frame, with the steps done side by side
+    long long first_frame = monotonicNs();
+    LOG_INFO("First frame after %.1f ms (window %.1f ms, session %.1f ms, map %.1f ms)",
+             (first_frame - launch) / 1e6, (window_ready - launch) / 1e6, (connected - launch) / 1e6, (map_ready - connected) / 1e6);
+
     // Create the thread data for the receiveUpdates thread
     recv_thread_data_t *recv_data = malloc(sizeof(recv_thread_data_t));
     if (!recv_data) {
         fprintf(stderr, "Failed to allocate memory for thread data\n");
-        TTF_CloseFont(font);
-        TTF_Quit();
+        fontClose(font);
         SDL_DestroyRenderer(renderer);
         SDL_DestroyWindow(window);
         SDL_Quit();
         return 1;
     }
-    recv_data->sock_fd = sock.fd;
+    recv_data->sock = &sock;
     recv_data->map = map;
+    recv_data->player = &player;
+    recv_data->token = hello.token;
+
+    // Positions go over the UDP channel, a lost one does not delay the next ones
+    if (!spectating) {
+        openChannel(&sock, hello.token);
+    }
+    if (channel_socket.fd >= 0) {
+        pthread_t channel_thread;
+        if (pthread_create(&channel_thread, NULL, receiveDatagrams, &player) == 0) {
+            pthread_detach(channel_thread);
+        }
+    }
 
     // Create the receiveUpdates thread
     pthread_t recv_thread;
     if (pthread_create(&recv_thread, NULL, receiveUpdates, recv_data) != 0) {
         fprintf(stderr, "Failed to create receiveUpdates thread\n");
         free(recv_data);
-        TTF_CloseFont(font);
-        TTF_Quit();
+        fontClose(font);
         SDL_DestroyRenderer(renderer);
         SDL_DestroyWindow(window);
         SDL_Quit();
-        printf("Debug: Closing socket\n");
+        LOG_DEBUG("Closing socket");
+        traceDump();
+        logShutdown();
         return 1;
     }
 
@@ -189,18 +221,20 @@ int main() {
                 case SDL_QUIT:
                     running = 0;
                     // Send a disconnect message to the server
-                    int disconnect = -1;
-                    send(sock.fd, &disconnect, sizeof(int), 0);
+                    if (!spectating) {
+                        sendToServer(&sock, MSG_QUIT, NULL);
+                    }
                     break;
                 case SDL_KEYDOWN:
                     if (event.key.keysym.sym == SDLK_ESCAPE) {
                         // Exit the game if the user closes the window or presses the ESC key
                         running = 0;
                         // Send a disconnect message to the server
-                        int disconnect = -1;
-                        send(sock.fd, &disconnect, sizeof(int), 0);
+                        if (!spectating) {
+                            sendToServer(&sock, MSG_QUIT, NULL);
+                        }
                         break;
-                    } else {
+                    } else if (!spectating) {
                         // Handle player input based on the key pressed
                         int action = -1; // Default action
                         switch (event.key.keysym.sym) {
@@ -244,8 +278,11 @@ int main() {
                         }
 
                         handleInput(&player, map, action);
+                        if (action >= MOVE_UP && action <= MOVE_RIGHT) {
+                            sendPosition(&player, &sock);
+                        }
                         if (action == PLACE_BOMB || action == DEACTIVATE_BOMB) {
-                            placePoint(map, renderer, font, player.x, player.y, action == PLACE_BOMB ? BOMB : DEACTIVATED_BOMB, sock.fd);
+                            placePoint(map, renderer, font, player.x, player.y, action == PLACE_BOMB ? BOMB : DEACTIVATED_BOMB, &sock);
                         }
                     }
                     break;
@@ -253,12 +290,15 @@ int main() {
                     switch (event.user.code) {
                         case 1:
                             // Render the updated map
-                            pthread_mutex_lock(&renderer_mutex);
+                            traceMutexLock(&renderer_mutex, "lock_wait renderer");
+                            TRACE_BEGIN(render_span, "render");
                             SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
                             SDL_RenderClear(renderer);
                             drawMap(renderer, map, font);
+                            renderOpponent(renderer);
                             renderPlayer(renderer, &player);
                             SDL_RenderPresent(renderer);
+                            TRACE_END(render_span);
                             pthread_mutex_unlock(&renderer_mutex);
                             break;
                         case 2:
@@ -277,46 +317,113 @@ int main() {
         }
         if (SDL_USEREVENT != event.type) {
             // Render the updated map
-            pthread_mutex_lock(&renderer_mutex);
+            traceMutexLock(&renderer_mutex, "lock_wait renderer");
+            TRACE_BEGIN(render_span, "render");
             SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
             SDL_RenderClear(renderer);
             drawMap(renderer, map, font);
+            renderOpponent(renderer);
             renderPlayer(renderer, &player);
             SDL_RenderPresent(renderer);
+            TRACE_END(render_span);
             pthread_mutex_unlock(&renderer_mutex);
         }
     }
 
-    TTF_CloseFont(font);
-    TTF_Quit();
+    fontClose(font);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
-    close(sock.fd);
+    fermerSocket(&sock);
 
+    traceDump();
+    logShutdown();
     return 0;
 }
 
 /**
- * function map_new
- * @brief Create a new map
+ * function monotonicNs
+ * @brief Get the time of the monotonic clock, to measure the startup
  * 
- * @param width 
- * @param height 
- * @return Map*
+ * @return long long (ns)
  */
-Map* map_new(int width, int height) {
-    Map *map = malloc(sizeof(Map));
-    if (map == NULL) {
-        fprintf(stderr, "Could not allocate memory for map\n");
-        exit(1);
-    }
-    map->width = width;
-    map->height = height;
-    for (int i = 0; i < width * height; i++) {
-        map->cells[i] = WALL;
-    }
-    return map;
+long long monotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * function setupHardware
+ * @brief Set up the GPIO pins of the button matrix and the 7-segment display on the I2C bus, run during the startup
+ * 
+ * @param arg (unused)
+ * @return void*
+ */
+void *setupHardware(void *arg) {
+    (void)arg;
+    traceThreadName("setupHardware");
+    TRACE_BEGIN(span, "startup_hardware");
+    wiringPiSetup();
+    setupButtonMatrix();
+    fd = wiringPiI2CSetup(0x70); // Initialize the I2C bus for the 7-segment display
+    initHT16K33(fd);
+    TRACE_END(span);
+    return NULL;
+}
+
+/**
+ * function connectToServer
+ * @brief Connect to the server, open the session and receive the welcome message, run during the startup
+ * 
+ * @param arg (startup_t *, its status is -1 if the client must stop)
+ * @return void*
+ */
+void *connectToServer(void *arg) {
+    startup_t *startup = (startup_t *)arg;
+    traceThreadName("connectToServer");
+    TRACE_BEGIN(span, "startup_connect");
+    startup->status = -1;
+    startup->sock = createAndConnectToServer();
+    if (startup->sock.fd == -1) {
+        printf("Could not connect to the server\n");
+        TRACE_END(span);
+        return NULL;
+    }
+
+    // Open a new session, its token allows to resume it after a disconnection
+    session_hello_t *hello = &startup->hello;
+    if (sendHello(&startup->sock, startup->room, startup->flags) < 0 || receiveHello(&startup->sock, hello, CONNECT_TIMEOUT_MS) < 0) {
+        printf("The server did not answer\n");
+        fermerSocket(&startup->sock);
+        TRACE_END(span);
+        return NULL;
+    }
+    // The session comes once the server found an opponent
+    if (hello->flags & SESSION_QUEUED) {
+        printf("Waiting for an opponent...\n");
+        if (receiveHello(&startup->sock, hello, 0) < 0) {
+            printf("The server closed the connection\n");
+            fermerSocket(&startup->sock);
+            TRACE_END(span);
+            return NULL;
+        }
+    }
+    if (hello->flags & SESSION_FULL) {
+        printf(spectating ? "No match to watch\n" : "A match is in progress, try again later\n");
+        fermerSocket(&startup->sock);
+        TRACE_END(span);
+        return NULL;
+    }
+
+    // Receive the welcome message from the server
+    message_u message;
+    if (!spectating && recevoir(&startup->sock, &message) == MSG_TEXT) {
+        LOG_INFO("%s", message.text.buffer);
+    }
+    startup->status = 0;
+    TRACE_END(span);
+    return NULL;
 }
 
 /**
@@ -327,11 +434,46 @@ Map* map_new(int width, int height) {
  * @param map 
  * @return void
  */
-void drawMap(SDL_Renderer *renderer, Map *map, TTF_Font *font) {
+void drawMap(SDL_Renderer *renderer, Map *map, font_t *font) {
+    drawRows(renderer, map, font, 0, map->height);
+}
+
+/**
+ * function drawReceivedRows
+ * @brief Show the rows of the map received so far, while the rest arrives (called by receiveMap)
+ * 
+ * @param map 
+ * @param first (first row completed by the last piece received)
+ * @param last (rows received)
+ * @param arg (map_view_t *)
+ * @return void
+ */
+void drawReceivedRows(const Map *map, int first, int last, void *arg) {
+    map_view_t *view = (map_view_t *)arg;
+    // The frame presented is not kept by the renderer: the rows received before are drawn again
+    (void)first;
+    SDL_SetRenderDrawColor(view->renderer, 255, 255, 255, 255);
+    SDL_RenderClear(view->renderer);
+    drawRows(view->renderer, map, view->font, 0, last);
+    SDL_RenderPresent(view->renderer);
+}
+
+/**
+ * function drawRows
+ * @brief Draw rows of the map
+ * 
+ * @param renderer 
+ * @param map 
+ * @param font 
+ * @param first (first row drawn)
+ * @param last (row after the last one drawn)
+ * @return void
+ */
+void drawRows(SDL_Renderer *renderer, const Map *map, font_t *font, int first, int last) {
     SDL_Color textColor = { 255, 255, 255, 255 }; // White
     SDL_Color bgColor = { 0, 0, 0, 255 }; // Black
 
-    for (int y = 0; y < map->height; y++) {
+    for (int y = first; y < last; y++) {
         for (int x = 0; x < map->width; x++) {
             SDL_Rect rect = { x * CELL_SIZE, y * CELL_SIZE, CELL_SIZE, CELL_SIZE };
 
@@ -364,93 +506,15 @@ void drawMap(SDL_Renderer *renderer, Map *map, TTF_Font *font) {
                 }
 
                 if ((x == 0 && y != 0) || (y == 0 && x != 0)) {
-                    SDL_Surface *surface = TTF_RenderText_Solid(font, coords, textColor);
-                    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
-                    int text_width = surface->w;
-                    int text_height = surface->h;
-                    SDL_FreeSurface(surface);
-
-                    SDL_Rect textRect = { x * CELL_SIZE + (CELL_SIZE - text_width) / 2, y * CELL_SIZE + (CELL_SIZE - text_height) / 2, text_width, text_height };
-                    SDL_RenderCopy(renderer, texture, NULL, &textRect);
-                    SDL_DestroyTexture(texture);
+                    int text_width, text_height;
+                    fontMeasure(FONT_SMALL, coords, &text_width, &text_height);
+                    fontDraw(renderer, font, FONT_SMALL, coords, x * CELL_SIZE + (CELL_SIZE - text_width) / 2, y * CELL_SIZE + (CELL_SIZE - text_height) / 2, textColor);
                 }
             }
         }
     }
 }
 
-/**
- * function setSpecialPoint
- * @brief Set a special point on the map
- * 
- * @param map 
- * @param x 
- * @param y 
- * @param state 
- * @return void
- */
-void setSpecialPoint(Map *map, int x, int y, int state) {
-    if (x >= 0 && x < map->width && y >= 0 && y < map->height) {
-        map->cells[y * map->width + x] = state;
-        printf("Debug: Cell (%d, %d) set to %d\n", x, y, state);
-    }
-}
-
-/**
- * function isAccessible
- * @brief Check if a cell is accessible from a path, i.e. not surrounded by walls
- * 
- * @param map 
- * @param x 
- * @param y 
- * @return int
- */
-int isAccessible(Map *map, int x, int y) {
-    // Check if the coordinates are within the map boundaries
-    if (x < 0 || x >= map->width || y < 0 || y >= map->height) {
-        return 0;
-    }
-
-    // Check if the cell itself is a path or a bomb
-    if (map->cells[y * map->width + x] != PATH && map->cells[y * map->width + x] != BOMB) {
-        return 0;
-    }
-
-    // Check adjacent cells
-    int numWalls = 0;
-    if (x > 0 && map->cells[y * map->width + (x - 1)] == WALL) {
-        numWalls++; // Left cell
-    }
-    if (x < map->width - 1 && map->cells[y * map->width + (x + 1)] == WALL) {
-        numWalls++; // Right cell
-    }
-    if (y > 0 && map->cells[(y - 1) * map->width + x] == WALL) {
-        numWalls++; // Upper cell
-    }
-    if (y < map->height - 1 && map->cells[(y + 1) * map->width + x] == WALL) {
-        numWalls++; // Lower cell
-    }
-
-    // If there are 4 walls around the cell, it's not accessible
-    if (numWalls == 4) {
-        return 0;
-    }
-
-    // Check if the cell is connected to a path
-    if (numWalls == 3) {
-        // Check diagonally adjacent cells
-        if ((x > 0 && y > 0 && map->cells[(y - 1) * map->width + (x - 1)] != WALL) ||
-            (x < map->width - 1 && y > 0 && map->cells[(y - 1) * map->width + (x + 1)] != WALL) ||
-            (x > 0 && y < map->height - 1 && map->cells[(y + 1) * map->width + (x - 1)] != WALL) ||
-            (x < map->width - 1 && y < map->height - 1 && map->cells[(y + 1) * map->width + (x + 1)] != WALL)) {
-            return 1;
-        }
-        return 0;
-    }
-
-    return 1;
-}
-
 /**
  * function placePoint
  * @brief Place a point on the map
@@ -464,8 +528,11 @@ int isAccessible(Map *map, int x, int y) {
  * @param sock 
  * @return void
  */
-void placePoint(Map *map, SDL_Renderer *renderer, TTF_Font *font, int x, int y, int action, int sock) {  
-    if (!isAccessible(map, x, y)) {
+void placePoint(Map *map, SDL_Renderer *renderer, font_t *font, int x, int y, int action, socket_t *sock) {  
+    traceMutexLock(&map_mutex, "lock_wait map");
+    int accessible = isAccessible(&map_regions, x, y);
+    pthread_mutex_unlock(&map_mutex);
+    if (!accessible) {
         showMessage(renderer, font, "Cannot place point: The cell is not accessible.");
         return;
     }
@@ -475,7 +542,7 @@ void placePoint(Map *map, SDL_Renderer *renderer, TTF_Font *font, int x, int y,
         showMessage(renderer, font, "Cannot place point: The cell is a wall.");
         return;
     }
-    printf("Placing point at (%d, %d)\n", x, y);
+    LOG_DEBUG("Placing point at (%d, %d)", x, y);
 
     // If the player is a mine clearer, they can only deactivate bombs on a cell with a bomb state
     if (action == DEACTIVATED_BOMB && map->cells[y * map->width + x] != BOMB) {
@@ -485,7 +552,22 @@ void placePoint(Map *map, SDL_Renderer *renderer, TTF_Font *font, int x, int y,
     
     // Send the state and coordinates of the point to the server
     Point point = { x, y, action };
-    send(sock, &point, sizeof(Point), 0);
+    sendToServer(sock, MSG_POINT, &point);
+}
+
+/**
+ * function sendToServer
+ * @brief Send a request to the server, on the connection of the session (replaced when it is resumed)
+ * 
+ * @param sock 
+ * @param type 
+ * @param msg (of the C type given by the schema)
+ * @return void
+ */
+void sendToServer(socket_t *sock, msg_type_t type, const void *msg) {
+    traceMutexLock(&socket_mutex, "lock_wait socket");
+    envoyer(sock, type, msg);
+    pthread_mutex_unlock(&socket_mutex);
 }
 
 /**
@@ -500,30 +582,12 @@ void placePoint(Map *map, SDL_Renderer *renderer, TTF_Font *font, int x, int y,
  * @param color 
  * @return void
  */
-void renderText(SDL_Renderer *renderer, TTF_Font *font, const char *text, int x, int y, SDL_Color color, SDL_Color bgColor) {
-    TTF_SetFontSize(font, 26);
-    // Render text surface
-    SDL_Surface *textSurface = TTF_RenderText_Solid(font, text, color);
-    if (textSurface == NULL) {
-        fprintf(stderr, "Unable to render text surface: %s\n", TTF_GetError());
-        return;
-    }
-
-    // Create texture from surface
-    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, textSurface);
-    if (texture == NULL) {
-        fprintf(stderr, "Unable to create texture from surface: %s\n", SDL_GetError());
-        SDL_FreeSurface(textSurface);
-        return;
-    }
-
+void renderText(SDL_Renderer *renderer, font_t *font, const char *text, int x, int y, SDL_Color color, SDL_Color bgColor) {
     // Get text dimensions
-    int text_width = textSurface->w;
-    int text_height = textSurface->h;
-    SDL_FreeSurface(textSurface);
+    int text_width, text_height;
+    fontMeasure(FONT_LARGE, text, &text_width, &text_height);
 
     // Create background rectangle
-    SDL_Rect textRect = { x, y, text_width, text_height };
     SDL_Rect bgRect = { x - 5, y - 5, text_width + 10, text_height + 10 }; // Add padding to background
 
     // Render background rectangle
@@ -532,9 +596,7 @@ void renderText(SDL_Renderer *renderer, TTF_Font *font, const char *text, int x,
     SDL_RenderFillRect(renderer, &bgRect);
 
     // Render text
-    SDL_RenderCopy(renderer, texture, NULL, &textRect);
-    SDL_DestroyTexture(texture);
-    TTF_SetFontSize(font, 12);
+    fontDraw(renderer, font, FONT_LARGE, text, x, y, color);
 }
 
 /**
@@ -546,15 +608,12 @@ void renderText(SDL_Renderer *renderer, TTF_Font *font, const char *text, int x,
  * @param message 
  * @return void
  */
-void showMessage(SDL_Renderer *renderer, TTF_Font *font, const char *message) {
+void showMessage(SDL_Renderer *renderer, font_t *font, const char *message) {
     SDL_Color color = { 255, 0, 0, 255 }; // Red color
     SDL_Color bgColor = { 0, 0, 0, 200 }; // Semi-transparent black background
     // Measure the text dimensions
     int textWidth, textHeight;
-    if (TTF_SizeText(font, message, &textWidth, &textHeight) != 0) {
-        fprintf(stderr, "Failed to measure text: %s\n", TTF_GetError());
-        return;
-    }
+    fontMeasure(FONT_SMALL, message, &textWidth, &textHeight);
 
     // Calculate the position to center the text on the screen
     int screenWidth = MAX_MAP_WIDTH * CELL_SIZE;
@@ -575,53 +634,6 @@ void showMessage(SDL_Renderer *renderer, TTF_Font *font, const char *message) {
     SDL_RenderClear(renderer);
 }
 
-/**
- * function handleInput
- * @brief Handle the input from the user
- * 
- * @param player 
- * @param map 
- * @param event 
- * @return void
- */
-void handleInput(Player *player, Map *map, int action) {
-    switch (action) {
-        case MOVE_UP:
-            movePlayer(player, map, 0, -1);
-            break;
-        case MOVE_DOWN:
-            movePlayer(player, map, 0, 1);
-            break;
-        case MOVE_LEFT:
-            movePlayer(player, map, -1, 0);
-            break;
-        case MOVE_RIGHT:
-            movePlayer(player, map, 1, 0);
-            break;
-    }
-}
-
-/**
- * function movePlayer
- * @brief Move the player on the map with the arrow keys or gpio buttons
- * 
- * @param map
- * @param player
- * @param dx
- * @param dy
- * @return void
- */
-void movePlayer(Player *player, Map *map, int dx, int dy) {
-    int newX = player->x + dx;
-    int newY = player->y + dy;
-
-    // Check if the new position is within the map boundaries and is not a wall
-    if (newX >= 0 && newX < map->width && newY >= 0 && newY < map->height && map->cells[newY * map->width + newX] != WALL) {
-        player->x = newX;
-        player->y = newY;
-    }
-}
-
 /**
  * function renderPlayer
  * @brief Render the player on the map
@@ -640,6 +652,23 @@ void renderPlayer(SDL_Renderer *renderer, Player *player) {
     SDL_RenderFillRect(renderer, &playerRect);
 }
 
+/**
+ * function renderOpponent
+ * @brief Render the opponent at its last position received on the UDP channel
+ * 
+ * @param renderer 
+ * @return void
+ */
+void renderOpponent(SDL_Renderer *renderer) {
+    traceMutexLock(&channel_mutex, "lock_wait channel");
+    Player copy = opponent;
+    int known = opponent_known;
+    pthread_mutex_unlock(&channel_mutex);
+    if (known) {
+        renderPlayer(renderer, &copy);
+    }
+}
+
 /**
  * function initHT16K33
  * @brief Initialize the 7-segment display
@@ -738,7 +767,7 @@ void generateSDLEventButton(int btnIndex) {
     SDL_Event event;
     SDL_zero(event);
 
-    printf("button : %d ", btnIndex);
+    LOG_DEBUG("Button : %d", btnIndex);
     switch (btnIndex) {
         case 2: // Button 2
             event.type = SDL_KEYDOWN;
@@ -761,7 +790,7 @@ void generateSDLEventButton(int btnIndex) {
             event.key.keysym.sym = SDLK_SPACE; // Use space for bomb action
             break;
         default:
-            printf("Invalid button pressed\n");
+            LOG_WARN("Invalid button pressed");
             return;
     }
 
@@ -780,7 +809,7 @@ void handleButtonMatrix() {
         digitalWrite(cols[i], LOW);
         for (int j = 0; j < ROWS; j++) {
             if (digitalRead(rows[j]) == LOW) {
-                printf("Button pressed :%d ",rows[j]);
+                LOG_DEBUG("Button pressed : %d", rows[j]);
                 generateSDLEventButton(j * 3 + i + 1);
                 usleep(500000); // Debounce delay
             }
@@ -799,38 +828,46 @@ void handleButtonMatrix() {
  * @return void*
  */
 void *receiveUpdates(void *arg) {
+    traceThreadName("receiveUpdates");
     recv_thread_data_t *data = (recv_thread_data_t *)arg;
-    int sock = data->sock_fd;
     Map *map = data->map;
 
-    char buffer[BUFFER_SIZE];
-    ssize_t recv_size;
+    message_u message;
+    int game_over = 0;
 
     while (1) {
-        // Reset buffer
-        memset(buffer, 0, BUFFER_SIZE);
-
-        // Receive data from the server
-        recv_size = recv(sock, buffer, sizeof(buffer), 0);
-        if (recv_size <= 0) {
-            if (recv_size == 0) {
-                printf("Server closed connection.\n");
-            } else {
-                perror("recv");
+        // Receive the next message from the server
+        TRACE_BEGIN(recv_span, "recv");
+        int type = recevoir(data->sock, &message);
+        TRACE_END(recv_span);
+        if (type < 0) {
+            LOG_INFO("Server closed connection.");
+            // The connection dropped during the match: resume the session on a new one
+            if (!game_over && !spectating && reconnectToServer(data) == 0) {
+                continue;
+            }
+            if (!game_over) {
+                SDL_Event event;
+                event.type = SDL_USEREVENT;
+                event.user.code = 3;
+                event.user.data1 = strcpy(malloc(32), "Connection to the server lost");
+                SDL_PushEvent(&event);
             }
             break;
         }
 
-        printf("Debug: Received %d bytes\n", recv_size);
+        LOG_DEBUG("Received message %d", type);
 
         // Determine the type of message received
-        if (recv_size == sizeof(Point)) {
-            Point point;
-            memcpy(&point, buffer, sizeof(Point));
-            printf("Debug: Received point from server: (%d, %d, %d)\n", point.x, point.y, point.state);
+        if (type == MSG_POINT) {
+            Point point = message.point;
+            LOG_DEBUG("Received point from server: (%d, %d, %d)", point.x, point.y, point.state);
 
-            pthread_mutex_lock(&map_mutex);
+            traceMutexLock(&map_mutex, "lock_wait map");
+            TRACE_BEGIN(apply_span, "apply_point");
             setSpecialPoint(map, point.x, point.y, point.state);
+            regionsUpdate(&map_regions, map, point.x, point.y);
+            TRACE_END(apply_span);
             pthread_mutex_unlock(&map_mutex);
 
             SDL_Event event;
@@ -839,10 +876,47 @@ void *receiveUpdates(void *arg) {
             SDL_PushEvent(&event);
             // delay
             usleep(200000); // 200 ms
-        } else {
-            printf("Debug: Received message from server: %s\n", buffer);
+        } else if (type == MSG_BLAST) {
+            LOG_DEBUG("Received blast of %d rows from row %d", message.blast.rows, message.blast.top);
+
+            traceMutexLock(&map_mutex, "lock_wait map");
+            applyBlast(map, &message.blast);
+            pthread_mutex_unlock(&map_mutex);
+
+            SDL_Event event;
+            event.type = SDL_USEREVENT;
+            event.user.code = 1; // Code 1 for rendering the map
+            SDL_PushEvent(&event);
+        } else if (type == MSG_MAP) {
+            // A spectator gets the whole map when it joins, when it fell behind and at each new match
+            traceMutexLock(&map_mutex, "lock_wait map");
+            map->width = message.map.width;
+            map->height = message.map.height;
+            memcpy(map->cells, message.map.cells, map->width * map->height * sizeof(int));
+            regionsBuild(&map_regions, map);
+            pthread_mutex_unlock(&map_mutex);
+        } else if (type == MSG_ACTOR) {
+            // Player 0 is drawn as the player, the other one as the opponent
+            traceMutexLock(&channel_mutex, "lock_wait channel");
+            Player *actor = message.actor.id == 0 ? data->player : &opponent;
+            actor->x = message.actor.x;
+            actor->y = message.actor.y;
+            actor->role = message.actor.role;
+            if (message.actor.id != 0) {
+                opponent_known = 1;
+            }
+            pthread_mutex_unlock(&channel_mutex);
+
+            SDL_Event event;
+            event.type = SDL_USEREVENT;
+            event.user.code = 1; // Code 1 for rendering the map
+            SDL_PushEvent(&event);
+        } else if (type == MSG_TEXT) {
+            const char *buffer = message.text.buffer;
+            LOG_DEBUG("Received message from server: %s", buffer);
 
             if (strstr(buffer, "Game ended") != NULL) {
+                game_over = 1;
                 SDL_Event event;
                 event.type = SDL_USEREVENT;
                 event.user.code = 3;
@@ -850,7 +924,7 @@ void *receiveUpdates(void *arg) {
                 SDL_PushEvent(&event);
             } else if (strstr(buffer, "The countdown starts now!") != NULL) {
                 // Start the countdown timer
-                printf("Debug: start timer\n");
+                LOG_DEBUG("Start timer");
                 pthread_t timer_thread;
                 pthread_create(&timer_thread, NULL, chrono_thread, &fd);
                 pthread_detach(timer_thread);
@@ -872,4 +946,158 @@ void *receiveUpdates(void *arg) {
     }
 
     return NULL;
-}
\ No newline at end of file
+}
+
+/**
+ * function reconnectToServer
+ * @brief Reconnect to the server and resume the session: the map is kept,
+ *        the server sends the player and the bombs placed in the meantime
+ * 
+ * @param data (thread data, its socket is replaced)
+ * @return int (0 if the session was resumed, -1 otherwise)
+ */
+int reconnectToServer(recv_thread_data_t *data) {
+    time_t deadline = time(NULL) + RECONNECT_TIMEOUT_S;
+
+    while (time(NULL) < deadline) {
+        LOG_INFO("Reconnecting to the server...");
+        socket_t sock = createAndConnectToServer();
+        if (sock.fd < 0) {
+            sleep(1);
+            continue;
+        }
+
+        session_hello_t hello;
+        if (sendHello(&sock, data->token, 0) < 0 || receiveHello(&sock, &hello, CONNECT_TIMEOUT_MS) < 0) {
+            fermerSocket(&sock);
+            sleep(1);
+            continue;
+        }
+        if (!(hello.flags & SESSION_RESUMED)) {
+            LOG_WARN("The server could not resume the session");
+            fermerSocket(&sock);
+            return -1;
+        }
+
+        // The bombs placed in the meantime follow, as the usual updates
+        message_u message;
+        if (recevoir(&sock, &message) != MSG_PLAYER) {
+            fermerSocket(&sock);
+            continue;
+        }
+
+        traceMutexLock(&map_mutex, "lock_wait map");
+        data->player->x = message.player.x;
+        data->player->y = message.player.y;
+        data->player->role = message.player.state;
+        pthread_mutex_unlock(&map_mutex);
+
+        // The main loop sends its requests on the new connection from now on
+        traceMutexLock(&socket_mutex, "lock_wait socket");
+        socket_t old_sock = *data->sock;
+        *data->sock = sock;
+        pthread_mutex_unlock(&socket_mutex);
+        fermerSocket(&old_sock);
+        LOG_INFO("Session resumed");
+
+        SDL_Event event;
+        event.type = SDL_USEREVENT;
+        event.user.code = 1; // Code 1 for rendering the map
+        SDL_PushEvent(&event);
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * function openChannel
+ * @brief Open the UDP channel with the server of the TCP connection (disabled by BOMBO2I_UDP=0)
+ * 
+ * @param sock (TCP connection to the server)
+ * @param token (session token, identifies the player on the channel)
+ * @return void
+ */
+void openChannel(socket_t *sock, unsigned long long token) {
+    const char *udp = getenv("BOMBO2I_UDP");
+    if ((udp != NULL && strcmp(udp, "0") == 0) || sock->addrDst.sin_family != AF_INET) {
+        return;
+    }
+    channel_socket = channelSocket(NULL, 0);
+    if (channel_socket.fd < 0) {
+        return;
+    }
+    // The server listens on the same port in UDP
+    channelPeerInit(&channel_peer, &sock->addrDst, token);
+    channelSend(&channel_socket, &channel_peer, CHANNEL_JOIN, NULL, 0, 1);
+}
+
+/**
+ * function sendPosition
+ * @brief Send the position of the player on the UDP channel (unreliable, the newest one wins).
+ *        Without the channel it goes on the connection, as a point on a path: the server checks the requests against it
+ * 
+ * @param player 
+ * @param sock (connection of the session, NULL when the channel is open)
+ * @return void
+ */
+void sendPosition(Player *player, socket_t *sock) {
+    if (channel_socket.fd < 0) {
+        Point move = { player->x, player->y, PATH };
+        sendToServer(sock, MSG_POINT, &move);
+        return;
+    }
+    Point point = { player->x, player->y, player->role };
+    unsigned char payload[CHANNEL_MAX_PAYLOAD];
+    size_t len = encodePayload(payload, MSG_POINT, &point);
+    traceMutexLock(&channel_mutex, "lock_wait channel");
+    channelSend(&channel_socket, &channel_peer, CHANNEL_POSITION, payload, len, 0);
+    pthread_mutex_unlock(&channel_mutex);
+}
+
+/**
+ * function receiveDatagrams
+ * @brief Receive the position of the opponent on the UDP channel, send the acks and refresh our position
+ * 
+ * @param arg (Player *, the player of this client)
+ * @return void*
+ */
+void *receiveDatagrams(void *arg) {
+    traceThreadName("receiveDatagrams");
+    Player *player = (Player *)arg;
+    struct pollfd pfd = { .fd = channel_socket.fd, .events = POLLIN };
+    channel_packet_t packet;
+    struct sockaddr_in from;
+    Uint32 last_refresh = 0;
+
+    while (1) {
+        poll(&pfd, 1, CHANNEL_ACK_MS);
+
+        int moved = 0;
+        traceMutexLock(&channel_mutex, "lock_wait channel");
+        while (channelReceive(&channel_socket, &packet, &from) > 0) {
+            Point point;
+            if (channelAccept(&channel_peer, &packet) && packet.header.type == CHANNEL_POSITION
+                && decodePayload(MSG_POINT, packet.payload, packet.header.len, &point) == 0) {
+                opponent.x = point.x;
+                opponent.y = point.y;
+                opponent.role = point.state;
+                opponent_known = 1;
+                moved = 1;
+            }
+        }
+        channelUpdate(&channel_socket, &channel_peer);
+        pthread_mutex_unlock(&channel_mutex);
+
+        if (SDL_GetTicks() - last_refresh >= POSITION_REFRESH_MS) {
+            last_refresh = SDL_GetTicks();
+            sendPosition(player, NULL);
+        }
+        if (moved) {
+            SDL_Event event;
+            event.type = SDL_USEREVENT;
+            event.user.code = 1; // Code 1 for rendering the map
+            SDL_PushEvent(&event);
+        }
+    }
+    return NULL;
+}
@@ -2,13 +2,19 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <SDL2/SDL.h>
-#include <SDL2/SDL_ttf.h>
 #include <time.h>
 #include <pthread.h>
+#include <signal.h>
+#include <poll.h>
 #include <wiringPi.h>
 #include <wiringPiI2C.h>
 #include "../library/data.h"
 #include "../library/session.h"
+#include "../library/log.h"
+#include "../library/trace.h"
+#include "../library/channel.h"
+#include "game.h"
+#include "font.h"
 
 // --- Constants ---
 #define BUFFER_SIZE 1024
@@ -19,56 +25,49 @@
 #define HT16K33_CMD_SYSTEM_SETUP 0x20
 #define HT16K33_CMD_DISPLAY_SETUP 0x80
 #define HT16K33_CMD_BRIGHTNESS 0xE0
+#define RECONNECT_TIMEOUT_S 30 // The server keeps a dropped player for 30 s
+#define POSITION_REFRESH_MS 500 // The position is sent again on the UDP channel, a lost one is replaced
 
 // Define GPIO pins for the rows and columns
 int rows[ROWS] = {2, 3, 21, 22};
 int cols[COLS] = {6, 25, 24, 23};
 
 // --- Structures ---
-typedef enum {
-    WALL,
-    PATH,
-    BOMB,
-    DEACTIVATED_BOMB,
-} Cell;
-
-typedef enum {
-    MOVE_UP,
-    MOVE_DOWN,
-    MOVE_LEFT,
-    MOVE_RIGHT,
-    PLACE_BOMB,
-    DEACTIVATE_BOMB
-} Action;
-
-typedef enum {
-    BOMBER,
-    MINE_CLEARER
-} Role;
+typedef struct {
+    socket_t *sock;             // Replaced when the session is resumed on a new connection
+    Map *map;
+    Player *player;
+    unsigned long long token;   // Session token given by the server
+} recv_thread_data_t;
 
+// Session opened by connectToServer while the window is created
 typedef struct {
-    int x;
-    int y;
-    Role role;
-} Player;
+    socket_t sock;
+    session_hello_t hello;
+    unsigned long long room;    // Room watched by a spectator
+    unsigned int flags;         // Flags of the hello
+    int status;                 // 0 once the session is open, -1 if the client must stop
+} startup_t;
 
+// Where the rows of the map are drawn while it arrives
 typedef struct {
-    int sock_fd;
-    Map *map;
-} recv_thread_data_t;
+    SDL_Renderer *renderer;
+    font_t *font;
+} map_view_t;
 
 // --- Functions ---
-Map* map_new(int width, int height);
-void drawMap(SDL_Renderer *renderer, Map *map, TTF_Font *font);
-void setSpecialPoint(Map *map, int x, int y, int state);
-int isAccessible(Map *map, int x, int y);
-void placePoint(Map *map, SDL_Renderer *renderer, TTF_Font *font, int x, int y, int action, int sock);
-void renderText(SDL_Renderer *renderer, TTF_Font *font, const char *text, int x, int y, SDL_Color color, SDL_Color bgColor);
-void showMessage(SDL_Renderer *renderer, TTF_Font *font, const char *message);
-void movePlayer(Player *player, Map *map, int dx, int dy);
-void handleInput(Player *player, Map *map, int action);
-void movePlayer(Player *player, Map *map, int dx, int dy);
+long long monotonicNs(void);
+void *setupHardware(void *arg);
+void *connectToServer(void *arg);
+void drawMap(SDL_Renderer *renderer, Map *map, font_t *font);
+void drawRows(SDL_Renderer *renderer, const Map *map, font_t *font, int first, int last);
+void drawReceivedRows(const Map *map, int first, int last, void *arg);
+void placePoint(Map *map, SDL_Renderer *renderer, font_t *font, int x, int y, int action, socket_t *sock);
+void sendToServer(socket_t *sock, msg_type_t type, const void *msg);
+void renderText(SDL_Renderer *renderer, font_t *font, const char *text, int x, int y, SDL_Color color, SDL_Color bgColor);
+void showMessage(SDL_Renderer *renderer, font_t *font, const char *message);
 void renderPlayer(SDL_Renderer *renderer, Player *player);
+void renderOpponent(SDL_Renderer *renderer);
 
 void handleButtonMatrix();
 void generateSDLEventButton(int btnIndex);
@@ -79,4 +78,8 @@ void chrono(int fd);
 void display7segments(int fd, int sec);
 void *chrono_thread(void *arg);
 
-void *receiveUpdates(void *arg);
\ No newline at end of file
+void *receiveUpdates(void *arg);
+int reconnectToServer(recv_thread_data_t *data);
+void openChannel(socket_t *sock, unsigned long long token);
+void sendPosition(Player *player, socket_t *sock);
+void *receiveDatagrams(void *arg);
\ No newline at end of file
@@ -0,0 +1,542 @@
+#define _GNU_SOURCE
+#include "mapgen.h"
+#include <time.h>
+
+// --- Constants ---
+#define MAZE_LOOP_PERCENT 8     // Walls between two corridors of a maze removed to make loops
+#define CAVES_FILL_PERCENT 42   // Walls of the caves before the smoothing
+#define CAVES_SMOOTHING 5       // Smoothing passes of the caves
+#define ROOMS_MIN_LEAF 8        // Smallest side of a part of the BSP split, it holds a room
+
+static void generateGrid(Map *map, rng_t *rng);
+static void generateMaze(Map *map, rng_t *rng);
+static void generateCaves(Map *map, rng_t *rng);
+static void generateRooms(Map *map, rng_t *rng);
+
+// Indexed by generator_id_t
+static const map_generator_t generators[GENERATOR_COUNT] = {
+    { "grid", generateGrid },
+    { "maze", generateMaze },
+    { "caves", generateCaves },
+    { "rooms", generateRooms },
+};
+
+// --- Random numbers ---
+
+/**
+ * function rngSeed
+ * @brief Seed a generator, the state is spread from the seed by splitmix64
+ *
+ * @param rng
+ * @param seed
+ * @return void
+ */
+void rngSeed(rng_t *rng, unsigned int seed) {
+    unsigned long long z = seed;
+    for (int i = 0; i < 4; i += 2) {
+        z += 0x9E3779B97F4A7C15ull;
+        unsigned long long v = z;
+        v = (v ^ (v >> 30)) * 0xBF58476D1CE4E5B9ull;
+        v = (v ^ (v >> 27)) * 0x94D049BB133111EBull;
+        v ^= v >> 31;
+        rng->s[i] = (unsigned int)v;
+        rng->s[i + 1] = (unsigned int)(v >> 32);
+    }
+}
+
+/**
+ * function rotl
+ * @brief Rotate a word to the left
+ *
+ * @param x
+ * @param k
+ * @return unsigned int
+ */
+static unsigned int rotl(unsigned int x, int k) {
+    return (x << k) | (x >> (32 - k));
+}
+
+/**
+ * function rngNext
+ * @brief Draw the next number of a generator (xoshiro128**)
+ *
+ * @param rng
+ * @return unsigned int
+ */
+unsigned int rngNext(rng_t *rng) {
+    unsigned int *s = rng->s;
+    unsigned int result = rotl(s[1] * 5, 7) * 9;
+    unsigned int t = s[1] << 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 11);
+    return result;
+}
+
+/**
+ * function rngRange
+ * @brief Draw a number in [0, n)
+ *
+ * @param rng
+ * @param n
+ * @return int
+ */
+int rngRange(rng_t *rng, int n) {
+    return (int)(((unsigned long long)rngNext(rng) * (unsigned int)n) >> 32);
+}
+
+// --- Generators ---
+
+/**
+ * function fillMap
+ * @brief Set all the cells of a map
+ *
+ * @param map
+ * @param cell
+ * @return void
+ */
+static void fillMap(Map *map, int cell) {
+    for (int i = 0; i < map->width * map->height; i++) {
+        map->cells[i] = cell;
+    }
+}
+
+/**
+ * function generateGrid
+ * @brief Generate a grid of corridors with open crossings and a few obstacles, as generateMap does
+ *
+ * @param map
+ * @param rng
+ * @return void
+ */
+static void generateGrid(Map *map, rng_t *rng) {
+    fillMap(map, WALL);
+
+    // Corridors
+    for (int y = 1; y < map->height; y += 2) {
+        for (int x = 1; x < map->width; x += 2) {
+            map->cells[y * map->width + x] = PATH;
+            if (x + 1 < map->width) {
+                map->cells[y * map->width + x + 1] = PATH;
+            }
+            if (y + 1 < map->height) {
+                map->cells[(y + 1) * map->width + x] = PATH;
+            }
+        }
+    }
+
+    // Open crossings
+    for (int y = 3; y < map->height; y += 4) {
+        for (int x = 3; x < map->width; x += 4) {
+            map->cells[y * map->width + x] = PATH;
+            if (x + 1 < map->width) {
+                map->cells[y * map->width + x + 1] = PATH;
+            }
+            if (y + 1 < map->height) {
+                map->cells[(y + 1) * map->width + x] = PATH;
+            }
+            if (x - 1 > 0) {
+                map->cells[y * map->width + x - 1] = PATH;
+            }
+            if (y - 1 > 0) {
+                map->cells[(y - 1) * map->width + x] = PATH;
+            }
+        }
+    }
+
+    // Obstacles
+    for (int y = 1; y < map->height; y++) {
+        for (int x = 1; x < map->width; x++) {
+            if (map->cells[y * map->width + x] == PATH && rngRange(rng, 100) < 4) {
+                map->cells[y * map->width + x] = WALL;
+            }
+        }
+    }
+}
+
+/**
+ * function generateMaze
+ * @brief Generate a maze with a recursive backtracker on the cells of odd coordinates, the stack is explicit.
+ *        A few walls between two corridors are removed afterwards, a maze without loops is a poor arena.
+ *
+ * @param map
+ * @param rng
+ * @return void
+ */
+static void generateMaze(Map *map, rng_t *rng) {
+    static const int dx[4] = { 0, 0, -1, 1 };
+    static const int dy[4] = { -1, 1, 0, 0 };
+    fillMap(map, WALL);
+
+    // Maze cell (i, j) is the map cell (2i + 1, 2j + 1)
+    int columns = (map->width - 1) / 2, rows = (map->height - 1) / 2;
+    if (columns <= 0 || rows <= 0) {
+        return;
+    }
+    int stack[MAX_MAP_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    map->cells[map->width + 1] = PATH;
+    while (top > 0) {
+        int i = stack[top - 1] % columns, j = stack[top - 1] / columns;
+        int next[4], count = 0;
+        for (int d = 0; d < 4; d++) {
+            int ni = i + dx[d], nj = j + dy[d];
+            if (ni >= 0 && ni < columns && nj >= 0 && nj < rows
+                && map->cells[(2 * nj + 1) * map->width + 2 * ni + 1] == WALL) {
+                next[count++] = d;
+            }
+        }
+        if (count == 0) {
+            top--;
+            continue;
+        }
+        int d = next[rngRange(rng, count)];
+        int ni = i + dx[d], nj = j + dy[d];
+        map->cells[(2 * j + 1 + dy[d]) * map->width + 2 * i + 1 + dx[d]] = PATH;
+        map->cells[(2 * nj + 1) * map->width + 2 * ni + 1] = PATH;
+        stack[top++] = nj * columns + ni;
+    }
+
+    // Loops: a wall with a corridor on both sides
+    for (int y = 1; y < 2 * rows; y++) {
+        for (int x = 1; x < 2 * columns; x++) {
+            int cell = y * map->width + x;
+            if (map->cells[cell] != WALL || (x + y) % 2 == 0) {
+                continue;
+            }
+            if (rngRange(rng, 100) < MAZE_LOOP_PERCENT) {
+                map->cells[cell] = PATH;
+            }
+        }
+    }
+}
+
+/**
+ * function generateCaves
+ * @brief Generate caves with a cellular automaton: random walls smoothed by their neighbours.
+ *        The pockets outside the largest cave are filled, the map then always connects.
+ *
+ * @param map
+ * @param rng
+ * @return void
+ */
+static void generateCaves(Map *map, rng_t *rng) {
+    int width = map->width, height = map->height;
+    int cells[MAX_MAP_SIZE];
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int border = x == 0 || y == 0 || x == width - 1 || y == height - 1;
+            map->cells[y * width + x] = border || rngRange(rng, 100) < CAVES_FILL_PERCENT ? WALL : PATH;
+        }
+    }
+
+    // A cell becomes a wall with at least 5 walls around it (itself included), out of the map counts as walls
+    for (int pass = 0; pass < CAVES_SMOOTHING; pass++) {
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                int walls = 0;
+                for (int ny = y - 1; ny <= y + 1; ny++) {
+                    for (int nx = x - 1; nx <= x + 1; nx++) {
+                        walls += nx < 0 || ny < 0 || nx >= width || ny >= height || map->cells[ny * width + nx] == WALL;
+                    }
+                }
+                cells[y * width + x] = walls >= 5 ? WALL : PATH;
+            }
+        }
+        memcpy(map->cells, cells, sizeof(int) * width * height);
+    }
+
+    regions_t regions;
+    regionsBuild(&regions, map);
+    int main_root = regionsFind(&regions, regions.main);
+    for (int cell = 0; cell < width * height; cell++) {
+        if (map->cells[cell] != WALL && regionsFind(&regions, cell) != main_root) {
+            map->cells[cell] = WALL;
+        }
+    }
+}
+
+/**
+ * function carveRect
+ * @brief Open the cells of a rectangle
+ *
+ * @param map
+ * @param x
+ * @param y
+ * @param width
+ * @param height
+ * @return void
+ */
+static void carveRect(Map *map, int x, int y, int width, int height) {
+    for (int j = y; j < y + height; j++) {
+        for (int i = x; i < x + width; i++) {
+            map->cells[j * map->width + i] = PATH;
+        }
+    }
+}
+
+/**
+ * function splitRooms
+ * @brief Split a part of the map in two until it is too small, place a room in each leaf
+ *        and link the two halves of each split by a corridor
+ *
+ * @param map
+ * @param rng
+ * @param x
+ * @param y
+ * @param width
+ * @param height
+ * @param cx (center of a room of the part)
+ * @param cy
+ * @return void
+ */
+static void splitRooms(Map *map, rng_t *rng, int x, int y, int width, int height, int *cx, int *cy) {
+    int ax, ay, bx, by;
+    if (width >= 2 * ROOMS_MIN_LEAF && (width >= height || height < 2 * ROOMS_MIN_LEAF)) {
+        int split = ROOMS_MIN_LEAF + rngRange(rng, width - 2 * ROOMS_MIN_LEAF + 1);
+        splitRooms(map, rng, x, y, split, height, &ax, &ay);
+        splitRooms(map, rng, x + split, y, width - split, height, &bx, &by);
+    } else if (height >= 2 * ROOMS_MIN_LEAF) {
+        int split = ROOMS_MIN_LEAF + rngRange(rng, height - 2 * ROOMS_MIN_LEAF + 1);
+        splitRooms(map, rng, x, y, width, split, &ax, &ay);
+        splitRooms(map, rng, x, y + split, width, height - split, &bx, &by);
+    } else {
+        // Leaf: a room of at least 3x3 cells, a wall of the leaf kept on each side
+        int room_width = 3 + rngRange(rng, width - 4);
+        int room_height = 3 + rngRange(rng, height - 4);
+        int room_x = x + 1 + rngRange(rng, width - room_width - 1);
+        int room_y = y + 1 + rngRange(rng, height - room_height - 1);
+        carveRect(map, room_x, room_y, room_width, room_height);
+        *cx = room_x + room_width / 2;
+        *cy = room_y + room_height / 2;
+        return;
+    }
+
+    // L-shaped corridor between a room of each half
+    int step_x = ax < bx ? 1 : -1, step_y = ay < by ? 1 : -1;
+    for (int i = ax; i != bx; i += step_x) {
+        map->cells[ay * map->width + i] = PATH;
+    }
+    for (int j = ay; j != by + step_y; j += step_y) {
+        map->cells[j * map->width + bx] = PATH;
+    }
+    *cx = ax;
+    *cy = ay;
+}
+
+/**
+ * function generateRooms
+ * @brief Generate rooms in the parts of a BSP split of the map, linked by corridors
+ *
+ * @param map
+ * @param rng
+ * @return void
+ */
+static void generateRooms(Map *map, rng_t *rng) {
+    fillMap(map, WALL);
+    if (map->width < ROOMS_MIN_LEAF || map->height < ROOMS_MIN_LEAF) {
+        return;
+    }
+    int cx, cy;
+    splitRooms(map, rng, 0, 0, map->width, map->height, &cx, &cy);
+}
+
+/**
+ * function generatorFind
+ * @brief Find a generator by its name
+ *
+ * @param name
+ * @return int (id of the generator, -1 if there is none of this name)
+ */
+int generatorFind(const char *name) {
+    for (int i = 0; i < GENERATOR_COUNT; i++) {
+        if (strcmp(generators[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * function generatorName
+ * @brief Get the name of a generator
+ *
+ * @param generator
+ * @return const char*
+ */
+const char *generatorName(int generator) {
+    return generator >= 0 && generator < GENERATOR_COUNT ? generators[generator].name : "unknown";
+}
+
+/**
+ * function generateMapWith
+ * @brief Generate a map with a generator from a seed, the same seed always gives the same map
+ *
+ * @param map (its size is kept)
+ * @param generator
+ * @param seed
+ * @return void
+ */
+void generateMapWith(Map *map, int generator, unsigned int seed) {
+    rng_t rng;
+    rngSeed(&rng, seed);
+    generators[generator].generate(map, &rng);
+}
+
+/**
+ * function generateValidMap
+ * @brief Generate a map whose paths all connect, the seeds after the first one are tried until one does
+ *
+ * @param out (map, its regions and the seed that made it)
+ * @param generator
+ * @param seed (first seed tried)
+ * @return int (0 if the map connects, -1 if no seed gave a connected map)
+ */
+int generateValidMap(pooled_map_t *out, int generator, unsigned int seed) {
+    TRACE_BEGIN(span, "generateValidMap");
+    out->map.width = MAX_MAP_WIDTH;
+    out->map.height = MAX_MAP_HEIGHT;
+    out->generator = generator;
+    for (int attempt = 0; attempt < MAP_ATTEMPTS; attempt++) {
+        out->seed = seed + attempt;
+        generateMapWith(&out->map, generator, out->seed);
+        regionsBuild(&out->regions, &out->map);
+        if (out->regions.count == 1) {
+            TRACE_END(span);
+            return 0;
+        }
+        LOG_DEBUG("Map %s of seed %u rejected, %d regions", generatorName(generator), out->seed, out->regions.count);
+    }
+    TRACE_END(span);
+    return -1;
+}
+
+// --- Map pool ---
+
+/**
+ * function mapPoolInit
+ * @brief Initialise a pool of maps
+ *
+ * @param pool
+ * @param generators (names of the generators used in turn, separated by commas, NULL for the grid only)
+ * @return void
+ */
+void mapPoolInit(map_pool_t *pool, const char *generators) {
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->not_full, NULL);
+    pool->head = 0;
+    pool->count = 0;
+    pool->next = 0;
+    pool->misses = 0;
+    pool->generator_count = 0;
+
+    char names[256];
+    snprintf(names, sizeof(names), "%s", generators != NULL ? generators : "");
+    char *save = NULL;
+    for (char *name = strtok_r(names, ",", &save); name != NULL; name = strtok_r(NULL, ",", &save)) {
+        int generator = generatorFind(name);
+        if (generator < 0) {
+            LOG_WARN("Unknown map generator %s, ignored", name);
+        } else if (pool->generator_count < GENERATOR_COUNT) {
+            pool->generators[pool->generator_count++] = generator;
+        }
+    }
+    if (pool->generator_count == 0) {
+        pool->generators[pool->generator_count++] = GENERATOR_GRID;
+    }
+}
+
+/**
+ * function poolGenerate
+ * @brief Generate the next map of a pool, from the next generator and a new seed. A map whose paths
+ *        do not all connect never enters the pool: the next seeds are tried, with the next generator
+ *
+ * @param pool
+ * @param out
+ * @return void
+ */
+static void poolGenerate(map_pool_t *pool, pooled_map_t *out) {
+    pthread_mutex_lock(&pool->mutex);
+    unsigned int n = pool->next++;
+    int generator = pool->generators[n % pool->generator_count];
+    pthread_mutex_unlock(&pool->mutex);
+
+    // Far apart first seeds, the attempts of two maps do not overlap
+    unsigned int seed = ((unsigned int)time(NULL) + n) * 2654435761u;
+    for (int round = 1; generateValidMap(out, generator, seed) != 0; round++) {
+        LOG_WARN("No connected %s map after %d seeds, trying the next ones", generatorName(generator), MAP_ATTEMPTS);
+        seed += MAP_ATTEMPTS;
+        generator = pool->generators[(n + round) % pool->generator_count];
+    }
+}
+
+/**
+ * function mapPoolFill
+ * @brief Thread keeping a pool of maps full
+ *
+ * @param arg (map_pool_t*)
+ * @return void*
+ */
+static void *mapPoolFill(void *arg) {
+    map_pool_t *pool = (map_pool_t *)arg;
+    pooled_map_t next;
+    for (;;) {
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->count == MAP_POOL_SIZE) {
+            pthread_cond_wait(&pool->not_full, &pool->mutex);
+        }
+        pthread_mutex_unlock(&pool->mutex);
+
+        // Only this thread adds maps: the free place is still free after the generation
+        poolGenerate(pool, &next);
+        pthread_mutex_lock(&pool->mutex);
+        pool->maps[(pool->head + pool->count) % MAP_POOL_SIZE] = next;
+        pool->count++;
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    return NULL;
+}
+
+/**
+ * function mapPoolStart
+ * @brief Start the thread filling a pool of maps
+ *
+ * @param pool
+ * @return int (0 on success, -1 on error)
+ */
+int mapPoolStart(map_pool_t *pool) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, mapPoolFill, pool) != 0) {
+        LOG_ERROR("Could not create the map pool thread");
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+/**
+ * function mapPoolTake
+ * @brief Take the next map of a pool, it is generated now if the pool is empty
+ *
+ * @param pool
+ * @param out
+ * @return void
+ */
+void mapPoolTake(map_pool_t *pool, pooled_map_t *out) {
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->count > 0) {
+        *out = pool->maps[pool->head];
+        pool->head = (pool->head + 1) % MAP_POOL_SIZE;
+        pool->count--;
+        pthread_cond_signal(&pool->not_full);
+        pthread_mutex_unlock(&pool->mutex);
+        return;
+    }
+    pool->misses++;
+    pthread_mutex_unlock(&pool->mutex);
+    poolGenerate(pool, out);
+}
@@ -0,0 +1,66 @@
+#ifndef MAPGEN_H
+#define MAPGEN_H
+
+#include "game.h"
+#include <pthread.h>
+
+// --- Constants ---
+#define MAP_POOL_SIZE 8     // Validated maps kept ready for the next matches
+#define MAP_ATTEMPTS 64     // Seeds tried for a map whose paths all connect
+
+// Generators, their id is recorded in the journals
+typedef enum {
+    GENERATOR_GRID,     // Grid of corridors with open crossings and a few obstacles
+    GENERATOR_MAZE,     // Recursive backtracker maze, with some walls removed to make loops
+    GENERATOR_CAVES,    // Cellular automaton caves
+    GENERATOR_ROOMS,    // Rooms of a BSP split of the map, linked by corridors
+    GENERATOR_COUNT
+} generator_id_t;
+
+// --- Structures ---
+// xoshiro128** generator, one per generation (rand() is shared by all the threads)
+typedef struct {
+    unsigned int s[4];
+} rng_t;
+
+typedef struct {
+    const char *name;
+    void (*generate)(Map *map, rng_t *rng);
+} map_generator_t;
+
+// Map generated and validated ahead of its match
+typedef struct {
+    Map map;
+    regions_t regions;
+    unsigned int seed;
+    int generator;
+} pooled_map_t;
+
+// Maps generated in the background by a thread, taken by the matches
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t not_full;
+    pooled_map_t maps[MAP_POOL_SIZE];
+    int head;                       // Next map taken
+    int count;
+    int generators[GENERATOR_COUNT];// Generators used in turn
+    int generator_count;
+    unsigned int next;              // Generations so far, drawn in turn from the generators
+    unsigned long long misses;      // Maps generated by a match because the pool was empty
+} map_pool_t;
+
+// --- Functions ---
+void rngSeed(rng_t *rng, unsigned int seed);
+unsigned int rngNext(rng_t *rng);
+int rngRange(rng_t *rng, int n);
+
+int generatorFind(const char *name);
+const char *generatorName(int generator);
+void generateMapWith(Map *map, int generator, unsigned int seed);
+int generateValidMap(pooled_map_t *out, int generator, unsigned int seed);
+
+void mapPoolInit(map_pool_t *pool, const char *generators);
+int mapPoolStart(map_pool_t *pool);
+void mapPoolTake(map_pool_t *pool, pooled_map_t *out);
+
+#endif // MAPGEN_H
@@ -0,0 +1,207 @@
+#define _GNU_SOURCE
+#include "game.h"
+#include "mapgen.h"
+#include "../library/journal.h"
+#include <time.h>
+
+// --- Constants ---
+#define MAX_REPLAY_PLAYERS 16
+#define COUNTDOWN_NS 60000000000ULL // The bomber wins 60 s after the last bomb
+
+// --- Structures ---
+typedef struct {
+    Map *map;
+    int generator;                       // Generator of the next map, -1 for rand() (older journals)
+    Player players[MAX_REPLAY_PLAYERS];
+    int bombCount;
+    int deactivatedBombCount;
+    unsigned long long countdown_start;  // Timestamp of the last bomb, 0 before
+    int winner;                          // Simulated winner, -1 while the match runs
+    int recorded_winner;
+    long records;
+    long actions;
+    long mismatches;
+    unsigned long long last_timestamp;
+} replay_state_t;
+
+/**
+ * function replayNow
+ * @brief Get the monotonic time in nanoseconds
+ *
+ * @return unsigned long long
+ */
+static unsigned long long replayNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * function replayWait
+ * @brief Wait until the record timestamp, scaled by the replay speed
+ *
+ * @param wall_start
+ * @param timestamp
+ * @param speed (0 for as fast as possible)
+ * @return void
+ */
+static void replayWait(unsigned long long wall_start, unsigned long long timestamp, double speed) {
+    if (speed <= 0.0) {
+        return;
+    }
+    unsigned long long target = wall_start + (unsigned long long)(timestamp / speed);
+    unsigned long long now = replayNow();
+    if (target > now) {
+        struct timespec ts = { (target - now) / 1000000000ULL, (target - now) % 1000000000ULL };
+        nanosleep(&ts, NULL);
+    }
+}
+
+/**
+ * function replayRecord
+ * @brief Re-simulate one record with the server rules
+ *
+ * @param state
+ * @param record
+ * @param verbose
+ * @return void
+ */
+static void replayRecord(replay_state_t *state, const journal_record_t *record, int verbose) {
+    state->records++;
+    state->last_timestamp = record->timestamp;
+
+    switch (record->type) {
+        case JOURNAL_MAP_SEED:
+            // Same seed, same generator: the map is rebuilt identically
+            state->map->width = record->b;
+            state->map->height = record->c;
+            if (state->generator >= 0 && state->generator < GENERATOR_COUNT) {
+                generateMapWith(state->map, state->generator, (unsigned int)record->a);
+            } else {
+                srand((unsigned int)record->a);
+                generateMap(state->map);
+            }
+            if (mapChecksum(state->map) != (unsigned int)record->d) {
+                printf("map seed %u (%s): regenerated map differs from the recorded one\n", (unsigned int)record->a,
+                       state->generator >= 0 ? generatorName(state->generator) : "rand");
+                state->mismatches++;
+            }
+            break;
+        case JOURNAL_MAP_GENERATOR:
+            state->generator = record->a;
+            break;
+        case JOURNAL_ROLE:
+            if (record->player < 0 || record->player >= MAX_REPLAY_PLAYERS) break;
+            state->players[record->player].role = record->a;
+            state->players[record->player].x = record->b;
+            state->players[record->player].y = record->c;
+            break;
+        case JOURNAL_ACTION: {
+            if (record->player < 0 || record->player >= MAX_REPLAY_PLAYERS) break;
+            Player *player = &state->players[record->player];
+            player->x = record->a;
+            player->y = record->b;
+            int result = applyRequest(state->map, player, record->c, &state->bombCount, &state->deactivatedBombCount);
+            state->actions++;
+            if (result != record->d) {
+                state->mismatches++;
+            }
+            if (verbose) {
+                printf("%10.3f ms  player %d  (%d, %d) %d -> %d%s\n", record->timestamp / 1e6, record->player,
+                       record->a, record->b, record->c, result, result != record->d ? "  MISMATCH" : "");
+            }
+            if (result == BOMB && state->bombCount == BOMB_COUNT) {
+                state->countdown_start = record->timestamp;
+            }
+            if (state->winner < 0 && state->deactivatedBombCount == BOMB_COUNT && state->countdown_start != 0
+                && record->timestamp - state->countdown_start < COUNTDOWN_NS) {
+                state->winner = MINE_CLEARER;
+            }
+            break;
+        }
+        case JOURNAL_END:
+            state->recorded_winner = record->a;
+            // A match its players left ends without a winner (-1), whatever its countdown
+            if (record->a >= 0 && state->winner < 0 && state->countdown_start != 0
+                && record->timestamp - state->countdown_start >= COUNTDOWN_NS - 1000000000ULL) {
+                // The server checks the countdown once per second
+                state->winner = BOMBER;
+            }
+            break;
+        default:
+            printf("unknown record type %d\n", record->type);
+            state->mismatches++;
+            break;
+    }
+}
+
+/**
+ * function main
+ * @brief Replay a match journal at a given speed and check that it re-simulates identically
+ *
+ * usage: replay <journal> [-s speed] [-v]
+ *        speed 0 (default) replays as fast as possible, 1 in real time, 10 ten times faster...
+ * @return int (0 if the replay matches the journal, 2 otherwise)
+ */
+int main(int argc, char *argv[]) {
+    const char *path = NULL;
+    double speed = 0.0;
+    int verbose = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = 1;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == NULL) {
+        fprintf(stderr, "usage: %s <journal> [-s speed] [-v]\n", argv[0]);
+        return 1;
+    }
+
+    // The game functions log every cell change, only kept in verbose mode
+    FILE *devnull = fopen("/dev/null", "w");
+    logInit(verbose ? NULL : devnull);
+
+    journal_reader_t reader;
+    if (journalOpenRead(&reader, path) < 0) {
+        logShutdown();
+        return 1;
+    }
+
+    replay_state_t state;
+    memset(&state, 0, sizeof state);
+    state.map = map_new(MAX_MAP_WIDTH, MAX_MAP_HEIGHT);
+    state.generator = -1;
+    state.winner = -1;
+    state.recorded_winner = -1;
+
+    journal_record_t record;
+    unsigned long long wall_start = replayNow();
+    while (journalNext(&reader, &record)) {
+        replayWait(wall_start, record.timestamp, speed);
+        replayRecord(&state, &record, verbose);
+    }
+    unsigned long long wall = replayNow() - wall_start;
+    journalCloseRead(&reader);
+
+    const char *roles[] = { "bomber", "mine clearer" };
+    printf("journal      : %s\n", path);
+    printf("records      : %ld (%ld actions)\n", state.records, state.actions);
+    printf("bombs        : %d placed, %d deactivated\n", state.bombCount, state.deactivatedBombCount);
+    printf("winner       : %s (recorded: %s)\n",
+           state.winner >= 0 ? roles[state.winner] : "none",
+           state.recorded_winner >= 0 ? roles[state.recorded_winner] : "none");
+    printf("match time   : %.3f s\n", state.last_timestamp / 1e9);
+    printf("replay time  : %.3f ms (%.0fx real time)\n", wall / 1e6,
+           wall > 0 ? (double)state.last_timestamp / wall : 0.0);
+    printf("mismatches   : %ld\n", state.mismatches);
+
+    free(state.map);
+    logShutdown();
+    fclose(devnull);
+    return state.mismatches == 0 && state.winner == state.recorded_winner ? 0 : 2;
+}